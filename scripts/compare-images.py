@@ -1,16 +1,18 @@
 # Create a virtual env with `python -m venv .venv`
 # Activate it with `source .venv/bin/activate` (`source .venv/scripts/activate` on windows)
 # Install dependencies with `pip install imutils opencv-python`
-# Then run de script, change reference_path and test_path at lines 12 and 14
+# Then run de script with the reference and test directories, e.g. renders of
+# render-all.sh and render-all.sh --gpu-culling, or change the default paths
 
+import sys
 from pathlib import Path
 
 import cv2
 import imutils
 import numpy as np
 
-reference_path = Path("output-images/2023-02-08-10-30-06")
-test_path = Path("output-images/2023-02-08-10-33-08")
+reference_path = Path(sys.argv[1] if len(sys.argv) > 2 else "output-images/2023-02-08-10-30-06")
+test_path = Path(sys.argv[2] if len(sys.argv) > 2 else "output-images/2023-02-08-10-33-08")
 output_path = Path("output-images/_test-output")
 output_path.mkdir(exist_ok=True)
 
@@ -1,3 +1,4 @@
+# Extra arguments are given to the viewer, e.g. --gpu-culling
 cmake -S . -B build -DCMAKE_INSTALL_PREFIX=./dist -DCMAKE_BUILD_TYPE=Release
 cmake --build build -j --target install --config release
 ROOT=$(pwd)
@@ -6,6 +7,6 @@ mkdir -p $ROOT/output-images/$OUTDIR
 pushd gltf-sample-models/2.0/
 for f in */; do
   f=$(echo "$f" | sed 's:/*$::')
-  $ROOT/dist/gltf-viewer viewer "$f/glTF/$f.gltf" --output "$ROOT/output-images/$OUTDIR/$f.png"
+  $ROOT/dist/gltf-viewer viewer "$f/glTF/$f.gltf" --output "$ROOT/output-images/$OUTDIR/$f.png" "$@"
 done
 popd
@@ -3,16 +3,39 @@
 #include <stb_image_write.h>
 #include <tiny_gltf.h>
 
+#include <glm/gtc/matrix_inverse.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/io.hpp>
+#include <atomic>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <numeric>
 #include <random>
 
 #include "utils/cameras.hpp"
+#include "utils/culling.hpp"
+#include "utils/depth_pre_pass.hpp"
+#include "utils/draw_sorting.hpp"
+#include "utils/gl_extensions.hpp"
+#include "utils/gl_state_cache.hpp"
 #include "utils/images.hpp"
+#include "utils/indirect_draws.hpp"
+#include "utils/indirect_passes.hpp"
+#include "utils/materials.hpp"
+#include "utils/mipmaps.hpp"
+#include "utils/parallel.hpp"
+#include "utils/picking.hpp"
+#include "utils/render_target.hpp"
+#include "utils/scene_graph.hpp"
+#include "utils/scene_programs.hpp"
+#include "utils/shader_permutations.hpp"
+#include "utils/shader_reload.hpp"
+#include "utils/texture_arrays.hpp"
+#include "utils/uniform_blocks.hpp"
 
 template <typename T>
 T random_gen(T range_from, T range_to) {
@@ -30,69 +53,17 @@ void keyCallback(GLFWwindow *window, int key, int scancode, int action,
 }
 
 int ViewerApplication::run() {
-    // Loader shaders
-    const auto glslProgram =
-        compileProgram({m_ShadersRootPath / m_vertexShader,
-                        m_ShadersRootPath / m_fragmentShader});
-
-    const auto modelViewProjMatrixLocation =
-        glGetUniformLocation(glslProgram.glId(), "uModelViewProjMatrix");
-    const auto modelViewMatrixLocation =
-        glGetUniformLocation(glslProgram.glId(), "uModelViewMatrix");
-    const auto normalMatrixLocation =
-        glGetUniformLocation(glslProgram.glId(), "uNormalMatrix");
-
-    const auto uBaseColorTexture =
-        glGetUniformLocation(glslProgram.glId(), "uBaseColorTexture");
-    const auto uBaseColorFactorLocation =
-        glGetUniformLocation(glslProgram.glId(), "uBaseColorFactor");
-
-    const auto uMetallicFactorLocation =
-        glGetUniformLocation(glslProgram.glId(), "uMetallicFactor");
-    const auto uRoughnessFactorLocation =
-        glGetUniformLocation(glslProgram.glId(), "uRougnessFactor");
-    const auto uMetallicRoughnessTextureLocation =
-        glGetUniformLocation(glslProgram.glId(), "uMetallicRoughnessTexture");
-
-    const auto uEmissiveFactorLocation =
-        glGetUniformLocation(glslProgram.glId(), "uEmissiveFactor");
-    const auto uEmissiveTextureLocation =
-        glGetUniformLocation(glslProgram.glId(), "uEmissiveTexture");
-
-    // Occlusion
-    const auto uOcclusionTextureLocation  =
-      glGetUniformLocation(glslProgram.glId(), "uOcclusionTexture");
-  const auto uOcclusionStrengthLocation =
-      glGetUniformLocation(glslProgram.glId(), "uOcclusionStrength");
-  const auto uOcclusionOnOffLocation =
-      glGetUniformLocation(glslProgram.glId(), "uOcclusionOnOff");
-
-
-    const auto uLightDirectionLocation =
-        glGetUniformLocation(glslProgram.glId(), "uLightDirection");
-    const auto uLightIntensityLocation =
-        glGetUniformLocation(glslProgram.glId(), "uLightIntensity");
-
-    // Normal Mapping
-    const auto uNormalTextureOnOffLocation =
-        glGetUniformLocation(glslProgram.glId(), "uNormalTextureOnOff");
-    const auto uNormalTBNOnOffLocation =
-        glGetUniformLocation(glslProgram.glId(), "uNormalTBNOnOff");
-    const auto uNormalTextureScaleLocation =
-        glGetUniformLocation(glslProgram.glId(), "uNormalTextureScale");
-    const auto uNormalTextureLocation =
-        glGetUniformLocation(glslProgram.glId(), "uNormalTexture");
-
-    const auto uViewNormalOnOffLocation =
-        glGetUniformLocation(glslProgram.glId(), "uViewNormalOnOff");
-    const auto uApplyMonochromaticOnOffLocation =
-        glGetUniformLocation(glslProgram.glId(), "uApplyMonochromaticOnOff");
-
-    bool useOcclusion = true;
-    bool useNormalMap = true;
-    bool useTBN = true;
-    bool viewNormal = false;
-    bool useMonochromatic = false;
+    // Programs of previous runs are loaded from their binaries
+    const auto startupStart = glfwGetTime();
+    enableProgramBinaryCache(m_ProgramCachePath);
+
+    // Programs drawing the scene, see ScenePrograms. The shading programs are created once the material texture
+    // mode is known.
+    const bool hasMultiDrawIndirect = GLAD_GL_VERSION_4_3;
+    ScenePrograms scenePrograms{m_ShadersRootPath, m_vertexShader, m_fragmentShader, hasMultiDrawIndirect};
+
+    RendererToggles toggles;
+    toggles.encodeSRGBOutput = !isDrawFramebufferSRGB();
     glm::vec3 lightDirection(1);
     glm::vec3 lightIntensity({1.,1.,1.});
     static float lightIntensityFactor = 1.;
@@ -112,6 +83,14 @@ int ViewerApplication::run() {
     maxDistance = glm::length(diag);
 
     maxDistance = maxDistance > 0.f ? maxDistance : 100.f;
+
+    // Flattened default scene used by the draw loop
+    SceneGraph sceneGraph{model};
+    size_t updatedWorldMatrixCount = 0;
+
+    // Triangle BVHs used for picking are built in background
+    const ScenePicker scenePicker{model, sceneGraph};
+
     const auto projMatrix =
         glm::perspective(70.f, float(m_nWindowWidth) / m_nWindowHeight,
                          0.001f * maxDistance, 1.5f * maxDistance);
@@ -139,14 +118,16 @@ int ViewerApplication::run() {
     }
 
     // ======= Textures =============
-    const auto textureObjects = createTextureObjects(model);
+    SamplerObjects samplerObjects;
+    const auto textureObjects = createTextureObjects(model, samplerObjects);
 
     // White textures
     GLuint whiteTexture = 0;
     float white[] = {1, 1, 1, 1};
     glGenTextures(1, &whiteTexture);
     glBindTexture(GL_TEXTURE_2D, whiteTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_FLOAT, white);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_FLOAT, white);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -159,266 +140,291 @@ int ViewerApplication::run() {
     const auto bufferObjects = ViewerApplication::createBufferObjects(model);
     std::vector<VaoRange> meshToVertexArrays;
     const auto VertexArrayObjects = ViewerApplication::createVertexArrayObjects(model, bufferObjects, meshToVertexArrays);
+    std::vector<PacketBounds> packetLocalBounds;
+    std::vector<glm::mat4> instanceMatrices;
+    const auto drawPackets = createDrawPackets(model, sceneGraph, VertexArrayObjects, meshToVertexArrays, packetLocalBounds, instanceMatrices);
+
+    // Frustum culling of draw packets against their world space boxes, which
+    // are only recomputed when world matrices change
+    BoxSet packetWorldBoxes;
+    packetWorldBoxes.resize(drawPackets.size());
+    bool packetWorldBoxesValid = false;
+    std::vector<uint32_t> visiblePackets;
+    bool useFrustumCulling = true;
+    bool freezeCullingFrustum = false;
+    glm::mat4 cullingViewProjMatrix;
+    double cullingTime = 0.;
+
+    // Visible packets sorted by state then depth, buffers are reused between frames
+    bool sortDraws = true;
+    std::vector<uint64_t> drawKeys;
+    std::vector<uint32_t> drawOrder;
+    RadixSorter drawSorter;
+    const auto cullingFarPlane = 1.5f * maxDistance;
+
+    // Multi-draw indirect path, see IndirectPasses, created once the materials are known
+    bool useMultiDrawIndirect = hasMultiDrawIndirect;
+    bool useInstancing = true;
+    // World transform of each packet, computed with the world boxes
+    std::vector<GpuDrawData> drawData(drawPackets.size());
+
+    // Uniform blocks, see utils/uniform_blocks.hpp. The frame block is written once per frame. The classic path
+    // writes the draw blocks of a frame at once, each draw binds its range of the buffer.
+    StreamBuffer frameUniformsBuffer;
+    double previousFrameSeconds = -1.;
+    StreamBuffer drawUniformsBuffer;
+    std::vector<unsigned char> drawUniformsData;
+    std::vector<GLintptr> drawUniformsOffsets;  // Of each draw of drawOrder
+    GLint uniformBufferOffsetAlignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformBufferOffsetAlignment);
+    const auto drawUniformsStride = (sizeof(DrawUniforms) + uniformBufferOffsetAlignment - 1) / uniformBufferOffsetAlignment * uniformBufferOffsetAlignment;
+
+    // Depth pre-pass, see DepthPrePass
+    bool useDepthPrePass = false;
+    DepthPrePass depthPrePass;
+
+    // Draws of the last frame, state changes are counted by the state cache
+    DrawStats drawStats;
+
+    // Every program, VAO, texture, buffer and uniform change of the draw loop
+    // goes through the cache, which skips redundant calls
+    GLStateCache glState;
+    GLStateCache::Stats glStateStats;
 
     // Setup OpenGL state for rendering
     glEnable(GL_DEPTH_TEST);
-    glslProgram.use();
-
-    // Lambda function to bind texture
-    const auto bindMaterial = [&](const auto materialIndex) {
-        if (materialIndex >= 0) {
-            const auto &material = model.materials[materialIndex];
-            const auto &pbrMetallicRoughness = material.pbrMetallicRoughness;
-            if (uBaseColorFactorLocation >= 0) {
-                glUniform4f(uBaseColorFactorLocation,
-                            (float)pbrMetallicRoughness.baseColorFactor[0],
-                            (float)pbrMetallicRoughness.baseColorFactor[1],
-                            (float)pbrMetallicRoughness.baseColorFactor[2],
-                            (float)pbrMetallicRoughness.baseColorFactor[3]);
-            }
-            if (uBaseColorTexture >= 0) {
-                auto textureObject = whiteTexture;
-                if (pbrMetallicRoughness.baseColorTexture.index >= 0) {
-                    const auto &texture =
-                        model.textures[pbrMetallicRoughness.baseColorTexture.index];
-                    if (texture.source >= 0) {
-                        textureObject = textureObjects[texture.source];
-                    }
-                }
 
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, textureObject);
-                glUniform1i(uBaseColorTexture, 0);
-}
-                if (uMetallicFactorLocation >= 0) {
-                glUniform1f(
-                    uMetallicFactorLocation, (float)pbrMetallicRoughness.metallicFactor);
-            }
-            if (uRoughnessFactorLocation >= 0) {
-                glUniform1f(
-                    uRoughnessFactorLocation, (float)pbrMetallicRoughness.roughnessFactor);
-            }
-            if (uMetallicRoughnessTextureLocation >= 0) {
-                auto textureObject = whiteTexture;
-                if (pbrMetallicRoughness.metallicRoughnessTexture.index >= 0) {
-                    const auto &texture =
-                        model.textures[pbrMetallicRoughness.metallicRoughnessTexture.index];
-                    if (texture.source >= 0) {
-                        textureObject = textureObjects[texture.source];
-                    }
-                }
-
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, textureObject);
-                glUniform1i(uMetallicRoughnessTextureLocation, 1);
-            }
-
-            if (uEmissiveFactorLocation >= 0) {
-                glUniform3f(
-                    uEmissiveFactorLocation, (float)material.emissiveFactor[0],
-                    (float)material.emissiveFactor[1],
-                    (float)material.emissiveFactor[2]);
-            }
-            if (uEmissiveTextureLocation >= 0) {
-                auto textureObject = whiteTexture;
-                if (material.emissiveTexture.index >= 0) {
-                    const auto &texture =
-                        model.textures[material.emissiveTexture.index];
-                    if (texture.source >= 0) {
-                        textureObject = textureObjects[texture.source];
-                    }
-                }
-
-                glActiveTexture(GL_TEXTURE2);
-                glBindTexture(GL_TEXTURE_2D, textureObject);
-                glUniform1i(uEmissiveTextureLocation, 2);
-            }
-
-            // Occlusion
-            const auto &occlusionTexture = material.occlusionTexture;
-            if (uOcclusionStrengthLocation >= 0) {
-                glUniform1f(uOcclusionStrengthLocation, (float)material.occlusionTexture.strength);
-            }
-            if (uOcclusionTextureLocation >= 0) {
-                auto textureObject = whiteTexture;
-                if (occlusionTexture.index >= 0) {
-                    const auto &texture = model.textures[occlusionTexture.index];
-                    if (texture.source >= 0) {
-                        textureObject = textureObjects[texture.source];
-                    }
-                }
-                glActiveTexture(GL_TEXTURE3);
-                glBindTexture(GL_TEXTURE_2D, textureObject);
-                glUniform1i(uOcclusionTextureLocation, 3);
-            }
-            // Normal Mapping
-            const auto &normalTexture = material.normalTexture;
-
-            if (uNormalTextureLocation >= 0) {
-                auto textureObject = whiteTexture;
-                if (normalTexture.index >= 0) {
-                    const auto &texture =
-                        model.textures[normalTexture.index];
-                    if (texture.source >= 0) {
-                        textureObject = textureObjects[texture.source];
-                    }
-                }
+    // Materials are uploaded once, samplers always read the same texture units
+    MaterialTable materialTable{model, textureObjects, whiteTexture};
+
+    // Material textures: bindless handles or texture arrays referenced by the
+    // material buffer remove all texture binds from the draw loop. Draws of
+    // different textures are then batched in the same multi-draws. Programs
+    // are created here, with the first mode available.
+    if (!scenePrograms.hasMaterialTextureModes() ||
+        !((MaterialTable::isTextureModeSupported(kBindlessTextures) &&
+           scenePrograms.setMaterialTextureMode(glState, materialTable, kBindlessTextures, toggles.features())) ||
+          scenePrograms.setMaterialTextureMode(glState, materialTable, kArrayTextures, toggles.features()))) {
+        scenePrograms.setMaterialTextureMode(glState, materialTable, kBoundTextures, toggles.features());
+    }
+    // Material part of the program permutation, draws are bucketed by it
+    std::vector<ShaderFeatures> materialShaderFeatures(materialTable.size());
+    for (uint32_t i = 0; i < materialTable.size(); ++i) {
+        materialShaderFeatures[i] = materialFeatures(materialTable, i);
+    }
 
-                if (uNormalTextureScaleLocation >= 0) {
-                    glUniform1f(uNormalTextureScaleLocation, (float)normalTexture.scale);
-                }
-                glActiveTexture(GL_TEXTURE4);
-                glBindTexture(GL_TEXTURE_2D, textureObject);
-                glUniform1i(uNormalTextureLocation, 4);
-            }
-                    } else {
-            // No texture found
-            if (uBaseColorFactorLocation >= 0) {
-                glUniform4f(uBaseColorFactorLocation, 1, 1, 1, 1);
-            }
-            if (uBaseColorTexture >= 0) {
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, whiteTexture);
-                glUniform1i(uBaseColorTexture, 0);
-            }
-            if (uMetallicFactorLocation >= 0) {
-                glUniform1f(uMetallicFactorLocation, 1.f);
-            }
-            if (uRoughnessFactorLocation >= 0) {
-                glUniform1f(uRoughnessFactorLocation, 1.f);
-            }
-            if (uMetallicRoughnessTextureLocation >= 0) {
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, 0);
-                glUniform1i(uMetallicRoughnessTextureLocation, 1);
-            }
-            if (uEmissiveFactorLocation >= 0) {
-                glUniform3f(uEmissiveFactorLocation, 0., 0., 0.);
-            }
-            if (uEmissiveTextureLocation >= 0) {
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, 0);
-                glUniform1i(uEmissiveTextureLocation, 2);
-            }
-            if (uOcclusionStrengthLocation >= 0) {
-                glUniform1f(uOcclusionStrengthLocation, 0.);
-            }
-            if (uOcclusionTextureLocation >= 0) {
-                glActiveTexture(GL_TEXTURE3);
-                glBindTexture(GL_TEXTURE_2D, 0);
-                glUniform1i(uOcclusionTextureLocation, 3);
-            }
-            if (uNormalTextureScaleLocation >= 0) {
-                glUniform1f(uNormalTextureScaleLocation, 0.);
-            }
-            if (uNormalTextureLocation >= 0) {
-                glActiveTexture(GL_TEXTURE4);
-                glBindTexture(GL_TEXTURE_2D, 0);
-                glUniform1i(uNormalTextureLocation, 4);
-            }
-        }
-    };
+    // GPU culling and HiZ occlusion culling are part of the multi-draw indirect path
+    if (m_UseGpuCulling && !hasMultiDrawIndirect) {
+        std::cerr << "Warning: GPU culling needs OpenGL 4.3, culling on the CPU" << std::endl;
+    }
+    bool useGpuCulling = m_UseGpuCulling && hasMultiDrawIndirect;
+    bool useOcclusionCulling = useGpuCulling && m_UseOcclusionCulling;
+    int hiZDebugLevel = -1;  // Pyramid level shown instead of the scene, -1 for none
+    std::unique_ptr<IndirectPasses> indirectPasses;
+    if (hasMultiDrawIndirect) {
+        indirectPasses = std::make_unique<IndirectPasses>(m_ShadersRootPath, model, drawPackets, drawData, packetWorldBoxes,
+                                                          materialTable, materialShaderFeatures, m_nWindowWidth, m_nWindowHeight,
+                                                          toggles.encodeSRGBOutput);
+    }
 
     // Lambda function to draw the scene
     const auto drawScene = [&](const Camera &camera) {
+        // The GUI binds its own program, VAO and textures between frames
+        glState.invalidateBindings();
+        glState.resetStats();
+
+        // Clears honor the write masks, which the shading pass may have left off
+        glState.depthFunc(GL_LESS);
+        glState.depthMask(true);
+        glState.colorMask(true);
+        glState.blend(false);
         glViewport(0, 0, m_nWindowWidth, m_nWindowHeight);
+        // Disabled by the GUI
+        glEnable(GL_FRAMEBUFFER_SRGB);
+        // Blended draws, changed by the GUI
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, kMaterialBufferBinding, materialTable.bufferObject());
+        const auto &textureArrays = materialTable.textureArrays();
+        for (GLuint i = 0; i < textureArrays.size(); ++i) {
+            glState.bindTexture(kTextureArrayFirstUnit + i, GL_TEXTURE_2D_ARRAY, textureArrays[i]);
+        }
 
         const auto viewMatrix = camera.getViewMatrix();
 
-        if (uLightDirectionLocation >= 0) {
-            // Pass value if location not null
-            const auto lightDirectionInViewSpace =
-                glm::normalize(glm::vec3(viewMatrix * glm::vec4(lightDirection, 0.)));  // Transform to viexMatrix then normalize it
-            if (lightFromCamera) {
-                glUniform3f(uLightDirectionLocation, 0, 0, 1);
-            } else {
-                glUniform3f(uLightDirectionLocation, lightDirectionInViewSpace[0], lightDirectionInViewSpace[1], lightDirectionInViewSpace[2]);  // Pass each value to fragment shader like that
-            }
-        }
+        // Draw the scene referenced by gltf file. World matrices are only
+        // recomputed for nodes that moved since the last frame
+        updatedWorldMatrixCount = sceneGraph.updateWorldMatrices(defaultThreadPool());
+
+        const auto viewProjMatrix = projMatrix * viewMatrix;
+        const auto viewNormalMatrix = glm::mat3(viewMatrix);  // lookAt matrices are rigid
+
+        // Camera, light, viewport and time of all the programs of the frame, written and bound once. Toggles are
+        // program permutations.
+        const auto frameSeconds = glfwGetTime();
+        FrameUniforms frameUniforms;
+        frameUniforms.viewMatrix = viewMatrix;
+        frameUniforms.projMatrix = projMatrix;
+        frameUniforms.viewProjMatrix = viewProjMatrix;
+        frameUniforms.invViewMatrix = glm::inverse(viewMatrix);
+        frameUniforms.invProjMatrix = glm::inverse(projMatrix);
+        frameUniforms.lightDirection = lightFromCamera ? glm::vec4(0, 0, 1, 0) : glm::vec4(glm::normalize(glm::vec3(viewMatrix * glm::vec4(lightDirection, 0.))), 0);
+        frameUniforms.lightIntensity = glm::vec4(lightIntensity * lightIntensityFactor, 0);
+        frameUniforms.viewport = glm::vec4(m_nWindowWidth, m_nWindowHeight, 1.f / m_nWindowWidth, 1.f / m_nWindowHeight);
+        frameUniforms.time = float(frameSeconds);
+        frameUniforms.frameTime = previousFrameSeconds < 0. ? 0.f : float(frameSeconds - previousFrameSeconds);
+        previousFrameSeconds = frameSeconds;
+        frameUniformsBuffer.upload(&frameUniforms, sizeof(frameUniforms));
+        glState.bindBufferBase(GL_UNIFORM_BUFFER, kFrameUniformsBinding, frameUniformsBuffer.glId());
+
+        const auto cullingStart = glfwGetTime();
+        if (updatedWorldMatrixCount > 0 || !packetWorldBoxesValid) {
+            defaultThreadPool().parallelFor(0, drawPackets.size(), 1024, [&](size_t begin, size_t end) {
+                for (auto i = begin; i < end; ++i) {
+                    const auto &packet = drawPackets[i];
+                    auto &data = drawData[i];
+                    if (packet.instance < 0) {
+                        data.modelMatrix = sceneGraph.worldMatrix(packet.sceneNode);
+                        data.normalMatrix = glm::mat4(sceneGraph.worldNormalMatrix(packet.sceneNode));
+                    } else {
+                        const auto &instanceMatrix = instanceMatrices[packet.instance];
+                        data.modelMatrix = sceneGraph.worldMatrix(packet.sceneNode) * instanceMatrix;
+                        data.normalMatrix = glm::mat4(sceneGraph.worldNormalMatrix(packet.sceneNode) * glm::inverseTranspose(glm::mat3(instanceMatrix)));
+                    }
+                    data.materialIndex = uint32_t(materialTable.index(packet.material));
 
-        if (uLightIntensityLocation >= 0) {
-            glUniform3f(uLightIntensityLocation, lightIntensity[0] * lightIntensityFactor, lightIntensity[1] * lightIntensityFactor, lightIntensity[2] * lightIntensityFactor);
+                    const auto &bounds = packetLocalBounds[i];
+                    if (bounds.isValid) {
+                        packetWorldBoxes.setTransformedBox(i, bounds.bboxMin, bounds.bboxMax, data.modelMatrix);
+                    } else {
+                        packetWorldBoxes.setInfiniteBox(i);
+                    }
+                }
+            });
+            packetWorldBoxesValid = true;
+            if (indirectPasses) {
+                indirectPasses->invalidateDrawData();
+            }
         }
-
-        if (uOcclusionOnOffLocation >= 0) {
-            glUniform1i(uOcclusionOnOffLocation, useOcclusion);
+        if (!freezeCullingFrustum) {
+            cullingViewProjMatrix = viewProjMatrix;
         }
-
-        if (uNormalTextureOnOffLocation >= 0) {
-            glUniform1i(uNormalTextureOnOffLocation, useNormalMap);
+        const auto cullOnGpu = useMultiDrawIndirect && useGpuCulling;
+        if (cullOnGpu) {
+            visiblePackets.clear();  // Never read back, the compute pass writes the draws
+        } else if (useFrustumCulling) {
+            cullBoxes(extractFrustum(cullingViewProjMatrix), packetWorldBoxes, visiblePackets);
+        } else {
+            visiblePackets.resize(drawPackets.size());
+            std::iota(begin(visiblePackets), end(visiblePackets), 0);
         }
-        if (uNormalTBNOnOffLocation >= 0) {
-            glUniform1i(uNormalTBNOnOffLocation, useTBN);
+        cullingTime = glfwGetTime() - cullingStart;
+
+        drawOrder.assign(begin(visiblePackets), end(visiblePackets));
+        if (sortDraws && !cullOnGpu) {
+            drawKeys.resize(drawOrder.size());
+            for (size_t i = 0; i < drawOrder.size(); ++i) {
+                const auto &packet = drawPackets[drawOrder[i]];
+                const auto viewDepth = -(viewMatrix * glm::vec4(packetWorldBoxes.center(drawOrder[i]), 1.f)).z;
+                const auto normalizedDepth = viewDepth / cullingFarPlane;
+                const auto tableIndex = materialTable.index(packet.material);
+                // Material features are 6 bits, the size of the program field
+                const auto program = materialShaderFeatures[tableIndex] / kFirstMaterialTextureFeature;
+                // Blended draws are sorted back to front across all their states
+                drawKeys[i] = packet.pass == kBlendPass
+                                  ? makeBlendedDrawSortKey(packet.pass, program, tableIndex, packet.vao, normalizedDepth)
+                                  : makeDrawSortKey(packet.pass, program, tableIndex, packet.vao, normalizedDepth);
+            }
+            drawSorter.sort(drawKeys, drawOrder);
         }
-        if (uViewNormalOnOffLocation >= 0) {
-            glUniform1i(uViewNormalOnOffLocation, viewNormal);
+        toggles.encodeSRGBOutput = !isDrawFramebufferSRGB();
+        const auto frameFeatures = toggles.features();
+        depthPrePass.beginFrame(useDepthPrePass);
+
+        if (cullOnGpu) {
+            drawStats = indirectPasses->drawCulled(glState, scenePrograms, depthPrePass, extractFrustum(cullingViewProjMatrix),
+                                                   viewProjMatrix, useFrustumCulling, useOcclusionCulling, hiZDebugLevel, frameFeatures);
+            glStateStats = glState.stats();
+            return;
         }
-        if (uApplyMonochromaticOnOffLocation >= 0) {
-            glUniform1i(uApplyMonochromaticOnOffLocation, useMonochromatic);
+        if (useMultiDrawIndirect) {
+            drawStats = indirectPasses->draw(glState, scenePrograms, depthPrePass, drawOrder, useInstancing, frameFeatures);
+            glStateStats = glState.stats();
+            return;
         }
 
-        // The recursive function that should draw a node
-        // We use a std::function because a simple lambda cannot be recursive
-        const std::function<void(int, const glm::mat4 &)> drawNode =
-            [&](int nodeIdx, const glm::mat4 &parentMatrix) {
-                auto node = model.nodes[nodeIdx];
-                glm::mat4 modelMatrix = getLocalToWorldMatrix(node, parentMatrix);
-                if (node.mesh >= 0) {
-                    // Compute modelViewMatrix, modelViewProjectionMatrix, normalMatrix and send all of these to the shaders with glUniformMatrix4fv.
-                    const auto modelViewMatrix = viewMatrix * modelMatrix;
-                    const auto modelViewProjectionMatrix = projMatrix * modelViewMatrix;
-                    const auto normalMatrix = transpose(inverse(modelViewMatrix));
-
-                    glUniformMatrix4fv(modelViewProjMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewProjectionMatrix));
-                    glUniformMatrix4fv(modelViewMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewMatrix));
-                    glUniformMatrix4fv(normalMatrixLocation, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-                    // Get the mesh and the vertex array objects range of the current mesh.
-
-                    const auto &current_mesh = model.meshes[node.mesh];
-                    const auto &vaoRange = meshToVertexArrays[node.mesh];
-
-                    for (size_t i = 0; i < current_mesh.primitives.size(); i++) {
-                        const auto &primitive = current_mesh.primitives[i];
-                        const auto vao = VertexArrayObjects[vaoRange.begin + i];
-
-                        bindMaterial(primitive.material);
-                        glBindVertexArray(vao);
-
-                        if (primitive.indices >= 0) {
-                            const auto &accessor = model.accessors[primitive.indices];
-
-                            const auto &bufferView = model.bufferViews[accessor.bufferView];
-                            const auto byteOffset =
-                                accessor.byteOffset + bufferView.byteOffset;
-
-                            // glDrawElements(mode, count, type, indices)
-                            glDrawElements(primitive.mode, GLsizei(accessor.count), accessor.componentType, (const GLvoid *)byteOffset);
-
-                        } else {
-                            const auto accessorIdx = (*begin(primitive.attributes)).second;
-                            const auto &accessor = model.accessors[accessorIdx];
-
-                            bindMaterial(primitive.material);
-                            glDrawArrays(primitive.mode, 0, GLsizei(accessor.count));
-                        }
-                    }
-                }
-                // Draw the children recursively
-                for (const auto child : node.children) {
-                    drawNode(child, modelMatrix);
+        // Draw blocks are only written when the node, instance or material changes along the draw order, all of them
+        // with one buffer write. Draws sharing a block share its range, the state cache filters redundant range, VAO
+        // and texture binds. This path has no instancing, each instance is a draw call.
+        drawStats = DrawStats{};
+        drawUniformsData.clear();
+        drawUniformsOffsets.clear();
+        auto currentSceneNode = std::numeric_limits<uint32_t>::max();
+        auto currentInstance = -1;
+        auto currentMaterial = std::numeric_limits<size_t>::max();
+        for (const auto packetIdx : drawOrder) {
+            const auto &packet = drawPackets[packetIdx];
+            const auto tableIndex = materialTable.index(packet.material);
+            if (packet.sceneNode != currentSceneNode || packet.instance != currentInstance || tableIndex != currentMaterial) {
+                currentSceneNode = packet.sceneNode;
+                currentInstance = packet.instance;
+                currentMaterial = tableIndex;
+                ++drawStats.drawUniformBlocks;
+                const auto &modelMatrix = drawData[packetIdx].modelMatrix;
+                DrawUniforms drawUniforms;
+                drawUniforms.modelViewProjMatrix = viewProjMatrix * modelMatrix;
+                drawUniforms.modelViewMatrix = viewMatrix * modelMatrix;
+                drawUniforms.normalMatrix = glm::mat4(viewNormalMatrix * glm::mat3(drawData[packetIdx].normalMatrix));
+                drawUniforms.materialIndex = int32_t(tableIndex);
+                drawUniformsData.resize(drawUniformsData.size() + drawUniformsStride);
+                std::memcpy(drawUniformsData.data() + drawUniformsData.size() - drawUniformsStride, &drawUniforms, sizeof(drawUniforms));
+            }
+            drawUniformsOffsets.push_back(GLintptr(drawUniformsData.size() - drawUniformsStride));
+        }
+        drawUniformsBuffer.upload(drawUniformsData.data(), drawUniformsData.size());
+
+        if (depthPrePass.isEnabled()) {
+            depthPrePass.begin(glState);
+            scenePrograms.useDepth(glState, false);
+            for (size_t drawIdx = 0; drawIdx < drawOrder.size(); ++drawIdx) {
+                const auto &packet = drawPackets[drawOrder[drawIdx]];
+                if (packet.pass != kOpaquePass) {
+                    continue;
                 }
-            };
+                glState.bindBufferRange(GL_UNIFORM_BUFFER, kDrawUniformsBinding, drawUniformsBuffer.glId(), drawUniformsOffsets[drawIdx], sizeof(DrawUniforms));
+                // The shader only reads positions, the other attributes of the VAO are not fetched
+                glState.bindVertexArray(packet.vao);
+                submitDrawPacket(packet);
+                ++drawStats.drawCalls;
+            }
+            depthPrePass.end(glState);
+        }
 
-        // Draw the scene referenced by gltf file
-        if (model.defaultScene >= 0) {
-            for (const auto nodeIdx : model.scenes[model.defaultScene].nodes) {
-                drawNode(nodeIdx, glm::mat4(1));
+        depthPrePass.beginShading();
+        // Sorted draws switch permutation once per material feature set
+        auto currentFeatures = ~ShaderFeatures(0);
+        for (size_t drawIdx = 0; drawIdx < drawOrder.size(); ++drawIdx) {
+            const auto &packet = drawPackets[drawOrder[drawIdx]];
+            const auto tableIndex = materialTable.index(packet.material);
+            const auto features = frameFeatures | materialShaderFeatures[tableIndex];
+            if (features != currentFeatures) {
+                scenePrograms.useShading(glState, false, features);
+                currentFeatures = features;
             }
+            glState.bindBufferRange(GL_UNIFORM_BUFFER, kDrawUniformsBinding, drawUniformsBuffer.glId(), drawUniformsOffsets[drawIdx], sizeof(DrawUniforms));
+            depthPrePass.setShadingState(glState, packet.pass);
+            materialTable.bindTextures(glState, tableIndex);
+            glState.bindVertexArray(packet.vao);
+            submitDrawPacket(packet);
+            ++drawStats.drawCalls;
         }
+        depthPrePass.endShading();
+        drawStats.instances = drawOrder.size();
+        glStateStats = glState.stats();
     };
 
+    std::cout << "Startup: " << (glfwGetTime() - startupStart) * 1e3 << " ms, " << programBinaryCache()->statsSummary() << std::endl;
+
     std::cout << m_OutputPath.string() << std::endl;
     if (!m_OutputPath.empty()) {
         std::vector<unsigned char> pixels(m_nWindowHeight * m_nWindowWidth * 3);
@@ -438,12 +444,30 @@ int ViewerApplication::run() {
         return 0;
     }
 
+    // Picking state
+    PickResult pickResult;
+    bool hasPickResult = false;
+    bool pickUnderCursor = false;
+    bool leftButtonPressed = false;
+    double pickTime = 0.;
+
+    // Shader hot-reload: programs using an edited file of m_ShadersRootPath are compiled again in the background
+    // while the frames keep the previous programs, and swapped once all their permutations are linked. Errors are
+    // shown in the GUI and the previous programs stay in use.
+    DirectoryWatcher shaderWatcher{m_ShadersRootPath};
+    if (glExtensions().maxShaderCompilerThreads) {
+        // Let the driver choose the number of compiler threads
+        glExtensions().maxShaderCompilerThreads(0xFFFFFFFF);
+    }
+
     // RENDER LOOP
     // Loop until the user closes the window
     for (auto iterationCount = 0u; !m_GLFWHandle.shouldClose();
          ++iterationCount) {
         const auto seconds = glfwGetTime();
 
+        scenePrograms.updateReload(glState, shaderWatcher.changedFiles());
+
         const auto camera = cameraController->getCamera();
         drawScene(camera);
 
@@ -455,6 +479,8 @@ int ViewerApplication::run() {
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                         1000.0f / ImGui::GetIO().Framerate,
                         ImGui::GetIO().Framerate);
+            ImGui::Text("Scene nodes: %zu, world matrices updated: %zu",
+                        sceneGraph.size(), updatedWorldMatrixCount);
             static int e = 1;
             ImGui::Columns(2, "Camera");
             if (
@@ -489,8 +515,8 @@ int ViewerApplication::run() {
 
                 // Normal buttons
 
-                static bool pressed_normal = useNormalMap;
-                static bool pressed_TBN = useTBN;
+                static bool pressed_normal = toggles.useNormalMap;
+                static bool pressed_TBN = toggles.useTBN;
 
                 // static variable else it reset every loop
 
@@ -530,9 +556,7 @@ int ViewerApplication::run() {
 
                 ImGui::Columns(2, "");
 
-                if (ImGui::Checkbox("Lighting from camera", &lightFromCamera)) {
-                    glUniform3f(uLightDirectionLocation, 0, 0, 1);
-                }
+                ImGui::Checkbox("Lighting from camera", &lightFromCamera);
                 if (ImGui::Checkbox("Auto-increment phi and theta", &pressed)) {
                     if (autoIncrement) {
                         autoIncrement = false;
@@ -547,33 +571,33 @@ int ViewerApplication::run() {
                         autoIncrement_colors = true;
                     }
                 }
-                ImGui::Checkbox("Render in monochromatic", &useMonochromatic);
+                ImGui::Checkbox("Render in monochromatic", &toggles.useMonochromatic);
                 ImGui::NextColumn();
-                ImGui::Checkbox("Apply Occlusion", &useOcclusion);
+                ImGui::Checkbox("Apply Occlusion", &toggles.useOcclusion);
                 if (ImGui::Checkbox("Apply Normal Map", &pressed_normal)) {
-                    if (useNormalMap) {
-                        useNormalMap = false;
-                        useTBN = false;
+                    if (toggles.useNormalMap) {
+                        toggles.useNormalMap = false;
+                        toggles.useTBN = false;
                         pressed_TBN = false;
                     } else {
-                        useNormalMap = true;
+                        toggles.useNormalMap = true;
                     }
                 };
                 if (ImGui::Checkbox("Apply Normal w/ TBN", &pressed_TBN)) {
-                    if (useNormalMap) {
-                        if (useTBN) {
-                            useTBN = false;
+                    if (toggles.useNormalMap) {
+                        if (toggles.useTBN) {
+                            toggles.useTBN = false;
                         } else {
-                            useTBN = true;
+                            toggles.useTBN = true;
                         }
                     } else {
-                        useNormalMap = true;
-                        useTBN = true;
+                        toggles.useNormalMap = true;
+                        toggles.useTBN = true;
                         pressed_TBN = true;
                         pressed_normal = true;
                     };
                 }
-                ImGui::Checkbox("View Normal colorspace", &viewNormal);
+                ImGui::Checkbox("View Normal colorspace", &toggles.viewNormal);
                 ImGui::Columns();
             }
             if (ImGui::CollapsingHeader("Camera",
@@ -601,6 +625,133 @@ int ViewerApplication::run() {
                     glfwSetClipboardString(m_GLFWHandle.window(), str.c_str());
                 }
             }
+            if (ImGui::CollapsingHeader("Culling",
+                                        ImGuiTreeNodeFlags_DefaultOpen)) {
+                ImGui::Checkbox("Frustum culling", &useFrustumCulling);
+                ImGui::Checkbox("Freeze culling frustum", &freezeCullingFrustum);
+                if (hasMultiDrawIndirect) {
+                    ImGui::Checkbox("Cull on GPU (multi-draw indirect)", &useGpuCulling);
+                    if (useGpuCulling) {
+                        ImGui::Checkbox("HiZ occlusion culling (no MSAA)", &useOcclusionCulling);
+                    }
+                }
+                const auto testedCount = useFrustumCulling ? drawPackets.size() : 0;
+                if (useMultiDrawIndirect && useGpuCulling) {
+                    // Counts of the last frame the GPU finished culling, read back without stalling
+                    const auto &gpuStats = indirectPasses->gpuCuller().stats();
+                    ImGui::Text("draws tested: %zu, visible: %zu, culled: %zu",
+                                testedCount, gpuStats.drawCount,
+                                drawPackets.size() - gpuStats.drawCount);
+                    ImGui::Text("GPU culling time: %.3f ms, %s", indirectPasses->cullingSeconds() * 1e3,
+                                indirectPasses->gpuCuller().hasDrawCount() ? "indirect draw count" : "no indirect draw count, culled draws are empty commands");
+                    if (useOcclusionCulling) {
+                        ImGui::Text("first phase draws: %zu, second phase draws: %zu",
+                                    gpuStats.firstPhaseDrawCount, gpuStats.drawCount - gpuStats.firstPhaseDrawCount);
+                        ImGui::Text("occluded draws: %zu, occluded triangles: %zu",
+                                    gpuStats.occludedDrawCount, gpuStats.occludedTriangleCount);
+                        ImGui::Text("HiZ build time: %.3f ms", indirectPasses->hiZBuildSeconds() * 1e3);
+                        ImGui::SliderInt("HiZ debug level (-1: scene)", &hiZDebugLevel, -1, indirectPasses->hiZLevelCount() - 1);
+                    }
+                } else {
+                    ImGui::Text("draws tested: %zu, visible: %zu, culled: %zu",
+                                testedCount, visiblePackets.size(),
+                                drawPackets.size() - visiblePackets.size());
+                    ImGui::Text("culling time: %.3f ms", cullingTime * 1e3);
+                }
+            }
+            if (ImGui::CollapsingHeader("Draw sorting",
+                                        ImGuiTreeNodeFlags_DefaultOpen)) {
+                ImGui::Checkbox("Sort draws by state and depth", &sortDraws);
+                if (hasMultiDrawIndirect) {
+                    ImGui::Checkbox("Multi-draw indirect", &useMultiDrawIndirect);
+                    ImGui::Checkbox("Instance draws of the same primitive", &useInstancing);
+                } else {
+                    ImGui::Text("Multi-draw indirect requires OpenGL 4.3");
+                }
+                ImGui::Text("draws: %zu, instances: %zu, multi-draw calls: %zu, draw uniform blocks: %zu",
+                            drawStats.drawCalls, drawStats.instances, drawStats.multiDrawCalls, drawStats.drawUniformBlocks);
+            }
+            if (ImGui::CollapsingHeader("Material textures",
+                                        ImGuiTreeNodeFlags_DefaultOpen)) {
+                if (scenePrograms.hasMaterialTextureModes()) {
+                    for (int mode = 0; mode < kMaterialTextureModeCount; ++mode) {
+                        if (!MaterialTable::isTextureModeSupported(MaterialTextureMode(mode))) {
+                            continue;
+                        }
+                        if (mode > 0) {
+                            ImGui::SameLine();
+                        }
+                        if (ImGui::RadioButton(MaterialTable::textureModeName(MaterialTextureMode(mode)), materialTable.textureMode() == mode) &&
+                            scenePrograms.setMaterialTextureMode(glState, materialTable, MaterialTextureMode(mode), toggles.features()) &&
+                            indirectPasses) {
+                            indirectPasses->setBuckets();
+                        }
+                    }
+                    if (!MaterialTable::isTextureModeSupported(kBindlessTextures)) {
+                        ImGui::Text("Bindless textures require ARB_bindless_texture, with NV_gpu_shader5 or ARB_shader_ballot");
+                    }
+                    if (!scenePrograms.materialTextureModeError().empty()) {
+                        ImGui::Text("%s", scenePrograms.materialTextureModeError().c_str());
+                    }
+                } else {
+                    ImGui::Text("%s doesn't call sampleMaterialTexture(), textures are bound", m_fragmentShader.c_str());
+                }
+                ImGui::Text("shading program permutations compiled: %zu",
+                            scenePrograms.shadingPermutationCount());
+                ImGui::TextWrapped("%s", programBinaryCache()->statsSummary().c_str());
+            }
+            if (ImGui::CollapsingHeader("Shader hot-reload",
+                                        ImGuiTreeNodeFlags_DefaultOpen)) {
+                if (!shaderWatcher.isSupported()) {
+                    ImGui::Text("Unsupported, %s is not watched", m_ShadersRootPath.string().c_str());
+                } else {
+                    ImGui::Text("Watching %s, %s compilation", m_ShadersRootPath.string().c_str(),
+                                glExtensions().maxShaderCompilerThreads ? "parallel" : "blocking");
+                    ImGui::Text("program sets reloaded: %zu, compiling: %zu", scenePrograms.reloadCount(),
+                                scenePrograms.reloadingCount());
+                }
+                if (!scenePrograms.shaderErrors().empty()) {
+                    ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "%s", scenePrograms.shaderErrors().c_str());
+                }
+            }
+            if (ImGui::CollapsingHeader("Depth pre-pass",
+                                        ImGuiTreeNodeFlags_DefaultOpen)) {
+                ImGui::Checkbox("Depth pre-pass (opaque draws shaded with GL_EQUAL)", &useDepthPrePass);
+                ImGui::Text("GPU time: depth pre-pass %.3f ms, shading pass %.3f ms",
+                            depthPrePass.depthSeconds() * 1e3, depthPrePass.shadingSeconds() * 1e3);
+            }
+            if (ImGui::CollapsingHeader("GL state changes",
+                                        ImGuiTreeNodeFlags_DefaultOpen)) {
+                ImGui::Text("issued: %zu, skipped: %zu",
+                            glStateStats.issuedCount(), glStateStats.skippedCount());
+                for (int type = 0; type < GLStateCache::kStateTypeCount; ++type) {
+                    ImGui::BulletText("%s: %zu issued, %zu skipped",
+                                      GLStateCache::stateTypeName(GLStateCache::StateType(type)),
+                                      glStateStats.issued[type], glStateStats.skipped[type]);
+                }
+            }
+            if (ImGui::CollapsingHeader("Picking",
+                                        ImGuiTreeNodeFlags_DefaultOpen)) {
+                ImGui::Checkbox("Pick under cursor (else left click)", &pickUnderCursor);
+                if (!scenePicker.isReady()) {
+                    ImGui::Text("Building BVHs...");
+                } else if (hasPickResult) {
+                    ImGui::Text("node: %d, mesh: %d, primitive: %d, triangle: %d",
+                                pickResult.node, pickResult.mesh,
+                                pickResult.primitive, pickResult.triangle);
+                    if (pickResult.instance >= 0) {
+                        ImGui::Text("instance: %d", pickResult.instance);
+                    }
+                    ImGui::Text("barycentrics: %.3f %.3f",
+                                pickResult.barycentrics.x, pickResult.barycentrics.y);
+                    ImGui::Text("position: %.3f %.3f %.3f, distance: %.3f",
+                                pickResult.position.x, pickResult.position.y,
+                                pickResult.position.z, pickResult.distance);
+                    ImGui::Text("query time: %.1f us", pickTime * 1e6);
+                } else {
+                    ImGui::Text("Nothing picked");
+                }
+            }
             ImGui::End();
         }
 
@@ -615,58 +766,260 @@ int ViewerApplication::run() {
             cameraController->update(float(ellapsedTime));
         }
 
+        const auto leftButtonDown = glfwGetMouseButton(m_GLFWHandle.window(), GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        if (!guiHasFocus && scenePicker.isReady() &&
+            (pickUnderCursor || (leftButtonDown && !leftButtonPressed))) {
+            glm::dvec2 cursorPosition;
+            glfwGetCursorPos(m_GLFWHandle.window(), &cursorPosition.x, &cursorPosition.y);
+            const auto pickStart = glfwGetTime();
+            hasPickResult = scenePicker.pick(glm::vec2(cursorPosition),
+                                             glm::vec2(m_nWindowWidth, m_nWindowHeight),
+                                             cameraController->getCamera(), projMatrix, pickResult);
+            pickTime = glfwGetTime() - pickStart;
+        }
+        leftButtonPressed = leftButtonDown;
+
         m_GLFWHandle.swapBuffers();  // Swap front and back buffers
     }
 
     return 0;
 }
 
-std::vector<GLuint> ViewerApplication::createTextureObjects(const tinygltf::Model &model) const {
-    // Here we assume a texture object has been created and bound to GL_TEXTURE_2D
-
-    std::vector<GLuint> textureObjects(model.textures.size(), 0);
+std::vector<MaterialTexture> ViewerApplication::createTextureObjects(const tinygltf::Model &model, SamplerObjects &samplerObjects) const {
+    std::vector<MaterialTexture> textureObjects(model.textures.size());
 
     // Default Sampler
     tinygltf::Sampler defaultSampler;
-    defaultSampler.minFilter = GL_LINEAR;
+    // Without a filter in the sampler, the implementation chooses: trilinear
+    defaultSampler.minFilter = GL_LINEAR_MIPMAP_LINEAR;
     defaultSampler.magFilter = GL_LINEAR;
     defaultSampler.wrapS = GL_REPEAT;
     defaultSampler.wrapT = GL_REPEAT;
     defaultSampler.wrapR = GL_REPEAT;
 
+    // Base color and emissive textures hold sRGB colors, decoded by the sampler before filtering. Normal,
+    // metallic-roughness and occlusion textures hold linear data.
+    std::vector<bool> isColorTexture(model.textures.size(), false), isDataTexture(model.textures.size(), false);
+    const auto markTexture = [&](std::vector<bool> &marks, int index) {
+        if (index >= 0 && size_t(index) < marks.size()) {
+            marks[index] = true;
+        }
+    };
+    // Base color textures of masked materials keep their alpha test coverage in the mipmaps
+    std::vector<float> alphaCutoffs(model.textures.size(), -1.f);
+    for (const auto &material : model.materials) {
+        const auto baseColorTexture = material.pbrMetallicRoughness.baseColorTexture.index;
+        if (material.alphaMode == "MASK" && baseColorTexture >= 0 && size_t(baseColorTexture) < alphaCutoffs.size()) {
+            alphaCutoffs[baseColorTexture] = float(material.alphaCutoff);
+        }
+        markTexture(isColorTexture, material.pbrMetallicRoughness.baseColorTexture.index);
+        markTexture(isColorTexture, material.emissiveTexture.index);
+        markTexture(isDataTexture, material.pbrMetallicRoughness.metallicRoughnessTexture.index);
+        markTexture(isDataTexture, material.normalTexture.index);
+        markTexture(isDataTexture, material.occlusionTexture.index);
+    }
+
+    const auto sampler = [&](const tinygltf::Texture &texture) -> const tinygltf::Sampler & {
+        return texture.sampler >= 0 ? model.samplers[texture.sampler] : defaultSampler;
+    };
+    const auto minFilter = [&](const tinygltf::Texture &texture) {
+        return sampler(texture).minFilter != -1 ? sampler(texture).minFilter : GL_LINEAR_MIPMAP_LINEAR;
+    };
+    // Some samplers use mipmapping for their minification filter. In that case, the specification tells us we need to have mipmaps computed for the texture.
+    const auto hasMipmaps = [&](const tinygltf::Texture &texture) {
+        const auto filter = minFilter(texture);
+        return filter == GL_NEAREST_MIPMAP_NEAREST || filter == GL_NEAREST_MIPMAP_LINEAR ||
+               filter == GL_LINEAR_MIPMAP_NEAREST || filter == GL_LINEAR_MIPMAP_LINEAR;
+    };
+
+    // KHR_texture_basisu textures read a KTX2 image, their source is an optional fallback for the viewers that can't
+    // sample it. KTX2 levels are uploaded as BC1, BC3 and BC7 blocks or RGBA8 pixels: zstd supercompressed levels are
+    // decompressed and ETC1S and UASTC images transcoded to the best of these formats on the worker threads. Textures
+    // of the formats and supercompression schemes the viewer doesn't know use their fallback.
+    const auto transcodeStart = glfwGetTime();
+    const auto transcodeTarget = ktx2TranscodeTarget();
+    std::vector<Ktx2Texture> ktx2Textures(model.images.size());
+    std::vector<std::string> ktx2Errors(model.images.size());
+    std::atomic<size_t> transcodedCount{0};
+    parallelFor(0, model.images.size(), [&](size_t i) {
+        const auto &image = model.images[i];
+        if (image.mimeType != kKtx2MimeType) {
+            return;
+        }
+        try {
+            // Checked by loadGltfImage()
+            ktx2Textures[i] = parseKtx2(image.image.data(), image.image.size());
+            if (ktx2Textures[i].needsTranscoding()) {
+                transcodeKtx2(ktx2Textures[i], image.image.data(), transcodeTarget);
+                transcodedCount += ktx2Textures[i].needsTranscoding() ? 0 : 1;
+            }
+        } catch (const std::exception &e) {
+            ktx2Errors[i] = e.what();
+        }
+    });
+    if (transcodedCount) {
+        std::cout << "KTX2: " << transcodedCount << " images transcoded in " << (glfwGetTime() - transcodeStart) * 1e3
+                  << " ms" << std::endl;
+    }
+    // Queries the context, on this thread
+    for (size_t i = 0; i < model.images.size(); ++i) {
+        if (model.images[i].mimeType == kKtx2MimeType && ktx2Errors[i].empty()) {
+            ktx2Errors[i] = ktx2Textures[i].unsupportedReason();
+        }
+    }
+    // Image sampled by a texture, -1 if there is none the context can sample
+    const auto textureImage = [&](size_t textureIndex) {
+        const auto &texture = model.textures[textureIndex];
+        auto image = texture.source;
+        const auto basisu = texture.extensions.find("KHR_texture_basisu");
+        if (basisu != end(texture.extensions) && (*basisu).second.Has("source")) {
+            image = (*basisu).second.Get("source").GetNumberAsInt();
+        }
+        if (image >= 0 && size_t(image) < model.images.size() && !ktx2Errors[image].empty()) {
+            const auto fallback = texture.source != image && texture.source >= 0 && ktx2Errors[texture.source].empty() ? texture.source : -1;
+            std::cerr << "Warning: texture " << textureIndex << " can't use image " << image << ", " << ktx2Errors[image] << ". "
+                      << (fallback >= 0 ? "Using image " + std::to_string(fallback) : std::string("Drawn white")) << std::endl;
+            image = fallback;
+        }
+        return image >= 0 && size_t(image) < model.images.size() ? image : -1;
+    };
+
+    // Textures reading the same image in the same color space share a texture object, its pixels are uploaded once.
+    // The image has mipmaps if one of its textures needs them, samplers without mipmapping only read level 0.
+    struct ImageTexture {
+        int image;
+        bool isSRGB;
+        bool hasMipmaps = false;
+        float alphaCutoff = -1.f;
+        GLuint textureObject = 0;
+    };
+    std::vector<ImageTexture> imageTextures;
+    std::map<std::pair<int, bool>, size_t> imageTextureIndices;
+    std::vector<int> textureImageTextures(model.textures.size(), -1);
+    for (size_t i = 0; i < model.textures.size(); ++i) {
+        const auto &texture = model.textures[i];
+        const auto image = textureImage(i);
+        if (image < 0) {
+            continue;
+        }
+        if (isColorTexture[i] && isDataTexture[i]) {
+            std::cerr << "Warning: texture " << i << " is used as color and as data, stored as sRGB" << std::endl;
+        }
+        const auto key = std::make_pair(image, bool(isColorTexture[i]));
+        const auto inserted = imageTextureIndices.emplace(key, imageTextures.size());
+        if (inserted.second) {
+            imageTextures.push_back(ImageTexture{key.first, key.second});
+        }
+        auto &imageTexture = imageTextures[(*inserted.first).second];
+        imageTexture.hasMipmaps = imageTexture.hasMipmaps || hasMipmaps(texture);
+        // The chain keeps the coverage of one cutoff, the highest of the masked materials sharing the image
+        imageTexture.alphaCutoff = std::max(imageTexture.alphaCutoff, alphaCutoffs[i]);
+        textureImageTextures[i] = int((*inserted.first).second);
+    }
+
+    // Level 0 of the images as RGBA8 or RGBA16 pixels, null for compressed KTX2 images
+    const auto imagePixels = [&](int imageIndex) -> const unsigned char * {
+        const auto &image = model.images[imageIndex];
+        if (image.mimeType != kKtx2MimeType) {
+            return image.image.data();
+        }
+        const auto &ktx2 = ktx2Textures[imageIndex];
+        return ktx2.isRGBA8() ? ktx2.levelData(image.image.data(), 0) : nullptr;
+    };
+
+    // Mip chains of 8 bits images are filtered on the worker threads, or loaded from the cache of previous runs.
+    // 16 bits images are left to glGenerateMipmap(), KTX2 images keep the levels of their file if they have more
+    // than one, compressed ones can only use the levels of their file.
+    const auto mipmapStart = glfwGetTime();
+    const MipmapCache mipmapCache{m_TextureCachePath};
+    std::vector<MipLevels> mipLevels(imageTextures.size());
+    std::vector<char> isMipmapCached(imageTextures.size(), false);
+    parallelFor(0, imageTextures.size(), [&](size_t i) {
+        const auto &imageTexture = imageTextures[i];
+        const auto &image = model.images[imageTexture.image];
+        const auto pixels = imagePixels(imageTexture.image);
+        if (!imageTexture.hasMipmaps || image.pixel_type != GL_UNSIGNED_BYTE || !pixels ||
+            (image.mimeType == kKtx2MimeType && ktx2Textures[imageTexture.image].levels.size() > 1)) {
+            return;
+        }
+        MipmapOptions options;
+        options.isSRGB = imageTexture.isSRGB;
+        options.alphaCutoff = imageTexture.alphaCutoff;
+        const auto key = mipmapCache.key(pixels, image.width, image.height, options);
+        isMipmapCached[i] = mipmapCache.load(key, image.width, image.height, mipLevels[i]);
+        if (!isMipmapCached[i]) {
+            mipLevels[i] = generateMipmaps(pixels, image.width, image.height, options);
+            mipmapCache.store(key, mipLevels[i]);
+        }
+    });
+    const auto mipmappedCount = std::count_if(begin(mipLevels), end(mipLevels), [](const MipLevels &levels) { return !levels.empty(); });
+    std::cout << "Mipmaps: " << mipmappedCount << " images in " << (glfwGetTime() - mipmapStart) * 1e3 << " ms, "
+              << std::count(begin(isMipmapCached), end(isMipmapCached), true) << " from " << m_TextureCachePath.string() << std::endl;
+
     glActiveTexture(GL_TEXTURE0);
-    glGenTextures(GLsizei(model.textures.size()), textureObjects.data());
-
-    for (int i = 0; i < model.textures.size(); ++i) {
-        const auto &texture = model.textures[i];           // get i-th texture
-        assert(texture.source >= 0);                       // ensure a source image is present
-        const auto &image = model.images[texture.source];  // get the image
-
-        const auto &sampler =
-            texture.sampler >= 0 ? model.samplers[texture.sampler] : defaultSampler;
-        glBindTexture(GL_TEXTURE_2D, textureObjects[i]);
-        // fill the texture object with the data from the image
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, image.pixel_type, image.image.data());
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                        sampler.minFilter != -1 ? sampler.minFilter : GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
-                        sampler.magFilter != -1 ? sampler.magFilter : GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, sampler.wrapR);
-
-        // Some samplers use mipmapping for their minification filter. In that case, the specification tells us we need to have mipmaps computed for the texture. OpenGL can compute them for us:
-        if (sampler.minFilter == GL_NEAREST_MIPMAP_NEAREST ||
-            sampler.minFilter == GL_NEAREST_MIPMAP_LINEAR ||
-            sampler.minFilter == GL_LINEAR_MIPMAP_NEAREST ||
-            sampler.minFilter == GL_LINEAR_MIPMAP_LINEAR) {
+    size_t ktx2Count = 0;
+    for (size_t i = 0; i < imageTextures.size(); ++i) {
+        auto &imageTexture = imageTextures[i];
+        const auto &image = model.images[imageTexture.image];
+        const auto isKtx2Image = image.mimeType == kKtx2MimeType;
+        const auto &ktx2 = ktx2Textures[imageTexture.image];
+        ktx2Count += isKtx2Image ? 1 : 0;
+        // No 16 bits sRGB format, 16 bits colors are stored on 8 bits
+        const auto internalFormat = isKtx2Image ? ktx2.internalFormat(imageTexture.isSRGB)
+                                    : imageTexture.isSRGB ? GL_SRGB8_ALPHA8
+                                    : image.pixel_type == GL_UNSIGNED_SHORT ? GL_RGBA16 : GL_RGBA8;
+        const auto fileLevelCount = isKtx2Image ? int(ktx2.levels.size()) : 1;
+        const auto levelCount = !isKtx2Image && imageTexture.hasMipmaps ? mipLevelCount(image.width, image.height)
+                                                                        : std::max(fileLevelCount, 1 + int(mipLevels[i].size()));
+
+        glGenTextures(1, &imageTexture.textureObject);
+        glBindTexture(GL_TEXTURE_2D, imageTexture.textureObject);
+        // fill the immutable texture object with the data from the image, then the mip chain level by level
+        glTexStorage2D(GL_TEXTURE_2D, levelCount, internalFormat, image.width, image.height);
+        auto levelWidth = image.width, levelHeight = image.height;
+        for (auto level = 0; level < fileLevelCount; ++level) {
+            if (!isKtx2Image) {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, GL_RGBA, image.pixel_type, image.image.data());
+            } else if (ktx2.isCompressed()) {
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, levelWidth, levelHeight, internalFormat,
+                                          GLsizei(ktx2.levels[level].size), ktx2.levelData(image.image.data(), level));
+            } else {
+                glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, levelWidth, levelHeight, GL_RGBA, GL_UNSIGNED_BYTE,
+                                ktx2.levelData(image.image.data(), level));
+            }
+            levelWidth = std::max(levelWidth / 2, 1);
+            levelHeight = std::max(levelHeight / 2, 1);
+        }
+        for (size_t level = 0; level < mipLevels[i].size(); ++level) {
+            glTexSubImage2D(GL_TEXTURE_2D, GLint(level + 1), 0, 0, levelWidth, levelHeight, GL_RGBA, GL_UNSIGNED_BYTE,
+                            mipLevels[i][level].data());
+            levelWidth = std::max(levelWidth / 2, 1);
+            levelHeight = std::max(levelHeight / 2, 1);
+        }
+        if (levelCount > fileLevelCount + int(mipLevels[i].size())) {
             glGenerateMipmap(GL_TEXTURE_2D);
         }
-
+        // Complete with the default parameters, sampler objects override them for the draws
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
         glBindTexture(GL_TEXTURE_2D, 0);
     }
 
+    // Filters and wrap modes of each texture go to the sampler object of its parameters
+    for (size_t i = 0; i < model.textures.size(); ++i) {
+        const auto &texture = model.textures[i];
+        SamplerObjects::Parameters parameters;
+        parameters.minFilter = minFilter(texture);
+        parameters.magFilter = sampler(texture).magFilter != -1 ? sampler(texture).magFilter : GL_LINEAR;
+        parameters.wrapS = sampler(texture).wrapS;
+        parameters.wrapT = sampler(texture).wrapT;
+        parameters.wrapR = sampler(texture).wrapR;
+        if (textureImageTextures[i] >= 0) {
+            textureObjects[i] = MaterialTexture{imageTextures[textureImageTextures[i]].textureObject, samplerObjects.get(parameters)};
+        }
+    }
+    std::cout << "Textures: " << model.textures.size() << " textures, " << imageTextures.size() << " texture objects ("
+              << ktx2Count << " KTX2), " << samplerObjects.size() << " sampler objects" << std::endl;
+
     return textureObjects;
 }
 std::vector<GLuint> ViewerApplication::createVertexArrayObjects(const tinygltf::Model &model, const std::vector<GLuint> &bufferObjects, std::vector<VaoRange> &meshIndexToVaoRange) {
@@ -689,7 +1042,7 @@ std::vector<GLuint> ViewerApplication::createVertexArrayObjects(const tinygltf::
         int size_before = vaoOffset;
         vertexArrayObjects.resize(vaoOffset + model.meshes[meshIdx].primitives.size());
         const auto &vaoRange = VaoRange{vaoOffset, GLsizei(model.meshes[meshIdx].primitives.size())};
-        meshIndexToVaoRange.push_back(vaoRange);  // Will be used during rendering
+        meshIndexToVaoRange[meshIdx] = vaoRange;  // Will be used during rendering
 
         glGenVertexArrays(vaoRange.count, &vertexArrayObjects[vaoRange.begin]);
 
@@ -732,6 +1085,69 @@ std::vector<GLuint> ViewerApplication::createVertexArrayObjects(const tinygltf::
     return vertexArrayObjects;
 }
 
+std::vector<DrawPacket> ViewerApplication::createDrawPackets(const tinygltf::Model &model, const SceneGraph &sceneGraph, const std::vector<GLuint> &vertexArrayObjects, const std::vector<VaoRange> &meshIndexToVaoRange, std::vector<PacketBounds> &packetBounds, std::vector<glm::mat4> &instanceMatrices) const {
+    std::vector<DrawPacket> drawPackets;
+    packetBounds.clear();
+    instanceMatrices.clear();
+    for (const auto sceneNodeIdx : sceneGraph.meshNodes()) {
+        const auto meshIdx = sceneGraph.mesh(sceneNodeIdx);
+        const auto &mesh = model.meshes[meshIdx];
+        const auto &vaoRange = meshIndexToVaoRange[meshIdx];
+
+        // EXT_mesh_gpu_instancing, nodes without the extension have a single instance with no transform
+        const auto nodeInstances = readMeshInstances(model, model.nodes[sceneGraph.gltfNode(sceneNodeIdx)]);
+        const auto firstInstance = int32_t(instanceMatrices.size());
+        const auto instanceCount = std::max<size_t>(nodeInstances.size(), 1);
+        instanceMatrices.insert(end(instanceMatrices), begin(nodeInstances), end(nodeInstances));
+
+        for (size_t i = 0; i < mesh.primitives.size(); ++i) {
+            const auto &primitive = mesh.primitives[i];
+
+            DrawPacket packet;
+            packet.vao = vertexArrayObjects[vaoRange.begin + i];
+            packet.mode = GLenum(primitive.mode);
+            packet.material = primitive.material;
+            packet.sceneNode = sceneNodeIdx;
+            packet.mesh = meshIdx;
+            packet.primitive = uint32_t(i);
+            packet.pass = kOpaquePass;
+            if (primitive.material >= 0) {
+                const auto &alphaMode = model.materials[primitive.material].alphaMode;
+                packet.pass = alphaMode == "BLEND" ? kBlendPass : (alphaMode == "MASK" ? kMaskPass : kOpaquePass);
+            }
+            if (primitive.indices >= 0) {
+                const auto &accessor = model.accessors[primitive.indices];
+                const auto &bufferView = model.bufferViews[accessor.bufferView];
+                packet.count = GLsizei(accessor.count);
+                packet.indexType = GLenum(accessor.componentType);
+                packet.offset = GLintptr(accessor.byteOffset + bufferView.byteOffset);
+            } else {
+                // Non indexed primitives draw all their vertices, without attributes there are none
+                if (primitive.attributes.empty()) {
+                    std::cerr << "Warning: non indexed primitive " << i << " of mesh " << meshIdx << " has no attributes, skipping it." << std::endl;
+                    continue;
+                }
+                const auto positionIt = primitive.attributes.find("POSITION");
+                const auto accessorIdx = positionIt != end(primitive.attributes) ? (*positionIt).second : (*begin(primitive.attributes)).second;
+                packet.count = GLsizei(model.accessors[accessorIdx].count);
+                packet.indexType = GL_NONE;
+                packet.offset = 0;
+            }
+
+            PacketBounds bounds;
+            bounds.isValid = getPrimitiveBounds(model, primitive, bounds.bboxMin, bounds.bboxMax);
+
+            // Instances of a primitive are consecutive, so they can be merged into instanced draws even without sorting
+            for (size_t instance = 0; instance < instanceCount; ++instance) {
+                packet.instance = nodeInstances.empty() ? -1 : firstInstance + int32_t(instance);
+                drawPackets.emplace_back(packet);
+                packetBounds.emplace_back(bounds);
+            }
+        }
+    }
+    return drawPackets;
+}
+
 void ViewerApplication::computeTangent(const tinygltf::Model &model, const tinygltf::Primitive &primitive, GLuint attribArrayIndex) {
     std::vector<glm::vec3> positions;
     std::vector<glm::vec2> uvs;
@@ -858,15 +1274,20 @@ ViewerApplication::ViewerApplication(const fs::path &appPath, uint32_t width,
                                      const std::vector<float> &lookatArgs,
                                      const std::string &vertexShader,
                                      const std::string &fragmentShader,
-                                     const fs::path &output)
+                                     const fs::path &output, bool gpuCulling,
+                                     bool occlusionCulling)
     : m_nWindowWidth(width),
       m_nWindowHeight(height),
       m_AppPath{appPath},
       m_AppName{m_AppPath.stem().string()},
       m_ImGuiIniFilename{m_AppName + ".imgui.ini"},
       m_ShadersRootPath{m_AppPath.parent_path() / "shaders"},
+      m_ProgramCachePath{m_AppPath.parent_path() / "program_cache"},
+      m_TextureCachePath{m_AppPath.parent_path() / "texture_cache"},
       m_gltfFilePath{gltfFile},
-      m_OutputPath{output} {
+      m_OutputPath{output},
+      m_UseGpuCulling{gpuCulling},
+      m_UseOcclusionCulling{occlusionCulling} {
     if (!lookatArgs.empty()) {
         m_hasUserCamera = true;
         m_userCamera =
@@ -4,8 +4,13 @@
 
 #include "utils/GLFWHandle.hpp"
 #include "utils/cameras.hpp"
+#include "utils/draw_packets.hpp"
 #include "utils/filesystem.hpp"
 #include "utils/gltf.hpp"
+#include "utils/ktx2.hpp"
+#include "utils/materials.hpp"
+#include "utils/sampler_objects.hpp"
+#include "utils/scene_graph.hpp"
 #include "utils/shaders.hpp"
 class ViewerApplication {
    private:
@@ -15,12 +20,21 @@ class ViewerApplication {
         GLsizei count;  // Number of elements in range
     };
 
+    // Local space bounding box of the primitive of a draw packet
+    struct PacketBounds {
+        glm::vec3 bboxMin;
+        glm::vec3 bboxMax;
+        bool isValid;  // False if the primitive has no positions, never culled
+    };
+
     GLsizei m_nWindowWidth = 1280;
     GLsizei m_nWindowHeight = 720;
 
     const fs::path m_AppPath;
     const std::string m_AppName;
     const fs::path m_ShadersRootPath;
+    const fs::path m_ProgramCachePath;  // Binaries of the linked programs, see ProgramBinaryCache
+    const fs::path m_TextureCachePath;  // Mip chains of the textures, see MipmapCache
 
     fs::path m_gltfFilePath;
     // std::string m_vertexShader = "forward.vs.glsl";
@@ -36,6 +50,10 @@ class ViewerApplication {
 
     fs::path m_OutputPath;
 
+    // Culling of the first frame, the GUI changes it afterwards
+    bool m_UseGpuCulling = false;
+    bool m_UseOcclusionCulling = false;
+
     // Order is important here, see comment below
     const std::string m_ImGuiIniFilename;
     // Last to be initialized, first to be destroyed:
@@ -48,7 +66,8 @@ class ViewerApplication {
                       const std::vector<float> &lookatArgs,
                       const std::string &vertexShader,
                       const std::string &fragmentShader,
-                      const fs::path &output);
+                      const fs::path &output, bool gpuCulling,
+                      bool occlusionCulling);
 
     bool loadGltfFile(tinygltf::Model &model) {
         // using namespace tinygltf;
@@ -56,6 +75,8 @@ class ViewerApplication {
         tinygltf::TinyGLTF loader;
         std::string err;
         std::string warn;
+        // KTX2 images of KHR_texture_basisu are kept as is for createTextureObjects()
+        loader.SetImageLoader(loadGltfImage, nullptr);
         bool ret = loader.LoadASCIIFromFile(&model, &err, &warn,
                                             m_gltfFilePath.string());
 
@@ -90,9 +111,16 @@ class ViewerApplication {
     };
     std::vector<GLuint> createVertexArrayObjects(const tinygltf::Model &model, const std::vector<GLuint> &bufferObjects, std::vector<VaoRange> &meshIndexToVaoRange);
 
+    // One packet per primitive of each mesh node, in scene graph order, and the local bounds of each packet.
+    // Nodes using EXT_mesh_gpu_instancing get one packet per primitive and instance, the instance transforms
+    // relative to their node are appended to instanceMatrices.
+    std::vector<DrawPacket> createDrawPackets(const tinygltf::Model &model, const SceneGraph &sceneGraph, const std::vector<GLuint> &vertexArrayObjects, const std::vector<VaoRange> &meshIndexToVaoRange, std::vector<PacketBounds> &packetBounds, std::vector<glm::mat4> &instanceMatrices) const;
+
     void computeTangent(const tinygltf::Model &model, const tinygltf::Primitive &primitive, GLuint attribArrayIndex);
 
-    std::vector<GLuint> createTextureObjects(const tinygltf::Model &model) const;
+    // One texture object per image and color space and one sampler object per distinct sampler, shared by the
+    // textures of the model
+    std::vector<MaterialTexture> createTextureObjects(const tinygltf::Model &model, SamplerObjects &samplerObjects) const;
 
     bool nextColumnWrapper() {
         // Wrapper method used for separating 'First Person' and 'TrackBall' button
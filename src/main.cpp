@@ -1,6 +1,10 @@
 #include "ViewerApplication.hpp"
 #include "utils/GLFWHandle.hpp"
+#include "utils/benchmarks.hpp"
 #include "utils/filesystem.hpp"
+#include "utils/parallel.hpp"
+#include "utils/program_cache.hpp"
+#include "utils/shader_precompile.hpp"
 
 #include <args.hxx>
 
@@ -43,6 +47,13 @@ int main(int argc, char **argv)
             "Output path to render the image. If specified no window is shown. "
             "Only png is supported.",
             {"o", "output"}};
+        args::Flag gpuCulling{parser, "gpu-culling",
+            "Start with GPU culling, to compare --output images with the CPU "
+            "culling ones",
+            {"gpu-culling"}};
+        args::Flag occlusionCulling{parser, "occlusion-culling",
+            "Start with GPU culling and HiZ occlusion culling",
+            {"occlusion-culling"}};
         parser.Parse();
 
         std::vector<float> lookatParams;
@@ -64,10 +75,62 @@ int main(int argc, char **argv)
 
         ViewerApplication app{fs::path{argv[0]}, width, height, args::get(file),
             lookatParams, args::get(vertexShader), args::get(fragmentShader),
-            args::get(output)};
+            args::get(output), gpuCulling || occlusionCulling,
+            bool(occlusionCulling)};
         returnCode = app.run();
       }};
 
+  args::Command shaders{commands, "shaders",
+      "Compile and link every program permutation of the viewer, report "
+      "compile times and errors, and fill the program binary cache",
+      [&](args::Subparser &parser) {
+        args::ValueFlag<std::string> vertexShader{parser, "vs",
+            "Vertex shader of the shading programs, as given to the viewer",
+            {"vs"}};
+        args::ValueFlag<size_t> threads{parser, "threads",
+            "Number of compiling threads (default: hardware threads)",
+            {"threads"}};
+        args::Flag allToggles{parser, "all-toggles",
+            "Compile the permutations of all the renderer toggles, not only "
+            "of the startup ones",
+            {"all-toggles"}};
+        parser.Parse();
+
+        // Same directories as the viewer, see ViewerApplication
+        const auto appDirectory = fs::path{argv[0]}.parent_path();
+        GLFWHandle handle{1, 1, "", false};
+        printGLVersion();
+        enableProgramBinaryCache(appDirectory / "program_cache");
+        const auto programs = viewerPrograms(appDirectory / "shaders",
+            vertexShader ? args::get(vertexShader) : "forward_normal.vs.glsl",
+            allToggles);
+        const auto failedCount = precompilePrograms(handle.window(), programs,
+            threads ? args::get(threads) : workerThreadCount());
+        returnCode = failedCount ? 1 : 0;
+      }};
+
+  args::Command bench{commands, "bench",
+      "Measure world matrix updates of a synthetic scene graph with 1 to N "
+      "threads",
+      [&](args::Subparser &parser) {
+        args::ValueFlag<size_t> nodes{
+            parser, "nodes", "Number of nodes (default 1000000)", {"nodes"}};
+        args::ValueFlag<size_t> children{parser, "children",
+            "Number of children per node (default 8)", {"children"}};
+        args::ValueFlag<size_t> threads{parser, "threads",
+            "Maximum number of threads (default: hardware threads)",
+            {"threads"}};
+        args::ValueFlag<size_t> iterations{parser, "iterations",
+            "Updates per thread count, the fastest is kept (default 10)",
+            {"iterations"}};
+        parser.Parse();
+
+        runSceneGraphBenchmark(nodes ? args::get(nodes) : 1000000,
+            children ? args::get(children) : 8,
+            threads ? args::get(threads) : workerThreadCount(),
+            iterations ? args::get(iterations) : 10);
+      }};
+
   try {
     parser.ParseCLI(argc, argv);
   } catch (const args::Completion &e) {
@@ -0,0 +1,194 @@
+#version 430
+
+// Frustum and HiZ occlusion culling of draw packets, see GpuCuller in
+// utils/gpu_culling.hpp. Visible draws are appended to the command range of
+// their bucket, in the half of the buffers of the phase.
+
+layout(local_size_x = 64) in;
+
+struct Box
+{
+    vec4 center;
+    vec4 extent;
+};
+
+struct CullingDraw
+{
+    uint count;
+    uint firstIndex;
+    int baseVertex;
+    uint bucket;
+};
+
+// DrawElementsIndirectCommand
+struct Command
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 2) writeonly buffer Instances
+{
+    uint uInstanceDraws[];
+};
+
+layout(std430, binding = 3) readonly buffer Boxes
+{
+    Box uBoxes[];
+};
+
+layout(std430, binding = 4) readonly buffer CullingDraws
+{
+    CullingDraw uDraws[];
+};
+
+layout(std430, binding = 5) writeonly buffer Commands
+{
+    Command uCommands[];
+};
+
+layout(std430, binding = 6) buffer DrawCounts
+{
+    uint uDrawCounts[];
+};
+
+layout(std430, binding = 7) readonly buffer BucketOffsets
+{
+    uint uBucketOffsets[];
+};
+
+// 1 for draws visible in the last frame
+layout(std430, binding = 8) buffer Visibility
+{
+    uint uVisibility[];
+};
+
+// First phase draws, second phase draws, occluded draws, occluded triangles
+layout(std430, binding = 9) buffer Stats
+{
+    uint uStats[4];
+};
+
+const int kFrustumPhase = 0;
+const int kOcclusionFirstPhase = 1;
+const int kOcclusionSecondPhase = 2;
+
+uniform vec4 uFrustumPlanes[6];
+uniform int uDrawCount;
+uniform bool uUseFrustum;
+uniform int uPhase;
+
+// Second phase
+uniform mat4 uViewProjMatrix;
+uniform sampler2D uHiZ;
+
+bool isVisible(Box box)
+{
+    for (int i = 0; i < 6; ++i) {
+        vec4 plane = uFrustumPlanes[i];
+        // Distance of the box vertex the furthest along the plane normal
+        float distance = dot(plane.xyz, box.center.xyz) + plane.w +
+                         dot(abs(plane.xyz), box.extent.xyz);
+        if (distance < 0.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// True if the nearest depth of the box is behind the HiZ pyramid over the
+// screen rectangle of the box
+bool isOccluded(Box box)
+{
+    vec3 ndcMin = vec3(1.0);
+    vec3 ndcMax = vec3(-1.0);
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner = vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0,
+                           (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = uViewProjMatrix * vec4(box.center.xyz + corner * box.extent.xyz, 1.0);
+        // Boxes crossing the near plane are visible
+        if (clip.w <= 0.0) {
+            return false;
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc);
+        ndcMax = max(ndcMax, ndc);
+    }
+    vec2 uvMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0);
+    vec2 uvMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0);
+    float nearestDepth = ndcMin.z * 0.5 + 0.5;
+
+    // Level where the rectangle spans at most 2x2 texels
+    ivec2 baseSize = textureSize(uHiZ, 0);
+    ivec2 pixelMin = min(ivec2(uvMin * vec2(baseSize)), baseSize - 1);
+    ivec2 pixelMax = min(ivec2(uvMax * vec2(baseSize)), baseSize - 1);
+    ivec2 pixelSize = pixelMax - pixelMin + 1;
+    int level = int(ceil(log2(float(max(pixelSize.x, pixelSize.y)))));
+    level = clamp(level, 0, textureQueryLevels(uHiZ) - 1);
+    // Texel i of a level covers the pixels [i, i + 1) * 2^level of level 0, the
+    // last texel of odd sized levels also covers the remaining pixels: map
+    // pixels rather than uvs so the lookup stays conservative
+    ivec2 levelSize = textureSize(uHiZ, level);
+    ivec2 texelMin = min(pixelMin >> level, levelSize - 1);
+    ivec2 texelMax = min(pixelMax >> level, levelSize - 1);
+
+    float farthestDepth = 0.0;
+    for (int y = texelMin.y; y <= texelMax.y; ++y) {
+        for (int x = texelMin.x; x <= texelMax.x; ++x) {
+            farthestDepth = max(farthestDepth, texelFetch(uHiZ, ivec2(x, y), level).r);
+        }
+    }
+    return nearestDepth > farthestDepth;
+}
+
+void main()
+{
+    uint drawIndex = gl_GlobalInvocationID.x;
+    if (drawIndex >= uint(uDrawCount)) {
+        return;
+    }
+    Box box = uBoxes[drawIndex];
+    if (uUseFrustum && !isVisible(box)) {
+        if (uPhase == kOcclusionSecondPhase) {
+            uVisibility[drawIndex] = 0u;
+        }
+        return;
+    }
+
+    CullingDraw draw = uDraws[drawIndex];
+    bool wasVisible = uVisibility[drawIndex] != 0u;
+    if (uPhase == kOcclusionFirstPhase && !wasVisible) {
+        return;
+    }
+    if (uPhase == kOcclusionSecondPhase) {
+        bool occluded = isOccluded(box);
+        uVisibility[drawIndex] = occluded ? 0u : 1u;
+        if (occluded) {
+            atomicAdd(uStats[2], 1u);
+            atomicAdd(uStats[3], draw.count / 3u);
+        }
+        // Draws of the first phase are already in the depth buffer
+        if (occluded || wasVisible) {
+            return;
+        }
+    }
+    atomicAdd(uStats[uPhase == kOcclusionSecondPhase ? 1 : 0], 1u);
+
+    // Each phase writes its half of the buffers
+    uint bufferHalf = uPhase == kOcclusionSecondPhase ? 1u : 0u;
+    uint bucketCount = uint(uBucketOffsets.length());
+    uint slot = bufferHalf * uint(uDrawCount) + uBucketOffsets[draw.bucket] +
+                atomicAdd(uDrawCounts[bufferHalf * bucketCount + draw.bucket], 1u);
+
+    uInstanceDraws[slot] = drawIndex;
+    Command command;
+    command.count = draw.count;
+    command.instanceCount = 1u;
+    command.firstIndex = draw.firstIndex;
+    command.baseVertex = draw.baseVertex;
+    command.baseInstance = slot;
+    uCommands[slot] = command;
+}
@@ -0,0 +1,8 @@
+#version 330
+
+// Depth pre-pass, color writes are disabled and the depth is the one of the
+// rasterizer
+
+void main()
+{
+}
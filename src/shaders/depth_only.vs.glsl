@@ -0,0 +1,16 @@
+#version 330
+
+// Position only vertex shader of the depth pre-pass. gl_Position is invariant
+// and computed like in forward(_normal).vs.glsl so the shading pass can test
+// depths with GL_EQUAL.
+
+layout(location = 0) in vec3 aPosition;
+
+invariant gl_Position;
+
+#include "draw_uniforms.glsl"
+
+void main()
+{
+    gl_Position = uModelViewProjMatrix * vec4(aPosition, 1);
+}
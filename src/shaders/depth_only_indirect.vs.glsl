@@ -0,0 +1,35 @@
+#version 430
+
+// Same as depth_only.vs.glsl for draws submitted with
+// glMultiDrawElementsIndirect, see forward_normal_indirect.vs.glsl
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 4) in uint aDrawId; // baseInstance + instance index
+
+invariant gl_Position;
+
+// See GpuDrawData in utils/indirect_draws.hpp
+struct DrawData
+{
+    mat4 modelMatrix;
+    mat4 normalMatrix;
+    uint materialIndex;
+};
+
+layout(std430, binding = 1) readonly buffer Draws
+{
+    DrawData uDraws[];
+};
+
+layout(std430, binding = 2) readonly buffer Instances
+{
+    uint uInstanceDraws[];
+};
+
+#include "frame_uniforms.glsl"
+
+void main()
+{
+    DrawData draw = uDraws[uInstanceDraws[aDrawId]];
+    gl_Position = uViewProjMatrix * (draw.modelMatrix * vec4(aPosition, 1));
+}
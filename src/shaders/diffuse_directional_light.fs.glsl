@@ -4,11 +4,10 @@ in vec3 vViewSpacePosition;
 in vec3 vViewSpaceNormal;
 in vec2 vTexCoords;
 
-uniform vec3 uLightDirection;
-uniform vec3 uLightIntensity;
+#include "frame_uniforms.glsl"
 
 
-out vec3 fColor;
+out vec4 fColor;
 
 
 const float pi = 3.14;
@@ -16,12 +15,12 @@ const float pi = 3.14;
 
 void main()
 {
-   // Need another normalization because interpolation of vertex attributes does not maintain unit length
+    // Need another normalization because interpolation of vertex attributes does not maintain unit length
 
     vec3 simple_brdf = vec3(1/pi,1/pi,1/pi);
 
-   
-   //vec3 viewSpaceNormal = normalize(vViewSpaceNormal);
-   //fColor = viewSpaceNormal;
-   fColor = simple_brdf* uLightIntensity * dot(vViewSpaceNormal, uLightDirection);
+
+    //vec3 viewSpaceNormal = normalize(vViewSpaceNormal);
+    //fColor = viewSpaceNormal;
+    fColor = vec4(simple_brdf* uLightIntensity * dot(vViewSpaceNormal, uLightDirection), 1);
 }
\ No newline at end of file
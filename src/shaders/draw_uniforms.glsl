@@ -0,0 +1,9 @@
+// Matrices and material of a draw of one packet per call, see DrawUniforms in
+// utils/uniform_blocks.hpp
+layout(std140) uniform DrawUniforms
+{
+    mat4 uModelViewProjMatrix;
+    mat4 uModelViewMatrix;
+    mat4 uNormalMatrix;
+    int uMaterialIndex;
+};
@@ -4,18 +4,21 @@ layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoords;
 
+// Matches the depth pre-pass, see depth_only.vs.glsl
+invariant gl_Position;
+
 out vec3 vViewSpacePosition;
 out vec3 vViewSpaceNormal;
 out vec2 vTexCoords;
+flat out int vMaterialIndex;
 
-uniform mat4 uModelViewProjMatrix;
-uniform mat4 uModelViewMatrix;
-uniform mat4 uNormalMatrix;
+#include "draw_uniforms.glsl"
 
 void main()
 {
     vViewSpacePosition = vec3(uModelViewMatrix * vec4(aPosition, 1));
-	vViewSpaceNormal = normalize(vec3(uNormalMatrix * vec4(aNormal, 0)));
-	vTexCoords = aTexCoords;
+    vViewSpaceNormal = normalize(vec3(uNormalMatrix * vec4(aNormal, 0)));
+    vTexCoords = aTexCoords;
+    vMaterialIndex = uMaterialIndex;
     gl_Position =  uModelViewProjMatrix * vec4(aPosition, 1);
 }
\ No newline at end of file
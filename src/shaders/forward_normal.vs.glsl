@@ -6,21 +6,26 @@ layout(location = 2) in vec2 aTexCoords;
 layout(location = 3) in vec3 aTangent;
 //layout(location = 4) in vec3 aBitangent; 
 
+// Matches the depth pre-pass, see depth_only.vs.glsl
+invariant gl_Position;
+
 out vec3 vViewSpacePosition;
 out vec3 vViewSpaceNormal;
 out vec2 vTexCoords;
+flat out int vMaterialIndex;
 out mat3 TBN;
 
-uniform mat4 uModelViewProjMatrix;
-uniform mat4 uModelViewMatrix;
-uniform mat4 uNormalMatrix;
+#include "draw_uniforms.glsl"
 
 void main()
 {
     vViewSpacePosition = vec3(uModelViewMatrix * vec4(aPosition, 1));
-	vViewSpaceNormal = normalize(vec3(uNormalMatrix * vec4(aNormal, 0)));
-	vTexCoords = aTexCoords;
+    vViewSpaceNormal = normalize(vec3(uNormalMatrix * vec4(aNormal, 0)));
+    vTexCoords = aTexCoords;
+    vMaterialIndex = uMaterialIndex;
 
+    // Only read by normal mapped permutations, see pbr_normal.fs.glsl
+#if defined(USE_NORMAL_MAP) && defined(USE_TBN) && defined(HAS_NORMAL_TEXTURE)
     vec3 T = normalize(vec3(uModelViewMatrix * vec4(aTangent,   0.0)));
     //vec3 B = normalize(vec3(uModelViewMatrix * vec4(aBitangent, 0.0)));
     vec3 N = normalize(vec3(uModelViewMatrix * vec4(aNormal,    0.0)));
@@ -28,6 +33,7 @@ void main()
 
     vec3 B = normalize(cross(N, T));
     TBN = mat3(T, B, N);
+#endif
 
     gl_Position =  uModelViewProjMatrix * vec4(aPosition, 1);
 }
\ No newline at end of file
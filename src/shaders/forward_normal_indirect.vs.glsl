@@ -0,0 +1,66 @@
+#version 430
+
+// Same outputs as forward_normal.vs.glsl, for draws submitted with
+// glMultiDrawElementsIndirect: matrices and material come from the per-draw
+// storage buffer instead of uniforms
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoords;
+layout(location = 3) in vec3 aTangent;
+layout(location = 4) in uint aDrawId; // baseInstance + instance index
+
+// Matches the depth pre-pass, see depth_only.vs.glsl
+invariant gl_Position;
+
+out vec3 vViewSpacePosition;
+out vec3 vViewSpaceNormal;
+out vec2 vTexCoords;
+out mat3 TBN;
+flat out int vMaterialIndex;
+
+// See GpuDrawData in utils/indirect_draws.hpp
+struct DrawData
+{
+    mat4 modelMatrix;
+    mat4 normalMatrix;
+    uint materialIndex;
+};
+
+layout(std430, binding = 1) readonly buffer Draws
+{
+    DrawData uDraws[];
+};
+
+// Draw packet of each instance, consecutive instances of a draw command are
+// packets sharing the same primitive
+layout(std430, binding = 2) readonly buffer Instances
+{
+    uint uInstanceDraws[];
+};
+
+#include "frame_uniforms.glsl"
+
+void main()
+{
+    DrawData draw = uDraws[uInstanceDraws[aDrawId]];
+    mat4 modelViewMatrix = uViewMatrix * draw.modelMatrix;
+    // View matrices are rigid, their normal matrix is their upper 3x3
+    mat3 normalMatrix = mat3(uViewMatrix) * mat3(draw.normalMatrix);
+
+    vViewSpacePosition = vec3(modelViewMatrix * vec4(aPosition, 1));
+    vViewSpaceNormal = normalize(normalMatrix * aNormal);
+    vTexCoords = aTexCoords;
+    vMaterialIndex = int(draw.materialIndex);
+
+    // Only read by normal mapped permutations, see pbr_normal.fs.glsl
+#if defined(USE_NORMAL_MAP) && defined(USE_TBN) && defined(HAS_NORMAL_TEXTURE)
+    vec3 T = normalize(vec3(modelViewMatrix * vec4(aTangent, 0.0)));
+    vec3 N = normalize(vec3(modelViewMatrix * vec4(aNormal, 0.0)));
+    T = normalize(T - dot(T, N) * N);
+    vec3 B = normalize(cross(N, T));
+    TBN = mat3(T, B, N);
+#endif
+
+    gl_Position = uViewProjMatrix * (draw.modelMatrix * vec4(aPosition, 1));
+}
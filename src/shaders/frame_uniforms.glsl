@@ -0,0 +1,15 @@
+// Camera, light, viewport and time of the frame, shared by all the programs
+// drawing it. See FrameUniforms in utils/uniform_blocks.hpp.
+layout(std140) uniform FrameUniforms
+{
+    mat4 uViewMatrix;
+    mat4 uProjMatrix;
+    mat4 uViewProjMatrix;
+    mat4 uInvViewMatrix;
+    mat4 uInvProjMatrix;
+    vec3 uLightDirection; // View space
+    vec3 uLightIntensity;
+    vec4 uViewport; // Width, height and their inverses, in pixels
+    float uTime; // Seconds since the start of the viewer
+    float uFrameTime; // Seconds since the previous frame
+};
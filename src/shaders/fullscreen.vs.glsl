@@ -0,0 +1,12 @@
+#version 330
+
+// Triangle covering the viewport, drawn with glDrawArrays(GL_TRIANGLES, 0, 3)
+// and no vertex attributes
+
+out vec2 vTexCoords;
+
+void main()
+{
+    vTexCoords = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(vTexCoords * 2.0 - 1.0, 0.0, 1.0);
+}
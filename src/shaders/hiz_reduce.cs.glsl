@@ -0,0 +1,39 @@
+#version 430
+
+// Build one level of the HiZ pyramid, see HiZPyramid in utils/hiz_pyramid.hpp.
+// Copy the source when the sizes match (level 0), else keep the farthest
+// depth of the source texels covered by each destination texel.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(r32f, binding = 0) writeonly uniform image2D uDestination;
+
+uniform sampler2D uSource;
+uniform int uSourceLevel;
+
+void main()
+{
+    ivec2 destinationSize = imageSize(uDestination);
+    ivec2 sourceSize = textureSize(uSource, uSourceLevel);
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, destinationSize))) {
+        return;
+    }
+
+    if (destinationSize == sourceSize) {
+        imageStore(uDestination, texel, vec4(texelFetch(uSource, texel, uSourceLevel).r));
+        return;
+    }
+
+    // The last texel of a row/column also covers the odd texel of the source
+    ivec2 first = 2 * texel;
+    ivec2 last = min(first + 1 + ivec2(equal(texel, destinationSize - 1)) * (sourceSize & 1),
+                     sourceSize - 1);
+    float depth = 0.0;
+    for (int y = first.y; y <= last.y; ++y) {
+        for (int x = first.x; x <= last.x; ++x) {
+            depth = max(depth, texelFetch(uSource, ivec2(x, y), uSourceLevel).r);
+        }
+    }
+    imageStore(uDestination, texel, vec4(depth));
+}
@@ -0,0 +1,37 @@
+// Materials of the scene and their textures, shared by the fragment shaders
+// of the material permutations. The including shader declares vTexCoords.
+
+// Material factors, see GpuMaterial in utils/materials.hpp
+struct Material
+{
+    vec4 baseColorFactor;
+    vec3 emissiveFactor;
+    float metallicFactor;
+    float roughnessFactor;
+    float occlusionStrength;
+    float normalTextureScale;
+    float alphaCutoff; // Read with ALPHA_MASK, see pbr_normal.fs.glsl
+    uvec2 textures[5]; // Per texture unit, read by sampleMaterialTexture()
+};
+
+layout(std430, binding = 0) readonly buffer Materials
+{
+    Material uMaterials[];
+};
+
+// Material texture units, see MaterialTextureUnit in utils/materials.hpp
+const int kBaseColorTextureUnit = 0;
+const int kMetallicRoughnessTextureUnit = 1;
+const int kEmissiveTextureUnit = 2;
+const int kOcclusionTextureUnit = 3;
+const int kNormalTextureUnit = 4;
+
+// Defined by the material_textures_*.fs.glsl shader linked with this one,
+// depending on how textures are bound. textureRef is textures[unit] of the
+// material.
+vec4 sampleMaterialTexture(int unit, uvec2 textureRef, vec2 texCoords);
+
+vec4 sampleMaterialTexture(Material material, int unit)
+{
+    return sampleMaterialTexture(unit, material.textures[unit], vTexCoords);
+}
@@ -0,0 +1,25 @@
+#version 430
+
+// sampleMaterialTexture() of kArrayTextures, see TextureArrays in
+// utils/texture_arrays.hpp: textureRef is (array, layer), arrays past
+// kMaxTextureArrays are missing textures.
+
+const uint kMaxTextureArrays = 8u;
+
+uniform sampler2DArray uMaterialTextureArrays[kMaxTextureArrays];
+
+vec4 sampleMaterialTexture(int unit, uvec2 textureRef, vec2 texCoords)
+{
+    // Sampler arrays must be indexed with dynamically uniform expressions,
+    // which the material of a multi-draw is not: each array is tested with the
+    // loop index instead. Gradients are taken outside of the divergent branch.
+    vec2 dx = dFdx(texCoords);
+    vec2 dy = dFdy(texCoords);
+    vec3 coords = vec3(texCoords, float(textureRef.y));
+    for (uint i = 0u; i < kMaxTextureArrays; ++i) {
+        if (i == textureRef.x) {
+            return textureGrad(uMaterialTextureArrays[i], coords, dx, dy);
+        }
+    }
+    return vec4(1);
+}
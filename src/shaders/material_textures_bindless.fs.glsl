@@ -0,0 +1,39 @@
+#version 430
+#extension GL_ARB_bindless_texture : require
+#ifdef GL_NV_gpu_shader5
+#extension GL_NV_gpu_shader5 : require
+#else
+#extension GL_ARB_shader_ballot : require
+#endif
+
+// sampleMaterialTexture() of kBindlessTextures, see MaterialTable in
+// utils/materials.hpp: textureRef is the handle of a resident texture, or 0
+// for missing textures.
+
+vec4 sampleMaterialTexture(int unit, uvec2 textureRef, vec2 texCoords)
+{
+    // Gradients are taken outside of the branches on the handle, which varies
+    // between the draws of a multi-draw
+    vec2 dx = dFdx(texCoords);
+    vec2 dy = dFdy(texCoords);
+    if (textureRef == uvec2(0)) {
+        return vec4(1);
+    }
+#ifdef GL_NV_gpu_shader5
+    // NV_gpu_shader5 lifts the dynamically uniform requirement on handles
+    return textureGrad(sampler2D(textureRef), texCoords, dx, dy);
+#else
+    // Handles must be dynamically uniform otherwise: each iteration samples
+    // with the handle of the first active invocation, for all the invocations
+    // sharing it, until none is left
+    vec4 color = vec4(1);
+    for (;;) {
+        uvec2 uniformRef = readFirstInvocationARB(textureRef);
+        if (uniformRef == textureRef) {
+            color = textureGrad(sampler2D(uniformRef), texCoords, dx, dy);
+            break;
+        }
+    }
+    return color;
+#endif
+}
@@ -0,0 +1,27 @@
+#version 430
+
+// sampleMaterialTexture() of kBoundTextures, see MaterialTable in
+// utils/materials.hpp: each draw binds its textures to the material texture
+// units, textureRef is unused.
+
+uniform sampler2D uBaseColorTexture;
+uniform sampler2D uMetallicRoughnessTexture;
+uniform sampler2D uEmissiveTexture;
+uniform sampler2D uOcclusionTexture;
+uniform sampler2D uNormalTexture;
+
+vec4 sampleMaterialTexture(int unit, uvec2 textureRef, vec2 texCoords)
+{
+    switch (unit) {
+    case 0:
+        return texture(uBaseColorTexture, texCoords);
+    case 1:
+        return texture(uMetallicRoughnessTexture, texCoords);
+    case 2:
+        return texture(uEmissiveTexture, texCoords);
+    case 3:
+        return texture(uOcclusionTexture, texCoords);
+    default:
+        return texture(uNormalTexture, texCoords);
+    }
+}
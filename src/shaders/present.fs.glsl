@@ -0,0 +1,32 @@
+#version 330
+
+// Copy of an offscreen color texture, or debug view of a HiZ pyramid level
+// as linear depth
+
+in vec2 vTexCoords;
+
+uniform sampler2D uColorTexture;
+uniform sampler2D uHiZTexture;
+uniform int uHiZLevel; // < 0 to show the color texture
+
+#include "frame_uniforms.glsl"
+
+out vec4 fColor;
+
+#include "srgb_output.glsl"
+
+void main()
+{
+    if (uHiZLevel < 0) {
+        // Decoded by the sRGB color texture, encoded again on write
+        fColor = vec4(encodeOutput(texture(uColorTexture, vTexCoords).rgb), 1.0);
+        return;
+    }
+    float depth = textureLod(uHiZTexture, vTexCoords, float(uHiZLevel)).r;
+    // View space distances of the depth and of the far plane
+    vec4 position = uInvProjMatrix * vec4(0.0, 0.0, depth * 2.0 - 1.0, 1.0);
+    vec4 farPosition = uInvProjMatrix * vec4(0.0, 0.0, 1.0, 1.0);
+    float linearDepth = position.z / position.w;
+    float far = farPosition.z / farPosition.w;
+    fColor = vec4(encodeOutput(vec3(linearDepth / far)), 1.0);
+}
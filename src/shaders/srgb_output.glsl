@@ -0,0 +1,13 @@
+// Fragment colors are linear, the sRGB framebuffer encodes them on write.
+// SRGB_ENCODE is defined when the framebuffer doesn't, the shader then
+// encodes like the hardware would.
+vec3 encodeOutput(vec3 color)
+{
+#ifdef SRGB_ENCODE
+    color = clamp(color, 0.0, 1.0);
+    return mix(color * 12.92, 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055,
+        step(0.0031308, color));
+#else
+    return color;
+#endif
+}
@@ -33,6 +33,8 @@ public:
     glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
     glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
     glfwWindowHint(GLFW_SAMPLES, 4);
+    // Shaders write linear colors, encoded by the framebuffer
+    glfwWindowHint(GLFW_SRGB_CAPABLE, GL_TRUE);
 
     m_pWindow =
         glfwCreateWindow(int(width), int(height), title, nullptr, nullptr);
@@ -101,6 +103,8 @@ inline void imguiNewFrame()
 inline void imguiRenderFrame()
 {
   ImGui::Render();
+  // ImGui colors are sRGB already, written as is
+  glDisable(GL_FRAMEBUFFER_SRGB);
   ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
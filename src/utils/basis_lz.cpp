@@ -0,0 +1,506 @@
+#include "basis_lz.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+// Header of the supercompression global data, followed by an image
+// descriptor per level (from level 0) and the codebooks
+struct BasisLZGlobalHeader
+{
+  uint16_t endpointCount;
+  uint16_t selectorCount;
+  uint32_t endpointsByteLength;
+  uint32_t selectorsByteLength;
+  uint32_t tablesByteLength;
+  uint32_t extendedByteLength;
+};
+static_assert(sizeof(BasisLZGlobalHeader) == 20,
+    "BasisLZGlobalHeader must match the file");
+
+struct BasisLZImageDesc
+{
+  uint32_t imageFlags;
+  uint32_t rgbSliceByteOffset;
+  uint32_t rgbSliceByteLength;
+  uint32_t alphaSliceByteOffset;
+  uint32_t alphaSliceByteLength;
+};
+
+const uint32_t kPFrameFlag = 0x02;
+
+const uint32_t kMaxCodeLength = 16;
+// Code length codes 17 to 20 are runs of zeros or of the previous length,
+// their lengths are stored in this order
+const uint32_t kCodeLengthCodeCount = 21;
+const uint8_t kCodeLengthCodeOrder[kCodeLengthCodeCount] = {
+    17, 18, 19, 20, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15, 16};
+
+// Endpoint prediction symbols pack the predictions of a 2x2 group of blocks,
+// 2 bits each, or repeat the symbol of the previous group
+const uint32_t kRepeatPredictionSymbol = 256;
+const uint32_t kPredictionRepeatCountBits = 4;
+const uint32_t kMinPredictionRepeatCount = 3;
+enum EndpointPrediction
+{
+  kLeftEndpoint = 0,
+  kUpperEndpoint,
+  kUpperLeftEndpoint,
+  kDeltaEndpoint
+};
+
+// Runs of the first selector of the history
+const uint32_t kMinSelectorRunLength = 3;
+const uint32_t kSelectorRunSymbolCount = 64; // The last one reads a VLC
+
+const int kIntensityTables[8][4] = {{-8, -2, 2, 8}, {-17, -5, 5, 17},
+    {-29, -9, 9, 29}, {-42, -13, 13, 42}, {-60, -18, 18, 60},
+    {-80, -24, 24, 80}, {-106, -33, 33, 106}, {-183, -47, 47, 183}};
+
+// Selector history: used entries are moved toward the front, new ones are
+// added from the middle
+class SelectorHistory
+{
+public:
+  explicit SelectorHistory(size_t size) : m_Values(size), m_Rover(size / 2) {}
+
+  size_t size() const { return m_Values.size(); }
+  uint32_t operator[](size_t index) const { return m_Values[index]; }
+
+  void add(uint32_t value)
+  {
+    m_Values[m_Rover++] = value;
+    if (m_Rover == m_Values.size()) {
+      m_Rover = m_Values.size() / 2;
+    }
+  }
+
+  void use(size_t index) { std::swap(m_Values[index / 2], m_Values[index]); }
+
+private:
+  std::vector<uint32_t> m_Values;
+  size_t m_Rover;
+};
+} // namespace
+
+// Bits are read from the least significant bit of each byte
+class BasisLZDecoder::BitReader
+{
+public:
+  BitReader(const unsigned char *bytes, size_t size) :
+      m_Bytes(bytes), m_BitCount(size * 8)
+  {
+  }
+
+  uint32_t bit()
+  {
+    if (m_Position >= m_BitCount) {
+      throw std::runtime_error("Truncated BasisLZ data");
+    }
+    const auto value = (m_Bytes[m_Position / 8] >> (m_Position % 8)) & 1;
+    ++m_Position;
+    return value;
+  }
+
+  uint32_t bits(uint32_t count)
+  {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      value |= bit() << i;
+    }
+    return value;
+  }
+
+  // Chunks of chunkBits bits, each followed by a bit telling if another one
+  // follows
+  uint32_t variableLength(uint32_t chunkBits)
+  {
+    uint32_t value = 0;
+    for (uint32_t shift = 0; shift < 32; shift += chunkBits) {
+      const auto chunk = bits(chunkBits + 1);
+      value |= (chunk & ((1u << chunkBits) - 1)) << shift;
+      if (!(chunk >> chunkBits)) {
+        break;
+      }
+    }
+    return value;
+  }
+
+private:
+  const unsigned char *m_Bytes;
+  size_t m_BitCount;
+  size_t m_Position = 0;
+};
+
+BasisLZDecoder::BasisLZDecoder(
+    const unsigned char *globalData, size_t size, size_t levelCount)
+{
+  BasisLZGlobalHeader header;
+  if (size < sizeof(header) + levelCount * sizeof(BasisLZImageDesc)) {
+    throw std::runtime_error("Truncated BasisLZ global data");
+  }
+  std::memcpy(&header, globalData, sizeof(header));
+  const auto codebooksOffset =
+      sizeof(header) + levelCount * sizeof(BasisLZImageDesc);
+  if (size - codebooksOffset < size_t(header.endpointsByteLength) +
+                                   header.selectorsByteLength +
+                                   header.tablesByteLength) {
+    throw std::runtime_error("Truncated BasisLZ codebooks");
+  }
+  if (!header.endpointCount || !header.selectorCount) {
+    throw std::runtime_error("Empty BasisLZ codebooks");
+  }
+
+  for (size_t level = 0; level < levelCount; ++level) {
+    BasisLZImageDesc desc;
+    std::memcpy(&desc, globalData + sizeof(header) + level * sizeof(desc),
+        sizeof(desc));
+    if (desc.imageFlags & kPFrameFlag) {
+      throw std::runtime_error("BasisLZ video frames are not supported");
+    }
+    m_ColorSlices.push_back(
+        SliceDesc{desc.rgbSliceByteOffset, desc.rgbSliceByteLength});
+    m_AlphaSlices.push_back(
+        SliceDesc{desc.alphaSliceByteOffset, desc.alphaSliceByteLength});
+    m_HasAlpha = m_HasAlpha || desc.alphaSliceByteLength != 0;
+  }
+
+  m_Endpoints.resize(header.endpointCount);
+  m_Selectors.resize(size_t(header.selectorCount) * 4);
+  auto codebook = globalData + codebooksOffset;
+  decodeEndpoints(codebook, header.endpointsByteLength);
+  codebook += header.endpointsByteLength;
+  decodeSelectors(codebook, header.selectorsByteLength);
+  codebook += header.selectorsByteLength;
+  decodeTables(codebook, header.tablesByteLength);
+}
+
+BasisLZDecoder::HuffmanTable BasisLZDecoder::readHuffmanTable(
+    BitReader &reader)
+{
+  const auto symbolCount = reader.bits(14);
+  if (!symbolCount) {
+    return buildHuffmanTable({});
+  }
+
+  // Lengths of the codes are themselves Huffman coded
+  std::vector<uint8_t> codeLengthLengths(kCodeLengthCodeCount, 0);
+  const auto codeLengthCodeCount = reader.bits(5);
+  if (!codeLengthCodeCount || codeLengthCodeCount > kCodeLengthCodeCount) {
+    throw std::runtime_error("Invalid BasisLZ Huffman table");
+  }
+  for (uint32_t i = 0; i < codeLengthCodeCount; ++i) {
+    codeLengthLengths[kCodeLengthCodeOrder[i]] = uint8_t(reader.bits(3));
+  }
+  const auto codeLengthTable = buildHuffmanTable(codeLengthLengths);
+
+  std::vector<uint8_t> lengths;
+  lengths.reserve(symbolCount);
+  while (lengths.size() < symbolCount) {
+    const auto code = decodeSymbol(reader, codeLengthTable);
+    if (code <= kMaxCodeLength) {
+      lengths.push_back(uint8_t(code));
+      continue;
+    }
+    size_t runLength = 0;
+    uint8_t length = 0;
+    if (code == 17) {
+      runLength = reader.bits(3) + 3;
+    } else if (code == 18) {
+      runLength = reader.bits(7) + 11;
+    } else {
+      runLength = code == 19 ? reader.bits(2) + 3 : reader.bits(7) + 7;
+      length = lengths.empty() ? 0 : lengths.back();
+      if (!length) {
+        throw std::runtime_error("Invalid BasisLZ Huffman table");
+      }
+    }
+    if (runLength > symbolCount - lengths.size()) {
+      throw std::runtime_error("Invalid BasisLZ Huffman table");
+    }
+    lengths.insert(lengths.end(), runLength, length);
+  }
+  return buildHuffmanTable(lengths);
+}
+
+BasisLZDecoder::HuffmanTable BasisLZDecoder::buildHuffmanTable(
+    const std::vector<uint8_t> &lengths)
+{
+  HuffmanTable table;
+  std::fill(std::begin(table.lengthCount), std::end(table.lengthCount), 0);
+  for (const auto length : lengths) {
+    ++table.lengthCount[length];
+  }
+  table.lengthCount[0] = 0;
+
+  uint32_t code = 0, index = 0;
+  table.firstCode[0] = table.firstIndex[0] = 0;
+  for (uint32_t length = 1; length <= kMaxCodeLength; ++length) {
+    code = (code + table.lengthCount[length - 1]) << 1;
+    table.firstCode[length] = code;
+    table.firstIndex[length] = index;
+    index += table.lengthCount[length];
+    if (code + table.lengthCount[length] > (1u << length)) {
+      throw std::runtime_error("Invalid BasisLZ Huffman table");
+    }
+  }
+
+  table.sortedSymbols.resize(index);
+  uint32_t nextIndex[kMaxCodeLength + 1];
+  std::copy(std::begin(table.firstIndex), std::end(table.firstIndex),
+      nextIndex);
+  for (size_t symbol = 0; symbol < lengths.size(); ++symbol) {
+    if (lengths[symbol]) {
+      table.sortedSymbols[nextIndex[lengths[symbol]]++] = uint16_t(symbol);
+    }
+  }
+  return table;
+}
+
+uint32_t BasisLZDecoder::decodeSymbol(
+    BitReader &reader, const HuffmanTable &table)
+{
+  // Codes are stored from their most significant bit
+  uint32_t code = 0;
+  for (uint32_t length = 1; length <= kMaxCodeLength; ++length) {
+    code |= reader.bit();
+    const auto offset = code - table.firstCode[length];
+    if (code >= table.firstCode[length] &&
+        offset < table.lengthCount[length]) {
+      return table.sortedSymbols[table.firstIndex[length] + offset];
+    }
+    code <<= 1;
+  }
+  throw std::runtime_error("Invalid BasisLZ Huffman code");
+}
+
+void BasisLZDecoder::decodeEndpoints(const unsigned char *bytes, size_t size)
+{
+  BitReader reader(bytes, size);
+  // The delta of a 5 bits color channel is coded with one of three tables,
+  // depending on the value of the channel in the previous endpoint
+  HuffmanTable colorDeltaTables[3];
+  for (auto &colorDeltaTable : colorDeltaTables) {
+    colorDeltaTable = readHuffmanTable(reader);
+  }
+  const auto intensityDeltaTable = readHuffmanTable(reader);
+  const auto isGrayscale = reader.bit() != 0;
+
+  Endpoint previous = {{16, 16, 16}, 0};
+  for (auto &endpoint : m_Endpoints) {
+    endpoint.intensity = uint8_t(
+        (decodeSymbol(reader, intensityDeltaTable) + previous.intensity) & 7);
+    for (int c = 0; c < (isGrayscale ? 1 : 3); ++c) {
+      const auto tableIndex =
+          previous.color5[c] <= 9 ? 0 : previous.color5[c] <= 21 ? 1 : 2;
+      const auto delta = decodeSymbol(reader, colorDeltaTables[tableIndex]);
+      endpoint.color5[c] = uint8_t((previous.color5[c] + delta) & 31);
+    }
+    if (isGrayscale) {
+      endpoint.color5[1] = endpoint.color5[2] = endpoint.color5[0];
+    }
+    previous = endpoint;
+  }
+}
+
+void BasisLZDecoder::decodeSelectors(const unsigned char *bytes, size_t size)
+{
+  BitReader reader(bytes, size);
+  // Global and hybrid codebooks are from older versions of the format
+  if (reader.bit() || reader.bit()) {
+    throw std::runtime_error("BasisLZ global selector codebooks are not "
+                             "supported");
+  }
+  if (reader.bit()) {
+    for (auto &selectorRow : m_Selectors) {
+      selectorRow = uint8_t(reader.bits(8));
+    }
+    return;
+  }
+
+  // Each row of a selector is coded as a XOR with the row of the previous one
+  const auto deltaTable = readHuffmanTable(reader);
+  for (size_t i = 0; i < m_Selectors.size(); ++i) {
+    m_Selectors[i] = i < 4 ? uint8_t(reader.bits(8))
+                           : uint8_t(decodeSymbol(reader, deltaTable) ^
+                                     m_Selectors[i - 4]);
+  }
+}
+
+void BasisLZDecoder::decodeTables(const unsigned char *bytes, size_t size)
+{
+  BitReader reader(bytes, size);
+  m_EndpointPredictionTable = readHuffmanTable(reader);
+  m_EndpointDeltaTable = readHuffmanTable(reader);
+  m_SelectorTable = readHuffmanTable(reader);
+  m_SelectorHistoryRunTable = readHuffmanTable(reader);
+  m_SelectorHistorySize = reader.bits(13);
+}
+
+std::vector<ETC1SBlock> BasisLZDecoder::decodeSlice(size_t level, bool alpha,
+    const unsigned char *levelData, size_t levelSize, int width,
+    int height) const
+{
+  const auto &slice = alpha ? m_AlphaSlices[level] : m_ColorSlices[level];
+  if (!slice.size || slice.offset > levelSize ||
+      slice.size > levelSize - slice.offset) {
+    throw std::runtime_error("Invalid BasisLZ slice of level " +
+                             std::to_string(level));
+  }
+  BitReader reader(levelData + slice.offset, slice.size);
+
+  const auto blockCountX = size_t(width + 3) / 4;
+  const auto blockCountY = size_t(height + 3) / 4;
+  std::vector<ETC1SBlock> blocks(blockCountX * blockCountY);
+
+  // Endpoints of the previous row, and predictions of the odd rows read with
+  // the groups of the even rows
+  struct RowEntry
+  {
+    uint16_t endpoint;
+    uint8_t predictions;
+  };
+  std::vector<RowEntry> rows[2] = {
+      std::vector<RowEntry>(blockCountX), std::vector<RowEntry>(blockCountX)};
+
+  const auto selectorCount = uint32_t(m_Selectors.size() / 4);
+  const auto selectorRunSymbol = selectorCount + m_SelectorHistorySize;
+  SelectorHistory history(m_SelectorHistorySize);
+  size_t selectorRunLength = 0;
+
+  uint32_t predictions = 0, previousPredictions = 0;
+  size_t predictionRepeatCount = 0;
+  uint32_t previousEndpoint = 0;
+
+  for (size_t y = 0; y < blockCountY; ++y) {
+    auto &row = rows[y & 1];
+    auto &otherRow = rows[(y & 1) ^ 1];
+    for (size_t x = 0; x < blockCountX; ++x) {
+      if (!(x & 1)) {
+        if (y & 1) {
+          predictions = row[x].predictions;
+        } else {
+          if (predictionRepeatCount) {
+            --predictionRepeatCount;
+            predictions = previousPredictions;
+          } else {
+            predictions = decodeSymbol(reader, m_EndpointPredictionTable);
+            if (predictions == kRepeatPredictionSymbol) {
+              predictionRepeatCount =
+                  reader.variableLength(kPredictionRepeatCountBits) +
+                  kMinPredictionRepeatCount - 1;
+              predictions = previousPredictions;
+            } else {
+              previousPredictions = predictions;
+            }
+          }
+          otherRow[x].predictions = uint8_t(predictions >> 4);
+        }
+      }
+
+      const auto prediction = predictions & 3;
+      predictions >>= 2;
+      uint32_t endpoint = 0;
+      if (prediction == kLeftEndpoint && x > 0) {
+        endpoint = previousEndpoint;
+      } else if (prediction == kUpperEndpoint && y > 0) {
+        endpoint = otherRow[x].endpoint;
+      } else if (prediction == kUpperLeftEndpoint && x > 0 && y > 0) {
+        endpoint = otherRow[x - 1].endpoint;
+      } else if (prediction == kDeltaEndpoint) {
+        endpoint =
+            decodeSymbol(reader, m_EndpointDeltaTable) + previousEndpoint;
+        if (endpoint >= m_Endpoints.size()) {
+          endpoint -= uint32_t(m_Endpoints.size());
+        }
+      } else {
+        throw std::runtime_error("Invalid BasisLZ endpoint prediction");
+      }
+      if (endpoint >= m_Endpoints.size()) {
+        throw std::runtime_error("Invalid BasisLZ endpoint index");
+      }
+      row[x].endpoint = uint16_t(endpoint);
+      previousEndpoint = endpoint;
+
+      // Selector symbols are selector indices, history indices after them, or
+      // a run of the first history entry
+      uint32_t symbol = selectorCount;
+      if (selectorRunLength) {
+        --selectorRunLength;
+      } else {
+        symbol = decodeSymbol(reader, m_SelectorTable);
+        if (symbol == selectorRunSymbol) {
+          const auto runSymbol =
+              decodeSymbol(reader, m_SelectorHistoryRunTable);
+          selectorRunLength =
+              (runSymbol == kSelectorRunSymbolCount - 1
+                      ? reader.variableLength(7)
+                      : runSymbol) +
+              kMinSelectorRunLength;
+          if (selectorRunLength > blocks.size()) {
+            throw std::runtime_error("Invalid BasisLZ selector run");
+          }
+          --selectorRunLength;
+          symbol = selectorCount;
+        }
+      }
+      uint32_t selector = symbol;
+      if (symbol >= selectorCount) {
+        const auto historyIndex = symbol - selectorCount;
+        if (historyIndex >= history.size()) {
+          throw std::runtime_error("Invalid BasisLZ selector history index");
+        }
+        selector = history[historyIndex];
+        if (historyIndex) {
+          history.use(historyIndex);
+        }
+      } else if (history.size()) {
+        history.add(selector);
+      }
+
+      blocks[y * blockCountX + x] =
+          ETC1SBlock{uint16_t(endpoint), uint16_t(selector)};
+    }
+  }
+  return blocks;
+}
+
+void BasisLZDecoder::decodeBlock(ETC1SBlock colorBlock,
+    const ETC1SBlock *alphaBlock, uint8_t pixels[64]) const
+{
+  uint8_t colors[4][3];
+  endpointColors(m_Endpoints[colorBlock.endpoint], colors);
+  const auto selector = &m_Selectors[size_t(colorBlock.selector) * 4];
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 4; ++x) {
+      const auto color = colors[(selector[y] >> (2 * x)) & 3];
+      std::copy(color, color + 3, pixels + (y * 4 + x) * 4);
+      pixels[(y * 4 + x) * 4 + 3] = 255;
+    }
+  }
+  if (!alphaBlock) {
+    return;
+  }
+  endpointColors(m_Endpoints[alphaBlock->endpoint], colors);
+  const auto alphaSelector = &m_Selectors[size_t(alphaBlock->selector) * 4];
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 4; ++x) {
+      pixels[(y * 4 + x) * 4 + 3] =
+          colors[(alphaSelector[y] >> (2 * x)) & 3][1];
+    }
+  }
+}
+
+void BasisLZDecoder::endpointColors(
+    const Endpoint &endpoint, uint8_t colors[4][3]) const
+{
+  for (int c = 0; c < 3; ++c) {
+    const auto base = (endpoint.color5[c] << 3) | (endpoint.color5[c] >> 2);
+    for (int s = 0; s < 4; ++s) {
+      colors[s][c] = uint8_t(std::min(
+          std::max(base + kIntensityTables[endpoint.intensity][s], 0), 255));
+    }
+  }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Block of a Basis Universal ETC1S slice: indices in the endpoint and selector
+// codebooks
+struct ETC1SBlock
+{
+  uint16_t endpoint;
+  uint16_t selector;
+};
+
+// Decoder of the BasisLZ supercompression of KTX2 files, see
+// https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html#basisLZ. The
+// supercompression global data holds the codebooks of ETC1S endpoints
+// (base color and intensity table) and selectors (2 bits per pixel) shared by
+// all levels, and the Huffman tables of the slices. A level has a color slice
+// and an optional alpha slice, whose green channel is the alpha.
+//
+// Slices are entropy coded in a single stream, so decodeSlice() is serial;
+// the pixels of the blocks it returns can be decoded in parallel.
+class BasisLZDecoder
+{
+public:
+  // Throw std::runtime_error if the global data of the levelCount levels is
+  // invalid, or if the file is a video (P-frames)
+  BasisLZDecoder(const unsigned char *globalData, size_t size,
+      size_t levelCount);
+
+  bool hasAlpha() const { return m_HasAlpha; }
+
+  // Blocks of the color or alpha slice of a level of width x height pixels,
+  // row by row. levelData are the bytes of the level in the file. Throw
+  // std::runtime_error if the slice is invalid.
+  std::vector<ETC1SBlock> decodeSlice(size_t level, bool alpha,
+      const unsigned char *levelData, size_t levelSize, int width,
+      int height) const;
+
+  // RGBA8 pixels of a block, row major. The alpha is opaque without
+  // alphaBlock.
+  void decodeBlock(ETC1SBlock colorBlock, const ETC1SBlock *alphaBlock,
+      uint8_t pixels[64]) const;
+
+private:
+  struct Endpoint
+  {
+    uint8_t color5[3];
+    uint8_t intensity;
+  };
+
+  struct SliceDesc
+  {
+    uint32_t offset, size; // In the level data
+  };
+
+  // Canonical Huffman code, as in deflate
+  struct HuffmanTable
+  {
+    std::vector<uint16_t> sortedSymbols; // By code length then symbol
+    // Per code length, 0 unused
+    uint32_t firstCode[17];
+    uint32_t firstIndex[17]; // In sortedSymbols
+    uint32_t lengthCount[17];
+  };
+
+  class BitReader;
+
+  static HuffmanTable readHuffmanTable(BitReader &reader);
+  static HuffmanTable buildHuffmanTable(const std::vector<uint8_t> &lengths);
+  static uint32_t decodeSymbol(BitReader &reader, const HuffmanTable &table);
+
+  void decodeEndpoints(const unsigned char *bytes, size_t size);
+  void decodeSelectors(const unsigned char *bytes, size_t size);
+  void decodeTables(const unsigned char *bytes, size_t size);
+
+  // Colors of the 4 selectors of an endpoint, from the darkest
+  void endpointColors(const Endpoint &endpoint, uint8_t colors[4][3]) const;
+
+  std::vector<Endpoint> m_Endpoints;
+  // 4 bytes per selector, one per row, 2 bits per pixel from the left
+  std::vector<uint8_t> m_Selectors;
+  std::vector<SliceDesc> m_ColorSlices, m_AlphaSlices; // Per level
+  bool m_HasAlpha = false;
+
+  HuffmanTable m_EndpointPredictionTable;
+  HuffmanTable m_EndpointDeltaTable;
+  HuffmanTable m_SelectorTable;
+  HuffmanTable m_SelectorHistoryRunTable;
+  uint32_t m_SelectorHistorySize = 0;
+};
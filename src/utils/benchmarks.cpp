@@ -0,0 +1,91 @@
+#include "benchmarks.hpp"
+#include "parallel.hpp"
+#include "scene_graph.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <cstdio>
+#include <random>
+
+void runSceneGraphBenchmark(size_t nodeCount, size_t childCount,
+    size_t maxThreadCount, size_t iterationCount)
+{
+  nodeCount = std::max<size_t>(nodeCount, 1);
+  childCount = std::max<size_t>(childCount, 1);
+  maxThreadCount = std::max<size_t>(maxThreadCount, 1);
+  iterationCount = std::max<size_t>(iterationCount, 1);
+
+  // Complete tree with a single root, numbered in breadth-first order
+  std::vector<int32_t> parents(nodeCount);
+  parents[0] = -1;
+  for (size_t i = 1; i < nodeCount; ++i) {
+    parents[i] = int32_t((i - 1) / childCount);
+  }
+  SceneGraph sceneGraph{std::move(parents)};
+
+  // Small random transforms so matrices stay well conditioned at any depth
+  std::mt19937 generator{42};
+  std::uniform_real_distribution<float> distribution{-1.f, 1.f};
+  for (size_t i = 0; i < nodeCount; ++i) {
+    sceneGraph.setTranslation(i, glm::vec3(distribution(generator),
+                                     distribution(generator),
+                                     distribution(generator)));
+    sceneGraph.setRotation(i, glm::angleAxis(distribution(generator),
+                                  glm::normalize(glm::vec3(
+                                      distribution(generator), 1.f,
+                                      distribution(generator)))));
+    sceneGraph.setScale(i, glm::vec3(1.f + 0.1f * distribution(generator)));
+  }
+  sceneGraph.updateWorldMatrices();
+  std::vector<glm::mat4> referenceMatrices(nodeCount);
+  for (size_t i = 0; i < nodeCount; ++i) {
+    referenceMatrices[i] = sceneGraph.worldMatrix(i);
+  }
+
+  std::printf("Scene graph: %zu nodes, %zu children per node, %zu levels\n",
+      nodeCount, childCount, sceneGraph.levelCount());
+  std::printf("%8s %12s %10s %14s %12s\n", "threads", "ms/update", "speedup",
+      "Mnodes/s", "max error");
+
+  double singleThreadTime = 0;
+  for (size_t threadCount = 1; threadCount <= maxThreadCount; ++threadCount) {
+    ThreadPool pool{threadCount - 1};
+
+    // Touching the root makes the whole hierarchy dirty
+    const auto rootTranslation = sceneGraph.translation(0);
+    const auto update = [&]() {
+      sceneGraph.setTranslation(0, rootTranslation);
+      return sceneGraph.updateWorldMatrices(pool);
+    };
+    update(); // Warm up caches and wake up workers
+
+    auto bestTime = std::numeric_limits<double>::max();
+    for (size_t iteration = 0; iteration < iterationCount; ++iteration) {
+      const auto start = std::chrono::steady_clock::now();
+      update();
+      const auto end = std::chrono::steady_clock::now();
+      bestTime = std::min(
+          bestTime, std::chrono::duration<double>(end - start).count());
+    }
+    if (threadCount == 1) {
+      singleThreadTime = bestTime;
+    }
+
+    float maxError = 0.f;
+    for (size_t i = 0; i < nodeCount; ++i) {
+      const auto &matrix = sceneGraph.worldMatrix(i);
+      for (int column = 0; column < 4; ++column) {
+        const auto difference =
+            glm::abs(matrix[column] - referenceMatrices[i][column]);
+        maxError = std::max(maxError,
+            std::max(std::max(difference.x, difference.y),
+                std::max(difference.z, difference.w)));
+      }
+    }
+
+    std::printf("%8zu %12.3f %10.2f %14.2f %12g\n", threadCount,
+        bestTime * 1e3, singleThreadTime / bestTime,
+        nodeCount / bestTime * 1e-6, maxError);
+  }
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstddef>
+
+// Time SceneGraph::updateWorldMatrices() on a synthetic hierarchy of nodeCount
+// nodes where each node has childCount children, with 1 to maxThreadCount
+// threads. Every node is dirty at each update. Results are printed on stdout.
+void runSceneGraphBenchmark(size_t nodeCount, size_t childCount,
+    size_t maxThreadCount, size_t iterationCount);
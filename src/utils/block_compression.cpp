@@ -0,0 +1,453 @@
+#include "block_compression.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+// Endpoints of channels [firstChannel, firstChannel + channelCount) of a
+// block, before quantization. Pixels interpolate them with a weight from 0 at
+// e0 to 1 at e1.
+struct Endpoints
+{
+  float e0[4];
+  float e1[4];
+};
+
+// Extremes of the pixels on the principal axis of their channels
+Endpoints principalEndpoints(
+    const uint8_t pixels[64], int firstChannel, int channelCount)
+{
+  float mean[4] = {0, 0, 0, 0};
+  for (int i = 0; i < 16; ++i) {
+    for (int c = 0; c < channelCount; ++c) {
+      mean[c] += pixels[i * 4 + firstChannel + c];
+    }
+  }
+  for (int c = 0; c < channelCount; ++c) {
+    mean[c] /= 16.f;
+  }
+
+  float covariance[4][4] = {};
+  for (int i = 0; i < 16; ++i) {
+    const auto pixel = pixels + i * 4 + firstChannel;
+    for (int c = 0; c < channelCount; ++c) {
+      for (int d = 0; d < channelCount; ++d) {
+        covariance[c][d] += (pixel[c] - mean[c]) * (pixel[d] - mean[d]);
+      }
+    }
+  }
+
+  // Power iteration from the column of the channel of largest variance, a few
+  // steps are enough to separate the extremes
+  auto start = 0;
+  for (int c = 1; c < channelCount; ++c) {
+    start = covariance[c][c] > covariance[start][start] ? c : start;
+  }
+  float axis[4] = {0, 0, 0, 0};
+  for (int c = 0; c < channelCount; ++c) {
+    axis[c] = covariance[c][start];
+  }
+  for (int iteration = 0; iteration < 8; ++iteration) {
+    float next[4] = {0, 0, 0, 0};
+    auto norm = 0.f;
+    for (int c = 0; c < channelCount; ++c) {
+      for (int d = 0; d < channelCount; ++d) {
+        next[c] += covariance[c][d] * axis[d];
+      }
+      norm = std::max(norm, std::abs(next[c]));
+    }
+    if (norm == 0.f) {
+      break; // Uniform block
+    }
+    for (int c = 0; c < channelCount; ++c) {
+      axis[c] = next[c] / norm;
+    }
+  }
+  auto squaredLength = 0.f;
+  for (int c = 0; c < channelCount; ++c) {
+    squaredLength += axis[c] * axis[c];
+  }
+
+  auto lowT = 0.f, highT = 0.f;
+  for (int i = 0; i < 16; ++i) {
+    auto t = 0.f;
+    for (int c = 0; c < channelCount; ++c) {
+      t += (pixels[i * 4 + firstChannel + c] - mean[c]) * axis[c];
+    }
+    lowT = std::min(lowT, t);
+    highT = std::max(highT, t);
+  }
+
+  Endpoints endpoints;
+  for (int c = 0; c < channelCount; ++c) {
+    const auto scale = squaredLength > 0.f ? axis[c] / squaredLength : 0.f;
+    endpoints.e0[c] = std::min(std::max(mean[c] + lowT * scale, 0.f), 255.f);
+    endpoints.e1[c] = std::min(std::max(mean[c] + highT * scale, 0.f), 255.f);
+  }
+  return endpoints;
+}
+
+// Endpoints minimizing the squared error of the pixels interpolated with
+// weights, those of fallback if all the pixels have the same weight
+Endpoints leastSquaresEndpoints(const uint8_t pixels[64], int firstChannel,
+    int channelCount, const float weights[16], const Endpoints &fallback)
+{
+  auto a00 = 0.f, a01 = 0.f, a11 = 0.f;
+  float b0[4] = {0, 0, 0, 0}, b1[4] = {0, 0, 0, 0};
+  for (int i = 0; i < 16; ++i) {
+    const auto w1 = weights[i], w0 = 1.f - weights[i];
+    a00 += w0 * w0;
+    a01 += w0 * w1;
+    a11 += w1 * w1;
+    for (int c = 0; c < channelCount; ++c) {
+      b0[c] += w0 * pixels[i * 4 + firstChannel + c];
+      b1[c] += w1 * pixels[i * 4 + firstChannel + c];
+    }
+  }
+  const auto determinant = a00 * a11 - a01 * a01;
+  if (std::abs(determinant) < 1e-6f) {
+    return fallback;
+  }
+  Endpoints endpoints;
+  for (int c = 0; c < channelCount; ++c) {
+    const auto e0 = (a11 * b0[c] - a01 * b1[c]) / determinant;
+    const auto e1 = (a00 * b1[c] - a01 * b0[c]) / determinant;
+    endpoints.e0[c] = std::min(std::max(e0, 0.f), 255.f);
+    endpoints.e1[c] = std::min(std::max(e1, 0.f), 255.f);
+  }
+  return endpoints;
+}
+
+// Index of the closest entry of palette to each pixel, return the sum of the
+// squared errors
+int closestIndices(const uint8_t pixels[64], int firstChannel,
+    int channelCount, const int palette[][4], int paletteSize, int indices[16])
+{
+  auto error = 0;
+  for (int i = 0; i < 16; ++i) {
+    const auto pixel = pixels + i * 4 + firstChannel;
+    auto bestDistance = -1;
+    for (int p = 0; p < paletteSize; ++p) {
+      auto distance = 0;
+      for (int c = 0; c < channelCount; ++c) {
+        const auto delta = int(pixel[c]) - palette[p][c];
+        distance += delta * delta;
+      }
+      if (bestDistance < 0 || distance < bestDistance) {
+        bestDistance = distance;
+        indices[i] = p;
+      }
+    }
+    error += bestDistance;
+  }
+  return error;
+}
+
+// Little endian bit stream of a block, from bit 0 of byte 0
+void putBits(uint8_t *block, unsigned &bit, uint32_t value, unsigned count)
+{
+  for (unsigned i = 0; i < count; ++i, ++bit) {
+    if ((value >> i) & 1) {
+      block[bit / 8] |= uint8_t(1 << (bit % 8));
+    }
+  }
+}
+
+uint16_t packRGB565(const float color[4])
+{
+  const auto r = unsigned(color[0] * 31.f / 255.f + .5f);
+  const auto g = unsigned(color[1] * 63.f / 255.f + .5f);
+  const auto b = unsigned(color[2] * 31.f / 255.f + .5f);
+  return uint16_t((r << 11) | (g << 5) | b);
+}
+
+void unpackRGB565(uint16_t packed, int color[4])
+{
+  const auto r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+int quantize(float value, int bits)
+{
+  const auto maxValue = (1 << bits) - 1;
+  return std::min(std::max(int(value * maxValue / 255.f + .5f), 0), maxValue);
+}
+
+int unquantize(int value, int bits)
+{
+  return (value << (8 - bits)) | (value >> (2 * bits - 8));
+}
+
+void encodeBC4Block(const uint8_t pixels[64], int channel, uint8_t block[8])
+{
+  auto low = 255, high = 0;
+  for (int i = 0; i < 16; ++i) {
+    low = std::min(low, int(pixels[i * 4 + channel]));
+    high = std::max(high, int(pixels[i * 4 + channel]));
+  }
+  std::memset(block, 0, 8);
+  block[0] = uint8_t(high);
+  block[1] = uint8_t(low);
+  if (high == low) {
+    return; // Indices 0 read the first value
+  }
+
+  // 8 values mode, since block[0] > block[1]
+  int palette[8][4] = {{high}, {low}};
+  for (int i = 1; i < 7; ++i) {
+    palette[i + 1][0] = ((7 - i) * high + i * low) / 7;
+  }
+  int indices[16];
+  closestIndices(pixels, channel, 1, palette, 8, indices);
+  unsigned bit = 16;
+  for (const auto index : indices) {
+    putBits(block, bit, uint32_t(index), 3);
+  }
+}
+
+// BC7 index weights, of 64
+const int kBC7Weights2[4] = {0, 21, 43, 64};
+const int kBC7Weights4[16] = {
+    0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+int bc7Interpolate(int e0, int e1, int weight)
+{
+  return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+}
+
+// The index of the first pixel has an implicit high bit of 0, flip the
+// endpoints and indices if it is set. Return true if flipped.
+bool fixBC7Anchor(int indices[16], int indexBits)
+{
+  const auto maxIndex = (1 << indexBits) - 1;
+  if (indices[0] <= maxIndex / 2) {
+    return false;
+  }
+  for (int i = 0; i < 16; ++i) {
+    indices[i] = maxIndex - indices[i];
+  }
+  return true;
+}
+
+// Mode 6: RGBA endpoints of 7 bits plus a p-bit per endpoint, 4 bits indices
+// shared by the colors and the alpha
+int encodeBC7Mode6(const uint8_t pixels[64], uint8_t block[16])
+{
+  auto endpoints = principalEndpoints(pixels, 0, 4);
+  auto bestError = -1;
+  for (int pass = 0; pass < 2; ++pass) {
+    // The p-bit of each endpoint is picked for the smallest quantization error
+    int quantized[2][4];
+    int pBits[2];
+    const float *colors[2] = {endpoints.e0, endpoints.e1};
+    for (int e = 0; e < 2; ++e) {
+      auto bestQuantizationError = -1.f;
+      for (int p = 0; p < 2; ++p) {
+        int candidate[4];
+        auto error = 0.f;
+        for (int c = 0; c < 4; ++c) {
+          candidate[c] = std::min(
+              std::max(int(std::lround((colors[e][c] - p) / 2.f)), 0), 127);
+          const auto delta = float(candidate[c] * 2 + p) - colors[e][c];
+          error += delta * delta;
+        }
+        if (bestQuantizationError < 0.f || error < bestQuantizationError) {
+          bestQuantizationError = error;
+          std::copy(candidate, candidate + 4, quantized[e]);
+          pBits[e] = p;
+        }
+      }
+    }
+
+    int palette[16][4];
+    for (int i = 0; i < 16; ++i) {
+      for (int c = 0; c < 4; ++c) {
+        palette[i][c] = bc7Interpolate((quantized[0][c] << 1) | pBits[0],
+            (quantized[1][c] << 1) | pBits[1], kBC7Weights4[i]);
+      }
+    }
+    int indices[16];
+    const auto error = closestIndices(pixels, 0, 4, palette, 16, indices);
+    if (bestError < 0 || error < bestError) {
+      bestError = error;
+      int blockIndices[16];
+      std::copy(indices, indices + 16, blockIndices);
+      const auto first = fixBC7Anchor(blockIndices, 4) ? 1 : 0;
+      std::memset(block, 0, 16);
+      unsigned bit = 0;
+      putBits(block, bit, 1 << 6, 7);
+      for (int c = 0; c < 4; ++c) {
+        putBits(block, bit, uint32_t(quantized[first][c]), 7);
+        putBits(block, bit, uint32_t(quantized[1 - first][c]), 7);
+      }
+      putBits(block, bit, uint32_t(pBits[first]), 1);
+      putBits(block, bit, uint32_t(pBits[1 - first]), 1);
+      putBits(block, bit, uint32_t(blockIndices[0]), 3);
+      for (int i = 1; i < 16; ++i) {
+        putBits(block, bit, uint32_t(blockIndices[i]), 4);
+      }
+    }
+
+    float weights[16];
+    for (int i = 0; i < 16; ++i) {
+      weights[i] = kBC7Weights4[indices[i]] / 64.f;
+    }
+    endpoints = leastSquaresEndpoints(pixels, 0, 4, weights, endpoints);
+  }
+  return bestError;
+}
+
+// Mode 5: RGB endpoints of 7 bits and alpha endpoints of 8 bits, with their
+// own 2 bits indices, for alpha varying independently of the colors
+int encodeBC7Mode5(const uint8_t pixels[64], uint8_t block[16])
+{
+  int colorIndices[16], alphaIndices[16];
+  int colors[2][3], alphas[2];
+  auto colorError = -1;
+  auto endpoints = principalEndpoints(pixels, 0, 3);
+  for (int pass = 0; pass < 2; ++pass) {
+    int quantized[2][3];
+    int palette[4][4];
+    for (int c = 0; c < 3; ++c) {
+      quantized[0][c] = quantize(endpoints.e0[c], 7);
+      quantized[1][c] = quantize(endpoints.e1[c], 7);
+      for (int i = 0; i < 4; ++i) {
+        palette[i][c] = bc7Interpolate(unquantize(quantized[0][c], 7),
+            unquantize(quantized[1][c], 7), kBC7Weights2[i]);
+      }
+    }
+    int indices[16];
+    const auto error = closestIndices(pixels, 0, 3, palette, 4, indices);
+    if (colorError < 0 || error < colorError) {
+      colorError = error;
+      std::copy(indices, indices + 16, colorIndices);
+      std::memcpy(colors, quantized, sizeof(colors));
+    }
+    float weights[16];
+    for (int i = 0; i < 16; ++i) {
+      weights[i] = kBC7Weights2[indices[i]] / 64.f;
+    }
+    endpoints = leastSquaresEndpoints(pixels, 0, 3, weights, endpoints);
+  }
+
+  auto alphaError = -1;
+  auto alphaEndpoints = principalEndpoints(pixels, 3, 1);
+  for (int pass = 0; pass < 2; ++pass) {
+    const int quantized[2] = {
+        quantize(alphaEndpoints.e0[0], 8), quantize(alphaEndpoints.e1[0], 8)};
+    int palette[4][4];
+    for (int i = 0; i < 4; ++i) {
+      palette[i][0] =
+          bc7Interpolate(quantized[0], quantized[1], kBC7Weights2[i]);
+    }
+    int indices[16];
+    const auto error = closestIndices(pixels, 3, 1, palette, 4, indices);
+    if (alphaError < 0 || error < alphaError) {
+      alphaError = error;
+      std::copy(indices, indices + 16, alphaIndices);
+      std::copy(quantized, quantized + 2, alphas);
+    }
+    float weights[16];
+    for (int i = 0; i < 16; ++i) {
+      weights[i] = kBC7Weights2[indices[i]] / 64.f;
+    }
+    alphaEndpoints =
+        leastSquaresEndpoints(pixels, 3, 1, weights, alphaEndpoints);
+  }
+
+  const auto colorFirst = fixBC7Anchor(colorIndices, 2) ? 1 : 0;
+  const auto alphaFirst = fixBC7Anchor(alphaIndices, 2) ? 1 : 0;
+  std::memset(block, 0, 16);
+  unsigned bit = 0;
+  putBits(block, bit, 1 << 5, 6);
+  putBits(block, bit, 0, 2); // No channel rotation
+  for (int c = 0; c < 3; ++c) {
+    putBits(block, bit, uint32_t(colors[colorFirst][c]), 7);
+    putBits(block, bit, uint32_t(colors[1 - colorFirst][c]), 7);
+  }
+  putBits(block, bit, uint32_t(alphas[alphaFirst]), 8);
+  putBits(block, bit, uint32_t(alphas[1 - alphaFirst]), 8);
+  for (const auto indices : {colorIndices, alphaIndices}) {
+    putBits(block, bit, uint32_t(indices[0]), 1);
+    for (int i = 1; i < 16; ++i) {
+      putBits(block, bit, uint32_t(indices[i]), 2);
+    }
+  }
+  return colorError + alphaError;
+}
+} // namespace
+
+void encodeBC1Block(const uint8_t pixels[64], uint8_t block[8])
+{
+  // Weights of the 4 colors mode indices: color0, color1, then the 2
+  // interpolated colors
+  static const float kWeights[4] = {0.f, 1.f, 1.f / 3.f, 2.f / 3.f};
+
+  auto endpoints = principalEndpoints(pixels, 0, 3);
+  auto bestError = -1;
+  for (int pass = 0; pass < 2; ++pass) {
+    auto color0 = packRGB565(endpoints.e0);
+    auto color1 = packRGB565(endpoints.e1);
+    // 4 colors mode needs color0 > color1
+    if (color0 < color1) {
+      std::swap(color0, color1);
+      std::swap(endpoints.e0, endpoints.e1);
+    }
+    int palette[4][4];
+    unpackRGB565(color0, palette[0]);
+    unpackRGB565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    int indices[16];
+    // Equal colors are read in 3 colors mode, whose index 0 is still color0
+    const auto error = color0 == color1
+                           ? closestIndices(pixels, 0, 3, palette, 1, indices)
+                           : closestIndices(pixels, 0, 3, palette, 4, indices);
+    if (bestError < 0 || error < bestError) {
+      bestError = error;
+      std::memset(block, 0, 8);
+      block[0] = uint8_t(color0);
+      block[1] = uint8_t(color0 >> 8);
+      block[2] = uint8_t(color1);
+      block[3] = uint8_t(color1 >> 8);
+      unsigned bit = 32;
+      for (const auto index : indices) {
+        putBits(block, bit, uint32_t(index), 2);
+      }
+    }
+
+    float weights[16];
+    for (int i = 0; i < 16; ++i) {
+      weights[i] = kWeights[indices[i]];
+    }
+    endpoints = leastSquaresEndpoints(pixels, 0, 3, weights, endpoints);
+  }
+}
+
+void encodeBC3Block(const uint8_t pixels[64], uint8_t block[16])
+{
+  // The color block of BC3 is always read in 4 colors mode
+  encodeBC4Block(pixels, 3, block);
+  encodeBC1Block(pixels, block + 8);
+}
+
+void encodeBC7Block(const uint8_t pixels[64], uint8_t block[16])
+{
+  const auto mode6Error = encodeBC7Mode6(pixels, block);
+  auto isOpaque = true;
+  for (int i = 0; i < 16; ++i) {
+    isOpaque = isOpaque && pixels[i * 4 + 3] == 255;
+  }
+  if (isOpaque || mode6Error == 0) {
+    return;
+  }
+  uint8_t mode5Block[16];
+  if (encodeBC7Mode5(pixels, mode5Block) < mode6Error) {
+    std::memcpy(block, mode5Block, 16);
+  }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+// Encoders of 4x4 blocks of RGBA8 pixels, given in row major order, to the
+// block compressed formats transcoded KTX2 textures are uploaded in. The
+// endpoints are the extremes of the pixels on the principal axis of the block,
+// which suits the ETC1S blocks of Basis Universal payloads whose colors lie on
+// a line. Fast rather than optimal, for textures transcoded at load time.
+
+// BC1 with 4 colors, the alpha of the pixels is ignored
+void encodeBC1Block(const uint8_t pixels[64], uint8_t block[8]);
+
+// BC3: BC4 block of the alpha followed by a BC1 block of the colors
+void encodeBC3Block(const uint8_t pixels[64], uint8_t block[16]);
+
+// BC7 mode 6: one subset, RGBA endpoints of 7 bits plus a p-bit and 4 bits
+// indices shared by the colors and the alpha. Blocks with alpha fall back to
+// mode 5, with separate indices of 2 bits for the colors and the alpha, when
+// it has a lower error.
+void encodeBC7Block(const uint8_t pixels[64], uint8_t block[16]);
@@ -0,0 +1,520 @@
+#include "bvh.hpp"
+#include "gltf.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace
+{
+
+constexpr uint32_t kMaxLeafSize = 4; // One Leaf of the 4-wide tree
+constexpr int kBinCount = 16;
+// Past this depth, nodes are split at the median to bound the traversal stack
+constexpr int kMaxSAHDepth = 48;
+constexpr int kTraversalStackSize = 256;
+
+struct BuildNode
+{
+  glm::vec3 bboxMin, bboxMax;
+  uint32_t first, count; // Range in the triangle order array
+  int32_t left = -1, right = -1;
+
+  bool isLeaf() const { return left < 0; }
+};
+
+// Clamp null direction components so that 0 * inf never produces NaNs in
+// the slab tests
+float safeInverse(float x)
+{
+  const auto epsilon = 1e-20f;
+  return 1.f / (std::fabs(x) > epsilon ? x : std::copysign(epsilon, x));
+}
+
+float halfArea(const glm::vec3 &bboxMin, const glm::vec3 &bboxMax)
+{
+  const auto d = glm::max(bboxMax - bboxMin, glm::vec3(0));
+  return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+// Binary BVH built with the binned surface area heuristic
+class BinaryBVHBuilder
+{
+public:
+  std::vector<BuildNode> nodes;
+  std::vector<uint32_t> triangleOrder;
+
+  BinaryBVHBuilder(const std::vector<glm::vec3> &triangleMin,
+      const std::vector<glm::vec3> &triangleMax) :
+      m_TriangleMin(triangleMin),
+      m_TriangleMax(triangleMax)
+  {
+    const auto count = uint32_t(triangleMin.size());
+    triangleOrder.resize(count);
+    m_Centroids.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+      triangleOrder[i] = i;
+      m_Centroids[i] = 0.5f * (triangleMin[i] + triangleMax[i]);
+    }
+    nodes.reserve(2 * (count / kMaxLeafSize) + 1);
+    build(0, count, 0);
+  }
+
+private:
+  const std::vector<glm::vec3> &m_TriangleMin;
+  const std::vector<glm::vec3> &m_TriangleMax;
+  std::vector<glm::vec3> m_Centroids;
+
+  int32_t build(uint32_t first, uint32_t count, int depth)
+  {
+    const auto nodeIdx = int32_t(nodes.size());
+    nodes.emplace_back();
+
+    auto bboxMin = glm::vec3(std::numeric_limits<float>::max());
+    auto bboxMax = glm::vec3(std::numeric_limits<float>::lowest());
+    auto centroidMin = bboxMin;
+    auto centroidMax = bboxMax;
+    for (uint32_t i = first; i < first + count; ++i) {
+      const auto triangleIdx = triangleOrder[i];
+      bboxMin = glm::min(bboxMin, m_TriangleMin[triangleIdx]);
+      bboxMax = glm::max(bboxMax, m_TriangleMax[triangleIdx]);
+      centroidMin = glm::min(centroidMin, m_Centroids[triangleIdx]);
+      centroidMax = glm::max(centroidMax, m_Centroids[triangleIdx]);
+    }
+    nodes[nodeIdx].bboxMin = bboxMin;
+    nodes[nodeIdx].bboxMax = bboxMax;
+    nodes[nodeIdx].first = first;
+    nodes[nodeIdx].count = count;
+
+    if (count <= kMaxLeafSize) {
+      return nodeIdx;
+    }
+
+    const auto mid = depth < kMaxSAHDepth
+                         ? partitionSAH(first, count, centroidMin, centroidMax)
+                         : first + count / 2;
+
+    const auto left = build(first, mid - first, depth + 1);
+    const auto right = build(mid, first + count - mid, depth + 1);
+    nodes[nodeIdx].left = left;
+    nodes[nodeIdx].right = right;
+    return nodeIdx;
+  }
+
+  // Reorder the triangles of the range according to the best SAH split and
+  // return the index of the first triangle of the right child
+  uint32_t partitionSAH(uint32_t first, uint32_t count,
+      const glm::vec3 &centroidMin, const glm::vec3 &centroidMax)
+  {
+    struct Bin
+    {
+      glm::vec3 bboxMin = glm::vec3(std::numeric_limits<float>::max());
+      glm::vec3 bboxMax = glm::vec3(std::numeric_limits<float>::lowest());
+      uint32_t count = 0;
+    };
+
+    auto bestCost = std::numeric_limits<float>::max();
+    auto bestAxis = -1;
+    auto bestSplit = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+      const auto extent = centroidMax[axis] - centroidMin[axis];
+      if (extent <= 0.f) {
+        continue;
+      }
+      const auto scale = kBinCount / extent;
+
+      Bin bins[kBinCount];
+      for (uint32_t i = first; i < first + count; ++i) {
+        const auto triangleIdx = triangleOrder[i];
+        const auto binIdx = std::min(kBinCount - 1,
+            int((m_Centroids[triangleIdx][axis] - centroidMin[axis]) * scale));
+        auto &bin = bins[binIdx];
+        bin.bboxMin = glm::min(bin.bboxMin, m_TriangleMin[triangleIdx]);
+        bin.bboxMax = glm::max(bin.bboxMax, m_TriangleMax[triangleIdx]);
+        ++bin.count;
+      }
+
+      // Sweep from the right to get the cost of each right side, then from the
+      // left to evaluate each split
+      float rightCost[kBinCount];
+      Bin accumulated;
+      for (int i = kBinCount - 1; i > 0; --i) {
+        accumulated.bboxMin = glm::min(accumulated.bboxMin, bins[i].bboxMin);
+        accumulated.bboxMax = glm::max(accumulated.bboxMax, bins[i].bboxMax);
+        accumulated.count += bins[i].count;
+        rightCost[i] =
+            accumulated.count
+                ? accumulated.count *
+                      halfArea(accumulated.bboxMin, accumulated.bboxMax)
+                : std::numeric_limits<float>::max();
+      }
+      accumulated = Bin{};
+      for (int i = 1; i < kBinCount; ++i) {
+        accumulated.bboxMin = glm::min(accumulated.bboxMin, bins[i - 1].bboxMin);
+        accumulated.bboxMax = glm::max(accumulated.bboxMax, bins[i - 1].bboxMax);
+        accumulated.count += bins[i - 1].count;
+        if (!accumulated.count ||
+            rightCost[i] == std::numeric_limits<float>::max()) {
+          continue;
+        }
+        const auto cost =
+            accumulated.count *
+                halfArea(accumulated.bboxMin, accumulated.bboxMax) +
+            rightCost[i];
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestSplit = i;
+        }
+      }
+    }
+
+    if (bestAxis < 0) {
+      // All centroids are the same point, any split is as good as another
+      return first + count / 2;
+    }
+
+    const auto scale = kBinCount / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+    const auto it = std::partition(begin(triangleOrder) + first,
+        begin(triangleOrder) + first + count, [&](uint32_t triangleIdx) {
+          const auto binIdx = std::min(kBinCount - 1,
+              int((m_Centroids[triangleIdx][bestAxis] - centroidMin[bestAxis]) *
+                  scale));
+          return binIdx < bestSplit;
+        });
+    const auto mid = uint32_t(it - begin(triangleOrder));
+    return (mid == first || mid == first + count) ? first + count / 2 : mid;
+  }
+};
+
+} // namespace
+
+MeshBVH::MeshBVH(const tinygltf::Model &model, const tinygltf::Mesh &mesh)
+{
+  // Gather the triangles of all the primitives
+  std::vector<glm::vec3> vertices; // Three per triangle
+  for (const auto &primitive : mesh.primitives) {
+    const auto positionAttrIdxIt = primitive.attributes.find("POSITION");
+    if (primitive.mode == TINYGLTF_MODE_TRIANGLES &&
+        positionAttrIdxIt != end(primitive.attributes)) {
+      const auto positions =
+          readVec3Accessor(model, (*positionAttrIdxIt).second);
+      const auto indices = readPrimitiveIndices(model, primitive);
+      const auto triangleCount = positions.empty() ? 0 : indices.size() / 3;
+      for (size_t i = 0; i < 3 * triangleCount; ++i) {
+        // Out of range indices give degenerate triangles that can't be hit
+        vertices.emplace_back(
+            indices[i] < positions.size() ? positions[indices[i]] : glm::vec3(0));
+      }
+    }
+    m_PrimitiveTriangleOffsets.emplace_back(uint32_t(vertices.size() / 3));
+  }
+
+  const auto triangleCount = vertices.size() / 3;
+  if (!triangleCount) {
+    return;
+  }
+
+  std::vector<glm::vec3> triangleMin(triangleCount), triangleMax(triangleCount);
+  for (size_t i = 0; i < triangleCount; ++i) {
+    triangleMin[i] = glm::min(
+        vertices[3 * i], glm::min(vertices[3 * i + 1], vertices[3 * i + 2]));
+    triangleMax[i] = glm::max(
+        vertices[3 * i], glm::max(vertices[3 * i + 1], vertices[3 * i + 2]));
+  }
+
+  const BinaryBVHBuilder builder{triangleMin, triangleMax};
+  const auto &buildNodes = builder.nodes;
+
+  const auto emitLeaf = [&](const BuildNode &buildNode) {
+    Leaf leaf = {};
+    for (uint32_t lane = 0; lane < 4; ++lane) {
+      leaf.triangleIds[lane] = std::numeric_limits<uint32_t>::max();
+    }
+    for (uint32_t lane = 0; lane < buildNode.count; ++lane) {
+      const auto triangleIdx = builder.triangleOrder[buildNode.first + lane];
+      const auto &v0 = vertices[3 * triangleIdx];
+      const auto e1 = vertices[3 * triangleIdx + 1] - v0;
+      const auto e2 = vertices[3 * triangleIdx + 2] - v0;
+      leaf.v0x[lane] = v0.x;
+      leaf.v0y[lane] = v0.y;
+      leaf.v0z[lane] = v0.z;
+      leaf.e1x[lane] = e1.x;
+      leaf.e1y[lane] = e1.y;
+      leaf.e1z[lane] = e1.z;
+      leaf.e2x[lane] = e2.x;
+      leaf.e2y[lane] = e2.y;
+      leaf.e2z[lane] = e2.z;
+      leaf.triangleIds[lane] = triangleIdx;
+    }
+    m_Leaves.emplace_back(leaf);
+    return ~int32_t(m_Leaves.size() - 1);
+  };
+
+  // Collapse the binary tree: each 4-wide node takes the place of a binary
+  // node and adopts its descendants, opening the largest ones first
+  const std::function<int32_t(const std::vector<int32_t> &)> collapse =
+      [&](const std::vector<int32_t> &rootChildren) {
+        auto children = rootChildren;
+        while (children.size() < 4) {
+          auto largestIt = end(children);
+          auto largestArea = -1.f;
+          for (auto it = begin(children); it != end(children); ++it) {
+            const auto &buildNode = buildNodes[*it];
+            const auto area = halfArea(buildNode.bboxMin, buildNode.bboxMax);
+            if (!buildNode.isLeaf() && area > largestArea) {
+              largestArea = area;
+              largestIt = it;
+            }
+          }
+          if (largestIt == end(children)) {
+            break;
+          }
+          const auto &opened = buildNodes[*largestIt];
+          *largestIt = opened.left;
+          children.emplace_back(opened.right);
+        }
+
+        const auto nodeIdx = int32_t(m_Nodes.size());
+        m_Nodes.emplace_back();
+        for (size_t i = 0; i < 4; ++i) {
+          auto &node = m_Nodes[nodeIdx];
+          if (i >= children.size()) {
+            node.minX[i] = node.minY[i] = node.minZ[i] = 0.f;
+            node.maxX[i] = node.maxY[i] = node.maxZ[i] = 0.f;
+            node.children[i] = kEmptyChild;
+            continue;
+          }
+          const auto &buildNode = buildNodes[children[i]];
+          node.minX[i] = buildNode.bboxMin.x;
+          node.minY[i] = buildNode.bboxMin.y;
+          node.minZ[i] = buildNode.bboxMin.z;
+          node.maxX[i] = buildNode.bboxMax.x;
+          node.maxY[i] = buildNode.bboxMax.y;
+          node.maxZ[i] = buildNode.bboxMax.z;
+          // Recursion may reallocate m_Nodes, don't keep references on it
+          const auto child =
+              buildNode.isLeaf()
+                  ? emitLeaf(buildNode)
+                  : collapse({buildNodes[children[i]].left,
+                        buildNodes[children[i]].right});
+          m_Nodes[nodeIdx].children[i] = child;
+        }
+        return nodeIdx;
+      };
+
+  m_Nodes.reserve(buildNodes.size() / 2 + 1);
+  m_Leaves.reserve(buildNodes.size() / 2 + 1);
+  if (buildNodes[0].isLeaf()) {
+    collapse({0});
+  } else {
+    collapse({buildNodes[0].left, buildNodes[0].right});
+  }
+}
+
+bool MeshBVH::intersect(const Ray &ray, TriangleHit &hit) const
+{
+  if (m_Nodes.empty()) {
+    return false;
+  }
+
+  const Float4 ox(ray.origin.x), oy(ray.origin.y), oz(ray.origin.z);
+  const Float4 dx(ray.direction.x), dy(ray.direction.y), dz(ray.direction.z);
+  const Float4 invDx(safeInverse(ray.direction.x)),
+      invDy(safeInverse(ray.direction.y)), invDz(safeInverse(ray.direction.z));
+  const Float4 zero(0.f), one(1.f);
+
+  struct StackEntry
+  {
+    int32_t child;
+    float tNear;
+  };
+  StackEntry stack[kTraversalStackSize];
+  auto stackSize = 0;
+  stack[stackSize++] = {0, 0.f};
+
+  auto found = false;
+  uint32_t hitTriangleId = 0;
+  while (stackSize) {
+    const auto entry = stack[--stackSize];
+    if (entry.tNear >= hit.t) {
+      continue;
+    }
+
+    if (entry.child >= 0) {
+      const auto &node = m_Nodes[entry.child];
+      const auto tx0 = (Float4::load(node.minX) - ox) * invDx;
+      const auto tx1 = (Float4::load(node.maxX) - ox) * invDx;
+      const auto ty0 = (Float4::load(node.minY) - oy) * invDy;
+      const auto ty1 = (Float4::load(node.maxY) - oy) * invDy;
+      const auto tz0 = (Float4::load(node.minZ) - oz) * invDz;
+      const auto tz1 = (Float4::load(node.maxZ) - oz) * invDz;
+      const auto tNear = max(max(min(tx0, tx1), min(ty0, ty1)),
+          max(min(tz0, tz1), zero));
+      const auto tFar = min(min(max(tx0, tx1), max(ty0, ty1)),
+          min(max(tz0, tz1), Float4(hit.t)));
+      const auto mask = (tNear <= tFar).bits();
+      if (!mask) {
+        continue;
+      }
+
+      alignas(16) float nearValues[4];
+      tNear.store(nearValues);
+      // Push the farthest children first so the nearest is visited first
+      int lanes[4];
+      auto laneCount = 0;
+      for (int lane = 0; lane < 4; ++lane) {
+        if ((mask & (1 << lane)) && node.children[lane] != kEmptyChild) {
+          auto i = laneCount++;
+          for (; i > 0 && nearValues[lanes[i - 1]] < nearValues[lane]; --i) {
+            lanes[i] = lanes[i - 1];
+          }
+          lanes[i] = lane;
+        }
+      }
+      for (int i = 0; i < laneCount; ++i) {
+        stack[stackSize++] = {node.children[lanes[i]], nearValues[lanes[i]]};
+      }
+    } else {
+      // Moller-Trumbore on the four triangles of the leaf
+      const auto &leaf = m_Leaves[~entry.child];
+      const auto e1x = Float4::load(leaf.e1x), e1y = Float4::load(leaf.e1y),
+                 e1z = Float4::load(leaf.e1z);
+      const auto e2x = Float4::load(leaf.e2x), e2y = Float4::load(leaf.e2y),
+                 e2z = Float4::load(leaf.e2z);
+
+      const auto px = dy * e2z - dz * e2y;
+      const auto py = dz * e2x - dx * e2z;
+      const auto pz = dx * e2y - dy * e2x;
+      const auto det = e1x * px + e1y * py + e1z * pz;
+      const auto invDet = one / det;
+
+      const auto tx = ox - Float4::load(leaf.v0x);
+      const auto ty = oy - Float4::load(leaf.v0y);
+      const auto tz = oz - Float4::load(leaf.v0z);
+      const auto u = (tx * px + ty * py + tz * pz) * invDet;
+
+      const auto qx = ty * e1z - tz * e1y;
+      const auto qy = tz * e1x - tx * e1z;
+      const auto qz = tx * e1y - ty * e1x;
+      const auto v = (dx * qx + dy * qy + dz * qz) * invDet;
+      const auto t = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+
+      const auto mask = ((abs(det) > zero) & (u >= zero) & (v >= zero) &
+                         (u + v <= one) & (t >= zero) & (t < Float4(hit.t)))
+                            .bits();
+      if (!mask) {
+        continue;
+      }
+
+      alignas(16) float tValues[4], uValues[4], vValues[4];
+      t.store(tValues);
+      u.store(uValues);
+      v.store(vValues);
+      for (int lane = 0; lane < 4; ++lane) {
+        if ((mask & (1 << lane)) && tValues[lane] < hit.t) {
+          hit.t = tValues[lane];
+          hit.barycentrics = glm::vec2(uValues[lane], vValues[lane]);
+          hitTriangleId = leaf.triangleIds[lane];
+          found = true;
+        }
+      }
+    }
+  }
+
+  if (found) {
+    const auto it = std::upper_bound(begin(m_PrimitiveTriangleOffsets),
+                        end(m_PrimitiveTriangleOffsets), hitTriangleId) -
+                    1;
+    hit.primitive = int(it - begin(m_PrimitiveTriangleOffsets));
+    hit.triangle = int(hitTriangleId - *it);
+  }
+  return found;
+}
+
+BoxBVH::BoxBVH(
+    const std::vector<glm::vec3> &boxMin, const std::vector<glm::vec3> &boxMax) :
+    m_BoxMin(boxMin),
+    m_BoxMax(boxMax)
+{
+  if (boxMin.empty()) {
+    return;
+  }
+  BinaryBVHBuilder builder{boxMin, boxMax};
+  m_BoxOrder = std::move(builder.triangleOrder);
+  m_Nodes.reserve(builder.nodes.size());
+  for (const auto &buildNode : builder.nodes) {
+    m_Nodes.push_back(Node{buildNode.bboxMin, buildNode.bboxMax,
+        buildNode.first, buildNode.count, buildNode.left, buildNode.right});
+  }
+}
+
+void BoxBVH::traverse(const Ray &ray, float tMax,
+    const std::function<float(uint32_t box)> &visit) const
+{
+  if (m_Nodes.empty()) {
+    return;
+  }
+
+  const auto invDirection = glm::vec3(safeInverse(ray.direction.x),
+      safeInverse(ray.direction.y), safeInverse(ray.direction.z));
+  // Entry distance of the ray in a box, or a negative value if it misses the
+  // box before tMax
+  const auto entryDistance = [&](const glm::vec3 &bboxMin,
+                                 const glm::vec3 &bboxMax) {
+    const auto t0 = (bboxMin - ray.origin) * invDirection;
+    const auto t1 = (bboxMax - ray.origin) * invDirection;
+    const auto tNear = glm::max(glm::min(t0, t1), glm::vec3(0));
+    const auto tFar = glm::min(glm::max(t0, t1), glm::vec3(tMax));
+    const auto entry = glm::max(tNear.x, glm::max(tNear.y, tNear.z));
+    return entry <= glm::min(tFar.x, glm::min(tFar.y, tFar.z)) ? entry : -1.f;
+  };
+
+  struct StackEntry
+  {
+    int32_t node;
+    float tNear;
+  };
+  StackEntry stack[kTraversalStackSize];
+  auto stackSize = 0;
+  const auto rootDistance = entryDistance(m_Nodes[0].bboxMin, m_Nodes[0].bboxMax);
+  if (rootDistance < 0.f) {
+    return;
+  }
+  stack[stackSize++] = {0, rootDistance};
+
+  while (stackSize) {
+    const auto entry = stack[--stackSize];
+    if (entry.tNear >= tMax) {
+      continue;
+    }
+    const auto &node = m_Nodes[entry.node];
+    if (node.left < 0) {
+      for (auto i = node.first; i < node.first + node.count; ++i) {
+        const auto box = m_BoxOrder[i];
+        if (entryDistance(m_BoxMin[box], m_BoxMax[box]) >= 0.f) {
+          tMax = std::min(tMax, visit(box));
+        }
+      }
+      continue;
+    }
+    // Push the farthest child first so the nearest is visited first
+    const auto leftDistance = entryDistance(
+        m_Nodes[node.left].bboxMin, m_Nodes[node.left].bboxMax);
+    const auto rightDistance = entryDistance(
+        m_Nodes[node.right].bboxMin, m_Nodes[node.right].bboxMax);
+    const auto leftFirst = leftDistance >= 0.f &&
+                           (rightDistance < 0.f || leftDistance <= rightDistance);
+    const StackEntry near = {leftFirst ? node.left : node.right,
+        leftFirst ? leftDistance : rightDistance};
+    const StackEntry far = {leftFirst ? node.right : node.left,
+        leftFirst ? rightDistance : leftDistance};
+    if (far.tNear >= 0.f) {
+      stack[stackSize++] = far;
+    }
+    if (near.tNear >= 0.f) {
+      stack[stackSize++] = near;
+    }
+  }
+}
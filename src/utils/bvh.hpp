@@ -0,0 +1,108 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+struct Ray
+{
+  glm::vec3 origin;
+  glm::vec3 direction; // Not necessarily normalized
+};
+
+struct TriangleHit
+{
+  float t = std::numeric_limits<float>::max(); // origin + t * direction
+  int primitive = -1; // Index of the primitive in the mesh
+  int triangle = -1;  // Index of the triangle in the primitive
+  // Weights of the second and third vertices of the triangle, the weight of
+  // the first one being 1 - u - v
+  glm::vec2 barycentrics = glm::vec2(0);
+};
+
+// Bounding volume hierarchy over the triangles of all the primitives of a glTF
+// mesh (only primitives with mode TRIANGLES are considered).
+// A binary tree is first built with the binned surface area heuristic, then
+// collapsed into a 4-wide tree: each node stores the boxes of its four
+// children and each leaf stores up to four triangles, so traversal tests four
+// boxes or four triangles at a time with SIMD instructions.
+class MeshBVH
+{
+public:
+  MeshBVH() = default;
+
+  MeshBVH(const tinygltf::Model &model, const tinygltf::Mesh &mesh);
+
+  // Find the closest intersection with t in [0, hit.t). Return true and
+  // update hit if one is found.
+  bool intersect(const Ray &ray, TriangleHit &hit) const;
+
+  size_t triangleCount() const { return m_PrimitiveTriangleOffsets.back(); }
+
+  bool empty() const { return m_Nodes.empty(); }
+
+private:
+  // Four children boxes in SoA layout
+  struct alignas(16) Node
+  {
+    float minX[4], minY[4], minZ[4];
+    float maxX[4], maxY[4], maxZ[4];
+    // >= 0: index of an inner node, kEmptyChild: unused slot, otherwise
+    // ~index of a leaf in m_Leaves
+    int32_t children[4];
+  };
+
+  // Four triangles stored as (v0, e1 = v1 - v0, e2 = v2 - v0) in SoA layout.
+  // Unused lanes hold degenerate triangles that can't be hit.
+  struct alignas(16) Leaf
+  {
+    float v0x[4], v0y[4], v0z[4];
+    float e1x[4], e1y[4], e1z[4];
+    float e2x[4], e2y[4], e2z[4];
+    uint32_t triangleIds[4]; // Index in the mesh triangle list
+  };
+
+  static constexpr int32_t kEmptyChild = std::numeric_limits<int32_t>::min();
+
+  std::vector<Node> m_Nodes; // m_Nodes[0] is the root
+  std::vector<Leaf> m_Leaves;
+  // First mesh triangle of each primitive, plus the total triangle count
+  std::vector<uint32_t> m_PrimitiveTriangleOffsets = {0};
+};
+
+// Binary bounding volume hierarchy over boxes, built with the same binned
+// surface area heuristic as MeshBVH. ScenePicker uses it above the mesh BVHs
+// to only test the instances a ray may hit, nearest first.
+class BoxBVH
+{
+public:
+  BoxBVH() = default;
+
+  // Boxes must be finite
+  BoxBVH(const std::vector<glm::vec3> &boxMin,
+      const std::vector<glm::vec3> &boxMax);
+
+  // Call visit(box) for the boxes hit by the ray with t in [0, tMax), by
+  // increasing distance of the nodes containing them. visit() returns the new
+  // tMax, the nodes and boxes past it are skipped.
+  void traverse(const Ray &ray, float tMax,
+      const std::function<float(uint32_t box)> &visit) const;
+
+  bool empty() const { return m_Nodes.empty(); }
+
+private:
+  struct Node
+  {
+    glm::vec3 bboxMin, bboxMax;
+    uint32_t first, count; // Range in m_BoxOrder of a leaf
+    int32_t left, right;   // -1 for a leaf
+  };
+
+  std::vector<Node> m_Nodes; // m_Nodes[0] is the root
+  std::vector<glm::vec3> m_BoxMin, m_BoxMax;
+  std::vector<uint32_t> m_BoxOrder;
+};
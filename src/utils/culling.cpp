@@ -0,0 +1,119 @@
+#include "culling.hpp"
+#include "simd.hpp"
+
+// Boxes of this half extent contain any scene while staying finite, so the
+// plane distances never produce NaNs
+static const float kInfiniteExtent = 1e30f;
+
+Frustum extractFrustum(const glm::mat4 &viewProjMatrix)
+{
+  // Gribb & Hartmann: -w <= x, y, z <= w in clip space, each inequality
+  // being a plane made of the last row +/- another row of the matrix
+  const auto row = [&](int i) {
+    return glm::vec4(viewProjMatrix[0][i], viewProjMatrix[1][i],
+        viewProjMatrix[2][i], viewProjMatrix[3][i]);
+  };
+  const auto w = row(3);
+  Frustum frustum;
+  for (int axis = 0; axis < 3; ++axis) {
+    frustum.planes[2 * axis] = w + row(axis);
+    frustum.planes[2 * axis + 1] = w - row(axis);
+  }
+  // Normalized so distances are comparable between planes
+  for (auto &plane : frustum.planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
+
+void BoxSet::resize(size_t count)
+{
+  m_Size = count;
+  const auto paddedSize = (count + 3) & ~size_t(3);
+  // Padding boxes have a negative extent, no plane can see them
+  for (auto *values : {&m_CenterX, &m_CenterY, &m_CenterZ}) {
+    values->resize(paddedSize, 0.f);
+  }
+  for (auto *values : {&m_ExtentX, &m_ExtentY, &m_ExtentZ}) {
+    values->resize(paddedSize, -kInfiniteExtent);
+  }
+}
+
+void BoxSet::setBox(size_t i, const glm::vec3 &bboxMin, const glm::vec3 &bboxMax)
+{
+  const auto center = 0.5f * (bboxMin + bboxMax);
+  const auto extent = 0.5f * (bboxMax - bboxMin);
+  m_CenterX[i] = center.x;
+  m_CenterY[i] = center.y;
+  m_CenterZ[i] = center.z;
+  m_ExtentX[i] = extent.x;
+  m_ExtentY[i] = extent.y;
+  m_ExtentZ[i] = extent.z;
+}
+
+void BoxSet::setTransformedBox(size_t i, const glm::vec3 &localMin,
+    const glm::vec3 &localMax, const glm::mat4 &matrix)
+{
+  // Arvo: the transformed extent is |M| * extent, no need for the 8 corners
+  const auto localCenter = 0.5f * (localMin + localMax);
+  const auto localExtent = 0.5f * (localMax - localMin);
+  const auto center = glm::vec3(matrix * glm::vec4(localCenter, 1.f));
+  const auto extent = glm::abs(glm::vec3(matrix[0])) * localExtent.x +
+                      glm::abs(glm::vec3(matrix[1])) * localExtent.y +
+                      glm::abs(glm::vec3(matrix[2])) * localExtent.z;
+  setBox(i, center - extent, center + extent);
+}
+
+void BoxSet::setInfiniteBox(size_t i)
+{
+  m_CenterX[i] = m_CenterY[i] = m_CenterZ[i] = 0.f;
+  m_ExtentX[i] = m_ExtentY[i] = m_ExtentZ[i] = kInfiniteExtent;
+}
+
+size_t cullBoxes(const Frustum &frustum, const BoxSet &boxes,
+    std::vector<uint32_t> &visibleIndices)
+{
+  Float4 planeX[6], planeY[6], planeZ[6], planeW[6];
+  Float4 absPlaneX[6], absPlaneY[6], absPlaneZ[6];
+  for (int p = 0; p < 6; ++p) {
+    const auto &plane = frustum.planes[p];
+    planeX[p] = Float4(plane.x);
+    planeY[p] = Float4(plane.y);
+    planeZ[p] = Float4(plane.z);
+    planeW[p] = Float4(plane.w);
+    absPlaneX[p] = abs(planeX[p]);
+    absPlaneY[p] = abs(planeY[p]);
+    absPlaneZ[p] = abs(planeZ[p]);
+  }
+
+  visibleIndices.resize(boxes.m_CenterX.size());
+  size_t visibleCount = 0;
+  const auto zero = Float4(0.f);
+  for (size_t i = 0; i < boxes.m_CenterX.size(); i += 4) {
+    const auto cx = Float4::loadUnaligned(&boxes.m_CenterX[i]);
+    const auto cy = Float4::loadUnaligned(&boxes.m_CenterY[i]);
+    const auto cz = Float4::loadUnaligned(&boxes.m_CenterZ[i]);
+    const auto ex = Float4::loadUnaligned(&boxes.m_ExtentX[i]);
+    const auto ey = Float4::loadUnaligned(&boxes.m_ExtentY[i]);
+    const auto ez = Float4::loadUnaligned(&boxes.m_ExtentZ[i]);
+
+    // A box is outside a plane if its center is farther behind it than the
+    // projection of its extent on the plane normal
+    int insideBits = 0xF;
+    for (int p = 0; p < 6 && insideBits; ++p) {
+      const auto distance =
+          planeX[p] * cx + planeY[p] * cy + planeZ[p] * cz + planeW[p];
+      const auto radius =
+          absPlaneX[p] * ex + absPlaneY[p] * ey + absPlaneZ[p] * ez;
+      insideBits &= (distance + radius >= zero).bits();
+    }
+
+    // Compaction without branches on the mask
+    for (int lane = 0; lane < 4; ++lane) {
+      visibleIndices[visibleCount] = uint32_t(i + lane);
+      visibleCount += (insideBits >> lane) & 1;
+    }
+  }
+  visibleIndices.resize(visibleCount);
+  return visibleCount;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Planes (a, b, c, d) of a view frustum, a point p is on the inner side of a
+// plane if dot(vec3(a, b, c), p) + d >= 0.
+struct Frustum
+{
+  glm::vec4 planes[6]; // left, right, bottom, top, near, far
+};
+
+// Extract the planes of viewProjMatrix, in the space of the points it
+// transforms (world space for projMatrix * viewMatrix)
+Frustum extractFrustum(const glm::mat4 &viewProjMatrix);
+
+// Axis aligned boxes stored as centers and half extents in SoA layout, so the
+// culling kernel loads the same coordinate of 4 boxes at once. Arrays are
+// padded to a multiple of 4 with boxes that are always culled.
+class BoxSet
+{
+public:
+  size_t size() const { return m_Size; }
+
+  void resize(size_t count);
+
+  void setBox(size_t i, const glm::vec3 &bboxMin, const glm::vec3 &bboxMax);
+
+  // Set box i to the bounds of the box (localMin, localMax) transformed by
+  // matrix, which must be affine
+  void setTransformedBox(size_t i, const glm::vec3 &localMin,
+      const glm::vec3 &localMax, const glm::mat4 &matrix);
+
+  // Box that is never culled
+  void setInfiniteBox(size_t i);
+
+  glm::vec3 center(size_t i) const
+  {
+    return glm::vec3(m_CenterX[i], m_CenterY[i], m_CenterZ[i]);
+  }
+
+  glm::vec3 extent(size_t i) const
+  {
+    return glm::vec3(m_ExtentX[i], m_ExtentY[i], m_ExtentZ[i]);
+  }
+
+private:
+  friend size_t cullBoxes(const Frustum &, const BoxSet &,
+      std::vector<uint32_t> &);
+
+  size_t m_Size = 0;
+  std::vector<float> m_CenterX, m_CenterY, m_CenterZ;
+  std::vector<float> m_ExtentX, m_ExtentY, m_ExtentZ;
+};
+
+// Test 4 boxes per iteration against the 6 planes and write the indices of
+// the boxes intersecting the frustum in visibleIndices, in increasing order.
+// Return the number of visible boxes.
+size_t cullBoxes(const Frustum &frustum, const BoxSet &boxes,
+    std::vector<uint32_t> &visibleIndices);
@@ -0,0 +1,62 @@
+#include "depth_pre_pass.hpp"
+#include "gl_state_cache.hpp"
+
+namespace {
+double sectionSeconds(const GpuTimer *timers, size_t count)
+{
+  auto seconds = 0.;
+  for (size_t i = 0; i < count; ++i) {
+    seconds += timers[i].seconds();
+  }
+  return seconds;
+}
+} // namespace
+
+void DepthPrePass::beginFrame(bool isEnabled)
+{
+  m_IsEnabled = isEnabled;
+  m_DepthSectionCount = m_ShadingSectionCount = 0;
+}
+
+void DepthPrePass::begin(GLStateCache &glState)
+{
+  m_DepthTimers[m_DepthSectionCount++].begin();
+  glState.colorMask(false);
+  glState.depthFunc(GL_LESS);
+  glState.depthMask(true);
+}
+
+void DepthPrePass::end(GLStateCache &glState)
+{
+  glState.colorMask(true);
+  m_DepthTimers[m_DepthSectionCount - 1].end();
+}
+
+void DepthPrePass::beginShading()
+{
+  m_ShadingTimers[m_ShadingSectionCount++].begin();
+}
+
+void DepthPrePass::endShading()
+{
+  m_ShadingTimers[m_ShadingSectionCount - 1].end();
+}
+
+void DepthPrePass::setShadingState(
+    GLStateCache &glState, RenderPass pass) const
+{
+  const auto isPrePassed = m_IsEnabled && pass == kOpaquePass;
+  glState.depthFunc(isPrePassed ? GL_EQUAL : GL_LESS);
+  glState.depthMask(!isPrePassed && pass != kBlendPass);
+  glState.blend(pass == kBlendPass);
+}
+
+double DepthPrePass::depthSeconds() const
+{
+  return sectionSeconds(m_DepthTimers, m_DepthSectionCount);
+}
+
+double DepthPrePass::shadingSeconds() const
+{
+  return sectionSeconds(m_ShadingTimers, m_ShadingSectionCount);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "draw_packets.hpp"
+#include "gpu_timer.hpp"
+
+#include <cstddef>
+
+class GLStateCache;
+
+// Depth pre-pass: the opaque draws are first rendered with a position only
+// program, then shaded with GL_EQUAL depth tests and depth writes off, so the
+// PBR shader runs once per pixel. Masked draws are left out: their shading
+// programs discard fragments by alpha (ALPHA_MASK), the position only program
+// can't, so they are shaded with GL_LESS and write their depth then. Blended
+// draws don't write depth and are blended over the other passes.
+//
+// Time elapsed queries can't be nested, so occlusion culling, whose phases
+// are interleaved with the HiZ build, times each phase of a pass in its own
+// section. The times of a pass add its sections.
+class DepthPrePass
+{
+public:
+  // Reset the sections, to call once per frame before the first pass
+  void beginFrame(bool isEnabled);
+
+  bool isEnabled() const { return m_IsEnabled; }
+
+  // Section of depth only draws: color writes off, depth writes with GL_LESS
+  void begin(GLStateCache &glState);
+  void end(GLStateCache &glState);
+
+  // Section of shading draws, whose depth test is set by setShadingState()
+  void beginShading();
+  void endShading();
+
+  // Depth test, depth writes and blending of the shading draws of a pass. With
+  // the pre-pass, opaque draws only shade the fragments whose depth it wrote.
+  void setShadingState(GLStateCache &glState, RenderPass pass) const;
+
+  // GPU times of the sections of the last measured frame
+  double depthSeconds() const;
+  double shadingSeconds() const;
+
+private:
+  // One per phase of occlusion culling, and one for the blended draws of
+  // both phases
+  static const size_t kMaxSectionCount = 3;
+
+  bool m_IsEnabled = false;
+  GpuTimer m_DepthTimers[kMaxSectionCount];
+  GpuTimer m_ShadingTimers[kMaxSectionCount];
+  size_t m_DepthSectionCount = 0; // Timers used by the last frame
+  size_t m_ShadingSectionCount = 0;
+};
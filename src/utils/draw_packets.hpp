@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// Passes in submission order, from the alpha mode of the material
+enum RenderPass : uint8_t
+{
+  kOpaquePass = 0,
+  kMaskPass,
+  kBlendPass
+};
+
+// Everything needed to issue the draw call of a primitive instance, resolved
+// once at load time so the draw loop never looks at the glTF model.
+struct DrawPacket
+{
+  GLuint vao;
+  GLenum mode;         // GL_TRIANGLES, GL_LINES, ...
+  GLsizei count;       // Number of indices, or of vertices for glDrawArrays
+  GLenum indexType;    // GL_UNSIGNED_*, or GL_NONE for non indexed primitives
+  GLintptr offset;     // Byte offset in the element buffer, or first vertex
+  int32_t material;    // Index in model.materials, -1 for the default material
+  uint32_t sceneNode;  // Index in the SceneGraph
+  int32_t mesh;        // Index in model.meshes
+  uint32_t primitive;  // Index in the primitives of the mesh
+  int32_t instance;    // Index of the EXT_mesh_gpu_instancing transform, -1 if none
+  RenderPass pass;
+};
+
+// Draws of a frame, state changes are counted by the state cache
+struct DrawStats
+{
+  size_t drawCalls = 0; // Draws submitted, including the ones of multi-draws
+  size_t multiDrawCalls = 0;
+  size_t instances = 0;
+  size_t drawUniformBlocks = 0; // Classic path, written for the draws
+};
+
+inline void submitDrawPacket(const DrawPacket &packet)
+{
+  if (packet.indexType != GL_NONE) {
+    glDrawElements(packet.mode, packet.count, packet.indexType,
+        (const GLvoid *)packet.offset);
+  } else {
+    glDrawArrays(packet.mode, GLint(packet.offset), packet.count);
+  }
+}
@@ -0,0 +1,49 @@
+#include "draw_sorting.hpp"
+
+#include <cassert>
+
+void RadixSorter::sort(std::vector<uint64_t> &keys, std::vector<uint32_t> &values)
+{
+  assert(keys.size() == values.size());
+  const auto count = keys.size();
+  if (count < 2) {
+    return;
+  }
+  m_Keys.resize(count);
+  m_Values.resize(count);
+
+  // Histograms of all bytes in a single read of the keys
+  for (auto &counts : m_Counts) {
+    counts.fill(0);
+  }
+  for (const auto key : keys) {
+    for (int byte = 0; byte < 8; ++byte) {
+      ++m_Counts[byte][(key >> (8 * byte)) & 0xFF];
+    }
+  }
+
+  for (int byte = 0; byte < 8; ++byte) {
+    auto &counts = m_Counts[byte];
+    const auto shift = 8 * byte;
+    if (counts[(keys[0] >> shift) & 0xFF] == count) {
+      continue; // Same byte everywhere, the order is unchanged
+    }
+
+    // Exclusive prefix sum: first output position of each byte value
+    uint32_t offset = 0;
+    for (auto &bucket : counts) {
+      const auto bucketSize = bucket;
+      bucket = offset;
+      offset += bucketSize;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+      const auto position = counts[(keys[i] >> shift) & 0xFF]++;
+      m_Keys[position] = keys[i];
+      m_Values[position] = values[i];
+    }
+    // The scratch buffers become the input of the next pass
+    keys.swap(m_Keys);
+    values.swap(m_Values);
+  }
+}
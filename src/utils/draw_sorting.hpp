@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Layout of the 64 bits sort key of a draw, from most to least significant:
+// | pass: 2 | program: 6 | material: 16 | vao: 16 | depth: 24 |
+// Sorting by key groups draws by pass, then by state from the most to the
+// least expensive to change, then front to back inside each state bucket.
+// Blended draws use the layout of makeBlendedDrawSortKey() instead.
+const int kDrawKeyDepthBits = 24;
+const int kDrawKeyVaoBits = 16;
+const int kDrawKeyMaterialBits = 16;
+const int kDrawKeyProgramBits = 6;
+
+// normalizedDepth in [0, 1] is quantized
+inline uint64_t quantizeDrawDepth(float normalizedDepth)
+{
+  const auto maxDepth = (uint32_t(1) << kDrawKeyDepthBits) - 1;
+  normalizedDepth = normalizedDepth < 0.f
+                        ? 0.f
+                        : (normalizedDepth > 1.f ? 1.f : normalizedDepth);
+  return uint64_t(normalizedDepth * maxDepth);
+}
+
+// Key of an opaque or masked draw, see the layout above
+inline uint64_t makeDrawSortKey(uint32_t pass, uint32_t program,
+    uint32_t material, uint32_t vao, float normalizedDepth)
+{
+  auto key = uint64_t(pass);
+  key = (key << kDrawKeyProgramBits) |
+        (program & ((1u << kDrawKeyProgramBits) - 1));
+  key = (key << kDrawKeyMaterialBits) |
+        (material & ((1u << kDrawKeyMaterialBits) - 1));
+  key = (key << kDrawKeyVaoBits) | (vao & ((1u << kDrawKeyVaoBits) - 1));
+  key = (key << kDrawKeyDepthBits) | quantizeDrawDepth(normalizedDepth);
+  return key;
+}
+
+// Key of a blended draw, whose depth comes right after the pass:
+// | pass: 2 | 1 - depth: 24 | program: 6 | material: 16 | vao: 16 |
+// Blending needs all the blended draws back to front, regardless of their
+// state. Only consecutive draws at the same quantized depth are grouped by
+// state.
+inline uint64_t makeBlendedDrawSortKey(uint32_t pass, uint32_t program,
+    uint32_t material, uint32_t vao, float normalizedDepth)
+{
+  auto key = uint64_t(pass);
+  key = (key << kDrawKeyDepthBits) | quantizeDrawDepth(1.f - normalizedDepth);
+  key = (key << kDrawKeyProgramBits) |
+        (program & ((1u << kDrawKeyProgramBits) - 1));
+  key = (key << kDrawKeyMaterialBits) |
+        (material & ((1u << kDrawKeyMaterialBits) - 1));
+  key = (key << kDrawKeyVaoBits) | (vao & ((1u << kDrawKeyVaoBits) - 1));
+  return key;
+}
+
+// LSD radix sort of (key, value) pairs, one byte per pass. Passes where all
+// keys share the same byte are skipped, and the scratch buffers are kept
+// between calls so sorting the draws of each frame doesn't allocate.
+class RadixSorter
+{
+public:
+  // Sort keys in increasing order and apply the same permutation to values.
+  // The sort is stable.
+  void sort(std::vector<uint64_t> &keys, std::vector<uint32_t> &values);
+
+private:
+  std::vector<uint64_t> m_Keys;
+  std::vector<uint32_t> m_Values;
+  std::array<std::array<uint32_t, 256>, 8> m_Counts;
+};
@@ -1,4 +1,21 @@
 #pragma once
 
 #include <filesystem>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
 namespace fs = std::filesystem; // Shorter namespace
+
+// Path next to path to write it aside before renaming it, unique to the
+// process and the calling thread so concurrent writers don't share it
+inline fs::path uniqueTempPath(const fs::path &path)
+{
+  static const auto processTag = std::random_device{}();
+  const auto threadTag =
+      std::hash<std::thread::id>{}(std::this_thread::get_id());
+  auto tmpPath = path;
+  tmpPath += "." + std::to_string(processTag) + "." +
+             std::to_string(threadTag) + ".tmp";
+  return tmpPath;
+}
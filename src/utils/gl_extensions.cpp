@@ -0,0 +1,65 @@
+#include "gl_extensions.hpp"
+#include "glfw.hpp"
+
+namespace {
+template <typename Proc> Proc getProc(const char *name)
+{
+  return reinterpret_cast<Proc>(glfwGetProcAddress(name));
+}
+
+GLExtensions loadGLExtensions()
+{
+  GLExtensions extensions;
+
+  // Core names require a 4.6 context, ARB names the extension
+  if (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 6)) {
+    extensions.multiDrawElementsIndirectCount =
+        getProc<GLExtensions::MultiDrawElementsIndirectCountProc>(
+            "glMultiDrawElementsIndirectCount");
+  } else if (glfwExtensionSupported("GL_ARB_indirect_parameters")) {
+    extensions.multiDrawElementsIndirectCount =
+        getProc<GLExtensions::MultiDrawElementsIndirectCountProc>(
+            "glMultiDrawElementsIndirectCountARB");
+  }
+
+  if (glfwExtensionSupported("GL_ARB_bindless_texture")) {
+    extensions.getTextureHandle =
+        getProc<GLExtensions::GetTextureHandleProc>("glGetTextureHandleARB");
+    extensions.getTextureSamplerHandle =
+        getProc<GLExtensions::GetTextureSamplerHandleProc>(
+            "glGetTextureSamplerHandleARB");
+    extensions.makeTextureHandleResident =
+        getProc<GLExtensions::TextureHandleProc>(
+            "glMakeTextureHandleResidentARB");
+    extensions.makeTextureHandleNonResident =
+        getProc<GLExtensions::TextureHandleProc>(
+            "glMakeTextureHandleNonResidentARB");
+  }
+  extensions.gpuShader5NV = glfwExtensionSupported("GL_NV_gpu_shader5");
+  extensions.shaderBallot = glfwExtensionSupported("GL_ARB_shader_ballot");
+
+  // GL_COMPLETION_STATUS_KHR and _ARB have the same value
+  if (glfwExtensionSupported("GL_KHR_parallel_shader_compile")) {
+    extensions.maxShaderCompilerThreads =
+        getProc<GLExtensions::MaxShaderCompilerThreadsProc>(
+            "glMaxShaderCompilerThreadsKHR");
+  } else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile")) {
+    extensions.maxShaderCompilerThreads =
+        getProc<GLExtensions::MaxShaderCompilerThreadsProc>(
+            "glMaxShaderCompilerThreadsARB");
+  }
+
+  extensions.textureCompressionS3TC =
+      glfwExtensionSupported("GL_EXT_texture_compression_s3tc");
+  extensions.textureSRGBS3TC = extensions.textureCompressionS3TC &&
+                               glfwExtensionSupported("GL_EXT_texture_sRGB");
+
+  return extensions;
+}
+} // namespace
+
+const GLExtensions &glExtensions()
+{
+  static const GLExtensions extensions = loadGLExtensions();
+  return extensions;
+}
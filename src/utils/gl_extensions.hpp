@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Indirect draw count binding point of ARB_indirect_parameters / GL 4.6
+#ifndef GL_PARAMETER_BUFFER
+#define GL_PARAMETER_BUFFER 0x80EE
+#endif
+
+// Program and shader query of KHR_parallel_shader_compile
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// glad only loads core OpenGL 4.4, entry points of later versions and of
+// extensions used by optional renderer paths are loaded here. A null pointer
+// means the context doesn't support the function.
+struct GLExtensions
+{
+  // GL 4.6 or ARB_indirect_parameters
+  typedef void(APIENTRYP MultiDrawElementsIndirectCountProc)(GLenum mode,
+      GLenum type, const void *indirect, GLintptr drawcount,
+      GLsizei maxdrawcount, GLsizei stride);
+  MultiDrawElementsIndirectCountProc multiDrawElementsIndirectCount = nullptr;
+
+  // ARB_bindless_texture, all null if unsupported
+  typedef GLuint64(APIENTRYP GetTextureHandleProc)(GLuint texture);
+  typedef GLuint64(APIENTRYP GetTextureSamplerHandleProc)(
+      GLuint texture, GLuint sampler);
+  typedef void(APIENTRYP TextureHandleProc)(GLuint64 handle);
+  GetTextureHandleProc getTextureHandle = nullptr;
+  GetTextureSamplerHandleProc getTextureSamplerHandle = nullptr;
+  TextureHandleProc makeTextureHandleResident = nullptr;
+  TextureHandleProc makeTextureHandleNonResident = nullptr;
+
+  // Shaders may only sample bindless handles that are dynamically uniform,
+  // unless NV_gpu_shader5 is supported. ARB_shader_ballot makes them uniform
+  // with readFirstInvocationARB().
+  bool gpuShader5NV = false;
+  bool shaderBallot = false;
+
+  // KHR_parallel_shader_compile or ARB_parallel_shader_compile, null if
+  // unsupported. When supported, GL_COMPLETION_STATUS_KHR tells whether a
+  // shader or program is compiled without waiting for it.
+  typedef void(APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+  MaxShaderCompilerThreadsProc maxShaderCompilerThreads = nullptr;
+
+  // EXT_texture_compression_s3tc (BC1 to BC3 textures), with EXT_texture_sRGB
+  // for their sRGB formats. BC7 is core since OpenGL 4.2.
+  bool textureCompressionS3TC = false;
+  bool textureSRGBS3TC = false;
+};
+
+// Loaded on first call, the OpenGL context must be current
+const GLExtensions &glExtensions();
@@ -0,0 +1,224 @@
+#include "gl_state_cache.hpp"
+
+#include <cstring>
+#include <numeric>
+
+size_t GLStateCache::Stats::issuedCount() const
+{
+  return std::accumulate(std::begin(issued), std::end(issued), size_t(0));
+}
+
+size_t GLStateCache::Stats::skippedCount() const
+{
+  return std::accumulate(std::begin(skipped), std::end(skipped), size_t(0));
+}
+
+const char *GLStateCache::stateTypeName(StateType type)
+{
+  static const char *names[kStateTypeCount] = {
+      "program", "vertex array", "texture", "buffer", "uniform", "raster"};
+  return names[type];
+}
+
+void GLStateCache::invalidateBindings()
+{
+  m_Program = kUnknown;
+  m_VertexArray = kUnknown;
+  m_ActiveTextureUnit = kUnknown;
+  m_TextureUnits.clear();
+  m_Buffers.clear();
+  m_IndexedBuffers.clear();
+  m_DepthFunc = kUnknown;
+  m_DepthMask = kUnknown;
+  m_ColorMask = kUnknown;
+  m_Blend = kUnknown;
+}
+
+void GLStateCache::invalidateUniforms(GLuint program)
+{
+  for (auto it = begin(m_Uniforms); it != end(m_Uniforms);) {
+    if (GLuint((*it).first >> 32) == program) {
+      it = m_Uniforms.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void GLStateCache::useProgram(GLuint program)
+{
+  if (changed(kProgramState, program != m_Program)) {
+    glUseProgram(program);
+    m_Program = program;
+  }
+}
+
+void GLStateCache::bindVertexArray(GLuint vao)
+{
+  if (changed(kVertexArrayState, vao != m_VertexArray)) {
+    glBindVertexArray(vao);
+    m_VertexArray = vao;
+  }
+}
+
+void GLStateCache::bindTexture(
+    GLuint unit, GLenum target, GLuint texture, GLuint sampler)
+{
+  if (unit >= m_TextureUnits.size()) {
+    m_TextureUnits.resize(unit + 1);
+  }
+  auto &textureUnit = m_TextureUnits[unit];
+  // Sampler bindings don't need the active unit
+  if (changed(kTextureState, textureUnit.sampler != sampler)) {
+    glBindSampler(unit, sampler);
+    textureUnit.sampler = sampler;
+  }
+  if (!changed(kTextureState,
+          textureUnit.texture != texture || textureUnit.target != target)) {
+    return;
+  }
+  if (m_ActiveTextureUnit != unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    m_ActiveTextureUnit = unit;
+  }
+  glBindTexture(target, texture);
+  textureUnit.target = target;
+  textureUnit.texture = texture;
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+  const auto it = m_Buffers.find(target);
+  if (changed(kBufferState, it == end(m_Buffers) || (*it).second != buffer)) {
+    glBindBuffer(target, buffer);
+    m_Buffers[target] = buffer;
+  }
+}
+
+void GLStateCache::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+  const auto key = (uint64_t(target) << 32) | index;
+  const auto it = m_IndexedBuffers.find(key);
+  if (changed(kBufferState, it == end(m_IndexedBuffers) ||
+                                (*it).second.buffer != buffer ||
+                                (*it).second.size != 0)) {
+    // Also binds the generic binding point
+    glBindBufferBase(target, index, buffer);
+    m_IndexedBuffers[key] = IndexedBuffer{buffer, 0, 0};
+    m_Buffers[target] = buffer;
+  }
+}
+
+void GLStateCache::bindBufferRange(GLenum target, GLuint index, GLuint buffer,
+    GLintptr offset, GLsizeiptr size)
+{
+  const auto key = (uint64_t(target) << 32) | index;
+  const auto it = m_IndexedBuffers.find(key);
+  if (changed(kBufferState, it == end(m_IndexedBuffers) ||
+                                (*it).second.buffer != buffer ||
+                                (*it).second.offset != offset ||
+                                (*it).second.size != size)) {
+    glBindBufferRange(target, index, buffer, offset, size);
+    m_IndexedBuffers[key] = IndexedBuffer{buffer, offset, size};
+    m_Buffers[target] = buffer;
+  }
+}
+
+void GLStateCache::depthFunc(GLenum func)
+{
+  if (changed(kRasterState, func != m_DepthFunc)) {
+    glDepthFunc(func);
+    m_DepthFunc = func;
+  }
+}
+
+void GLStateCache::depthMask(bool write)
+{
+  if (changed(kRasterState, GLuint(write) != m_DepthMask)) {
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+    m_DepthMask = GLuint(write);
+  }
+}
+
+void GLStateCache::colorMask(bool write)
+{
+  if (changed(kRasterState, GLuint(write) != m_ColorMask)) {
+    const auto mask = write ? GL_TRUE : GL_FALSE;
+    glColorMask(mask, mask, mask, mask);
+    m_ColorMask = GLuint(write);
+  }
+}
+
+void GLStateCache::blend(bool enable)
+{
+  if (changed(kRasterState, GLuint(enable) != m_Blend)) {
+    if (enable) {
+      glEnable(GL_BLEND);
+    } else {
+      glDisable(GL_BLEND);
+    }
+    m_Blend = GLuint(enable);
+  }
+}
+
+bool GLStateCache::uniformChanged(
+    GLint location, const void *value, size_t size)
+{
+  const auto key = (uint64_t(m_Program) << 32) | uint32_t(location);
+  auto it = m_Uniforms.find(key);
+  if (it != end(m_Uniforms) &&
+      std::memcmp((*it).second.data(), value, size) == 0) {
+    return changed(kUniformState, false);
+  }
+  if (it == end(m_Uniforms)) {
+    it = m_Uniforms.emplace(key, UniformValue{}).first;
+  }
+  std::memcpy((*it).second.data(), value, size);
+  return changed(kUniformState, true);
+}
+
+void GLStateCache::uniform1i(GLint location, GLint x)
+{
+  if (location >= 0 && uniformChanged(location, &x, sizeof(x))) {
+    glUniform1i(location, x);
+  }
+}
+
+void GLStateCache::uniform1f(GLint location, GLfloat x)
+{
+  if (location >= 0 && uniformChanged(location, &x, sizeof(x))) {
+    glUniform1f(location, x);
+  }
+}
+
+void GLStateCache::uniform2f(GLint location, GLfloat x, GLfloat y)
+{
+  const GLfloat value[] = {x, y};
+  if (location >= 0 && uniformChanged(location, value, sizeof(value))) {
+    glUniform2f(location, x, y);
+  }
+}
+
+void GLStateCache::uniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z)
+{
+  const GLfloat value[] = {x, y, z};
+  if (location >= 0 && uniformChanged(location, value, sizeof(value))) {
+    glUniform3f(location, x, y, z);
+  }
+}
+
+void GLStateCache::uniform4f(
+    GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w)
+{
+  const GLfloat value[] = {x, y, z, w};
+  if (location >= 0 && uniformChanged(location, value, sizeof(value))) {
+    glUniform4f(location, x, y, z, w);
+  }
+}
+
+void GLStateCache::uniformMatrix4fv(GLint location, const GLfloat *value)
+{
+  if (location >= 0 && uniformChanged(location, value, 16 * sizeof(GLfloat))) {
+    glUniformMatrix4fv(location, 1, GL_FALSE, value);
+  }
+}
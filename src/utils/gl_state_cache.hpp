@@ -0,0 +1,128 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Shadow copy of the GL state the renderer changes the most often. Calls
+// setting a state to its current value are skipped, so the draw loop can
+// bind what each draw needs without checking what the previous draw used.
+// All state changes of the renderer must go through the cache, or
+// invalidateBindings() must be called after external code changed bindings.
+class GLStateCache
+{
+public:
+  enum StateType
+  {
+    kProgramState = 0,
+    kVertexArrayState,
+    kTextureState,
+    kBufferState,
+    kUniformState,
+    kRasterState,
+    kStateTypeCount
+  };
+
+  struct Stats
+  {
+    size_t issued[kStateTypeCount] = {};
+    size_t skipped[kStateTypeCount] = {};
+
+    size_t issuedCount() const;
+    size_t skippedCount() const;
+  };
+
+  static const char *stateTypeName(StateType type);
+
+  // Forget all bindings and raster states, the next change of each state is
+  // always issued. Uniform values are kept since they belong to programs.
+  void invalidateBindings();
+
+  // Forget the uniform values of a program (relinked or deleted)
+  void invalidateUniforms(GLuint program);
+
+  // Statistics since the last call to resetStats()
+  const Stats &stats() const { return m_Stats; }
+  void resetStats() { m_Stats = Stats{}; }
+
+  void useProgram(GLuint program);
+
+  void bindVertexArray(GLuint vao);
+
+  // The sampler object bound to the unit overrides the filters and wrap modes
+  // of the texture, 0 samples with the parameters of the texture
+  void bindTexture(
+      GLuint unit, GLenum target, GLuint texture, GLuint sampler = 0);
+
+  // Non indexed binding points (GL_ARRAY_BUFFER, GL_DRAW_INDIRECT_BUFFER...)
+  void bindBuffer(GLenum target, GLuint buffer);
+
+  // Indexed binding points of GL_UNIFORM_BUFFER and GL_SHADER_STORAGE_BUFFER
+  void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+  void bindBufferRange(GLenum target, GLuint index, GLuint buffer,
+      GLintptr offset, GLsizeiptr size);
+
+  // Depth test function and write masks, the color mask applies to all
+  // channels of all draw buffers
+  void depthFunc(GLenum func);
+  void depthMask(bool write);
+  void colorMask(bool write);
+
+  // GL_BLEND, with the blend function set by the caller
+  void blend(bool enable);
+
+  // Uniforms of the program bound with useProgram(), ignored for location -1
+  void uniform1i(GLint location, GLint x);
+  void uniform1f(GLint location, GLfloat x);
+  void uniform2f(GLint location, GLfloat x, GLfloat y);
+  void uniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z);
+  void uniform4f(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w);
+  void uniformMatrix4fv(GLint location, const GLfloat *value);
+
+private:
+  // Same comparison for all uniform types: the raw bytes of the value
+  bool uniformChanged(GLint location, const void *value, size_t size);
+
+  bool changed(StateType type, bool isDifferent)
+  {
+    ++(isDifferent ? m_Stats.issued : m_Stats.skipped)[type];
+    return isDifferent;
+  }
+
+  // 0 is a valid binding, so unknown bindings use a name GL never returns
+  static const GLuint kUnknown = ~GLuint(0);
+
+  struct TextureUnit
+  {
+    GLenum target = GL_NONE;
+    GLuint texture = kUnknown;
+    GLuint sampler = kUnknown;
+  };
+
+  GLuint m_Program = kUnknown;
+  GLuint m_VertexArray = kUnknown;
+  GLuint m_ActiveTextureUnit = kUnknown;
+  std::vector<TextureUnit> m_TextureUnits;
+  std::unordered_map<GLenum, GLuint> m_Buffers;
+  struct IndexedBuffer
+  {
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size; // 0 for the whole buffer
+  };
+  std::unordered_map<uint64_t, IndexedBuffer> m_IndexedBuffers;
+  GLenum m_DepthFunc = kUnknown;
+  GLuint m_DepthMask = kUnknown;
+  GLuint m_ColorMask = kUnknown;
+  GLuint m_Blend = kUnknown;
+
+  // Values are stored as 16 floats, enough for a mat4
+  using UniformValue = std::array<uint32_t, 16>;
+  std::unordered_map<uint64_t, UniformValue> m_Uniforms;
+
+  Stats m_Stats;
+};
@@ -3,7 +3,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <numeric>
 
 glm::mat4 getLocalToWorldMatrix(
     const tinygltf::Node &node, const glm::mat4 &parentMatrix)
@@ -49,7 +52,30 @@ void computeSceneBounds(
           const auto &node = model.nodes[nodeIdx];
           const glm::mat4 modelMatrix =
               getLocalToWorldMatrix(node, parentMatrix);
-          if (node.mesh >= 0) {
+          const auto instances = readMeshInstances(model, node);
+          if (node.mesh >= 0 && !instances.empty()) {
+            // Transformed primitive boxes, iterating on the vertices of each
+            // instance would be too slow for large instance counts
+            for (const auto &primitive : model.meshes[node.mesh].primitives) {
+              glm::vec3 localMin, localMax;
+              if (!getPrimitiveBounds(model, primitive, localMin, localMax)) {
+                continue;
+              }
+              for (const auto &instanceMatrix : instances) {
+                const auto matrix = modelMatrix * instanceMatrix;
+                for (int corner = 0; corner < 8; ++corner) {
+                  const auto localPosition =
+                      glm::vec3((corner & 1) ? localMax.x : localMin.x,
+                          (corner & 2) ? localMax.y : localMin.y,
+                          (corner & 4) ? localMax.z : localMin.z);
+                  const auto worldPosition =
+                      glm::vec3(matrix * glm::vec4(localPosition, 1.f));
+                  bboxMin = glm::min(bboxMin, worldPosition);
+                  bboxMax = glm::max(bboxMax, worldPosition);
+                }
+              }
+            }
+          } else if (node.mesh >= 0) {
             const auto &mesh = model.meshes[node.mesh];
             for (size_t pIdx = 0; pIdx < mesh.primitives.size(); ++pIdx) {
               const auto &primitive = mesh.primitives[pIdx];
@@ -150,4 +176,266 @@ void computeSceneBounds(
       updateBounds(nodeIdx, glm::mat4(1));
     }
   }
-}
\ No newline at end of file
+}
+static float readComponent(
+    const unsigned char *ptr, int componentType, bool normalized)
+{
+  switch (componentType) {
+  case TINYGLTF_COMPONENT_TYPE_FLOAT:
+    return *((const float *)ptr);
+  case TINYGLTF_COMPONENT_TYPE_BYTE: {
+    const auto value = float(*((const int8_t *)ptr));
+    return normalized ? glm::max(value / 127.f, -1.f) : value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+    const auto value = float(*((const uint8_t *)ptr));
+    return normalized ? value / 255.f : value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_SHORT: {
+    const auto value = float(*((const int16_t *)ptr));
+    return normalized ? glm::max(value / 32767.f, -1.f) : value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+    const auto value = float(*((const uint16_t *)ptr));
+    return normalized ? value / 65535.f : value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    return float(*((const uint32_t *)ptr));
+  }
+  return 0.f;
+}
+
+// True if the buffer view of an accessor exists and holds all its elements
+static bool isAccessorInBuffer(
+    const tinygltf::Model &model, const tinygltf::Accessor &accessor)
+{
+  if (accessor.bufferView < 0 ||
+      size_t(accessor.bufferView) >= model.bufferViews.size()) {
+    return false;
+  }
+  const auto &bufferView = model.bufferViews[accessor.bufferView];
+  if (bufferView.buffer < 0 ||
+      size_t(bufferView.buffer) >= model.buffers.size()) {
+    return false;
+  }
+  const auto byteStride = accessor.ByteStride(bufferView);
+  const auto componentSize =
+      tinygltf::GetComponentSizeInBytes(accessor.componentType);
+  const auto componentCount = tinygltf::GetNumComponentsInType(accessor.type);
+  if (byteStride <= 0 || componentSize <= 0 || componentCount <= 0) {
+    return false;
+  }
+  if (accessor.count == 0) {
+    return true;
+  }
+  const auto end = accessor.byteOffset + bufferView.byteOffset +
+                   size_t(byteStride) * (accessor.count - 1) +
+                   size_t(componentSize * componentCount);
+  return end <= model.buffers[bufferView.buffer].data.size();
+}
+
+// Read the first numComponents components of each element of an accessor.
+// Accessors without buffer view are zero-filled, sparse accessors are not
+// supported.
+static std::vector<float> readAccessorComponents(
+    const tinygltf::Model &model, int accessorIdx, int numComponents)
+{
+  std::vector<float> values;
+  if (accessorIdx < 0) {
+    return values;
+  }
+  const auto &accessor = model.accessors[accessorIdx];
+  if (tinygltf::GetNumComponentsInType(accessor.type) < numComponents) {
+    return values;
+  }
+  if (accessor.bufferView < 0) {
+    values.resize(accessor.count * numComponents, 0.f);
+    return values;
+  }
+  if (!isAccessorInBuffer(model, accessor)) {
+    std::cerr << "Accessor " << accessorIdx
+              << " is out of its buffer, skipping it." << std::endl;
+    return values;
+  }
+  const auto &bufferView = model.bufferViews[accessor.bufferView];
+  const auto &buffer = model.buffers[bufferView.buffer];
+  const auto byteOffset = accessor.byteOffset + bufferView.byteOffset;
+  const auto byteStride = accessor.ByteStride(bufferView);
+  const auto componentSize =
+      tinygltf::GetComponentSizeInBytes(accessor.componentType);
+
+  values.resize(accessor.count * numComponents);
+  for (size_t i = 0; i < accessor.count; ++i) {
+    const auto *element = &buffer.data[byteOffset + byteStride * i];
+    for (int c = 0; c < numComponents; ++c) {
+      values[i * numComponents + c] = readComponent(element + c * componentSize,
+          accessor.componentType, accessor.normalized);
+    }
+  }
+  return values;
+}
+
+std::vector<glm::vec3> readVec3Accessor(
+    const tinygltf::Model &model, int accessorIdx)
+{
+  std::vector<glm::vec3> result;
+  if (accessorIdx < 0 ||
+      model.accessors[accessorIdx].type != TINYGLTF_TYPE_VEC3) {
+    return result;
+  }
+  const auto values = readAccessorComponents(model, accessorIdx, 3);
+  result.resize(values.size() / 3);
+  std::memcpy(result.data(), values.data(), values.size() * sizeof(float));
+  return result;
+}
+
+std::vector<glm::vec2> readVec2Accessor(
+    const tinygltf::Model &model, int accessorIdx)
+{
+  std::vector<glm::vec2> result;
+  if (accessorIdx < 0 ||
+      model.accessors[accessorIdx].type != TINYGLTF_TYPE_VEC2) {
+    return result;
+  }
+  const auto values = readAccessorComponents(model, accessorIdx, 2);
+  result.resize(values.size() / 2);
+  std::memcpy(result.data(), values.data(), values.size() * sizeof(float));
+  return result;
+}
+
+std::vector<glm::vec4> readVec4Accessor(
+    const tinygltf::Model &model, int accessorIdx)
+{
+  std::vector<glm::vec4> result;
+  if (accessorIdx < 0 ||
+      model.accessors[accessorIdx].type != TINYGLTF_TYPE_VEC4) {
+    return result;
+  }
+  const auto values = readAccessorComponents(model, accessorIdx, 4);
+  result.resize(values.size() / 4);
+  std::memcpy(result.data(), values.data(), values.size() * sizeof(float));
+  return result;
+}
+
+std::vector<glm::mat4> readMeshInstances(
+    const tinygltf::Model &model, const tinygltf::Node &node)
+{
+  std::vector<glm::mat4> instances;
+  const auto extensionIt = node.extensions.find("EXT_mesh_gpu_instancing");
+  if (extensionIt == end(node.extensions) ||
+      !(*extensionIt).second.Has("attributes")) {
+    return instances;
+  }
+  const auto &attributes = (*extensionIt).second.Get("attributes");
+  const auto accessorIndex = [&](const char *name) {
+    const auto index =
+        attributes.Has(name) ? attributes.Get(name).GetNumberAsInt() : -1;
+    return index >= 0 && size_t(index) < model.accessors.size() ? int(index)
+                                                                : -1;
+  };
+
+  // All attributes have the same count, missing ones use their default value
+  const auto translations = readVec3Accessor(model, accessorIndex("TRANSLATION"));
+  const auto rotations = readVec4Accessor(model, accessorIndex("ROTATION"));
+  const auto scales = readVec3Accessor(model, accessorIndex("SCALE"));
+  const auto count =
+      std::max(translations.size(), std::max(rotations.size(), scales.size()));
+  instances.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    const auto translation =
+        i < translations.size() ? translations[i] : glm::vec3(0);
+    const auto rotation = i < rotations.size()
+                              ? glm::quat(rotations[i].w, rotations[i].x,
+                                    rotations[i].y, rotations[i].z)
+                              : glm::quat(1, 0, 0, 0);
+    const auto scale = i < scales.size() ? scales[i] : glm::vec3(1);
+    instances.emplace_back(glm::scale(
+        glm::translate(glm::mat4(1), translation) * glm::mat4_cast(rotation),
+        scale));
+  }
+  return instances;
+}
+
+std::vector<uint32_t> readPrimitiveIndices(
+    const tinygltf::Model &model, const tinygltf::Primitive &primitive)
+{
+  std::vector<uint32_t> indices;
+  if (primitive.indices < 0) {
+    const auto positionAttrIdxIt = primitive.attributes.find("POSITION");
+    if (positionAttrIdxIt == end(primitive.attributes)) {
+      return indices;
+    }
+    indices.resize(model.accessors[(*positionAttrIdxIt).second].count);
+    std::iota(begin(indices), end(indices), 0);
+    return indices;
+  }
+
+  if (size_t(primitive.indices) >= model.accessors.size()) {
+    std::cerr << "Primitive index accessor " << primitive.indices
+              << " doesn't exist, skipping it." << std::endl;
+    return indices;
+  }
+  const auto &accessor = model.accessors[primitive.indices];
+  // Zero-filled, sparse accessors are not supported
+  if (accessor.bufferView < 0) {
+    indices.resize(accessor.count, 0);
+    return indices;
+  }
+  if (!isAccessorInBuffer(model, accessor)) {
+    std::cerr << "Primitive index accessor with bad componentType "
+              << accessor.componentType
+              << " or out of its buffer, skipping it." << std::endl;
+    return indices;
+  }
+  const auto &bufferView = model.bufferViews[accessor.bufferView];
+  const auto &buffer = model.buffers[bufferView.buffer];
+  const auto byteOffset = accessor.byteOffset + bufferView.byteOffset;
+  const auto byteStride = accessor.ByteStride(bufferView);
+
+  indices.resize(accessor.count);
+  for (size_t i = 0; i < accessor.count; ++i) {
+    const auto *element = &buffer.data[byteOffset + byteStride * i];
+    switch (accessor.componentType) {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      indices[i] = *((const uint8_t *)element);
+      break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+      indices[i] = *((const uint16_t *)element);
+      break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+      indices[i] = *((const uint32_t *)element);
+      break;
+    }
+  }
+  return indices;
+}
+
+bool getPrimitiveBounds(const tinygltf::Model &model,
+    const tinygltf::Primitive &primitive, glm::vec3 &bboxMin,
+    glm::vec3 &bboxMax)
+{
+  const auto positionAttrIdxIt = primitive.attributes.find("POSITION");
+  if (positionAttrIdxIt == end(primitive.attributes)) {
+    return false;
+  }
+  const auto &accessor = model.accessors[(*positionAttrIdxIt).second];
+  if (accessor.minValues.size() == 3 && accessor.maxValues.size() == 3) {
+    bboxMin = glm::vec3(
+        accessor.minValues[0], accessor.minValues[1], accessor.minValues[2]);
+    bboxMax = glm::vec3(
+        accessor.maxValues[0], accessor.maxValues[1], accessor.maxValues[2]);
+    return true;
+  }
+
+  const auto positions = readVec3Accessor(model, (*positionAttrIdxIt).second);
+  if (positions.empty()) {
+    return false;
+  }
+  bboxMin = glm::vec3(std::numeric_limits<float>::max());
+  bboxMax = glm::vec3(std::numeric_limits<float>::lowest());
+  for (const auto &position : positions) {
+    bboxMin = glm::min(bboxMin, position);
+    bboxMax = glm::max(bboxMax, position);
+  }
+  return true;
+}
@@ -7,4 +7,38 @@ glm::mat4 getLocalToWorldMatrix(
     const tinygltf::Node &node, const glm::mat4 &parentMatrix);
 
 void computeSceneBounds(
-    const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax);
\ No newline at end of file
+    const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax);
+
+// Read the elements of a VEC3 accessor (POSITION, NORMAL, ...) as floats.
+// Return an empty vector if the accessor is not a VEC3 accessor or is out of
+// its buffer. Accessors without buffer view are zero-filled.
+std::vector<glm::vec3> readVec3Accessor(
+    const tinygltf::Model &model, int accessorIdx);
+
+// Same as readVec3Accessor() for VEC2 accessors (TEXCOORD_n), normalized
+// integer components are converted to [0, 1] or [-1, 1]
+std::vector<glm::vec2> readVec2Accessor(
+    const tinygltf::Model &model, int accessorIdx);
+
+// Same as readVec3Accessor() for VEC4 accessors (TANGENT, COLOR_n, ...)
+std::vector<glm::vec4> readVec4Accessor(
+    const tinygltf::Model &model, int accessorIdx);
+
+// Transforms of the instances of a node, relative to the node, from the
+// TRANSLATION, ROTATION and SCALE accessors of its EXT_mesh_gpu_instancing
+// extension. Return an empty vector if the node doesn't use the extension.
+std::vector<glm::mat4> readMeshInstances(
+    const tinygltf::Model &model, const tinygltf::Node &node);
+
+// Read the vertex indices of a primitive. For non-indexed primitives, the
+// indices 0..count-1 are generated from the POSITION accessor. Return an empty
+// vector if the index accessor is invalid or out of its buffer.
+std::vector<uint32_t> readPrimitiveIndices(
+    const tinygltf::Model &model, const tinygltf::Primitive &primitive);
+
+// Local space bounds of a primitive, from the min/max of its POSITION accessor
+// or from its vertices if the accessor has no bounds. Return false if the
+// primitive has no POSITION attribute.
+bool getPrimitiveBounds(const tinygltf::Model &model,
+    const tinygltf::Primitive &primitive, glm::vec3 &bboxMin,
+    glm::vec3 &bboxMax);
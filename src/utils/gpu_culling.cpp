@@ -0,0 +1,264 @@
+#include "gpu_culling.hpp"
+#include "gl_extensions.hpp"
+#include "gl_state_cache.hpp"
+#include "hiz_pyramid.hpp"
+#include "indirect_draws.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+
+// Must match local_size_x of cull_draws.cs.glsl
+static const GLuint kCullingGroupSize = 64;
+
+static const GLuint kCullingBucketOffsetBufferBinding = 7;
+static const GLuint kCullingVisibilityBufferBinding = 8;
+static const GLuint kCullingStatsBufferBinding = 9;
+
+// Counters of the Stats block of cull_draws.cs.glsl
+enum CullingCounter
+{
+  kFirstPhaseDrawCounter = 0,
+  kSecondPhaseDrawCounter,
+  kOccludedDrawCounter,
+  kOccludedTriangleCounter,
+  kCullingCounterCount
+};
+
+namespace {
+// Immutable storage, glBufferStorage doesn't accept a size of 0
+GLuint createBuffer(size_t size, const void *data, GLbitfield flags)
+{
+  GLuint buffer = 0;
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glBufferStorage(GL_COPY_WRITE_BUFFER, std::max<size_t>(size, 4),
+      size ? data : nullptr, flags);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  return buffer;
+}
+
+// Fill a buffer with zeros, glClearBufferSubData works on immutable storage
+// without GL_DYNAMIC_STORAGE_BIT
+void clearBuffer(GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glClearBufferSubData(GL_COPY_WRITE_BUFFER, GL_R32UI, offset, size,
+      GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+} // namespace
+
+GpuCuller::GpuCuller(GLProgram program,
+    const std::vector<GpuCullingDraw> &draws,
+    const std::vector<uint32_t> &bucketSizes) :
+    m_Program(std::move(program)),
+    m_DrawCount(draws.size()),
+    m_BucketSizes(bucketSizes),
+    m_HasDrawCount(glExtensions().multiDrawElementsIndirectCount != nullptr)
+{
+  const auto location = [&](const char *name) {
+    return glGetUniformLocation(m_Program.glId(), name);
+  };
+  m_FrustumPlanesLocation = location("uFrustumPlanes");
+  m_DrawCountLocation = location("uDrawCount");
+  m_UseFrustumLocation = location("uUseFrustum");
+  m_PhaseLocation = location("uPhase");
+  m_ViewProjMatrixLocation = location("uViewProjMatrix");
+  m_HiZLocation = location("uHiZ");
+
+  m_BucketOffsets.resize(bucketSizes.size());
+  std::exclusive_scan(begin(bucketSizes), end(bucketSizes),
+      begin(m_BucketOffsets), uint32_t(0));
+
+  m_Boxes.resize(2 * m_DrawCount);
+  m_BoxBuffer = createBuffer(
+      m_Boxes.size() * sizeof(glm::vec4), nullptr, GL_DYNAMIC_STORAGE_BIT);
+  m_DrawBuffer =
+      createBuffer(draws.size() * sizeof(GpuCullingDraw), draws.data(), 0);
+  m_BucketOffsetBuffer = createBuffer(m_BucketOffsets.size() * sizeof(uint32_t),
+      m_BucketOffsets.data(), 0);
+  // One half per occlusion culling phase
+  m_CommandBuffer = createBuffer(
+      2 * m_DrawCount * sizeof(DrawElementsIndirectCommand), nullptr, 0);
+  m_DrawCountBuffer =
+      createBuffer(2 * bucketSizes.size() * sizeof(uint32_t), nullptr, 0);
+  m_InstanceBuffer =
+      createBuffer(2 * m_DrawCount * sizeof(uint32_t), nullptr, 0);
+  m_VisibilityBuffer = createBuffer(m_DrawCount * sizeof(uint32_t), nullptr, 0);
+  clearBuffer(m_VisibilityBuffer, 0, m_DrawCount * sizeof(uint32_t));
+  m_StatsBuffer =
+      createBuffer(kCullingCounterCount * sizeof(uint32_t), nullptr, 0);
+  clearBuffer(m_StatsBuffer, 0, kCullingCounterCount * sizeof(uint32_t));
+
+  const auto readbackFlags =
+      GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  const auto readbackSize =
+      kStatsReadbackCount * kCullingCounterCount * sizeof(uint32_t);
+  m_StatsReadbackBuffer = createBuffer(readbackSize, nullptr, readbackFlags);
+  glBindBuffer(GL_COPY_READ_BUFFER, m_StatsReadbackBuffer);
+  m_StatsReadback = static_cast<const uint32_t *>(glMapBufferRange(
+      GL_COPY_READ_BUFFER, 0, readbackSize, readbackFlags));
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+GpuCuller::~GpuCuller()
+{
+  for (const auto fence : m_StatsFences) {
+    glDeleteSync(fence);
+  }
+  // Deleting the readback buffer unmaps it
+  const GLuint buffers[] = {m_BoxBuffer, m_DrawBuffer, m_BucketOffsetBuffer,
+      m_CommandBuffer, m_DrawCountBuffer, m_InstanceBuffer, m_VisibilityBuffer,
+      m_StatsBuffer, m_StatsReadbackBuffer};
+  glDeleteBuffers(GLsizei(std::size(buffers)), buffers);
+}
+
+void GpuCuller::setBoxes(const BoxSet &boxes)
+{
+  for (size_t i = 0; i < m_DrawCount; ++i) {
+    m_Boxes[2 * i] = glm::vec4(boxes.center(i), 0.f);
+    m_Boxes[2 * i + 1] = glm::vec4(boxes.extent(i), 0.f);
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_BoxBuffer);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, 0, m_Boxes.size() * sizeof(glm::vec4),
+      m_Boxes.data());
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GpuCuller::beginFrame()
+{
+  // Copies complete in order, the last signaled one has the latest counters
+  while (m_StatsReadbackPendingCount > 0) {
+    auto &fence = m_StatsFences[m_StatsReadbackFirst];
+    const auto status = glClientWaitSync(fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+    const auto counters =
+        m_StatsReadback + m_StatsReadbackFirst * kCullingCounterCount;
+    m_Stats.firstPhaseDrawCount = counters[kFirstPhaseDrawCounter];
+    m_Stats.drawCount =
+        counters[kFirstPhaseDrawCounter] + counters[kSecondPhaseDrawCounter];
+    m_Stats.occludedDrawCount = counters[kOccludedDrawCounter];
+    m_Stats.occludedTriangleCount = counters[kOccludedTriangleCounter];
+    m_StatsReadbackFirst = (m_StatsReadbackFirst + 1) % kStatsReadbackCount;
+    --m_StatsReadbackPendingCount;
+  }
+
+  if (m_HasCulled) {
+    const auto countersSize = kCullingCounterCount * sizeof(uint32_t);
+    // Atomic counters written by the culling shader, read by the copy
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    if (m_StatsReadbackPendingCount < kStatsReadbackCount) {
+      const auto slot = (m_StatsReadbackFirst + m_StatsReadbackPendingCount) %
+                        kStatsReadbackCount;
+      glBindBuffer(GL_COPY_READ_BUFFER, m_StatsBuffer);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, m_StatsReadbackBuffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+          slot * countersSize, countersSize);
+      glBindBuffer(GL_COPY_READ_BUFFER, 0);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      m_StatsFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      ++m_StatsReadbackPendingCount;
+    }
+    clearBuffer(m_StatsBuffer, 0, countersSize);
+  }
+  m_HasCulled = false;
+}
+
+void GpuCuller::cull(
+    GLStateCache &glState, const Frustum &frustum, bool useFrustum)
+{
+  dispatch(glState, kFrustumPhase, frustum, useFrustum);
+}
+
+void GpuCuller::cullFirstPhase(GLStateCache &glState, const Frustum &frustum)
+{
+  dispatch(glState, kOcclusionFirstPhase, frustum, true);
+}
+
+void GpuCuller::cullSecondPhase(GLStateCache &glState, const Frustum &frustum,
+    const glm::mat4 &viewProjMatrix, const HiZPyramid &hiZPyramid)
+{
+  glState.useProgram(m_Program.glId());
+  glState.uniformMatrix4fv(
+      m_ViewProjMatrixLocation, glm::value_ptr(viewProjMatrix));
+  glState.uniform1i(m_HiZLocation, GLint(kHiZTextureUnit));
+  glState.bindTexture(kHiZTextureUnit, GL_TEXTURE_2D, hiZPyramid.texture());
+  dispatch(glState, kOcclusionSecondPhase, frustum, true);
+}
+
+void GpuCuller::dispatch(GLStateCache &glState, Phase phase,
+    const Frustum &frustum, bool useFrustum)
+{
+  m_LastPhase = phase;
+  m_HasCulled = true;
+  if (m_DrawCount == 0) {
+    return;
+  }
+
+  // The second phase writes the second half of the buffers
+  const auto half = phase == kOcclusionSecondPhase ? 1 : 0;
+  const auto countsSize = m_BucketOffsets.size() * sizeof(uint32_t);
+  clearBuffer(m_DrawCountBuffer, half * countsSize, countsSize);
+  if (!m_HasDrawCount) {
+    const auto commandsSize = m_DrawCount * sizeof(DrawElementsIndirectCommand);
+    clearBuffer(m_CommandBuffer, half * commandsSize, commandsSize);
+  }
+
+  glState.useProgram(m_Program.glId());
+  if (m_FrustumPlanesLocation >= 0) {
+    // Elements of a uniform array of basic type have consecutive locations
+    for (int i = 0; i < 6; ++i) {
+      const auto &plane = frustum.planes[i];
+      glState.uniform4f(
+          m_FrustumPlanesLocation + i, plane.x, plane.y, plane.z, plane.w);
+    }
+  }
+  glState.uniform1i(m_DrawCountLocation, GLint(m_DrawCount));
+  glState.uniform1i(m_UseFrustumLocation, useFrustum);
+  glState.uniform1i(m_PhaseLocation, phase);
+
+  glState.bindBufferBase(
+      GL_SHADER_STORAGE_BUFFER, kCullingBoxBufferBinding, m_BoxBuffer);
+  glState.bindBufferBase(
+      GL_SHADER_STORAGE_BUFFER, kCullingDrawBufferBinding, m_DrawBuffer);
+  glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER,
+      kCullingBucketOffsetBufferBinding, m_BucketOffsetBuffer);
+  glState.bindBufferBase(
+      GL_SHADER_STORAGE_BUFFER, kCullingCommandBufferBinding, m_CommandBuffer);
+  glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER,
+      kCullingDrawCountBufferBinding, m_DrawCountBuffer);
+  glState.bindBufferBase(
+      GL_SHADER_STORAGE_BUFFER, kInstanceBufferBinding, m_InstanceBuffer);
+  glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER,
+      kCullingVisibilityBufferBinding, m_VisibilityBuffer);
+  glState.bindBufferBase(
+      GL_SHADER_STORAGE_BUFFER, kCullingStatsBufferBinding, m_StatsBuffer);
+
+  glDispatchCompute(
+      GLuint((m_DrawCount + kCullingGroupSize - 1) / kCullingGroupSize), 1, 1);
+
+  // Commands and counts are read by indirect draws, instances by the vertex
+  // shader and visibility by the next phase
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+GLintptr GpuCuller::commandOffset(size_t bucket, Phase phase) const
+{
+  const size_t half = phase == kOcclusionSecondPhase ? m_DrawCount : 0;
+  return GLintptr((half + m_BucketOffsets[bucket]) *
+                  sizeof(DrawElementsIndirectCommand));
+}
+
+GLintptr GpuCuller::drawCountOffset(size_t bucket, Phase phase) const
+{
+  const auto half =
+      phase == kOcclusionSecondPhase ? m_BucketOffsets.size() : 0;
+  return GLintptr((half + bucket) * sizeof(uint32_t));
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "culling.hpp"
+#include "shaders.hpp"
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <vector>
+
+class GLStateCache;
+class HiZPyramid;
+
+// Shader storage bindings of cull_draws.cs.glsl. The instance buffer it
+// writes uses kInstanceBufferBinding, shared with the indirect vertex shader.
+const GLuint kCullingBoxBufferBinding = 3;
+const GLuint kCullingDrawBufferBinding = 4;
+const GLuint kCullingCommandBufferBinding = 5;
+const GLuint kCullingDrawCountBufferBinding = 6;
+
+// Static part of the indirect command of a draw packet and the bucket its
+// visible instances are written to, std430 layout of CullingDraw
+struct GpuCullingDraw
+{
+  GLuint count;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint bucket;
+};
+
+// Culling of draw packets in a compute shader. Each bucket owns a fixed range
+// of the command buffer, sized for all its draws, and a draw counter: visible
+// draws are appended to the range of their bucket with an atomic increment of
+// its counter. A bucket is then submitted with
+// glMultiDrawElementsIndirectCount, or without the extension with
+// glMultiDrawElementsIndirect on its whole range, unused commands being
+// cleared to zero (empty draws).
+// Instance i of the commands is packet instanceDraws[i], where instanceDraws
+// is the instance buffer, so the commands read the same per-draw data as the
+// CPU path.
+//
+// Occlusion culling runs in two phases per frame, each followed by the draws
+// of its commands:
+// - the first phase writes the draws in the frustum that were visible last
+//   frame,
+// - the HiZ pyramid is then built from the depth of these draws and the
+//   second phase tests all the draws in the frustum against it: it writes the
+//   visible ones not drawn by the first phase and records which draws are
+//   visible for the next frame.
+// The two phases use separate halves of the command, count and instance
+// buffers, so the second phase never overwrites commands in use.
+class GpuCuller
+{
+public:
+  enum Phase
+  {
+    kFrustumPhase = 0, // Frustum culling alone
+    kOcclusionFirstPhase,
+    kOcclusionSecondPhase
+  };
+
+  // Counters of the last frame the GPU has finished culling, usually one or
+  // two frames late, read back by beginFrame()
+  struct Stats
+  {
+    size_t drawCount = 0; // Written by all phases
+    size_t firstPhaseDrawCount = 0;
+    size_t occludedDrawCount = 0;
+    size_t occludedTriangleCount = 0; // Index count / 3 of occluded draws
+  };
+
+  // program is cull_draws.cs.glsl, draws[i] describes packet i and
+  // bucketSizes[b] is the number of draws in bucket b
+  GpuCuller(GLProgram program, const std::vector<GpuCullingDraw> &draws,
+      const std::vector<uint32_t> &bucketSizes);
+
+  ~GpuCuller();
+
+  GpuCuller(const GpuCuller &) = delete;
+  GpuCuller &operator=(const GpuCuller &) = delete;
+
+  // Upload the world boxes of the draws, to call when they change
+  void setBoxes(const BoxSet &boxes);
+
+  // Queue the copy of the counters of the previous frame and reset them, to
+  // call once per frame before the first cull. The copies go to a ring of
+  // persistently mapped buffers, each guarded by a fence: the stats are
+  // updated from the copies whose fence is signaled, without waiting for the
+  // others. A frame is dropped if the ring is full.
+  void beginFrame();
+
+  // Write the visible draws of each bucket and their count. If useFrustum is
+  // false, all draws are written. Dispatch and barrier only, the commands are
+  // consumed by the next draws.
+  void cull(GLStateCache &glState, const Frustum &frustum, bool useFrustum);
+
+  // Occlusion culling phases, see above. viewProjMatrix is the matrix the
+  // depth of the pyramid was rendered with.
+  void cullFirstPhase(GLStateCache &glState, const Frustum &frustum);
+  void cullSecondPhase(GLStateCache &glState, const Frustum &frustum,
+      const glm::mat4 &viewProjMatrix, const HiZPyramid &hiZPyramid);
+
+  // True if buckets are drawn with glMultiDrawElementsIndirectCount
+  bool hasDrawCount() const { return m_HasDrawCount; }
+
+  GLuint commandBuffer() const { return m_CommandBuffer; }
+  GLuint drawCountBuffer() const { return m_DrawCountBuffer; }
+  GLuint instanceBuffer() const { return m_InstanceBuffer; }
+
+  size_t bucketCount() const { return m_BucketOffsets.size(); }
+
+  // Byte offsets of the first command and of the draw count of a bucket,
+  // in the half of the buffers written by a phase, by default the last one.
+  // The commands of the first phase stay valid after the second phase.
+  GLintptr commandOffset(size_t bucket, Phase phase) const;
+  GLintptr drawCountOffset(size_t bucket, Phase phase) const;
+  GLintptr commandOffset(size_t bucket) const
+  {
+    return commandOffset(bucket, m_LastPhase);
+  }
+  GLintptr drawCountOffset(size_t bucket) const
+  {
+    return drawCountOffset(bucket, m_LastPhase);
+  }
+  GLsizei maxDrawCount(size_t bucket) const { return m_BucketSizes[bucket]; }
+
+  const Stats &stats() const { return m_Stats; }
+
+private:
+  void dispatch(GLStateCache &glState, Phase phase, const Frustum &frustum,
+      bool useFrustum);
+
+  GLProgram m_Program;
+  GLint m_FrustumPlanesLocation = -1;
+  GLint m_DrawCountLocation = -1;
+  GLint m_UseFrustumLocation = -1;
+  GLint m_PhaseLocation = -1;
+  GLint m_ViewProjMatrixLocation = -1;
+  GLint m_HiZLocation = -1;
+
+  size_t m_DrawCount = 0;
+  std::vector<uint32_t> m_BucketOffsets;
+  std::vector<uint32_t> m_BucketSizes;
+  bool m_HasDrawCount = false;
+  Phase m_LastPhase = kFrustumPhase;
+  bool m_HasCulled = false;
+  Stats m_Stats;
+
+  std::vector<glm::vec4> m_Boxes; // center, extent
+  GLuint m_BoxBuffer = 0;
+  GLuint m_DrawBuffer = 0;
+  GLuint m_BucketOffsetBuffer = 0;
+  GLuint m_CommandBuffer = 0;
+  GLuint m_DrawCountBuffer = 0;
+  GLuint m_InstanceBuffer = 0;
+  GLuint m_VisibilityBuffer = 0; // 1 per draw visible last frame
+  GLuint m_StatsBuffer = 0;
+
+  // Readback ring of the counters, a set of counters per fence
+  static const int kStatsReadbackCount = 3;
+  GLuint m_StatsReadbackBuffer = 0;
+  const uint32_t *m_StatsReadback = nullptr; // Persistent mapping
+  GLsync m_StatsFences[kStatsReadbackCount] = {};
+  int m_StatsReadbackFirst = 0; // Oldest pending copy
+  int m_StatsReadbackPendingCount = 0;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// GPU duration of a sequence of commands with GL_TIME_ELAPSED queries. Queries
+// are double buffered: begin() reads the result of the query issued two
+// frames ago, which is normally available, so the CPU never waits for the GPU.
+class GpuTimer
+{
+public:
+  GpuTimer() { glGenQueries(kQueryCount, m_Queries); }
+
+  ~GpuTimer() { glDeleteQueries(kQueryCount, m_Queries); }
+
+  GpuTimer(const GpuTimer &) = delete;
+  GpuTimer &operator=(const GpuTimer &) = delete;
+
+  // Time elapsed queries can't be nested, a single timer can be active
+  void begin()
+  {
+    auto &query = m_Queries[m_Current];
+    if (m_Issued[m_Current]) {
+      GLint available = GL_FALSE;
+      glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (available) {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        m_Seconds = double(nanoseconds) * 1e-9;
+      }
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+  }
+
+  void end()
+  {
+    glEndQuery(GL_TIME_ELAPSED);
+    m_Issued[m_Current] = true;
+    m_Current = (m_Current + 1) % kQueryCount;
+  }
+
+  // Last available measure
+  double seconds() const { return m_Seconds; }
+
+private:
+  static const int kQueryCount = 2;
+  GLuint m_Queries[kQueryCount] = {};
+  bool m_Issued[kQueryCount] = {};
+  int m_Current = 0;
+  double m_Seconds = 0.;
+};
@@ -0,0 +1,61 @@
+#include "hiz_pyramid.hpp"
+#include "gl_state_cache.hpp"
+
+#include <algorithm>
+
+// Must match local_size_x and local_size_y of hiz_reduce.cs.glsl
+static const GLuint kHiZGroupSize = 8;
+
+// Image unit of the level written by hiz_reduce.cs.glsl
+static const GLuint kHiZImageUnit = 0;
+
+HiZPyramid::HiZPyramid(GLProgram program, GLsizei width, GLsizei height) :
+    m_Program(std::move(program)), m_Width(width), m_Height(height)
+{
+  m_SourceLocation = glGetUniformLocation(m_Program.glId(), "uSource");
+  m_SourceLevelLocation =
+      glGetUniformLocation(m_Program.glId(), "uSourceLevel");
+
+  m_LevelCount = 1;
+  for (auto size = std::max(width, height); size > 1; size /= 2) {
+    ++m_LevelCount;
+  }
+
+  glGenTextures(1, &m_Texture);
+  glBindTexture(GL_TEXTURE_2D, m_Texture);
+  glTexStorage2D(GL_TEXTURE_2D, m_LevelCount, GL_R32F, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+HiZPyramid::~HiZPyramid() { glDeleteTextures(1, &m_Texture); }
+
+void HiZPyramid::build(GLStateCache &glState, GLuint depthTexture)
+{
+  glState.useProgram(m_Program.glId());
+  glState.uniform1i(m_SourceLocation, GLint(kHiZTextureUnit));
+
+  auto sourceWidth = m_Width;
+  auto sourceHeight = m_Height;
+  for (GLint level = 0; level < m_LevelCount; ++level) {
+    // Level 0 copies the depth texture, the others reduce the previous level
+    const auto width = level == 0 ? m_Width : std::max(sourceWidth / 2, 1);
+    const auto height = level == 0 ? m_Height : std::max(sourceHeight / 2, 1);
+    glState.bindTexture(
+        kHiZTextureUnit, GL_TEXTURE_2D, level == 0 ? depthTexture : m_Texture);
+    glState.uniform1i(m_SourceLevelLocation, level == 0 ? 0 : level - 1);
+    glBindImageTexture(
+        kHiZImageUnit, m_Texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glDispatchCompute((width + kHiZGroupSize - 1) / kHiZGroupSize,
+        (height + kHiZGroupSize - 1) / kHiZGroupSize, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    sourceWidth = width;
+    sourceHeight = height;
+  }
+  glBindImageTexture(
+      kHiZImageUnit, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+}
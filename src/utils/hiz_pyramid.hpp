@@ -0,0 +1,47 @@
+#pragma once
+
+#include "shaders.hpp"
+
+#include <glad/glad.h>
+
+class GLStateCache;
+
+// Texture unit the pyramid is read from by the culling shader and the HiZ
+// debug view, and used as source while building it. Above the material units.
+const GLuint kHiZTextureUnit = 8;
+
+// Hierarchical depth buffer: level 0 is a copy of a depth texture and each
+// texel of level n is the farthest depth of the texels of level n - 1 it
+// covers, including the extra row/column of odd sized levels. A box whose
+// nearest depth is farther than the pyramid over its screen footprint is
+// hidden.
+class HiZPyramid
+{
+public:
+  // program is hiz_reduce.cs.glsl
+  HiZPyramid(GLProgram program, GLsizei width, GLsizei height);
+
+  ~HiZPyramid();
+
+  HiZPyramid(const HiZPyramid &) = delete;
+  HiZPyramid &operator=(const HiZPyramid &) = delete;
+
+  // Rebuild all levels from depthTexture, which must have the size of the
+  // pyramid. Ends with the barriers needed to sample the pyramid.
+  void build(GLStateCache &glState, GLuint depthTexture);
+
+  GLuint texture() const { return m_Texture; }
+  GLsizei width() const { return m_Width; }
+  GLsizei height() const { return m_Height; }
+  GLint levelCount() const { return m_LevelCount; }
+
+private:
+  GLProgram m_Program;
+  GLint m_SourceLocation = -1;
+  GLint m_SourceLevelLocation = -1;
+
+  GLsizei m_Width;
+  GLsizei m_Height;
+  GLint m_LevelCount;
+  GLuint m_Texture = 0;
+};
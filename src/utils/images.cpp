@@ -29,7 +29,9 @@ void renderToImage(size_t width, size_t height, size_t numComponents,
   // case need to todo glBlitFramebuffer in another one in order to be able to
   // glGetTexImage)
   // https://stackoverflow.com/questions/14019910/how-does-glteximage2dmultisample-work
-  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, w, h);
+  // sRGB like the window, drawScene() writes linear colors encoded by the
+  // framebuffer with GL_FRAMEBUFFER_SRGB enabled
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_SRGB8_ALPHA8, w, h);
 
   GLuint depthTexture;
   glGenTextures(1, &depthTexture);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+
+// Binding point of the per-draw data storage buffer, must match the "binding"
+// layout qualifier of the Draws block of the indirect vertex shaders
+const GLuint kDrawDataBufferBinding = 1;
+
+// Binding point of the instance buffer, mapping the draw id attribute
+// (baseInstance + instance index) to an index in the per-draw data
+const GLuint kInstanceBufferBinding = 2;
+
+// Layout required by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint baseInstance;
+};
+
+// std430 layout of the DrawData struct of the indirect vertex shaders, one per
+// draw packet
+struct GpuDrawData
+{
+  glm::mat4 modelMatrix;
+  glm::mat4 normalMatrix; // Upper 3x3 is the world space normal matrix
+  uint32_t materialIndex; // Index in the MaterialTable
+  uint32_t padding[3];
+};
+static_assert(sizeof(GpuDrawData) == 144, "GpuDrawData must match std430");
+
+// Buffer object rewritten by the CPU, typically each frame. Storage grows to
+// the largest upload and is orphaned before each write so the driver doesn't
+// wait for draws still reading the previous contents.
+class StreamBuffer
+{
+public:
+  StreamBuffer() { glGenBuffers(1, &m_GLId); }
+
+  ~StreamBuffer() { glDeleteBuffers(1, &m_GLId); }
+
+  StreamBuffer(const StreamBuffer &) = delete;
+  StreamBuffer &operator=(const StreamBuffer &) = delete;
+
+  GLuint glId() const { return m_GLId; }
+
+  // Written through GL_COPY_WRITE_BUFFER, so no binding used for drawing is
+  // changed
+  void upload(const void *data, size_t size)
+  {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_GLId);
+    if (size > m_Capacity) {
+      m_Capacity = std::max(size, 2 * m_Capacity);
+    }
+    glBufferData(GL_COPY_WRITE_BUFFER, m_Capacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+private:
+  GLuint m_GLId = 0;
+  size_t m_Capacity = 0;
+};
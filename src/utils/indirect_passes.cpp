@@ -0,0 +1,355 @@
+#include "indirect_passes.hpp"
+#include "depth_pre_pass.hpp"
+#include "gl_extensions.hpp"
+#include "gl_state_cache.hpp"
+#include "scene_programs.hpp"
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+IndirectPasses::IndirectPasses(const fs::path &shadersRootPath,
+    const tinygltf::Model &model, const std::vector<DrawPacket> &drawPackets,
+    const std::vector<GpuDrawData> &drawData, const BoxSet &worldBoxes,
+    const MaterialTable &materialTable,
+    const std::vector<ShaderFeatures> &materialFeatures, GLsizei width,
+    GLsizei height, bool encodeSRGBOutput) :
+    m_DrawPackets(drawPackets),
+    m_DrawData(drawData),
+    m_WorldBoxes(worldBoxes),
+    m_MaterialTable(materialTable),
+    m_MaterialFeatures(materialFeatures),
+    m_ShadersRootPath(shadersRootPath),
+    m_MergedGeometry(model, 2 * drawPackets.size()),
+    m_SceneTarget(width, height),
+    m_HiZPyramid(compileProgram({shadersRootPath / "hiz_reduce.cs.glsl"}),
+        width, height),
+    m_PresentProgram(compileProgram({shadersRootPath / "fullscreen.vs.glsl",
+                                        shadersRootPath / "present.fs.glsl"},
+        encodeSRGBOutput ? std::vector<std::string>{"SRGB_ENCODE"}
+                         : std::vector<std::string>{}))
+{
+  const auto &presentReflection = m_PresentProgram.reflection();
+  m_PresentColorTextureLocation = presentReflection.location("uColorTexture");
+  m_PresentHiZTextureLocation = presentReflection.location("uHiZTexture");
+  m_PresentHiZLevelLocation = presentReflection.location("uHiZLevel");
+  glGenVertexArrays(1, &m_PresentVertexArray);
+  setBuckets();
+}
+
+IndirectPasses::~IndirectPasses()
+{
+  glDeleteVertexArrays(1, &m_PresentVertexArray);
+}
+
+void IndirectPasses::setBuckets()
+{
+  // Textures only split buckets when draws bind them
+  const auto bucketTextures = [&](size_t tableIndex) {
+    return m_MaterialTable.textureMode() == kBoundTextures
+               ? m_MaterialTable.textures(uint32_t(tableIndex))
+               : MaterialTextures{};
+  };
+  const auto bucketKey = [&](const DrawPacket &packet) {
+    const auto tableIndex = m_MaterialTable.index(packet.material);
+    return std::make_tuple(packet.pass, m_MaterialFeatures[tableIndex],
+        packet.mode, bucketTextures(tableIndex));
+  };
+
+  std::map<std::tuple<RenderPass, ShaderFeatures, GLenum, MaterialTextures>,
+      size_t>
+      bucketIndices;
+  for (const auto &packet : m_DrawPackets) {
+    bucketIndices.emplace(
+        bucketKey(packet), m_MaterialTable.index(packet.material));
+  }
+  m_CullingBuckets.clear();
+  for (auto &bucket : bucketIndices) {
+    m_CullingBuckets.push_back(IndirectBucket{std::get<0>(bucket.first),
+        std::get<2>(bucket.first), std::get<1>(bucket.first), bucket.second, 0,
+        0});
+    bucket.second = m_CullingBuckets.size() - 1;
+  }
+
+  std::vector<GpuCullingDraw> cullingDraws;
+  std::vector<uint32_t> bucketSizes(m_CullingBuckets.size(), 0);
+  for (const auto &packet : m_DrawPackets) {
+    const auto &range = m_MergedGeometry.range(packet.mesh, packet.primitive);
+    const auto bucket = bucketIndices[bucketKey(packet)];
+    cullingDraws.push_back(GpuCullingDraw{
+        range.indexCount, range.firstIndex, range.baseVertex, GLuint(bucket)});
+    ++bucketSizes[bucket];
+  }
+  m_GpuCuller = std::make_unique<GpuCuller>(
+      compileProgram({m_ShadersRootPath / "cull_draws.cs.glsl"}), cullingDraws,
+      bucketSizes);
+  m_CullingBoxesUploaded = false;
+}
+
+void IndirectPasses::invalidateDrawData()
+{
+  m_DrawDataUploaded = false;
+  m_CullingBoxesUploaded = false;
+}
+
+DrawStats IndirectPasses::draw(GLStateCache &glState, ScenePrograms &programs,
+    DepthPrePass &depthPrePass, const std::vector<uint32_t> &drawOrder,
+    bool useInstancing, ShaderFeatures frameFeatures)
+{
+  uploadDrawData(glState);
+
+  m_Commands.clear();
+  m_Buckets.clear();
+  m_InstanceDraws.clear();
+  const DrawPacket *previousPacket = nullptr;
+  for (const auto packetIdx : drawOrder) {
+    const auto &packet = m_DrawPackets[packetIdx];
+    m_InstanceDraws.push_back(packetIdx);
+    // Same primitive implies same mode and material, so the same bucket
+    if (useInstancing && previousPacket &&
+        previousPacket->mesh == packet.mesh &&
+        previousPacket->primitive == packet.primitive) {
+      ++m_Commands.back().instanceCount;
+      continue;
+    }
+    previousPacket = &packet;
+
+    const auto &range = m_MergedGeometry.range(packet.mesh, packet.primitive);
+    const auto tableIndex = m_MaterialTable.index(packet.material);
+    const auto features = m_MaterialFeatures[tableIndex];
+    if (m_Buckets.empty() || m_Buckets.back().pass != packet.pass ||
+        m_Buckets.back().mode != packet.mode ||
+        m_Buckets.back().features != features ||
+        !m_MaterialTable.sharesTextures(
+            uint32_t(m_Buckets.back().material), tableIndex)) {
+      m_Buckets.push_back(IndirectBucket{packet.pass, packet.mode, features,
+          tableIndex, m_Commands.size(), 0});
+    }
+    ++m_Buckets.back().commandCount;
+    m_Commands.push_back(DrawElementsIndirectCommand{range.indexCount, 1,
+        range.firstIndex, range.baseVertex,
+        GLuint(m_InstanceDraws.size() - 1)});
+  }
+  m_CommandBuffer.upload(
+      m_Commands.data(), m_Commands.size() * sizeof(DrawElementsIndirectCommand));
+  m_InstanceDrawBuffer.upload(
+      m_InstanceDraws.data(), m_InstanceDraws.size() * sizeof(uint32_t));
+
+  glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_CommandBuffer.glId());
+  glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, kInstanceBufferBinding,
+      m_InstanceDrawBuffer.glId());
+  DrawStats drawStats;
+  const auto drawCommands = [&](GLenum mode, size_t firstCommand,
+                                size_t commandCount) {
+    glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT,
+        (const GLvoid *)(firstCommand * sizeof(DrawElementsIndirectCommand)),
+        GLsizei(commandCount), 0);
+    ++drawStats.multiDrawCalls;
+  };
+  if (depthPrePass.isEnabled()) {
+    depthPrePass.begin(glState);
+    beginPass(glState, programs, true);
+    // Textures don't matter without shading: consecutive opaque buckets of the
+    // same mode are one call
+    for (size_t i = 0; i < m_Buckets.size();) {
+      const auto &bucket = m_Buckets[i];
+      auto commandCount = bucket.commandCount;
+      for (++i; i < m_Buckets.size() && m_Buckets[i].pass == bucket.pass &&
+                m_Buckets[i].mode == bucket.mode;
+           ++i) {
+        commandCount += m_Buckets[i].commandCount;
+      }
+      if (bucket.pass == kOpaquePass) {
+        drawCommands(bucket.mode, bucket.firstCommand, commandCount);
+      }
+    }
+    depthPrePass.end(glState);
+  }
+  depthPrePass.beginShading();
+  beginPass(glState, programs, false);
+  for (const auto &bucket : m_Buckets) {
+    setUpShading(glState, programs, depthPrePass, bucket, frameFeatures);
+    drawCommands(bucket.mode, bucket.firstCommand, bucket.commandCount);
+  }
+  depthPrePass.endShading();
+  drawStats.drawCalls = m_Commands.size();
+  drawStats.instances = m_InstanceDraws.size();
+  return drawStats;
+}
+
+DrawStats IndirectPasses::drawCulled(GLStateCache &glState,
+    ScenePrograms &programs, DepthPrePass &depthPrePass,
+    const Frustum &frustum, const glm::mat4 &viewProjMatrix, bool useFrustum,
+    bool useOcclusion, int hiZDebugLevel, ShaderFeatures frameFeatures)
+{
+  GLint targetFramebuffer = 0;
+  if (useOcclusion) {
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &targetFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_SceneTarget.framebuffer());
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // The offscreen target is sRGB, present() encodes for the framebuffer if
+    // needed
+    frameFeatures &= ~ShaderFeatures(kSRGBEncodeFeature);
+  }
+
+  if (!m_CullingBoxesUploaded) {
+    m_GpuCuller->setBoxes(m_WorldBoxes);
+    m_CullingBoxesUploaded = true;
+  }
+  m_GpuCuller->beginFrame();
+  m_CullingTimer.begin();
+  if (useOcclusion) {
+    m_GpuCuller->cullFirstPhase(glState, frustum);
+  } else {
+    m_GpuCuller->cull(glState, frustum, useFrustum);
+  }
+  m_CullingTimer.end();
+
+  uploadDrawData(glState);
+
+  DrawStats drawStats;
+  // The depth of the first phase feeds the HiZ pyramid: with the pre-pass,
+  // both phases are shaded after the second one. Blended draws of both phases
+  // come last, over all the draws they don't hide.
+  const auto firstPhase = useOcclusion ? GpuCuller::kOcclusionFirstPhase
+                                       : GpuCuller::kFrustumPhase;
+  const auto drawPhase = [&](GpuCuller::Phase phase) {
+    if (depthPrePass.isEnabled()) {
+      depthPrePass.begin(glState);
+      drawCullingBuckets(glState, programs, depthPrePass, phase,
+          kDepthOnlyBuckets, frameFeatures, drawStats);
+      depthPrePass.end(glState);
+    } else {
+      depthPrePass.beginShading();
+      drawCullingBuckets(glState, programs, depthPrePass, phase,
+          kShadedBuckets, frameFeatures, drawStats);
+      depthPrePass.endShading();
+    }
+  };
+  drawPhase(firstPhase);
+
+  if (useOcclusion) {
+    // Depth of the draws visible last frame hides the others
+    m_HiZBuildTimer.begin();
+    m_HiZPyramid.build(glState, m_SceneTarget.depthTexture());
+    m_HiZBuildTimer.end();
+    m_GpuCuller->cullSecondPhase(
+        glState, frustum, viewProjMatrix, m_HiZPyramid);
+    drawPhase(GpuCuller::kOcclusionSecondPhase);
+  }
+  depthPrePass.beginShading();
+  if (depthPrePass.isEnabled()) {
+    drawCullingBuckets(glState, programs, depthPrePass, firstPhase,
+        kShadedBuckets, frameFeatures, drawStats);
+    if (useOcclusion) {
+      drawCullingBuckets(glState, programs, depthPrePass,
+          GpuCuller::kOcclusionSecondPhase, kShadedBuckets, frameFeatures,
+          drawStats);
+    }
+  }
+  drawCullingBuckets(glState, programs, depthPrePass, firstPhase,
+      kBlendedBuckets, frameFeatures, drawStats);
+  if (useOcclusion) {
+    drawCullingBuckets(glState, programs, depthPrePass,
+        GpuCuller::kOcclusionSecondPhase, kBlendedBuckets, frameFeatures,
+        drawStats);
+  }
+  depthPrePass.endShading();
+
+  if (useOcclusion) {
+    present(glState, programs, GLuint(targetFramebuffer), hiZDebugLevel);
+  }
+
+  drawStats.drawCalls = drawStats.instances = m_GpuCuller->stats().drawCount;
+  return drawStats;
+}
+
+void IndirectPasses::uploadDrawData(GLStateCache &glState)
+{
+  // Per draw data of all packets, visible or not, only changes with world
+  // matrices
+  if (!m_DrawDataUploaded) {
+    m_DrawDataBuffer.upload(
+        m_DrawData.data(), m_DrawData.size() * sizeof(GpuDrawData));
+    m_DrawDataUploaded = true;
+  }
+  glState.bindBufferBase(
+      GL_SHADER_STORAGE_BUFFER, kDrawDataBufferBinding, m_DrawDataBuffer.glId());
+}
+
+void IndirectPasses::beginPass(
+    GLStateCache &glState, ScenePrograms &programs, bool depthOnly) const
+{
+  if (depthOnly) {
+    programs.useDepth(glState, true);
+  }
+  glState.bindVertexArray(depthOnly
+                              ? m_MergedGeometry.positionVertexArrayObject()
+                              : m_MergedGeometry.vertexArrayObject());
+}
+
+void IndirectPasses::setUpShading(GLStateCache &glState,
+    ScenePrograms &programs, const DepthPrePass &depthPrePass,
+    const IndirectBucket &bucket, ShaderFeatures frameFeatures) const
+{
+  programs.useShading(glState, true, frameFeatures | bucket.features);
+  depthPrePass.setShadingState(glState, bucket.pass);
+  m_MaterialTable.bindTextures(glState, uint32_t(bucket.material));
+}
+
+void IndirectPasses::drawCullingBuckets(GLStateCache &glState,
+    ScenePrograms &programs, const DepthPrePass &depthPrePass,
+    GpuCuller::Phase phase, BucketSelection selection,
+    ShaderFeatures frameFeatures, DrawStats &drawStats)
+{
+  const auto depthOnly = selection == kDepthOnlyBuckets;
+  beginPass(glState, programs, depthOnly);
+  glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_GpuCuller->commandBuffer());
+  glState.bindBufferBase(
+      GL_SHADER_STORAGE_BUFFER, kDrawDataBufferBinding, m_DrawDataBuffer.glId());
+  glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, kInstanceBufferBinding,
+      m_GpuCuller->instanceBuffer());
+  if (m_GpuCuller->hasDrawCount()) {
+    glState.bindBuffer(GL_PARAMETER_BUFFER, m_GpuCuller->drawCountBuffer());
+  }
+  for (size_t i = 0; i < m_CullingBuckets.size(); ++i) {
+    const auto &bucket = m_CullingBuckets[i];
+    const auto isSelected =
+        depthOnly ? bucket.pass == kOpaquePass
+                  : (bucket.pass == kBlendPass) == (selection == kBlendedBuckets);
+    if (!isSelected) {
+      continue;
+    }
+    if (!depthOnly) {
+      setUpShading(glState, programs, depthPrePass, bucket, frameFeatures);
+    }
+    const auto commands = (const GLvoid *)m_GpuCuller->commandOffset(i, phase);
+    if (m_GpuCuller->hasDrawCount()) {
+      glExtensions().multiDrawElementsIndirectCount(bucket.mode,
+          GL_UNSIGNED_INT, commands, m_GpuCuller->drawCountOffset(i, phase),
+          m_GpuCuller->maxDrawCount(i), 0);
+    } else {
+      glMultiDrawElementsIndirect(bucket.mode, GL_UNSIGNED_INT, commands,
+          m_GpuCuller->maxDrawCount(i), 0);
+    }
+    ++drawStats.multiDrawCalls;
+  }
+}
+
+void IndirectPasses::present(GLStateCache &glState, ScenePrograms &programs,
+    GLuint targetFramebuffer, int hiZDebugLevel)
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+  glDisable(GL_DEPTH_TEST);
+  glState.blend(false);
+  programs.use(glState, m_PresentProgram);
+  glState.uniform1i(m_PresentColorTextureLocation, 0);
+  glState.uniform1i(m_PresentHiZTextureLocation, GLint(kHiZTextureUnit));
+  glState.uniform1i(m_PresentHiZLevelLocation,
+      std::min(hiZDebugLevel, m_HiZPyramid.levelCount() - 1));
+  glState.bindTexture(0, GL_TEXTURE_2D, m_SceneTarget.colorTexture());
+  glState.bindTexture(kHiZTextureUnit, GL_TEXTURE_2D, m_HiZPyramid.texture());
+  glState.bindVertexArray(m_PresentVertexArray);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glEnable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "culling.hpp"
+#include "draw_packets.hpp"
+#include "filesystem.hpp"
+#include "gpu_culling.hpp"
+#include "gpu_timer.hpp"
+#include "hiz_pyramid.hpp"
+#include "indirect_draws.hpp"
+#include "materials.hpp"
+#include "merged_geometry.hpp"
+#include "render_target.hpp"
+#include "shader_permutations.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class DepthPrePass;
+class GLStateCache;
+class ScenePrograms;
+
+// Consecutive indirect commands drawn with one multi-draw call: same pass,
+// program permutation, mode and textures
+struct IndirectBucket
+{
+  RenderPass pass;
+  GLenum mode;
+  ShaderFeatures features; // Material features of the program permutation
+  size_t material;         // Index in the material table, for its textures
+  size_t firstCommand;
+  size_t commandCount;
+};
+
+// Multi-draw indirect path: all primitives are merged in one VAO and the
+// shading programs read matrices and material from the per-draw storage
+// buffer, whose entry i describes draw packet i. Instance i of the commands
+// reads the draw data of packet instanceDraws[i], where instanceDraws is the
+// instance buffer.
+//
+// The visible packets are either turned into commands by the CPU, see
+// draw(), or by the compute pass of GpuCuller, see drawCulled(). With GPU
+// culling, packets are grouped once in buckets sharing pass, program
+// permutation, mode and textures, ordered by pass, and draws are neither
+// sorted nor instanced.
+//
+// Two phase HiZ occlusion culling is part of GPU culling: the scene is drawn
+// in an offscreen target whose depth feeds the pyramid, then copied to the
+// current framebuffer (without multisampling).
+class IndirectPasses
+{
+public:
+  // drawData[i] and worldBoxes[i] are the world transform and box of
+  // drawPackets[i], materialFeatures[i] the material features of entry i of
+  // the material table. All of them must outlive the passes, call
+  // invalidateDrawData() when they change. The passes draw to framebuffers
+  // of width x height, encodeSRGBOutput if they are not sRGB.
+  IndirectPasses(const fs::path &shadersRootPath,
+      const tinygltf::Model &model, const std::vector<DrawPacket> &drawPackets,
+      const std::vector<GpuDrawData> &drawData, const BoxSet &worldBoxes,
+      const MaterialTable &materialTable,
+      const std::vector<ShaderFeatures> &materialFeatures, GLsizei width,
+      GLsizei height, bool encodeSRGBOutput);
+
+  ~IndirectPasses();
+
+  IndirectPasses(const IndirectPasses &) = delete;
+  IndirectPasses &operator=(const IndirectPasses &) = delete;
+
+  // Rebuild the buckets of GPU culling, which depend on the material texture
+  // mode
+  void setBuckets();
+
+  // Upload the draw data and the boxes again before the next draws
+  void invalidateDrawData();
+
+  // Draw the packets of drawOrder, in this order. Consecutive packets of the
+  // same primitive (nodes sharing a mesh, EXT_mesh_gpu_instancing) are merged
+  // into a single instanced command if useInstancing, consecutive commands
+  // with the same mode and textures are submitted with one call.
+  DrawStats draw(GLStateCache &glState, ScenePrograms &programs,
+      DepthPrePass &depthPrePass, const std::vector<uint32_t> &drawOrder,
+      bool useInstancing, ShaderFeatures frameFeatures);
+
+  // Cull all the packets on the GPU, against the frustum if useFrustum, and
+  // draw the visible ones. useOcclusion enables occlusion culling, whose
+  // scene is replaced by a level of the pyramid if hiZDebugLevel >= 0.
+  DrawStats drawCulled(GLStateCache &glState, ScenePrograms &programs,
+      DepthPrePass &depthPrePass, const Frustum &frustum,
+      const glm::mat4 &viewProjMatrix, bool useFrustum, bool useOcclusion,
+      int hiZDebugLevel, ShaderFeatures frameFeatures);
+
+  const GpuCuller &gpuCuller() const { return *m_GpuCuller; }
+  GLint hiZLevelCount() const { return m_HiZPyramid.levelCount(); }
+
+  // GPU times of the last measured frame with GPU culling
+  double cullingSeconds() const { return m_CullingTimer.seconds(); }
+  double hiZBuildSeconds() const { return m_HiZBuildTimer.seconds(); }
+
+private:
+  void uploadDrawData(GLStateCache &glState);
+
+  // VAO of the pre-pass or of the shading pass, and program of the pre-pass.
+  // The shading programs are bound per bucket.
+  void beginPass(GLStateCache &glState, ScenePrograms &programs,
+      bool depthOnly) const;
+
+  // Shading program, depth test and textures of a bucket
+  void setUpShading(GLStateCache &glState, ScenePrograms &programs,
+      const DepthPrePass &depthPrePass, const IndirectBucket &bucket,
+      ShaderFeatures frameFeatures) const;
+
+  // Buckets drawn by drawCullingBuckets()
+  enum BucketSelection
+  {
+    kDepthOnlyBuckets = 0, // Opaque buckets with the pre-pass program
+    kShadedBuckets,        // Opaque and masked buckets
+    kBlendedBuckets
+  };
+
+  // Buckets are drawn whole, the draw count or the empty commands skip culled
+  // draws
+  void drawCullingBuckets(GLStateCache &glState, ScenePrograms &programs,
+      const DepthPrePass &depthPrePass, GpuCuller::Phase phase,
+      BucketSelection selection, ShaderFeatures frameFeatures,
+      DrawStats &drawStats);
+
+  // Blit the offscreen target, or the HiZ level, to targetFramebuffer
+  void present(GLStateCache &glState, ScenePrograms &programs,
+      GLuint targetFramebuffer, int hiZDebugLevel);
+
+  const std::vector<DrawPacket> &m_DrawPackets;
+  const std::vector<GpuDrawData> &m_DrawData;
+  const BoxSet &m_WorldBoxes;
+  const MaterialTable &m_MaterialTable;
+  const std::vector<ShaderFeatures> &m_MaterialFeatures;
+  fs::path m_ShadersRootPath;
+
+  // GPU culling writes the commands of its two phases in two halves of the
+  // instance range
+  MergedGeometry m_MergedGeometry;
+  StreamBuffer m_DrawDataBuffer;
+  bool m_DrawDataUploaded = false;
+
+  // Commands of draw(), buffers are reused between frames
+  std::vector<DrawElementsIndirectCommand> m_Commands;
+  std::vector<IndirectBucket> m_Buckets;
+  std::vector<uint32_t> m_InstanceDraws;
+  StreamBuffer m_CommandBuffer;
+  StreamBuffer m_InstanceDrawBuffer;
+
+  std::unique_ptr<GpuCuller> m_GpuCuller;
+  // firstCommand and commandCount are unused
+  std::vector<IndirectBucket> m_CullingBuckets;
+  bool m_CullingBoxesUploaded = false;
+  GpuTimer m_CullingTimer;
+
+  RenderTarget m_SceneTarget;
+  HiZPyramid m_HiZPyramid;
+  GLProgram m_PresentProgram;
+  GLint m_PresentColorTextureLocation = -1;
+  GLint m_PresentHiZTextureLocation = -1;
+  GLint m_PresentHiZLevelLocation = -1;
+  // Without attributes, the vertex shader uses gl_VertexID
+  GLuint m_PresentVertexArray = 0;
+  GpuTimer m_HiZBuildTimer;
+};
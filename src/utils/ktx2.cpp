@@ -0,0 +1,471 @@
+#include "ktx2.hpp"
+#include "basis_lz.hpp"
+#include "block_compression.hpp"
+#include "gl_extensions.hpp"
+#include "parallel.hpp"
+#include "uastc.hpp"
+
+#include <zstd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+const unsigned char kKtx2Identifier[12] = {
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+// Header and index following the identifier
+struct Ktx2Header
+{
+  uint32_t vkFormat;
+  uint32_t typeSize;
+  uint32_t pixelWidth, pixelHeight, pixelDepth;
+  uint32_t layerCount, faceCount, levelCount;
+  uint32_t supercompressionScheme;
+  uint32_t dfdByteOffset, dfdByteLength;
+  uint32_t kvdByteOffset, kvdByteLength;
+  // 64 bits values, misaligned for uint64_t after the identifier
+  uint32_t sgdByteOffset[2], sgdByteLength[2];
+};
+static_assert(sizeof(Ktx2Header) == 68, "Ktx2Header must match the file");
+
+struct Ktx2LevelIndex
+{
+  uint64_t byteOffset;
+  uint64_t byteLength;
+  uint64_t uncompressedByteLength;
+};
+
+// KHR_DF_MODEL_UASTC of the data format descriptor, and its channels with
+// alpha: KHR_DF_CHANNEL_UASTC_RGBA and KHR_DF_CHANNEL_UASTC_RRRG
+const uint8_t kUASTCColorModel = 166;
+const uint8_t kUASTCRGBAChannel = 3;
+const uint8_t kUASTCRRRGChannel = 5;
+const size_t kUASTCBlockBytes = 16;
+
+enum SupercompressionScheme
+{
+  kNoSupercompression = 0,
+  kBasisLZSupercompression,
+  kZstdSupercompression
+};
+
+// VkFormat values of the payloads uploaded as is, with their OpenGL formats
+struct FormatDescription
+{
+  uint32_t vkFormat;
+  GLenum linearFormat, srgbFormat;
+  uint32_t blockBytes; // Of a 4x4 block, 0 for uncompressed RGBA8 pixels
+  bool isS3TC;
+};
+
+const FormatDescription kFormats[] = {
+    {37, GL_RGBA8, GL_SRGB8_ALPHA8, 0, false}, // R8G8B8A8_UNORM
+    {43, GL_RGBA8, GL_SRGB8_ALPHA8, 0, false}, // R8G8B8A8_SRGB
+    {131, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, 8,
+        true}, // BC1_RGB_UNORM_BLOCK
+    {132, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, 8,
+        true}, // BC1_RGB_SRGB_BLOCK
+    {133, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+        GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, 8,
+        true}, // BC1_RGBA_UNORM_BLOCK
+    {134, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+        GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, 8,
+        true}, // BC1_RGBA_SRGB_BLOCK
+    {137, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+        GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 16, true}, // BC3_UNORM_BLOCK
+    {138, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+        GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 16, true}, // BC3_SRGB_BLOCK
+    {145, GL_COMPRESSED_RGBA_BPTC_UNORM, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM,
+        16, false}, // BC7_UNORM_BLOCK
+    {146, GL_COMPRESSED_RGBA_BPTC_UNORM, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM,
+        16, false}, // BC7_SRGB_BLOCK
+};
+
+const FormatDescription *findFormat(uint32_t vkFormat)
+{
+  const auto it = std::find_if(std::begin(kFormats), std::end(kFormats),
+      [&](const FormatDescription &format) {
+        return format.vkFormat == vkFormat;
+      });
+  return it != std::end(kFormats) ? it : nullptr;
+}
+
+// Bytes of a level of the format, before supercompression
+size_t levelSize(const FormatDescription &format, int width, int height)
+{
+  if (!format.blockBytes) {
+    return size_t(width) * height * 4;
+  }
+  return size_t((width + 3) / 4) * ((height + 3) / 4) * format.blockBytes;
+}
+
+uint64_t readUint64(const uint32_t words[2])
+{
+  return uint64_t(words[0]) | (uint64_t(words[1]) << 32);
+}
+
+void decompressZstdLevels(Ktx2Texture &texture, const unsigned char *bytes)
+{
+  std::vector<unsigned char> data;
+  for (size_t level = 0; level < texture.levels.size(); ++level) {
+    auto &levelRange = texture.levels[level];
+    const auto offset = data.size();
+    data.resize(offset + levelRange.uncompressedSize);
+    const auto size = ZSTD_decompress(data.data() + offset,
+        levelRange.uncompressedSize, bytes + levelRange.offset,
+        levelRange.size);
+    if (ZSTD_isError(size)) {
+      throw std::runtime_error("Level " + std::to_string(level) +
+                               " can't be decompressed: " +
+                               ZSTD_getErrorName(size));
+    }
+    if (size != levelRange.uncompressedSize) {
+      throw std::runtime_error("Decompressed level " + std::to_string(level) +
+                               " doesn't have its uncompressed size");
+    }
+    levelRange.offset = offset;
+    levelRange.size = size;
+  }
+  texture.transcodedData = std::move(data);
+  texture.supercompressionScheme = kNoSupercompression;
+}
+
+// VkFormat Basis Universal payloads are transcoded to
+uint32_t transcodedFormat(Ktx2TranscodeTarget target, bool hasAlpha)
+{
+  if (target == kTranscodeToBC7) {
+    return 145; // BC7_UNORM_BLOCK
+  }
+  if (target == kTranscodeToBC1OrBC3) {
+    return hasAlpha ? 137 : 131; // BC3_UNORM_BLOCK, BC1_RGB_UNORM_BLOCK
+  }
+  return 37; // R8G8B8A8_UNORM
+}
+
+// Store the pixels of a block in a level of the transcoded format, at
+// output. RGBA8 rows are stored without the pixels of the blocks past the
+// edges.
+void storeTranscodedBlock(const uint8_t pixels[64],
+    const FormatDescription &format, unsigned char *output, size_t blockX,
+    size_t blockY, int width, int height)
+{
+  const auto blockCountX = size_t(width + 3) / 4;
+  const auto blockOutput =
+      output + (blockY * blockCountX + blockX) * format.blockBytes;
+  if (format.vkFormat == 145) {
+    encodeBC7Block(pixels, blockOutput);
+  } else if (format.vkFormat == 137) {
+    encodeBC3Block(pixels, blockOutput);
+  } else if (format.vkFormat == 131) {
+    encodeBC1Block(pixels, blockOutput);
+  } else {
+    for (size_t y = 0; y < 4 && blockY * 4 + y < size_t(height); ++y) {
+      const auto pixelX = blockX * 4;
+      const auto rowPixels = std::min<size_t>(4, size_t(width) - pixelX);
+      std::memcpy(output + ((blockY * 4 + y) * width + pixelX) * 4,
+          pixels + y * 16, rowPixels * 4);
+    }
+  }
+}
+
+void transcodeBasisLZLevels(Ktx2Texture &texture, const unsigned char *bytes,
+    Ktx2TranscodeTarget target)
+{
+  const BasisLZDecoder decoder(bytes + texture.globalDataOffset,
+      texture.globalDataSize, texture.levels.size());
+  const auto hasAlpha = decoder.hasAlpha();
+  const auto vkFormat = transcodedFormat(target, hasAlpha);
+  const auto &format = *findFormat(vkFormat);
+
+  std::vector<unsigned char> data;
+  for (size_t level = 0; level < texture.levels.size(); ++level) {
+    auto &levelRange = texture.levels[level];
+    const auto width = std::max(texture.width >> level, 1);
+    const auto height = std::max(texture.height >> level, 1);
+    const auto colorBlocks = decoder.decodeSlice(level, false,
+        bytes + levelRange.offset, levelRange.size, width, height);
+    const auto alphaBlocks = hasAlpha
+                                 ? decoder.decodeSlice(level, true,
+                                       bytes + levelRange.offset,
+                                       levelRange.size, width, height)
+                                 : std::vector<ETC1SBlock>();
+
+    const auto offset = data.size();
+    data.resize(offset + levelSize(format, width, height));
+    const auto output = data.data() + offset;
+    const auto blockCountX = size_t(width + 3) / 4;
+    const auto blockCountY = size_t(height + 3) / 4;
+    // Rows of blocks are independent once their indices are decoded
+    defaultThreadPool().parallelFor(
+        0, blockCountY, 1, [&](size_t rowBegin, size_t rowEnd) {
+          uint8_t pixels[64];
+          for (auto blockY = rowBegin; blockY < rowEnd; ++blockY) {
+            for (size_t blockX = 0; blockX < blockCountX; ++blockX) {
+              const auto block = blockY * blockCountX + blockX;
+              decoder.decodeBlock(colorBlocks[block],
+                  hasAlpha ? &alphaBlocks[block] : nullptr, pixels);
+              storeTranscodedBlock(
+                  pixels, format, output, blockX, blockY, width, height);
+            }
+          }
+        });
+    levelRange.offset = offset;
+    levelRange.size = levelSize(format, width, height);
+    levelRange.uncompressedSize = levelRange.size;
+  }
+  texture.vkFormat = vkFormat;
+  texture.transcodedData = std::move(data);
+  texture.supercompressionScheme = kNoSupercompression;
+}
+
+// UASTC levels are 16 bytes per block, once zstd supercompressed levels are
+// decompressed
+void transcodeUASTCLevels(Ktx2Texture &texture, const unsigned char *bytes,
+    Ktx2TranscodeTarget target)
+{
+  if (texture.supercompressionScheme == kZstdSupercompression) {
+    decompressZstdLevels(texture, bytes);
+  }
+  const auto hasAlpha = texture.firstChannel == kUASTCRGBAChannel ||
+                        texture.firstChannel == kUASTCRRRGChannel;
+  const auto vkFormat = transcodedFormat(target, hasAlpha);
+  const auto &format = *findFormat(vkFormat);
+
+  std::vector<unsigned char> data;
+  for (size_t level = 0; level < texture.levels.size(); ++level) {
+    auto &levelRange = texture.levels[level];
+    const auto width = std::max(texture.width >> level, 1);
+    const auto height = std::max(texture.height >> level, 1);
+    const auto blockCountX = size_t(width + 3) / 4;
+    const auto blockCountY = size_t(height + 3) / 4;
+    if (levelRange.size != blockCountX * blockCountY * kUASTCBlockBytes) {
+      throw std::runtime_error("Level " + std::to_string(level) +
+                               " doesn't have the size of its UASTC blocks");
+    }
+    const auto blocks = texture.levelData(bytes, level);
+
+    const auto offset = data.size();
+    data.resize(offset + levelSize(format, width, height));
+    const auto output = data.data() + offset;
+    std::atomic<bool> hasInvalidBlock{false};
+    defaultThreadPool().parallelFor(
+        0, blockCountY, 1, [&](size_t rowBegin, size_t rowEnd) {
+          uint8_t pixels[64];
+          for (auto blockY = rowBegin; blockY < rowEnd; ++blockY) {
+            for (size_t blockX = 0; blockX < blockCountX; ++blockX) {
+              const auto block = blockY * blockCountX + blockX;
+              if (!decodeUASTCBlock(
+                      blocks + block * kUASTCBlockBytes, pixels)) {
+                hasInvalidBlock = true;
+                return;
+              }
+              storeTranscodedBlock(
+                  pixels, format, output, blockX, blockY, width, height);
+            }
+          }
+        });
+    if (hasInvalidBlock) {
+      throw std::runtime_error(
+          "Level " + std::to_string(level) + " has an invalid UASTC block");
+    }
+    levelRange.offset = offset;
+    levelRange.size = levelSize(format, width, height);
+    levelRange.uncompressedSize = levelRange.size;
+  }
+  texture.vkFormat = vkFormat;
+  texture.transcodedData = std::move(data);
+  texture.supercompressionScheme = kNoSupercompression;
+}
+} // namespace
+
+bool Ktx2Texture::isCompressed() const
+{
+  const auto format = findFormat(vkFormat);
+  return format && format->blockBytes != 0;
+}
+
+bool Ktx2Texture::isRGBA8() const
+{
+  const auto format = findFormat(vkFormat);
+  return format && format->blockBytes == 0;
+}
+
+std::string Ktx2Texture::unsupportedReason() const
+{
+  if (supercompressionScheme != kNoSupercompression) {
+    return "supercompression scheme " + std::to_string(supercompressionScheme) +
+           " is not supported";
+  }
+  const auto format = findFormat(vkFormat);
+  if (!format) {
+    return "VkFormat " + std::to_string(vkFormat) + " is not supported";
+  }
+  if (format->isS3TC && !glExtensions().textureCompressionS3TC) {
+    return "BC1 and BC3 need EXT_texture_compression_s3tc";
+  }
+  return "";
+}
+
+GLenum Ktx2Texture::internalFormat(bool isSRGB) const
+{
+  const auto format = findFormat(vkFormat);
+  if (!format) {
+    return GL_NONE;
+  }
+  // Without EXT_texture_sRGB, sRGB blocks are read as linear
+  return isSRGB && (!format->isS3TC || glExtensions().textureSRGBS3TC)
+             ? format->srgbFormat
+             : format->linearFormat;
+}
+
+Ktx2TranscodeTarget ktx2TranscodeTarget()
+{
+  if (GLAD_GL_VERSION_4_2) {
+    return kTranscodeToBC7;
+  }
+  return glExtensions().textureCompressionS3TC ? kTranscodeToBC1OrBC3
+                                               : kTranscodeToRGBA8;
+}
+
+bool isKtx2(const unsigned char *bytes, size_t size)
+{
+  return size >= sizeof(kKtx2Identifier) &&
+         std::memcmp(bytes, kKtx2Identifier, sizeof(kKtx2Identifier)) == 0;
+}
+
+Ktx2Texture parseKtx2(const unsigned char *bytes, size_t size)
+{
+  Ktx2Header header;
+  if (!isKtx2(bytes, size) ||
+      size < sizeof(kKtx2Identifier) + sizeof(header)) {
+    throw std::runtime_error("Not a KTX2 file");
+  }
+  std::memcpy(&header, bytes + sizeof(kKtx2Identifier), sizeof(header));
+  if (header.pixelWidth == 0 || header.pixelHeight == 0 ||
+      header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1) {
+    throw std::runtime_error("KTX2 file is not a single 2D image");
+  }
+
+  Ktx2Texture texture;
+  texture.vkFormat = header.vkFormat;
+  texture.supercompressionScheme = header.supercompressionScheme;
+  texture.width = int(header.pixelWidth);
+  texture.height = int(header.pixelHeight);
+
+  // A level count of 0 asks the loader to generate the mipmaps
+  const auto levelCount = std::max<uint32_t>(header.levelCount, 1);
+  const auto indexOffset = sizeof(kKtx2Identifier) + sizeof(header);
+  if (size < indexOffset + levelCount * sizeof(Ktx2LevelIndex)) {
+    throw std::runtime_error("Truncated KTX2 level index");
+  }
+  const auto format = findFormat(header.vkFormat);
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    Ktx2LevelIndex index;
+    std::memcpy(&index, bytes + indexOffset + level * sizeof(index),
+        sizeof(index));
+    if (index.byteOffset > size || index.byteLength > size - index.byteOffset) {
+      throw std::runtime_error(
+          "Level " + std::to_string(level) + " is past the end of the file");
+    }
+    const auto width = std::max(texture.width >> level, 1);
+    const auto height = std::max(texture.height >> level, 1);
+    // zstd levels must decompress to the size of their format
+    const auto payloadSize =
+        header.supercompressionScheme == kZstdSupercompression
+            ? index.uncompressedByteLength
+            : index.byteLength;
+    if (format &&
+        (header.supercompressionScheme == kNoSupercompression ||
+            header.supercompressionScheme == kZstdSupercompression) &&
+        payloadSize != levelSize(*format, width, height)) {
+      throw std::runtime_error("Level " + std::to_string(level) +
+                               " doesn't have the size of its format");
+    }
+    // Basis Universal payloads (VkFormat 0) have at most 16 bytes per 4x4
+    // block, as UASTC
+    const auto maxBasisLevelSize =
+        size_t((width + 3) / 4) * size_t((height + 3) / 4) * 16;
+    if (header.vkFormat == 0 &&
+        header.supercompressionScheme == kZstdSupercompression &&
+        index.uncompressedByteLength > maxBasisLevelSize) {
+      throw std::runtime_error("Level " + std::to_string(level) +
+                               " is larger than its Basis Universal blocks");
+    }
+    texture.levels.push_back(Ktx2Texture::Level{size_t(index.byteOffset),
+        size_t(index.byteLength), size_t(index.uncompressedByteLength)});
+  }
+
+  const auto globalDataOffset = readUint64(header.sgdByteOffset);
+  const auto globalDataSize = readUint64(header.sgdByteLength);
+  if (globalDataOffset > size || globalDataSize > size - globalDataOffset) {
+    throw std::runtime_error(
+        "Supercompression global data is past the end of the file");
+  }
+  texture.globalDataOffset = size_t(globalDataOffset);
+  texture.globalDataSize = size_t(globalDataSize);
+
+  // Color model of the basic descriptor block, after the total size of the
+  // descriptor and the two words of the block header
+  texture.colorModel = 0;
+  if (header.dfdByteLength >= 13 &&
+      size_t(header.dfdByteOffset) + 13 <= size) {
+    texture.colorModel = bytes[header.dfdByteOffset + 12];
+  }
+  // Channel type of the first sample, after the 24 bytes of the block, less
+  // its qualifiers in the high bits
+  texture.firstChannel = 0;
+  if (header.dfdByteLength >= 32 &&
+      size_t(header.dfdByteOffset) + 32 <= size) {
+    texture.firstChannel = bytes[header.dfdByteOffset + 31] & 0x0F;
+  }
+  return texture;
+}
+
+void transcodeKtx2(Ktx2Texture &texture, const unsigned char *bytes,
+    Ktx2TranscodeTarget target)
+{
+  // Levels of formats the viewer can't upload are left compressed
+  if (texture.supercompressionScheme == kZstdSupercompression &&
+      findFormat(texture.vkFormat)) {
+    decompressZstdLevels(texture, bytes);
+  } else if (texture.supercompressionScheme == kBasisLZSupercompression &&
+             texture.vkFormat == 0) {
+    transcodeBasisLZLevels(texture, bytes, target);
+  } else if ((texture.supercompressionScheme == kNoSupercompression ||
+                 texture.supercompressionScheme == kZstdSupercompression) &&
+             texture.vkFormat == 0 && texture.colorModel == kUASTCColorModel) {
+    transcodeUASTCLevels(texture, bytes, target);
+  }
+}
+
+bool loadGltfImage(tinygltf::Image *image, const int imageIndex,
+    std::string *err, std::string *warn, int requiredWidth, int requiredHeight,
+    const unsigned char *bytes, int size, void *userData)
+{
+  if (!isKtx2(bytes, size_t(size))) {
+    return tinygltf::LoadImageData(image, imageIndex, err, warn, requiredWidth,
+        requiredHeight, bytes, size, userData);
+  }
+  try {
+    const auto texture = parseKtx2(bytes, size_t(size));
+    image->width = texture.width;
+    image->height = texture.height;
+  } catch (const std::runtime_error &e) {
+    if (err) {
+      (*err) += "Invalid KTX2 image[" + std::to_string(imageIndex) +
+                "] name = \"" + image->name + "\": " + e.what() + "\n";
+    }
+    return false;
+  }
+  // Levels are transcoded and uploaded when the textures are created,
+  // unsupported payloads leave the texture to its fallback image
+  image->component = 4;
+  image->bits = 8;
+  image->pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+  image->mimeType = kKtx2MimeType;
+  image->image.assign(bytes, bytes + size);
+  return true;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <tiny_gltf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// EXT_texture_compression_s3tc and EXT_texture_sRGB formats, not in the core
+// profile headers
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// Mime type of the images kept as KTX2 containers by loadGltfImage()
+const char *const kKtx2MimeType = "image/ktx2";
+
+// Single 2D image of a KTX2 container, see
+// https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html. Levels are
+// ranges of the container bytes, or of transcodedData once transcoded.
+struct Ktx2Texture
+{
+  struct Level
+  {
+    size_t offset;
+    size_t size;
+    size_t uncompressedSize; // Before supercompression, 0 for BasisLZ
+  };
+
+  uint32_t vkFormat;
+  uint32_t supercompressionScheme;
+  int width, height;
+  std::vector<Level> levels; // From level 0, the largest
+  uint8_t colorModel;        // Of the data format descriptor
+  uint8_t firstChannel;      // Channel of the first sample of the descriptor
+  // Supercompression global data, the BasisLZ codebooks
+  size_t globalDataOffset, globalDataSize;
+  std::vector<unsigned char> transcodedData;
+
+  // Payload without supercompression in a format the viewer uploads as is:
+  // 4x4 blocks of BC1, BC3 or BC7, or RGBA8 pixels
+  bool isCompressed() const;
+  bool isRGBA8() const;
+
+  // Supercompressed or Basis Universal (VkFormat 0), see transcodeKtx2()
+  bool needsTranscoding() const
+  {
+    return supercompressionScheme != 0 || vkFormat == 0;
+  }
+
+  // Bytes of a level, in the container or in transcodedData
+  const unsigned char *levelData(
+      const unsigned char *containerBytes, size_t level) const
+  {
+    return (transcodedData.empty() ? containerBytes : transcodedData.data()) +
+           levels[level].offset;
+  }
+
+  // Why the context can't sample the payload, empty if it can. The viewer
+  // has no zlib decompressor.
+  std::string unsupportedReason() const;
+
+  // Sized internal format of the payload, in its sRGB or linear variant. The
+  // colors of a texture are sRGB depending on its use by the materials, not
+  // on the format of the file.
+  GLenum internalFormat(bool isSRGB) const;
+};
+
+// Formats Basis Universal ETC1S and UASTC payloads are transcoded to, from the
+// best supported by the context
+enum Ktx2TranscodeTarget
+{
+  kTranscodeToBC7,
+  kTranscodeToBC1OrBC3, // BC3 if the payload has alpha
+  kTranscodeToRGBA8
+};
+
+// BC7 (core since OpenGL 4.2), then BC1 and BC3, RGBA8 without any of them
+Ktx2TranscodeTarget ktx2TranscodeTarget();
+
+// True if bytes start with the KTX2 file identifier
+bool isKtx2(const unsigned char *bytes, size_t size);
+
+// Layout of a KTX2 container. Throw std::runtime_error if the container is
+// truncated or is not a single 2D image (array, cubemap or 3D texture).
+Ktx2Texture parseKtx2(const unsigned char *bytes, size_t size);
+
+// Decompress the zstd supercompressed levels of texture in a format the viewer
+// uploads, and transcode the BasisLZ supercompressed ETC1S payloads and the
+// UASTC payloads, zstd supercompressed or not, to target. The blocks of a
+// level are decoded and encoded in parallel on the default thread pool. Other
+// payloads are left as they are, for unsupportedReason() to report. bytes are
+// the container texture was parsed from. Throw std::runtime_error if a level
+// is invalid.
+void transcodeKtx2(Ktx2Texture &texture, const unsigned char *bytes,
+    Ktx2TranscodeTarget target);
+
+// Image loader given to tinygltf::TinyGLTF::SetImageLoader(). KTX2 files are
+// kept in image->image as is, with mimeType kKtx2MimeType and the size of
+// level 0, stb_image decodes the other formats.
+bool loadGltfImage(tinygltf::Image *image, const int imageIndex,
+    std::string *err, std::string *warn, int requiredWidth, int requiredHeight,
+    const unsigned char *bytes, int size, void *userData);
@@ -0,0 +1,189 @@
+#include "materials.hpp"
+#include "gl_extensions.hpp"
+#include "gl_state_cache.hpp"
+#include "texture_arrays.hpp"
+
+#include <stdexcept>
+
+MaterialTable::MaterialTable(const tinygltf::Model &model,
+    const std::vector<MaterialTexture> &textureObjects, GLuint whiteTexture) :
+    m_WhiteTexture(whiteTexture)
+{
+  const auto getTexture = [&](int textureIdx) {
+    return textureIdx >= 0 && textureObjects[textureIdx].texture
+               ? textureObjects[textureIdx]
+               : MaterialTexture{whiteTexture, 0};
+  };
+
+  for (const auto &material : model.materials) {
+    const auto &pbrMetallicRoughness = material.pbrMetallicRoughness;
+    GpuMaterial gpuMaterial = {};
+    gpuMaterial.baseColorFactor =
+        glm::vec4(pbrMetallicRoughness.baseColorFactor[0],
+            pbrMetallicRoughness.baseColorFactor[1],
+            pbrMetallicRoughness.baseColorFactor[2],
+            pbrMetallicRoughness.baseColorFactor[3]);
+    gpuMaterial.emissiveFactor = glm::vec3(material.emissiveFactor[0],
+        material.emissiveFactor[1], material.emissiveFactor[2]);
+    gpuMaterial.metallicFactor = float(pbrMetallicRoughness.metallicFactor);
+    gpuMaterial.roughnessFactor = float(pbrMetallicRoughness.roughnessFactor);
+    gpuMaterial.occlusionStrength = float(material.occlusionTexture.strength);
+    gpuMaterial.normalTextureScale = float(material.normalTexture.scale);
+    gpuMaterial.alphaCutoff =
+        material.alphaMode == "MASK" ? float(material.alphaCutoff) : 0.f;
+    m_Materials.emplace_back(gpuMaterial);
+
+    MaterialTextures textures;
+    textures[kBaseColorTextureUnit] =
+        getTexture(pbrMetallicRoughness.baseColorTexture.index);
+    textures[kMetallicRoughnessTextureUnit] =
+        getTexture(pbrMetallicRoughness.metallicRoughnessTexture.index);
+    textures[kEmissiveTextureUnit] = getTexture(material.emissiveTexture.index);
+    textures[kOcclusionTextureUnit] =
+        getTexture(material.occlusionTexture.index);
+    textures[kNormalTextureUnit] = getTexture(material.normalTexture.index);
+    m_Textures.emplace_back(textures);
+  }
+
+  // Default material of the glTF specification
+  GpuMaterial defaultMaterial = {};
+  defaultMaterial.baseColorFactor = glm::vec4(1);
+  defaultMaterial.emissiveFactor = glm::vec3(0);
+  defaultMaterial.metallicFactor = 1.f;
+  defaultMaterial.roughnessFactor = 1.f;
+  defaultMaterial.occlusionStrength = 0.f;
+  defaultMaterial.normalTextureScale = 1.f;
+  defaultMaterial.alphaCutoff = 0.f;
+  m_Materials.emplace_back(defaultMaterial);
+  MaterialTextures defaultTextures;
+  defaultTextures.fill(MaterialTexture{whiteTexture, 0});
+  m_Textures.emplace_back(defaultTextures);
+
+  glGenBuffers(1, &m_BufferObject);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_BufferObject);
+  // Rewritten when the texture mode changes
+  glBufferStorage(GL_SHADER_STORAGE_BUFFER,
+      m_Materials.size() * sizeof(GpuMaterial), m_Materials.data(),
+      GL_DYNAMIC_STORAGE_BIT);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+MaterialTable::~MaterialTable()
+{
+  if (m_TextureMode == kBindlessTextures) {
+    for (const auto &handle : m_TextureHandles) {
+      glExtensions().makeTextureHandleNonResident(handle.second);
+    }
+  }
+  glDeleteBuffers(1, &m_BufferObject);
+}
+
+const char *MaterialTable::textureModeName(MaterialTextureMode mode)
+{
+  static const char *names[kMaterialTextureModeCount] = {
+      "bound textures", "bindless textures", "texture arrays"};
+  return names[mode];
+}
+
+bool MaterialTable::isTextureModeSupported(MaterialTextureMode mode)
+{
+  return mode != kBindlessTextures ||
+         (glExtensions().getTextureSamplerHandle != nullptr &&
+             (glExtensions().gpuShader5NV || glExtensions().shaderBallot));
+}
+
+void MaterialTable::setTextureMode(MaterialTextureMode mode)
+{
+  if (mode == m_TextureMode) {
+    return;
+  }
+  if (!isTextureModeSupported(mode)) {
+    throw std::runtime_error(
+        std::string(textureModeName(mode)) + " are not supported");
+  }
+
+  if (mode == kBindlessTextures && m_TextureHandles.empty()) {
+    // A handle freezes the state of its texture and sampler, which is final
+    // after loading
+    for (const auto &textures : m_Textures) {
+      for (const auto &texture : textures) {
+        if (texture.texture == m_WhiteTexture ||
+            m_TextureHandles.count(texture)) {
+          continue;
+        }
+        m_TextureHandles[texture] =
+            texture.sampler ? glExtensions().getTextureSamplerHandle(
+                                  texture.texture, texture.sampler)
+                            : glExtensions().getTextureHandle(texture.texture);
+      }
+    }
+  }
+  if (mode == kArrayTextures && !m_TextureArrays) {
+    std::vector<MaterialTexture> textures;
+    for (const auto &materialTextures : m_Textures) {
+      for (const auto &texture : materialTextures) {
+        if (texture.texture != m_WhiteTexture) {
+          textures.push_back(texture);
+        }
+      }
+    }
+    m_TextureArrays = std::make_unique<TextureArrays>(textures);
+  }
+
+  // Only resident handles can be read by shaders
+  if (m_TextureMode == kBindlessTextures || mode == kBindlessTextures) {
+    const auto setResidency = mode == kBindlessTextures
+                                  ? glExtensions().makeTextureHandleResident
+                                  : glExtensions().makeTextureHandleNonResident;
+    for (const auto &handle : m_TextureHandles) {
+      setResidency(handle.second);
+    }
+  }
+  m_TextureMode = mode;
+  uploadMaterials();
+}
+
+const std::vector<GLuint> &MaterialTable::textureArrays() const
+{
+  static const std::vector<GLuint> noArrays;
+  return m_TextureMode == kArrayTextures ? m_TextureArrays->arrays()
+                                         : noArrays;
+}
+
+void MaterialTable::bindTextures(GLStateCache &glState, uint32_t i) const
+{
+  if (m_TextureMode != kBoundTextures) {
+    return;
+  }
+  const auto &textures = m_Textures[i];
+  for (GLuint unit = 0; unit < textures.size(); ++unit) {
+    glState.bindTexture(
+        unit, GL_TEXTURE_2D, textures[unit].texture, textures[unit].sampler);
+  }
+}
+
+void MaterialTable::uploadMaterials()
+{
+  for (size_t i = 0; i < m_Materials.size(); ++i) {
+    for (size_t unit = 0; unit < kMaterialTextureUnitCount; ++unit) {
+      const auto &texture = m_Textures[i][unit];
+      const auto isWhite = texture.texture == m_WhiteTexture;
+      auto &reference = m_Materials[i].textures[unit];
+      if (m_TextureMode == kBindlessTextures && !isWhite) {
+        const auto handle = m_TextureHandles.at(texture);
+        reference = glm::uvec2(uint32_t(handle), uint32_t(handle >> 32));
+      } else if (m_TextureMode == kArrayTextures && !isWhite) {
+        const auto layer = m_TextureArrays->layer(texture);
+        reference = glm::uvec2(layer.array, layer.layer);
+      } else if (m_TextureMode == kArrayTextures) {
+        reference = glm::uvec2(kMaxTextureArrays, 0);
+      } else {
+        reference = glm::uvec2(0);
+      }
+    }
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_BufferObject);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+      m_Materials.size() * sizeof(GpuMaterial), m_Materials.data());
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
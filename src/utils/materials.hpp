@@ -0,0 +1,167 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+class GLStateCache;
+class TextureArrays;
+
+// Binding point of the material shader storage buffer, must match the
+// "binding" layout qualifier of the Materials block in the shaders
+const GLuint kMaterialBufferBinding = 0;
+
+// Texture units of the material textures
+enum MaterialTextureUnit
+{
+  kBaseColorTextureUnit = 0,
+  kMetallicRoughnessTextureUnit,
+  kEmissiveTextureUnit,
+  kOcclusionTextureUnit,
+  kNormalTextureUnit,
+  kMaterialTextureUnitCount
+};
+
+// How the shaders reach the material textures
+enum MaterialTextureMode
+{
+  // Each draw binds its textures to the material texture units
+  kBoundTextures = 0,
+  // ARB_bindless_texture handles of resident textures
+  kBindlessTextures,
+  // Layers of texture arrays bound once, see TextureArrays
+  kArrayTextures,
+  kMaterialTextureModeCount
+};
+
+// Factors of a material, std430 layout of the Material struct of the shaders
+struct GpuMaterial
+{
+  glm::vec4 baseColorFactor;
+  glm::vec3 emissiveFactor;
+  float metallicFactor;
+  float roughnessFactor;
+  float occlusionStrength;
+  float normalTextureScale;
+  float alphaCutoff;
+  // Per texture unit, the bindless handle or the (array, layer) pair of the
+  // texture depending on the texture mode. Missing textures are (0, 0) for
+  // handles and (kMaxTextureArrays, 0) for arrays, shaders read them as white.
+  glm::uvec2 textures[kMaterialTextureUnitCount];
+  uint32_t padding[2];
+};
+static_assert(sizeof(GpuMaterial) == 96, "GpuMaterial must match std430");
+
+// Texture object and sampler object of a glTF texture. Textures of the same
+// image share their texture object and textures with the same filters and wrap
+// modes share their sampler object. Sampler 0 samples with the parameters of
+// the texture object.
+struct MaterialTexture
+{
+  GLuint texture = 0;
+  GLuint sampler = 0;
+
+  bool operator==(const MaterialTexture &other) const
+  {
+    return texture == other.texture && sampler == other.sampler;
+  }
+  bool operator!=(const MaterialTexture &other) const
+  {
+    return !(*this == other);
+  }
+  bool operator<(const MaterialTexture &other) const
+  {
+    return std::tie(texture, sampler) < std::tie(other.texture, other.sampler);
+  }
+};
+
+using MaterialTextures = std::array<MaterialTexture, kMaterialTextureUnitCount>;
+
+// All the materials of a model converted once at load time: factors are
+// packed in a shader storage buffer indexed by material, and texture objects
+// are resolved per texture unit. The glTF default material is appended after
+// the materials of the model. Outside of kBoundTextures, the buffer also
+// references the textures and draws don't bind any.
+class MaterialTable
+{
+public:
+  // textureObjects[i] is the texture and sampler of model.textures[i],
+  // missing textures are replaced by whiteTexture and its own parameters
+  MaterialTable(const tinygltf::Model &model,
+      const std::vector<MaterialTexture> &textureObjects, GLuint whiteTexture);
+
+  ~MaterialTable();
+
+  MaterialTable(const MaterialTable &) = delete;
+  MaterialTable &operator=(const MaterialTable &) = delete;
+
+  size_t size() const { return m_Materials.size(); }
+
+  // Index in the table of a glTF material, -1 being the default material
+  uint32_t index(int32_t gltfMaterial) const
+  {
+    return gltfMaterial < 0 ? uint32_t(m_Materials.size() - 1)
+                            : uint32_t(gltfMaterial);
+  }
+
+  const GpuMaterial &material(uint32_t i) const { return m_Materials[i]; }
+
+  const MaterialTextures &textures(uint32_t i) const { return m_Textures[i]; }
+
+  // False if the texture of the unit is the white texture replacing a missing
+  // texture
+  bool hasTexture(uint32_t i, MaterialTextureUnit unit) const
+  {
+    return m_Textures[i][unit].texture != m_WhiteTexture;
+  }
+
+  // Shader storage buffer to bind at kMaterialBufferBinding
+  GLuint bufferObject() const { return m_BufferObject; }
+
+  static const char *textureModeName(MaterialTextureMode mode);
+
+  // False for kBindlessTextures if the context lacks ARB_bindless_texture, or
+  // both NV_gpu_shader5 and ARB_shader_ballot
+  static bool isTextureModeSupported(MaterialTextureMode mode);
+
+  // Create the handles or arrays of the mode on first use and rewrite the
+  // texture references of the buffer. Throw std::runtime_error and keep the
+  // current mode if the mode is unsupported or the arrays can't be built.
+  void setTextureMode(MaterialTextureMode mode);
+  MaterialTextureMode textureMode() const { return m_TextureMode; }
+
+  // Texture arrays of kArrayTextures, to bind from kTextureArrayFirstUnit.
+  // Empty in the other modes.
+  const std::vector<GLuint> &textureArrays() const;
+
+  // Bind the textures of entry i to the material texture units with
+  // kBoundTextures, the other modes bind nothing per draw
+  void bindTextures(GLStateCache &glState, uint32_t i) const;
+
+  // True if draws of entries i and j can share texture binds, which is
+  // always the case outside of kBoundTextures
+  bool sharesTextures(uint32_t i, uint32_t j) const
+  {
+    return m_TextureMode != kBoundTextures || m_Textures[i] == m_Textures[j];
+  }
+
+private:
+  void uploadMaterials();
+
+  std::vector<GpuMaterial> m_Materials;
+  std::vector<MaterialTextures> m_Textures;
+  GLuint m_WhiteTexture;
+  GLuint m_BufferObject = 0;
+
+  MaterialTextureMode m_TextureMode = kBoundTextures;
+  // One handle per pair, a handle freezes the sampling state
+  std::map<MaterialTexture, GLuint64> m_TextureHandles;
+  std::unique_ptr<TextureArrays> m_TextureArrays;
+};
@@ -0,0 +1,186 @@
+#include "merged_geometry.hpp"
+#include "gltf.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <numeric>
+
+namespace {
+struct Vertex
+{
+  glm::vec3 position;
+  glm::vec3 normal;
+  glm::vec2 texCoords;
+  glm::vec3 tangent;
+};
+
+int findAttribute(const tinygltf::Primitive &primitive, const char *name)
+{
+  const auto it = primitive.attributes.find(name);
+  return it != end(primitive.attributes) ? (*it).second : -1;
+}
+
+// Per vertex tangents accumulated from the triangles sharing each vertex
+void computeTangents(const std::vector<uint32_t> &indices, Vertex *vertices,
+    size_t vertexCount)
+{
+  std::vector<glm::vec3> tangents(vertexCount, glm::vec3(0));
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    const auto &v0 = vertices[indices[i]];
+    const auto &v1 = vertices[indices[i + 1]];
+    const auto &v2 = vertices[indices[i + 2]];
+    const auto edge1 = v1.position - v0.position;
+    const auto edge2 = v2.position - v0.position;
+    const auto deltaUV1 = v1.texCoords - v0.texCoords;
+    const auto deltaUV2 = v2.texCoords - v0.texCoords;
+    const auto determinant = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+    if (determinant == 0.f) {
+      continue;
+    }
+    const auto tangent = (deltaUV2.y * edge1 - deltaUV1.y * edge2) / determinant;
+    for (int k = 0; k < 3; ++k) {
+      tangents[indices[i + k]] += tangent;
+    }
+  }
+
+  for (size_t i = 0; i < vertexCount; ++i) {
+    const auto &normal = vertices[i].normal;
+    // Gram-Schmidt, with an arbitrary tangent for vertices without UVs
+    auto tangent = tangents[i] - glm::dot(tangents[i], normal) * normal;
+    if (glm::dot(tangent, tangent) < 1e-12f) {
+      tangent = glm::abs(normal.x) < 0.9f ? glm::cross(normal, glm::vec3(1, 0, 0))
+                                          : glm::cross(normal, glm::vec3(0, 1, 0));
+    }
+    vertices[i].tangent = glm::dot(tangent, tangent) > 0.f
+                              ? glm::normalize(tangent)
+                              : glm::vec3(1, 0, 0);
+  }
+}
+} // namespace
+
+MergedGeometry::MergedGeometry(const tinygltf::Model &model, size_t maxDrawIds)
+{
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+
+  for (const auto &mesh : model.meshes) {
+    m_MeshRangeOffsets.emplace_back(m_Ranges.size());
+    for (const auto &primitive : mesh.primitives) {
+      const auto positions =
+          readVec3Accessor(model, findAttribute(primitive, "POSITION"));
+      const auto normals =
+          readVec3Accessor(model, findAttribute(primitive, "NORMAL"));
+      const auto texCoords =
+          readVec2Accessor(model, findAttribute(primitive, "TEXCOORD_0"));
+      const auto tangents =
+          readVec4Accessor(model, findAttribute(primitive, "TANGENT"));
+      auto primitiveIndices = readPrimitiveIndices(model, primitive);
+      // Indices are relative to baseVertex, past the vertices of the primitive
+      // they would read other primitives or past the vertex buffer
+      if (std::any_of(begin(primitiveIndices), end(primitiveIndices),
+              [&](uint32_t index) { return index >= positions.size(); })) {
+        std::cerr << "Primitive with indices past its " << positions.size()
+                  << " vertices, skipping it." << std::endl;
+        primitiveIndices.clear();
+      }
+
+      Range range;
+      range.firstIndex = GLuint(indices.size());
+      range.indexCount = GLuint(primitiveIndices.size());
+      range.baseVertex = GLint(vertices.size());
+      m_Ranges.emplace_back(range);
+
+      const auto vertexOffset = vertices.size();
+      vertices.resize(vertexOffset + positions.size());
+      auto *primitiveVertices = vertices.data() + vertexOffset;
+      for (size_t i = 0; i < positions.size(); ++i) {
+        auto &vertex = primitiveVertices[i];
+        vertex.position = positions[i];
+        vertex.normal = i < normals.size() ? normals[i] : glm::vec3(0, 0, 1);
+        vertex.texCoords = i < texCoords.size() ? texCoords[i] : glm::vec2(0);
+        vertex.tangent =
+            i < tangents.size() ? glm::vec3(tangents[i]) : glm::vec3(0);
+      }
+      if (tangents.size() < positions.size() &&
+          primitive.mode == TINYGLTF_MODE_TRIANGLES) {
+        computeTangents(primitiveIndices, primitiveVertices, positions.size());
+      }
+
+      indices.insert(end(indices), begin(primitiveIndices), end(primitiveIndices));
+    }
+  }
+  m_VertexCount = vertices.size();
+  m_IndexCount = indices.size();
+
+  std::vector<uint32_t> drawIds(maxDrawIds);
+  std::iota(begin(drawIds), end(drawIds), 0);
+
+  // Immutable buffers, glBufferStorage doesn't accept a size of 0
+  const auto createBuffer = [](GLenum target, size_t size, const void *data) {
+    GLuint buffer = 0;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    glBufferStorage(target, std::max<size_t>(size, 1), size ? data : nullptr, 0);
+    return buffer;
+  };
+
+  glGenVertexArrays(1, &m_VertexArrayObject);
+  glBindVertexArray(m_VertexArrayObject);
+
+  m_VertexBuffer = createBuffer(
+      GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data());
+  const auto setAttribute = [](GLuint location, GLint size, size_t offset) {
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+        (const GLvoid *)offset);
+  };
+  setAttribute(kPositionAttribLocation, 3, offsetof(Vertex, position));
+  setAttribute(kNormalAttribLocation, 3, offsetof(Vertex, normal));
+  setAttribute(kTexCoordsAttribLocation, 2, offsetof(Vertex, texCoords));
+  setAttribute(kTangentAttribLocation, 3, offsetof(Vertex, tangent));
+
+  m_DrawIdBuffer = createBuffer(
+      GL_ARRAY_BUFFER, drawIds.size() * sizeof(uint32_t), drawIds.data());
+  const auto setDrawIdAttribute = [&]() {
+    glBindBuffer(GL_ARRAY_BUFFER, m_DrawIdBuffer);
+    glEnableVertexAttribArray(kDrawIdAttribLocation);
+    glVertexAttribIPointer(
+        kDrawIdAttribLocation, 1, GL_UNSIGNED_INT, sizeof(uint32_t), nullptr);
+    glVertexAttribDivisor(kDrawIdAttribLocation, 1);
+  };
+  setDrawIdAttribute();
+
+  // Captured by the VAO
+  m_IndexBuffer = createBuffer(GL_ELEMENT_ARRAY_BUFFER,
+      indices.size() * sizeof(uint32_t), indices.data());
+
+  std::vector<glm::vec3> positions(vertices.size());
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    positions[i] = vertices[i].position;
+  }
+
+  glGenVertexArrays(1, &m_PositionVertexArrayObject);
+  glBindVertexArray(m_PositionVertexArrayObject);
+
+  m_PositionBuffer = createBuffer(GL_ARRAY_BUFFER,
+      positions.size() * sizeof(glm::vec3), positions.data());
+  glEnableVertexAttribArray(kPositionAttribLocation);
+  glVertexAttribPointer(kPositionAttribLocation, 3, GL_FLOAT, GL_FALSE,
+      sizeof(glm::vec3), nullptr);
+  setDrawIdAttribute();
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+MergedGeometry::~MergedGeometry()
+{
+  const GLuint vertexArrays[] = {
+      m_VertexArrayObject, m_PositionVertexArrayObject};
+  glDeleteVertexArrays(2, vertexArrays);
+  const GLuint buffers[] = {
+      m_VertexBuffer, m_PositionBuffer, m_IndexBuffer, m_DrawIdBuffer};
+  glDeleteBuffers(4, buffers);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// Vertex attribute locations shared by all vertex shaders
+const GLuint kPositionAttribLocation = 0;
+const GLuint kNormalAttribLocation = 1;
+const GLuint kTexCoordsAttribLocation = 2;
+const GLuint kTangentAttribLocation = 3;
+// Integer attribute with divisor 1 read from an identity buffer, so its value
+// is the baseInstance of the draw (+ the instance index). It replaces
+// gl_DrawID, which needs GL 4.6 or ARB_shader_draw_parameters.
+const GLuint kDrawIdAttribLocation = 4;
+
+// All the primitives of a model in a single vertex buffer and a single
+// 32 bits index buffer behind one VAO, so any set of primitives can be drawn
+// with one glMultiDrawElementsIndirect call.
+class MergedGeometry
+{
+public:
+  // Location of a primitive in the merged buffers, in the units of
+  // DrawElementsIndirectCommand
+  struct Range
+  {
+    GLuint firstIndex;
+    GLuint indexCount;
+    GLint baseVertex;
+  };
+
+  // maxDrawIds is the number of values of the draw id attribute, i.e. the
+  // maximum baseInstance + instanceCount of draws
+  MergedGeometry(const tinygltf::Model &model, size_t maxDrawIds);
+
+  ~MergedGeometry();
+
+  MergedGeometry(const MergedGeometry &) = delete;
+  MergedGeometry &operator=(const MergedGeometry &) = delete;
+
+  GLuint vertexArrayObject() const { return m_VertexArrayObject; }
+
+  // Same vertices and indices with only the position and draw id attributes,
+  // positions are tightly packed in their own buffer for depth only passes
+  GLuint positionVertexArrayObject() const
+  {
+    return m_PositionVertexArrayObject;
+  }
+
+  // Range of model.meshes[mesh].primitives[primitive]
+  const Range &range(int mesh, size_t primitive) const
+  {
+    return m_Ranges[m_MeshRangeOffsets[mesh] + primitive];
+  }
+
+  size_t vertexCount() const { return m_VertexCount; }
+  size_t indexCount() const { return m_IndexCount; }
+
+private:
+  std::vector<Range> m_Ranges;
+  std::vector<size_t> m_MeshRangeOffsets;
+  size_t m_VertexCount = 0;
+  size_t m_IndexCount = 0;
+
+  GLuint m_VertexArrayObject = 0;
+  GLuint m_PositionVertexArrayObject = 0;
+  GLuint m_VertexBuffer = 0;
+  GLuint m_PositionBuffer = 0;
+  GLuint m_IndexBuffer = 0;
+  GLuint m_DrawIdBuffer = 0;
+};
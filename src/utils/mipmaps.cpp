@@ -0,0 +1,272 @@
+#include "mipmaps.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+// Changing the filters must change the keys of the cache
+const uint32_t kMipmapVersion = 1;
+
+struct ChainHeader
+{
+  char magic[4];
+  uint32_t levelCount; // Stored levels, from level 1
+};
+
+const char kChainMagic[4] = {'M', 'I', 'P', 'S'};
+
+float srgbToLinear(float c)
+{
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+// Linear value of each sRGB byte
+const std::array<float, 256> &srgbDecodeTable()
+{
+  static const auto table = []() {
+    std::array<float, 256> table;
+    for (int i = 0; i < 256; ++i) {
+      table[i] = srgbToLinear(i / 255.f);
+    }
+    return table;
+  }();
+  return table;
+}
+
+// Linear values half way between the decoded values of consecutive bytes:
+// encoding picks the byte whose decoded value is the closest
+const std::array<float, 255> &srgbEncodeThresholds()
+{
+  static const auto thresholds = []() {
+    const auto &decode = srgbDecodeTable();
+    std::array<float, 255> thresholds;
+    for (int i = 0; i < 255; ++i) {
+      thresholds[i] = 0.5f * (decode[i] + decode[i + 1]);
+    }
+    return thresholds;
+  }();
+  return thresholds;
+}
+
+uint8_t encodeLinear(float value)
+{
+  return uint8_t(std::min(std::max(value, 0.f), 1.f) * 255.f + 0.5f);
+}
+
+uint8_t encodeSRGB(float value)
+{
+  const auto &thresholds = srgbEncodeThresholds();
+  return uint8_t(std::upper_bound(begin(thresholds), end(thresholds), value) -
+                 begin(thresholds));
+}
+
+// Fraction of the texels whose alpha, scaled, passes the alpha test
+float alphaCoverage(
+    const std::vector<float> &texels, float cutoff, float alphaScale)
+{
+  size_t passingCount = 0;
+  for (size_t i = 3; i < texels.size(); i += 4) {
+    passingCount += texels[i] * alphaScale >= cutoff ? 1 : 0;
+  }
+  return float(passingCount) / float(texels.size() / 4);
+}
+
+// FNV-1a on 64 bits words, the image is hashed for each texture
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size)
+{
+  const auto bytes = static_cast<const unsigned char *>(data);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, bytes + i, 8);
+    hash = (hash ^ word) * 1099511628211ull;
+  }
+  for (; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+} // namespace
+
+int mipLevelCount(int width, int height)
+{
+  auto levelCount = 1;
+  while ((std::max(width, height) >> levelCount) > 0) {
+    ++levelCount;
+  }
+  return levelCount;
+}
+
+MipLevels generateMipmaps(
+    const uint8_t *pixels, int width, int height, const MipmapOptions &options)
+{
+  // Levels are filtered from the linear float texels of the previous level,
+  // rounding happens once per level
+  const auto &decode = srgbDecodeTable();
+  std::vector<float> texels(size_t(width) * height * 4);
+  for (size_t i = 0; i < texels.size(); ++i) {
+    texels[i] =
+        options.isSRGB && i % 4 != 3 ? decode[pixels[i]] : pixels[i] / 255.f;
+  }
+  const auto hasAlphaTest = options.alphaCutoff >= 0.f;
+  const auto coverage =
+      hasAlphaTest ? alphaCoverage(texels, options.alphaCutoff, 1.f) : 0.f;
+
+  MipLevels levels;
+  std::vector<float> nextTexels;
+  const auto levelCount = mipLevelCount(width, height);
+  for (auto level = 1; level < levelCount; ++level) {
+    const auto nextWidth = std::max(width / 2, 1);
+    const auto nextHeight = std::max(height / 2, 1);
+    nextTexels.resize(size_t(nextWidth) * nextHeight * 4);
+    for (auto y = 0; y < nextHeight; ++y) {
+      const auto row0 = texels.data() + size_t(2 * y) * width * 4;
+      const auto row1 =
+          texels.data() + size_t(std::min(2 * y + 1, height - 1)) * width * 4;
+      const auto nextRow = nextTexels.data() + size_t(y) * nextWidth * 4;
+      for (auto x = 0; x < nextWidth; ++x) {
+        const auto x0 = size_t(2 * x) * 4;
+        const auto x1 = size_t(std::min(2 * x + 1, width - 1)) * 4;
+        const auto sum = Float4::loadUnaligned(row0 + x0) +
+                         Float4::loadUnaligned(row0 + x1) +
+                         Float4::loadUnaligned(row1 + x0) +
+                         Float4::loadUnaligned(row1 + x1);
+        (sum * Float4(0.25f)).storeUnaligned(nextRow + size_t(x) * 4);
+      }
+    }
+    texels.swap(nextTexels);
+    width = nextWidth;
+    height = nextHeight;
+
+    // Bisection of the alpha scale restoring the coverage of the image. The
+    // chain keeps the unscaled alpha, each level is scaled on its own.
+    auto alphaScale = 1.f;
+    if (hasAlphaTest && options.alphaCutoff > 0.f) {
+      // Coverage is a step function of the scale, the closest of the bounds
+      // is kept
+      auto minScale = 0.f, maxScale = 4.f;
+      for (auto i = 0; i < 10; ++i) {
+        const auto scale = 0.5f * (minScale + maxScale);
+        if (alphaCoverage(texels, options.alphaCutoff, scale) < coverage) {
+          minScale = scale;
+        } else {
+          maxScale = scale;
+        }
+      }
+      const auto minError = coverage -
+          alphaCoverage(texels, options.alphaCutoff, minScale);
+      const auto maxError =
+          alphaCoverage(texels, options.alphaCutoff, maxScale) - coverage;
+      alphaScale = minError < maxError ? minScale : maxScale;
+    }
+
+    levels.emplace_back(texels.size());
+    auto &levelPixels = levels.back();
+    for (size_t i = 0; i < texels.size(); i += 4) {
+      for (size_t c = 0; c < 3; ++c) {
+        levelPixels[i + c] = options.isSRGB ? encodeSRGB(texels[i + c])
+                                            : encodeLinear(texels[i + c]);
+      }
+      levelPixels[i + 3] = encodeLinear(texels[i + 3] * alphaScale);
+    }
+  }
+  return levels;
+}
+
+MipmapCache::MipmapCache(fs::path directory) : m_Directory(std::move(directory))
+{
+  std::error_code error;
+  fs::create_directories(m_Directory, error);
+  if (error) {
+    std::cerr << "Mipmap cache disabled, unable to create " << m_Directory
+              << ": " << error.message() << std::endl;
+    return;
+  }
+  m_IsSupported = true;
+}
+
+uint64_t MipmapCache::key(const uint8_t *pixels, int width, int height,
+    const MipmapOptions &options) const
+{
+  auto hash = 14695981039346656037ull;
+  const int32_t parameters[] = {int32_t(kMipmapVersion), width, height,
+      options.isSRGB ? 1 : 0};
+  hash = hashBytes(hash, parameters, sizeof(parameters));
+  hash = hashBytes(hash, &options.alphaCutoff, sizeof(options.alphaCutoff));
+  return hashBytes(hash, pixels, size_t(width) * height * 4);
+}
+
+fs::path MipmapCache::binaryPath(uint64_t key) const
+{
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.mips", (unsigned long long)key);
+  return m_Directory / name;
+}
+
+bool MipmapCache::load(
+    uint64_t key, int width, int height, MipLevels &levels) const
+{
+  if (!m_IsSupported) {
+    return false;
+  }
+  std::ifstream input(binaryPath(key).string(), std::ios::binary);
+  ChainHeader header;
+  if (!input.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      !std::equal(kChainMagic, kChainMagic + 4, header.magic) ||
+      int(header.levelCount) != mipLevelCount(width, height) - 1) {
+    return false;
+  }
+  levels.resize(header.levelCount);
+  for (auto &level : levels) {
+    width = std::max(width / 2, 1);
+    height = std::max(height / 2, 1);
+    level.resize(size_t(width) * height * 4);
+    input.read(reinterpret_cast<char *>(level.data()),
+        std::streamsize(level.size()));
+  }
+  if (!input) {
+    levels.clear();
+    return false;
+  }
+  return true;
+}
+
+void MipmapCache::store(uint64_t key, const MipLevels &levels) const
+{
+  if (!m_IsSupported) {
+    return;
+  }
+  ChainHeader header;
+  std::copy(kChainMagic, kChainMagic + 4, header.magic);
+  header.levelCount = uint32_t(levels.size());
+
+  // Written aside then renamed, readers never see a partial file
+  const auto path = binaryPath(key);
+  const auto tmpPath = uniqueTempPath(path);
+  {
+    std::ofstream output(tmpPath.string(), std::ios::binary);
+    output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const auto &level : levels) {
+      output.write(reinterpret_cast<const char *>(level.data()),
+          std::streamsize(level.size()));
+    }
+    if (!output) {
+      std::cerr << "Unable to write mip chain " << tmpPath << std::endl;
+      output.close();
+      std::error_code error;
+      fs::remove(tmpPath, error);
+      return;
+    }
+  }
+  std::error_code error;
+  fs::rename(tmpPath, path, error);
+  if (error) {
+    fs::remove(tmpPath, error);
+  }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <cstdint>
+#include <vector>
+
+struct MipmapOptions
+{
+  // The RGB channels are sRGB encoded, they are decoded before filtering and
+  // encoded again. Alpha is always linear.
+  bool isSRGB = false;
+  // With a cutoff >= 0, the alpha of each level is scaled so that the
+  // fraction of texels passing the alpha test is the one of the image, masked
+  // materials don't fade out with distance
+  float alphaCutoff = -1.f;
+};
+
+// Levels of a mip chain, from the largest
+using MipLevels = std::vector<std::vector<uint8_t>>;
+
+// Number of levels of a full mip chain, down to 1x1
+int mipLevelCount(int width, int height);
+
+// Levels 1 to mipLevelCount() - 1 of a RGBA8 image, computed with a box
+// filter in linear space. Each level has half the size of the previous one,
+// rounded down; a last odd row or column is ignored.
+MipLevels generateMipmaps(
+    const uint8_t *pixels, int width, int height, const MipmapOptions &options);
+
+// Mip chains stored on disk by previous runs, keyed by a hash of the image and
+// of the options, so edited images miss the cache. load() and store() may be
+// called concurrently.
+class MipmapCache
+{
+public:
+  // The directory is created if needed
+  explicit MipmapCache(fs::path directory);
+
+  uint64_t key(const uint8_t *pixels, int width, int height,
+      const MipmapOptions &options) const;
+
+  // False if there is no chain for key, or if it doesn't have the levels of
+  // a width x height image
+  bool load(uint64_t key, int width, int height, MipLevels &levels) const;
+
+  void store(uint64_t key, const MipLevels &levels) const;
+
+private:
+  fs::path binaryPath(uint64_t key) const;
+
+  fs::path m_Directory;
+  bool m_IsSupported = false;
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+inline size_t workerThreadCount()
+{
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Persistent worker threads executing parallel loops.
+// The thread calling parallelFor() takes part in the loop, so a pool with N
+// workers runs loops on N + 1 threads, and a pool without workers runs them
+// serially. Several threads may call parallelFor() concurrently.
+class ThreadPool
+{
+public:
+  explicit ThreadPool(size_t workerCount = workerThreadCount() - 1)
+  {
+    for (size_t i = 0; i < workerCount; ++i) {
+      m_Workers.emplace_back([this]() { workerLoop(); });
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Stop = true;
+    }
+    m_TaskAvailable.notify_all();
+    for (auto &worker : m_Workers) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Number of threads running a loop, the calling thread included
+  size_t threadCount() const { return m_Workers.size() + 1; }
+
+  // Split [begin, end) in chunks of grainSize indices and call
+  // f(chunkBegin, chunkEnd) for each chunk. Return when all chunks are done.
+  template <typename Function>
+  void parallelFor(size_t begin, size_t end, size_t grainSize, Function &&f)
+  {
+    if (begin >= end) {
+      return;
+    }
+    grainSize = std::max<size_t>(grainSize, 1);
+    const auto chunkCount = (end - begin + grainSize - 1) / grainSize;
+    if (chunkCount == 1 || m_Workers.empty()) {
+      f(begin, end);
+      return;
+    }
+
+    // Shared with the helper tasks that may start after this call returned,
+    // in which case they find no chunk left and never call f
+    struct Job
+    {
+      std::atomic<size_t> nextChunk{0};
+      std::atomic<size_t> remainingChunks;
+      std::mutex mutex;
+      std::condition_variable done;
+    };
+    const auto job = std::make_shared<Job>();
+    job->remainingChunks = chunkCount;
+
+    const std::function<void(size_t, size_t)> chunkFunction = std::ref(f);
+    const auto work = [job, chunkCount, begin, end, grainSize,
+                          &chunkFunction]() {
+      for (auto chunk = job->nextChunk++; chunk < chunkCount;
+           chunk = job->nextChunk++) {
+        const auto chunkBegin = begin + chunk * grainSize;
+        chunkFunction(chunkBegin, std::min(end, chunkBegin + grainSize));
+        if (--job->remainingChunks == 0) {
+          std::lock_guard<std::mutex> lock(job->mutex);
+          job->done.notify_all();
+        }
+      }
+    };
+
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      const auto helperCount = std::min(m_Workers.size(), chunkCount - 1);
+      for (size_t i = 0; i < helperCount; ++i) {
+        // chunkFunction is only used while chunks remain, i.e. before this
+        // call returns
+        m_Tasks.emplace_back(work);
+      }
+    }
+    m_TaskAvailable.notify_all();
+
+    work();
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->done.wait(lock, [&]() { return job->remainingChunks == 0; });
+  }
+
+private:
+  void workerLoop()
+  {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_TaskAvailable.wait(
+            lock, [this]() { return m_Stop || !m_Tasks.empty(); });
+        if (m_Stop && m_Tasks.empty()) {
+          return;
+        }
+        task = std::move(m_Tasks.front());
+        m_Tasks.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> m_Workers;
+  std::deque<std::function<void()>> m_Tasks;
+  std::mutex m_Mutex;
+  std::condition_variable m_TaskAvailable;
+  bool m_Stop = false;
+};
+
+// Pool shared by the whole application, with one worker less than the number
+// of hardware threads
+inline ThreadPool &defaultThreadPool()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+// Call f(i) for each i in [begin, end) on the default thread pool. Indices are
+// handed out one at a time so tasks of uneven cost (e.g. meshes of different
+// sizes) are balanced between threads.
+template <typename Function>
+void parallelFor(size_t begin, size_t end, Function &&f)
+{
+  defaultThreadPool().parallelFor(begin, end, 1, [&](size_t b, size_t e) {
+    for (auto i = b; i < e; ++i) {
+      f(i);
+    }
+  });
+}
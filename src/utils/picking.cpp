@@ -0,0 +1,194 @@
+#include "picking.hpp"
+#include "gltf.hpp"
+#include "parallel.hpp"
+
+// Local space bounds of a mesh from the min/max of its POSITION accessors
+static bool getMeshBounds(const tinygltf::Model &model,
+    const tinygltf::Mesh &mesh, glm::vec3 &bboxMin, glm::vec3 &bboxMax)
+{
+  bboxMin = glm::vec3(std::numeric_limits<float>::max());
+  bboxMax = glm::vec3(std::numeric_limits<float>::lowest());
+  for (const auto &primitive : mesh.primitives) {
+    const auto positionAttrIdxIt = primitive.attributes.find("POSITION");
+    if (positionAttrIdxIt == end(primitive.attributes)) {
+      continue;
+    }
+    const auto &accessor = model.accessors[(*positionAttrIdxIt).second];
+    if (accessor.minValues.size() != 3 || accessor.maxValues.size() != 3) {
+      return false;
+    }
+    bboxMin = glm::min(bboxMin, glm::vec3(accessor.minValues[0],
+                                    accessor.minValues[1], accessor.minValues[2]));
+    bboxMax = glm::max(bboxMax, glm::vec3(accessor.maxValues[0],
+                                    accessor.maxValues[1], accessor.maxValues[2]));
+  }
+  return true;
+}
+
+ScenePicker::ScenePicker(
+    const tinygltf::Model &model, const SceneGraph &sceneGraph) :
+    m_Model(model), m_MeshBVHs(model.meshes.size())
+{
+  std::vector<glm::vec3> meshMin(model.meshes.size()),
+      meshMax(model.meshes.size());
+  std::vector<bool> hasMeshBounds(model.meshes.size());
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    hasMeshBounds[meshIdx] = getMeshBounds(
+        model, model.meshes[meshIdx], meshMin[meshIdx], meshMax[meshIdx]);
+  }
+
+  for (const auto sceneNodeIdx : sceneGraph.meshNodes()) {
+    const auto meshIdx = sceneGraph.mesh(sceneNodeIdx);
+    const auto nodeIdx = sceneGraph.gltfNode(sceneNodeIdx);
+    // EXT_mesh_gpu_instancing, one instance per matrix, placed like the draws
+    // of the node
+    auto instanceMatrices = readMeshInstances(model, model.nodes[nodeIdx]);
+    const auto hasInstances = !instanceMatrices.empty();
+    if (!hasInstances) {
+      instanceMatrices.emplace_back(1.f);
+    }
+    for (size_t instanceIdx = 0; instanceIdx < instanceMatrices.size();
+         ++instanceIdx) {
+      const auto modelMatrix =
+          sceneGraph.worldMatrix(sceneNodeIdx) * instanceMatrices[instanceIdx];
+      Instance instance;
+      instance.node = nodeIdx;
+      instance.mesh = meshIdx;
+      instance.instance = hasInstances ? int(instanceIdx) : -1;
+      instance.worldToLocal = glm::inverse(modelMatrix);
+      // Without accessor bounds, the box is infinite and the BVH does all the
+      // work
+      instance.bboxMin = glm::vec3(std::numeric_limits<float>::lowest());
+      instance.bboxMax = glm::vec3(std::numeric_limits<float>::max());
+      if (hasMeshBounds[meshIdx]) {
+        const auto &localMin = meshMin[meshIdx];
+        const auto &localMax = meshMax[meshIdx];
+        instance.bboxMin = glm::vec3(std::numeric_limits<float>::max());
+        instance.bboxMax = glm::vec3(std::numeric_limits<float>::lowest());
+        for (int corner = 0; corner < 8; ++corner) {
+          const auto localCorner =
+              glm::vec3(corner & 1 ? localMax.x : localMin.x,
+                  corner & 2 ? localMax.y : localMin.y,
+                  corner & 4 ? localMax.z : localMin.z);
+          const auto worldCorner =
+              glm::vec3(modelMatrix * glm::vec4(localCorner, 1.f));
+          instance.bboxMin = glm::min(instance.bboxMin, worldCorner);
+          instance.bboxMax = glm::max(instance.bboxMax, worldCorner);
+        }
+      }
+      m_Instances.emplace_back(instance);
+    }
+  }
+
+  // Only build the BVHs of meshes that are actually instantiated
+  std::vector<bool> isMeshUsed(model.meshes.size(), false);
+  std::vector<glm::vec3> boxMin, boxMax;
+  for (uint32_t i = 0; i < m_Instances.size(); ++i) {
+    const auto &instance = m_Instances[i];
+    isMeshUsed[instance.mesh] = true;
+    // Meshes without positions have an empty box, it stays out of the BVH
+    const auto isFinite = glm::all(glm::lessThanEqual(
+        glm::abs(instance.bboxMax - instance.bboxMin),
+        glm::vec3(std::numeric_limits<float>::max())));
+    if (hasMeshBounds[instance.mesh] && isFinite &&
+        glm::all(glm::lessThanEqual(instance.bboxMin, instance.bboxMax))) {
+      m_BoundedInstances.emplace_back(i);
+      boxMin.emplace_back(instance.bboxMin);
+      boxMax.emplace_back(instance.bboxMax);
+    } else {
+      m_UnboundedInstances.emplace_back(i);
+    }
+  }
+  m_BuildDone = std::async(std::launch::async,
+      [this, isMeshUsed, boxMin = std::move(boxMin),
+          boxMax = std::move(boxMax)]() {
+        parallelFor(0, m_MeshBVHs.size() + 1, [&](size_t i) {
+          if (i == m_MeshBVHs.size()) {
+            m_InstanceBVH = BoxBVH(boxMin, boxMax);
+          } else if (isMeshUsed[i]) {
+            m_MeshBVHs[i] = MeshBVH(m_Model, m_Model.meshes[i]);
+          }
+        });
+      }).share();
+}
+
+ScenePicker::~ScenePicker()
+{
+  if (m_BuildDone.valid()) {
+    m_BuildDone.wait();
+  }
+}
+
+bool ScenePicker::isReady() const
+{
+  return m_BuildDone.wait_for(std::chrono::seconds(0)) ==
+         std::future_status::ready;
+}
+
+bool ScenePicker::pick(const glm::vec2 &windowCoords,
+    const glm::vec2 &windowSize, const Camera &camera,
+    const glm::mat4 &projMatrix, PickResult &result) const
+{
+  // Unproject the cursor on the near and far planes
+  const auto ndc = glm::vec2(2.f * windowCoords.x / windowSize.x - 1.f,
+      1.f - 2.f * windowCoords.y / windowSize.y);
+  const auto clipToWorld = glm::inverse(projMatrix * camera.getViewMatrix());
+  const auto nearPoint = clipToWorld * glm::vec4(ndc, -1.f, 1.f);
+  const auto farPoint = clipToWorld * glm::vec4(ndc, 1.f, 1.f);
+
+  Ray ray;
+  ray.origin = glm::vec3(nearPoint) / nearPoint.w;
+  ray.direction = glm::vec3(farPoint) / farPoint.w - ray.origin;
+
+  if (!intersect(ray, result)) {
+    return false;
+  }
+  result.distance = glm::distance(camera.eye(), result.position);
+  return true;
+}
+
+bool ScenePicker::intersect(const Ray &ray, PickResult &result) const
+{
+  m_BuildDone.wait();
+
+  TriangleHit closestHit;
+  const Instance *closestInstance = nullptr;
+  for (const auto instanceIdx : m_UnboundedInstances) {
+    if (intersectInstance(ray, m_Instances[instanceIdx], closestHit)) {
+      closestInstance = &m_Instances[instanceIdx];
+    }
+  }
+  // Front to back, the boxes behind the closest hit are skipped
+  m_InstanceBVH.traverse(ray, closestHit.t, [&](uint32_t box) {
+    const auto &instance = m_Instances[m_BoundedInstances[box]];
+    if (intersectInstance(ray, instance, closestHit)) {
+      closestInstance = &instance;
+    }
+    return closestHit.t;
+  });
+
+  if (!closestInstance) {
+    return false;
+  }
+  result.node = closestInstance->node;
+  result.mesh = closestInstance->mesh;
+  result.instance = closestInstance->instance;
+  result.primitive = closestHit.primitive;
+  result.triangle = closestHit.triangle;
+  result.barycentrics = closestHit.barycentrics;
+  result.position = ray.origin + closestHit.t * ray.direction;
+  result.distance = closestHit.t * glm::length(ray.direction);
+  return true;
+}
+
+bool ScenePicker::intersectInstance(
+    const Ray &ray, const Instance &instance, TriangleHit &hit) const
+{
+  // The ray direction is not renormalized so t is the same in both spaces
+  Ray localRay;
+  localRay.origin =
+      glm::vec3(instance.worldToLocal * glm::vec4(ray.origin, 1.f));
+  localRay.direction =
+      glm::vec3(instance.worldToLocal * glm::vec4(ray.direction, 0.f));
+  return m_MeshBVHs[instance.mesh].intersect(localRay, hit);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "bvh.hpp"
+#include "cameras.hpp"
+#include "scene_graph.hpp"
+
+#include <future>
+
+struct PickResult
+{
+  int node = -1;      // Index in model.nodes
+  int mesh = -1;      // Index in model.meshes
+  // Index in the EXT_mesh_gpu_instancing instances of the node, -1 if the node
+  // doesn't use the extension
+  int instance = -1;
+  int primitive = -1; // Index in model.meshes[mesh].primitives
+  int triangle = -1;  // Index of the triangle in the primitive
+  // Weights of the second and third vertices of the triangle
+  glm::vec2 barycentrics = glm::vec2(0);
+  glm::vec3 position = glm::vec3(0); // World space position of the hit
+  float distance = 0.f;              // Distance from the camera eye
+};
+
+// Ray casting against the default scene of a model, for click-to-select and
+// "what is under the cursor" queries.
+// Each mesh gets a MeshBVH built once and shared by all the nodes referencing
+// it; nodes, and each EXT_mesh_gpu_instancing instance of a node, are then
+// tested in their local space. A BoxBVH over the world boxes of the instances
+// finds the ones to test, nearest first.
+class ScenePicker
+{
+public:
+  // Start building the BVHs of all meshes on worker threads. Nodes are placed
+  // with the current world matrices of the scene graph. The model must outlive
+  // the picker.
+  ScenePicker(const tinygltf::Model &model, const SceneGraph &sceneGraph);
+
+  ~ScenePicker();
+
+  ScenePicker(const ScenePicker &) = delete;
+  ScenePicker &operator=(const ScenePicker &) = delete;
+
+  // True once all BVHs are built, pick() doesn't block anymore
+  bool isReady() const;
+
+  // Cast a ray from the camera through windowCoords (in pixels, origin at the
+  // top left corner of the window) and return true if something is hit.
+  // Blocks until the BVHs are built.
+  bool pick(const glm::vec2 &windowCoords, const glm::vec2 &windowSize,
+      const Camera &camera, const glm::mat4 &projMatrix,
+      PickResult &result) const;
+
+  // Find the closest hit of a world space ray
+  bool intersect(const Ray &ray, PickResult &result) const;
+
+private:
+  struct Instance
+  {
+    int node;
+    int mesh;
+    int instance;
+    glm::mat4 worldToLocal;
+    glm::vec3 bboxMin, bboxMax; // World space bounds
+  };
+
+  // Test an instance, return true and update hit if it is hit before hit.t
+  bool intersectInstance(
+      const Ray &ray, const Instance &instance, TriangleHit &hit) const;
+
+  const tinygltf::Model &m_Model;
+  std::vector<Instance> m_Instances;
+  std::vector<MeshBVH> m_MeshBVHs;
+  // Over the instances with bounds, the others are always tested
+  BoxBVH m_InstanceBVH;
+  std::vector<uint32_t> m_BoundedInstances; // Instance of each box
+  std::vector<uint32_t> m_UnboundedInstances;
+  std::shared_future<void> m_BuildDone;
+};
@@ -0,0 +1,243 @@
+#include "program_cache.hpp"
+#include "shaders.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace {
+// Header of the binary files, followed by the binary
+struct BinaryHeader
+{
+  char magic[4];
+  uint32_t binaryFormat;
+  uint64_t binarySize;
+  double compileSeconds;
+};
+
+const char kBinaryMagic[4] = {'G', 'L', 'P', 'B'};
+
+// FNV-1a
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size)
+{
+  const auto bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+// Strings are hashed with their terminating null, so that consecutive strings
+// can't be split differently
+uint64_t hashString(uint64_t hash, const std::string &str)
+{
+  return hashBytes(hash, str.c_str(), str.size() + 1);
+}
+
+const uint64_t kHashSeed = 14695981039346656037ull;
+
+std::string glString(GLenum name)
+{
+  const auto str = glGetString(name);
+  return str ? reinterpret_cast<const char *>(str) : "";
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+std::unique_ptr<ProgramBinaryCache> &programBinaryCacheInstance()
+{
+  static std::unique_ptr<ProgramBinaryCache> cache;
+  return cache;
+}
+} // namespace
+
+ProgramBinaryCache::ProgramBinaryCache(fs::path directory) :
+    m_Directory(std::move(directory))
+{
+  GLint formatCount = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+  m_IsSupported = formatCount > 0;
+  if (!m_IsSupported) {
+    return;
+  }
+
+  std::error_code error;
+  fs::create_directories(m_Directory, error);
+  if (error) {
+    std::cerr << "Program binary cache disabled, unable to create "
+              << m_Directory << ": " << error.message() << std::endl;
+    m_IsSupported = false;
+    return;
+  }
+
+  m_DriverHash = kHashSeed;
+  for (const auto name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    m_DriverHash = hashString(m_DriverHash, glString(name));
+  }
+}
+
+uint64_t ProgramBinaryCache::key(const std::vector<ShaderSource> &shaderSources,
+    const std::vector<std::string> &defines) const
+{
+  auto hash = m_DriverHash;
+  for (const auto &shaderSource : shaderSources) {
+    // The file name gives the shader stage
+    hash = hashString(hash, shaderSource.path.filename().string());
+    hash = hashString(hash, shaderSource.source);
+  }
+  hash = hashBytes(hash, "defines", 8);
+  for (const auto &define : defines) {
+    const auto isReferenced = std::any_of(begin(shaderSources),
+        end(shaderSources), [&](const ShaderSource &shaderSource) {
+          return shaderSource.source.find(define) != std::string::npos;
+        });
+    if (isReferenced) {
+      hash = hashString(hash, define);
+    }
+  }
+  return hash;
+}
+
+fs::path ProgramBinaryCache::binaryPath(uint64_t key) const
+{
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+  return m_Directory / name;
+}
+
+bool ProgramBinaryCache::load(uint64_t key, GLuint program)
+{
+  if (!m_IsSupported) {
+    return false;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  const auto path = binaryPath(key);
+  std::ifstream input(path.string(), std::ios::binary);
+  if (!input) {
+    return false;
+  }
+
+  // The binary size of the header is only trusted if it matches the file,
+  // a corrupted one would otherwise make the allocation fail
+  std::error_code sizeError;
+  const auto fileSize = fs::file_size(path, sizeError);
+  BinaryHeader header;
+  std::vector<char> binary;
+  auto isValid = false;
+  if (!sizeError &&
+      input.read(reinterpret_cast<char *>(&header), sizeof(header)) &&
+      std::equal(kBinaryMagic, kBinaryMagic + 4, header.magic) &&
+      header.binarySize == fileSize - sizeof(header)) {
+    binary.resize(size_t(header.binarySize));
+    isValid = bool(input.read(binary.data(), std::streamsize(binary.size())));
+  }
+  auto isLinked = false;
+  if (isValid) {
+    glProgramBinary(
+        program, header.binaryFormat, binary.data(), GLsizei(binary.size()));
+    GLint linkStatus = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+    isLinked = linkStatus == GL_TRUE;
+  }
+  input.close();
+
+  std::lock_guard<std::mutex> lock(m_StatsMutex);
+  // Truncated or corrupted files and binaries of another driver build are
+  // replaced
+  if (!isLinked) {
+    ++m_Stats.rejectedCount;
+    std::error_code error;
+    fs::remove(path, error);
+    return false;
+  }
+  ++m_Stats.loadedCount;
+  m_Stats.loadSeconds += secondsSince(start);
+  m_Stats.loadedCompileSeconds += header.compileSeconds;
+  return true;
+}
+
+void ProgramBinaryCache::store(
+    uint64_t key, GLuint program, double compileSeconds)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_StatsMutex);
+    ++m_Stats.compiledCount;
+    m_Stats.compileSeconds += compileSeconds;
+  }
+  if (!m_IsSupported) {
+    return;
+  }
+
+  GLint binarySize = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+  if (binarySize <= 0) {
+    return;
+  }
+  std::vector<char> binary(binarySize);
+  BinaryHeader header;
+  std::copy(kBinaryMagic, kBinaryMagic + 4, header.magic);
+  GLenum binaryFormat = 0;
+  glGetProgramBinary(
+      program, binarySize, nullptr, &binaryFormat, binary.data());
+  header.binaryFormat = binaryFormat;
+  header.binarySize = uint64_t(binary.size());
+  header.compileSeconds = compileSeconds;
+
+  // Written aside then renamed, readers never see a partial file
+  const auto path = binaryPath(key);
+  const auto tmpPath = uniqueTempPath(path);
+  {
+    std::ofstream output(tmpPath.string(), std::ios::binary);
+    output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    output.write(binary.data(), std::streamsize(binary.size()));
+    if (!output) {
+      std::cerr << "Unable to write program binary " << tmpPath << std::endl;
+      output.close();
+      std::error_code error;
+      fs::remove(tmpPath, error);
+      return;
+    }
+  }
+  std::error_code error;
+  fs::rename(tmpPath, path, error);
+  if (error) {
+    fs::remove(tmpPath, error);
+  }
+}
+
+std::string ProgramBinaryCache::statsSummary() const
+{
+  std::lock_guard<std::mutex> lock(m_StatsMutex);
+  char summary[256];
+  if (!m_IsSupported) {
+    std::snprintf(summary, sizeof(summary),
+        "Program binary cache unsupported: %zu programs compiled in %.1f ms",
+        m_Stats.compiledCount, m_Stats.compileSeconds * 1e3);
+    return summary;
+  }
+  std::snprintf(summary, sizeof(summary),
+      "Program binary cache: %zu programs loaded in %.1f ms (%.1f ms of "
+      "compilation saved), %zu compiled in %.1f ms, %zu binaries rejected",
+      m_Stats.loadedCount, m_Stats.loadSeconds * 1e3,
+      (m_Stats.loadedCompileSeconds - m_Stats.loadSeconds) * 1e3,
+      m_Stats.compiledCount, m_Stats.compileSeconds * 1e3,
+      m_Stats.rejectedCount);
+  return summary;
+}
+
+ProgramBinaryCache *programBinaryCache()
+{
+  return programBinaryCacheInstance().get();
+}
+
+void enableProgramBinaryCache(const fs::path &directory)
+{
+  programBinaryCacheInstance() = std::make_unique<ProgramBinaryCache>(directory);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ShaderSource; // shaders.hpp
+
+// Linked programs stored on disk with glGetProgramBinary() and restored with
+// glProgramBinary() by later runs. A binary is keyed by a hash of the shader
+// sources, the defines and the GL vendor, renderer and version strings, so
+// any change of the shaders or of the driver misses the cache. Binaries the
+// driver rejects are deleted and the program is compiled from sources.
+// Defines that no shader mentions are left out of the key, so permutations
+// differing only by them share a binary. load() and store() may be called
+// concurrently by threads with their own shared context.
+class ProgramBinaryCache
+{
+public:
+  struct Stats
+  {
+    size_t loadedCount = 0;   // Programs restored from binaries
+    size_t compiledCount = 0; // Programs compiled from sources
+    size_t rejectedCount = 0; // Binaries rejected by the driver, compiled
+    double loadSeconds = 0.;
+    double compileSeconds = 0.;
+    // Compile time of the loaded programs, recorded when they were stored
+    double loadedCompileSeconds = 0.;
+  };
+
+  // The directory is created if needed. The OpenGL context must be current.
+  explicit ProgramBinaryCache(fs::path directory);
+
+  // False if the driver has no binary format, the cache never loads nor
+  // stores anything
+  bool isSupported() const { return m_IsSupported; }
+
+  uint64_t key(const std::vector<ShaderSource> &shaderSources,
+      const std::vector<std::string> &defines) const;
+
+  // Restore the binary of key in program, false if there is none or if the
+  // driver rejected it
+  bool load(uint64_t key, GLuint program);
+
+  // Store the binary of a program linked with
+  // GL_PROGRAM_BINARY_RETRIEVABLE_HINT, compileSeconds is the time spent
+  // compiling and linking it
+  void store(uint64_t key, GLuint program, double compileSeconds);
+
+  Stats stats() const
+  {
+    std::lock_guard<std::mutex> lock(m_StatsMutex);
+    return m_Stats;
+  }
+
+  // One line summary of the stats, for startup logs
+  std::string statsSummary() const;
+
+private:
+  fs::path binaryPath(uint64_t key) const;
+
+  fs::path m_Directory;
+  uint64_t m_DriverHash = 0;
+  bool m_IsSupported = false;
+  mutable std::mutex m_StatsMutex;
+  Stats m_Stats;
+};
+
+// Cache used by compileProgram(), null until enableProgramBinaryCache() is
+// called
+ProgramBinaryCache *programBinaryCache();
+void enableProgramBinaryCache(const fs::path &directory);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <stdexcept>
+
+// Single sample framebuffer with a sRGB color texture and a 32 bits float
+// depth texture, both readable by shaders (unlike the default framebuffer,
+// which is multisampled). Colors are encoded on write with
+// GL_FRAMEBUFFER_SRGB enabled and decoded when sampled.
+class RenderTarget
+{
+public:
+  RenderTarget(GLsizei width, GLsizei height) : m_Width(width), m_Height(height)
+  {
+    const auto createTexture = [&](GLenum internalFormat) {
+      GLuint texture = 0;
+      glGenTextures(1, &texture);
+      glBindTexture(GL_TEXTURE_2D, texture);
+      glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glBindTexture(GL_TEXTURE_2D, 0);
+      return texture;
+    };
+    m_ColorTexture = createTexture(GL_SRGB8_ALPHA8);
+    m_DepthTexture = createTexture(GL_DEPTH_COMPONENT32F);
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGenFramebuffers(1, &m_Framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_Framebuffer);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, m_ColorTexture, 0);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+        GL_TEXTURE_2D, m_DepthTexture, 0);
+    const auto status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousFramebuffer));
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+      throw std::runtime_error("Incomplete render target framebuffer");
+    }
+  }
+
+  ~RenderTarget()
+  {
+    glDeleteFramebuffers(1, &m_Framebuffer);
+    const GLuint textures[] = {m_ColorTexture, m_DepthTexture};
+    glDeleteTextures(2, textures);
+  }
+
+  RenderTarget(const RenderTarget &) = delete;
+  RenderTarget &operator=(const RenderTarget &) = delete;
+
+  GLsizei width() const { return m_Width; }
+  GLsizei height() const { return m_Height; }
+  GLuint framebuffer() const { return m_Framebuffer; }
+  GLuint colorTexture() const { return m_ColorTexture; }
+  GLuint depthTexture() const { return m_DepthTexture; }
+
+private:
+  GLsizei m_Width;
+  GLsizei m_Height;
+  GLuint m_Framebuffer = 0;
+  GLuint m_ColorTexture = 0;
+  GLuint m_DepthTexture = 0;
+};
+
+// True if the first color buffer of the bound draw framebuffer encodes to
+// sRGB with GL_FRAMEBUFFER_SRGB enabled. The default framebuffer is sRGB
+// capable if the platform honored GLFW_SRGB_CAPABLE.
+inline bool isDrawFramebufferSRGB()
+{
+  GLint framebuffer = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+  GLint encoding = GL_LINEAR;
+  glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER,
+      framebuffer ? GL_COLOR_ATTACHMENT0 : GL_BACK_LEFT,
+      GL_FRAMEBUFFER_ATTACHMENT_COLOR_ENCODING, &encoding);
+  return encoding == GL_SRGB;
+}
@@ -0,0 +1,25 @@
+#include "sampler_objects.hpp"
+
+SamplerObjects::~SamplerObjects()
+{
+  for (const auto &sampler : m_Samplers) {
+    glDeleteSamplers(1, &sampler.second);
+  }
+}
+
+GLuint SamplerObjects::get(const Parameters &parameters)
+{
+  const auto it = m_Samplers.find(parameters);
+  if (it != end(m_Samplers)) {
+    return (*it).second;
+  }
+  GLuint sampler = 0;
+  glGenSamplers(1, &sampler);
+  glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, parameters.minFilter);
+  glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, parameters.magFilter);
+  glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, parameters.wrapS);
+  glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, parameters.wrapT);
+  glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, parameters.wrapR);
+  m_Samplers.emplace(parameters, sampler);
+  return sampler;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <map>
+#include <tuple>
+
+// Sampler objects shared by all the textures with the same filters and wrap
+// modes: glTF models have many textures and few distinct samplers
+class SamplerObjects
+{
+public:
+  struct Parameters
+  {
+    GLint minFilter, magFilter, wrapS, wrapT, wrapR;
+
+    auto tie() const
+    {
+      return std::tie(minFilter, magFilter, wrapS, wrapT, wrapR);
+    }
+    bool operator<(const Parameters &other) const
+    {
+      return tie() < other.tie();
+    }
+  };
+
+  SamplerObjects() = default;
+  ~SamplerObjects();
+
+  SamplerObjects(const SamplerObjects &) = delete;
+  SamplerObjects &operator=(const SamplerObjects &) = delete;
+
+  // Sampler object of the parameters, created on first request
+  GLuint get(const Parameters &parameters);
+
+  size_t size() const { return m_Samplers.size(); }
+
+private:
+  std::map<Parameters, GLuint> m_Samplers;
+};
@@ -0,0 +1,341 @@
+#include "scene_graph.hpp"
+#include "parallel.hpp"
+#include "simd.hpp"
+
+#include <glm/gtx/matrix_decompose.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+// Nodes per task when a level is split between threads
+static const size_t kLevelGrainSize = 4096;
+
+// TRS closest to a matrix glm::decompose() rejects: its translation, the
+// lengths of its axes, and the rotation of its two longest axes if they are
+// independent, the identity otherwise
+static void approximateTRS(const glm::mat4 &matrix, glm::vec3 &translation,
+    glm::quat &rotation, glm::vec3 &scale)
+{
+  translation = glm::vec3(matrix[3]);
+  glm::vec3 axes[3];
+  for (int k = 0; k < 3; ++k) {
+    axes[k] = glm::vec3(matrix[k]);
+    scale[k] = glm::length(axes[k]);
+  }
+  rotation = glm::quat(1, 0, 0, 0);
+
+  int order[3] = {0, 1, 2};
+  std::sort(std::begin(order), std::end(order),
+      [&](int a, int b) { return scale[a] > scale[b]; });
+  const auto a = order[0], b = order[1], c = order[2];
+  if (scale[b] <= 0.f) {
+    return;
+  }
+  glm::vec3 basis[3];
+  basis[a] = axes[a] / scale[a];
+  const auto orthogonal = axes[b] - glm::dot(axes[b], basis[a]) * basis[a];
+  const auto orthogonalLength = glm::length(orthogonal);
+  if (orthogonalLength <= 1e-6f * scale[b]) {
+    return;
+  }
+  basis[b] = orthogonal / orthogonalLength;
+  // Right handed basis: c follows b as b follows a for a cyclic order
+  const auto isCyclic = (b - a + 3) % 3 == 1;
+  basis[c] = isCyclic ? glm::cross(basis[a], basis[b])
+                      : glm::cross(basis[b], basis[a]);
+  if (glm::dot(axes[c], basis[c]) < 0.f) {
+    scale[c] = -scale[c];
+  }
+  rotation = glm::quat_cast(glm::mat3(basis[0], basis[1], basis[2]));
+}
+
+SceneGraph::SceneGraph(const tinygltf::Model &model)
+{
+  if (model.defaultScene < 0) {
+    return;
+  }
+
+  const auto addNode = [&](int nodeIdx, int32_t parent) {
+    const auto &node = model.nodes[nodeIdx];
+    m_Parents.emplace_back(parent);
+    m_GltfNodes.emplace_back(nodeIdx);
+    m_Meshes.emplace_back(node.mesh);
+
+    auto translation = glm::vec3(0);
+    auto rotation = glm::quat(1, 0, 0, 0);
+    auto scale = glm::vec3(1);
+    if (!node.matrix.empty()) {
+      // glTF requires node matrices to be decomposable into TRS
+      const auto matrix = glm::mat4(node.matrix[0], node.matrix[1],
+          node.matrix[2], node.matrix[3], node.matrix[4], node.matrix[5],
+          node.matrix[6], node.matrix[7], node.matrix[8], node.matrix[9],
+          node.matrix[10], node.matrix[11], node.matrix[12], node.matrix[13],
+          node.matrix[14], node.matrix[15]);
+      glm::vec3 skew;
+      glm::vec4 perspective;
+      if (!glm::decompose(
+              matrix, scale, rotation, translation, skew, perspective)) {
+        // Singular matrix, a zero scale usually hides the node. The setters
+        // replace the matrix with the TRS, which keeps the node in place.
+        m_LocalMatrices.emplace(uint32_t(m_Parents.size() - 1), matrix);
+        approximateTRS(matrix, translation, rotation, scale);
+      }
+    } else {
+      if (!node.translation.empty()) {
+        translation = glm::vec3(
+            node.translation[0], node.translation[1], node.translation[2]);
+      }
+      if (!node.rotation.empty()) {
+        rotation = glm::quat(float(node.rotation[3]), float(node.rotation[0]),
+            float(node.rotation[1]),
+            float(node.rotation[2])); // prototype is w, x, y, z
+      }
+      if (!node.scale.empty()) {
+        scale = glm::vec3(node.scale[0], node.scale[1], node.scale[2]);
+      }
+    }
+    m_Translations.emplace_back(translation);
+    m_Rotations.emplace_back(rotation);
+    m_Scales.emplace_back(scale);
+  };
+
+  // Breadth-first traversal, the array itself is the queue
+  for (const auto nodeIdx : model.scenes[model.defaultScene].nodes) {
+    addNode(nodeIdx, -1);
+  }
+  for (size_t i = 0; i < m_GltfNodes.size(); ++i) {
+    for (const auto child : model.nodes[m_GltfNodes[i]].children) {
+      addNode(child, int32_t(i));
+    }
+  }
+
+  for (size_t i = 0; i < m_Meshes.size(); ++i) {
+    if (m_Meshes[i] >= 0) {
+      m_MeshNodes.emplace_back(uint32_t(i));
+    }
+  }
+
+  initLevels();
+}
+
+SceneGraph::SceneGraph(std::vector<int32_t> parents) :
+    m_Parents(std::move(parents))
+{
+  m_GltfNodes.assign(size(), -1);
+  m_Meshes.assign(size(), -1);
+  m_Translations.assign(size(), glm::vec3(0));
+  m_Rotations.assign(size(), glm::quat(1, 0, 0, 0));
+  m_Scales.assign(size(), glm::vec3(1));
+  initLevels();
+}
+
+void SceneGraph::initLevels()
+{
+  // Depths are non decreasing in breadth-first order, a level starts each
+  // time the depth changes
+  std::vector<uint32_t> depths(size());
+  m_LevelOffsets.clear();
+  for (size_t i = 0; i < size(); ++i) {
+    const auto parent = m_Parents[i];
+    if (parent >= int32_t(i)) {
+      throw std::runtime_error("Scene graph node " + std::to_string(i) +
+                               " comes before its parent");
+    }
+    depths[i] = parent < 0 ? 0 : depths[parent] + 1;
+    if (i == 0 || depths[i] != depths[i - 1]) {
+      if (i > 0 && depths[i] < depths[i - 1]) {
+        throw std::runtime_error(
+            "Scene graph nodes are not in breadth-first order");
+      }
+      m_LevelOffsets.emplace_back(i);
+    }
+  }
+  m_LevelOffsets.emplace_back(size());
+
+  m_WorldMatrices.resize(size());
+  m_WorldNormalMatrices.resize(size());
+  m_Dirty.assign(size(), 1);
+  m_HasDirtyNodes = true;
+  updateWorldMatrices();
+}
+
+size_t SceneGraph::updateWorldMatrices()
+{
+  if (!m_HasDirtyNodes) {
+    return 0;
+  }
+
+  size_t updatedCount = 0;
+  for (size_t level = 0; level < levelCount(); ++level) {
+    updatedCount +=
+        updateLevelRange(m_LevelOffsets[level], m_LevelOffsets[level + 1]);
+  }
+
+  std::fill(begin(m_Dirty), end(m_Dirty), 0);
+  m_HasDirtyNodes = false;
+  return updatedCount;
+}
+
+size_t SceneGraph::updateWorldMatrices(ThreadPool &pool)
+{
+  if (!m_HasDirtyNodes) {
+    return 0;
+  }
+
+  // A level only reads the matrices and dirty flags of the previous one, so
+  // the end of each parallelFor() is the only synchronization needed
+  std::atomic<size_t> updatedCount{0};
+  for (size_t level = 0; level < levelCount(); ++level) {
+    pool.parallelFor(m_LevelOffsets[level], m_LevelOffsets[level + 1],
+        kLevelGrainSize, [&](size_t begin, size_t end) {
+          updatedCount += updateLevelRange(begin, end);
+        });
+  }
+
+  pool.parallelFor(0, size(), 16 * kLevelGrainSize,
+      [&](size_t begin, size_t end) {
+        std::fill(m_Dirty.data() + begin, m_Dirty.data() + end, 0);
+      });
+  m_HasDirtyNodes = false;
+  return updatedCount;
+}
+
+size_t SceneGraph::updateLevelRange(size_t begin, size_t end)
+{
+  // Parents belong to the previous level, their dirty flag already accounts
+  // for their own ancestors
+  uint32_t batch[4];
+  size_t batchSize = 0;
+  size_t updatedCount = 0;
+  for (size_t i = begin; i < end; ++i) {
+    const auto parent = m_Parents[i];
+    if (parent >= 0 && m_Dirty[parent]) {
+      m_Dirty[i] = 1;
+    }
+    if (!m_Dirty[i]) {
+      continue;
+    }
+    batch[batchSize++] = uint32_t(i);
+    if (batchSize == 4) {
+      updateNodes4(batch);
+      batchSize = 0;
+    }
+    ++updatedCount;
+  }
+
+  if (batchSize > 0) {
+    // Unused lanes recompute the last node, writing the same values again
+    for (auto lane = batchSize; lane < 4; ++lane) {
+      batch[lane] = batch[batchSize - 1];
+    }
+    updateNodes4(batch);
+  }
+  return updatedCount;
+}
+
+void SceneGraph::updateNodes4(const uint32_t nodes[4])
+{
+  // Gather the local transforms, one node per lane
+  alignas(16) float lanes[10][4];
+  for (int lane = 0; lane < 4; ++lane) {
+    const auto i = nodes[lane];
+    const auto &t = m_Translations[i];
+    const auto &q = m_Rotations[i];
+    const auto &s = m_Scales[i];
+    const float values[10] = {q.x, q.y, q.z, q.w, s.x, s.y, s.z, t.x, t.y, t.z};
+    for (int k = 0; k < 10; ++k) {
+      lanes[k][lane] = values[k];
+    }
+  }
+  const auto qx = Float4::load(lanes[0]), qy = Float4::load(lanes[1]),
+             qz = Float4::load(lanes[2]), qw = Float4::load(lanes[3]);
+  const auto sx = Float4::load(lanes[4]), sy = Float4::load(lanes[5]),
+             sz = Float4::load(lanes[6]);
+
+  // Local matrix = T * R * S, same formula as glm::mat4_cast()
+  const auto one = Float4(1.f), two = Float4(2.f);
+  const auto xx = qx * qx, yy = qy * qy, zz = qz * qz;
+  const auto xy = qx * qy, xz = qx * qz, yz = qy * qz;
+  const auto wx = qw * qx, wy = qw * qy, wz = qw * qz;
+  const Float4 local[3][3] = {
+      {sx * (one - two * (yy + zz)), sx * (two * (xy + wz)),
+          sx * (two * (xz - wy))},
+      {sy * (two * (xy - wz)), sy * (one - two * (xx + zz)),
+          sy * (two * (yz + wx))},
+      {sz * (two * (xz + wy)), sz * (two * (yz - wx)),
+          sz * (one - two * (xx + yy))}};
+
+  alignas(16) float localLanes[3][3][4];
+  for (int column = 0; column < 3; ++column) {
+    for (int row = 0; row < 3; ++row) {
+      local[column][row].store(localLanes[column][row]);
+    }
+  }
+
+  // World matrices, one SIMD matrix product per node
+  alignas(16) float world[3][3][4];
+  for (int lane = 0; lane < 4; ++lane) {
+    const auto i = nodes[lane];
+    glm::mat4 localMatrix;
+    for (int column = 0; column < 3; ++column) {
+      localMatrix[column] = glm::vec4(localLanes[column][0][lane],
+          localLanes[column][1][lane], localLanes[column][2][lane], 0.f);
+    }
+    localMatrix[3] =
+        glm::vec4(lanes[7][lane], lanes[8][lane], lanes[9][lane], 1.f);
+    if (!m_LocalMatrices.empty()) {
+      const auto it = m_LocalMatrices.find(i);
+      if (it != end(m_LocalMatrices)) {
+        localMatrix = (*it).second;
+      }
+    }
+
+    auto &worldMatrix = m_WorldMatrices[i];
+    const auto parent = m_Parents[i];
+    if (parent < 0) {
+      worldMatrix = localMatrix;
+    } else {
+      multiplyMatrix4(&m_WorldMatrices[parent][0][0], &localMatrix[0][0],
+          &worldMatrix[0][0]);
+    }
+    for (int column = 0; column < 3; ++column) {
+      for (int row = 0; row < 3; ++row) {
+        world[column][row][lane] = worldMatrix[column][row];
+      }
+    }
+  }
+
+  // Normal matrices: transpose(inverse(M)) of a 3x3 matrix M with columns
+  // (a, b, c) is (b x c, c x a, a x b) / det(M)
+  Float4 m[3][3];
+  for (int column = 0; column < 3; ++column) {
+    for (int row = 0; row < 3; ++row) {
+      m[column][row] = Float4::load(world[column][row]);
+    }
+  }
+  const auto cross = [](const Float4 *u, const Float4 *v, Float4 *result) {
+    result[0] = u[1] * v[2] - u[2] * v[1];
+    result[1] = u[2] * v[0] - u[0] * v[2];
+    result[2] = u[0] * v[1] - u[1] * v[0];
+  };
+  Float4 normal[3][3];
+  cross(m[1], m[2], normal[0]);
+  cross(m[2], m[0], normal[1]);
+  cross(m[0], m[1], normal[2]);
+  const auto invDet = one / (m[0][0] * normal[0][0] + m[0][1] * normal[0][1] +
+                                m[0][2] * normal[0][2]);
+
+  alignas(16) float normalLanes[3][3][4];
+  for (int column = 0; column < 3; ++column) {
+    for (int row = 0; row < 3; ++row) {
+      (normal[column][row] * invDet).store(normalLanes[column][row]);
+    }
+  }
+  for (int lane = 0; lane < 4; ++lane) {
+    auto &normalMatrix = m_WorldNormalMatrices[nodes[lane]];
+    for (int column = 0; column < 3; ++column) {
+      normalMatrix[column] = glm::vec3(normalLanes[column][0][lane],
+          normalLanes[column][1][lane], normalLanes[column][2][lane]);
+    }
+  }
+}
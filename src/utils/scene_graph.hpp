@@ -0,0 +1,142 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class ThreadPool;
+
+// The default scene of a glTF model compiled for the draw loop.
+// Nodes are stored in breadth-first order, so a parent always comes before its
+// children and world matrices can be computed with a single linear pass.
+// Transforms are kept in structure-of-arrays form, indexed by "scene node"
+// index (not to be confused with the node index in model.nodes).
+// World matrices are persistent: editing a local transform marks the node
+// dirty and only dirty nodes and their descendants are recomputed by the next
+// updateWorldMatrices().
+// Nodes of a same depth ("level") are contiguous and independent from each
+// other, so large hierarchies are updated level by level in parallel.
+class SceneGraph
+{
+public:
+  SceneGraph() = default;
+
+  explicit SceneGraph(const tinygltf::Model &model);
+
+  // Hierarchy without glTF data (benchmarks, procedural scenes) with identity
+  // local transforms. parents must be in breadth-first order: roots first,
+  // then each node after its parent and depths never decreasing.
+  explicit SceneGraph(std::vector<int32_t> parents);
+
+  size_t size() const { return m_Parents.size(); }
+
+  // Number of distinct node depths
+  size_t levelCount() const
+  {
+    return m_LevelOffsets.empty() ? 0 : m_LevelOffsets.size() - 1;
+  }
+
+  // Recompute the world matrices of dirty nodes and their descendants.
+  // Return the number of recomputed nodes (0 for a static scene).
+  size_t updateWorldMatrices();
+
+  // Same as above, with the nodes of each level split between the threads of
+  // pool. Levels too small to be worth distributing run on the calling thread.
+  size_t updateWorldMatrices(ThreadPool &pool);
+
+  // Index of the parent scene node, -1 for roots
+  int32_t parent(size_t i) const { return m_Parents[i]; }
+
+  // Index in model.nodes
+  int32_t gltfNode(size_t i) const { return m_GltfNodes[i]; }
+
+  // Index in model.meshes, -1 if the node has no mesh
+  int32_t mesh(size_t i) const { return m_Meshes[i]; }
+
+  // Scene nodes referencing a mesh, in scene order
+  const std::vector<uint32_t> &meshNodes() const { return m_MeshNodes; }
+
+  const glm::mat4 &worldMatrix(size_t i) const { return m_WorldMatrices[i]; }
+
+  // transpose(inverse()) of the upper 3x3 of the world matrix. For a rigid view
+  // matrix, mat3(viewMatrix) * worldNormalMatrix(i) is the view space normal
+  // matrix.
+  const glm::mat3 &worldNormalMatrix(size_t i) const
+  {
+    return m_WorldNormalMatrices[i];
+  }
+
+  // Local TRS. Nodes whose glTF matrix can't be decomposed (singular, for
+  // example a zero scale hiding the node) keep that matrix as their local
+  // transform until one of the setters replaces it. Their TRS is then the
+  // translation, axis lengths and, when it can be recovered, rotation of the
+  // matrix.
+  const glm::vec3 &translation(size_t i) const { return m_Translations[i]; }
+  const glm::quat &rotation(size_t i) const { return m_Rotations[i]; }
+  const glm::vec3 &scale(size_t i) const { return m_Scales[i]; }
+
+  void setTranslation(size_t i, const glm::vec3 &translation)
+  {
+    m_Translations[i] = translation;
+    m_LocalMatrices.erase(uint32_t(i));
+    markDirty(i);
+  }
+
+  void setRotation(size_t i, const glm::quat &rotation)
+  {
+    m_Rotations[i] = rotation;
+    m_LocalMatrices.erase(uint32_t(i));
+    markDirty(i);
+  }
+
+  void setScale(size_t i, const glm::vec3 &scale)
+  {
+    m_Scales[i] = scale;
+    m_LocalMatrices.erase(uint32_t(i));
+    markDirty(i);
+  }
+
+private:
+  void markDirty(size_t i)
+  {
+    m_Dirty[i] = 1;
+    m_HasDirtyNodes = true;
+  }
+
+  void initLevels();
+
+  // Update the dirty nodes of [begin, end), a range inside a single level.
+  // Return the number of updated nodes.
+  size_t updateLevelRange(size_t begin, size_t end);
+
+  // Compute the world and normal matrices of 4 nodes of a same level at once
+  void updateNodes4(const uint32_t nodes[4]);
+
+  std::vector<int32_t> m_Parents;
+  std::vector<int32_t> m_GltfNodes;
+  std::vector<int32_t> m_Meshes;
+  std::vector<uint32_t> m_MeshNodes;
+
+  // Level l contains the nodes [m_LevelOffsets[l], m_LevelOffsets[l + 1])
+  std::vector<size_t> m_LevelOffsets;
+
+  // Local transforms
+  std::vector<glm::vec3> m_Translations;
+  std::vector<glm::quat> m_Rotations;
+  std::vector<glm::vec3> m_Scales;
+
+  // Local matrices of the nodes whose matrix isn't decomposable, used
+  // instead of their TRS
+  std::unordered_map<uint32_t, glm::mat4> m_LocalMatrices;
+
+  std::vector<glm::mat4> m_WorldMatrices;
+  std::vector<glm::mat3> m_WorldNormalMatrices;
+
+  // Set for nodes whose local transform changed since the last update
+  std::vector<uint8_t> m_Dirty;
+  bool m_HasDirtyNodes = false;
+};
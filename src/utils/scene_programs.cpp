@@ -0,0 +1,207 @@
+#include "scene_programs.hpp"
+#include "gl_state_cache.hpp"
+#include "texture_arrays.hpp"
+#include "uniform_blocks.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+ScenePrograms::ScenePrograms(const fs::path &shadersRootPath,
+    const std::string &vertexShader, const std::string &fragmentShader,
+    bool hasIndirect) :
+    m_ShadersRootPath(shadersRootPath),
+    m_VertexShader(vertexShader),
+    m_FragmentShader(fragmentShader),
+    m_HasIndirect(hasIndirect),
+    m_HasMaterialTextureModes(
+        loadShaderSource(shadersRootPath / fragmentShader)
+            .find("sampleMaterialTexture") != std::string::npos)
+{
+  m_DepthPrograms = std::make_unique<ProgramPermutations>(
+      std::vector<fs::path>{shadersRootPath / "depth_only.vs.glsl",
+          shadersRootPath / "depth_only.fs.glsl"});
+  m_DepthPrograms->program(0);
+  if (hasIndirect) {
+    m_DepthIndirectPrograms = std::make_unique<ProgramPermutations>(
+        std::vector<fs::path>{shadersRootPath / "depth_only_indirect.vs.glsl",
+            shadersRootPath / "depth_only.fs.glsl"});
+    m_DepthIndirectPrograms->program(0);
+  }
+}
+
+bool ScenePrograms::setMaterialTextureMode(GLStateCache &glState,
+    MaterialTable &materialTable, MaterialTextureMode mode,
+    ShaderFeatures features)
+{
+  const auto previousMode = materialTable.textureMode();
+  const auto compileShadingPrograms = [&](MaterialTextureMode mode) {
+    forget(glState, m_ShadingPrograms.get());
+    forget(glState, m_IndirectShadingPrograms.get());
+    createShadingPrograms(mode);
+    useShading(glState, false, features);
+    if (m_HasIndirect) {
+      useShading(glState, true, features);
+    }
+  };
+  try {
+    materialTable.setTextureMode(mode);
+    compileShadingPrograms(mode);
+    m_MaterialTextureModeError.clear();
+  } catch (const std::runtime_error &e) {
+    std::cerr << "Unable to use " << MaterialTable::textureModeName(mode)
+              << ": " << e.what() << std::endl;
+    m_MaterialTextureModeError = e.what();
+    materialTable.setTextureMode(previousMode);
+    compileShadingPrograms(previousMode);
+    return false;
+  }
+  return true;
+}
+
+void ScenePrograms::use(GLStateCache &glState, const GLProgram &program)
+{
+  static const std::pair<const char *, GLuint> samplerUnits[] = {
+      {"uBaseColorTexture", kBaseColorTextureUnit},
+      {"uMetallicRoughnessTexture", kMetallicRoughnessTextureUnit},
+      {"uEmissiveTexture", kEmissiveTextureUnit},
+      {"uOcclusionTexture", kOcclusionTextureUnit},
+      {"uNormalTexture", kNormalTextureUnit},
+      {"uMaterialTextureArrays", kTextureArrayFirstUnit}};
+
+  glState.useProgram(program.glId());
+  if (!m_SetUpPrograms.insert(program.glId()).second) {
+    return;
+  }
+  try {
+    bindUniformBlocks(program);
+  } catch (const std::runtime_error &error) {
+    std::cerr << error.what() << std::endl;
+    m_ShaderErrors += error.what();
+  }
+  const auto &uniforms = program.reflection().uniforms;
+  for (const auto &sampler : samplerUnits) {
+    const auto it = uniforms.find(sampler.first);
+    if (it == end(uniforms)) {
+      continue;
+    }
+    // Elements of sampler arrays read consecutive units
+    for (GLint i = 0; i < (*it).second.arraySize; ++i) {
+      glState.uniform1i((*it).second.location + i, GLint(sampler.second) + i);
+    }
+  }
+}
+
+void ScenePrograms::useShading(
+    GLStateCache &glState, bool indirect, ShaderFeatures features)
+{
+  use(glState,
+      (indirect ? m_IndirectShadingPrograms : m_ShadingPrograms)
+          ->program(features));
+}
+
+void ScenePrograms::useDepth(GLStateCache &glState, bool indirect)
+{
+  use(glState, (indirect ? m_DepthIndirectPrograms : m_DepthPrograms)
+                   ->program(0));
+}
+
+void ScenePrograms::updateReload(
+    GLStateCache &glState, const std::vector<fs::path> &changedFiles)
+{
+  if (!changedFiles.empty()) {
+    m_ShaderErrors.clear();
+  }
+  for (const auto programs : reloadablePrograms()) {
+    // Starting, swapping or failing a reload deletes programs, their ids can
+    // be reused
+    std::vector<GLuint> previousPrograms;
+    for (const auto &program : programs->programs()) {
+      previousPrograms.push_back(program.second.glId());
+    }
+    for (const auto &program : programs->reloadedPrograms()) {
+      previousPrograms.push_back(program.second.glId());
+    }
+    auto hasDeletedPrograms = false;
+    if (std::any_of(begin(changedFiles), end(changedFiles),
+            [&](const fs::path &path) { return programs->usesShader(path); })) {
+      // Replaces a reload in progress, even if this one throws
+      hasDeletedPrograms = true;
+      try {
+        programs->reload();
+      } catch (const std::runtime_error &error) {
+        m_ShaderErrors += error.what();
+      }
+    }
+    try {
+      if (programs->updateReload()) {
+        ++m_ReloadCount;
+        hasDeletedPrograms = true;
+      }
+    } catch (const std::runtime_error &error) {
+      m_ShaderErrors += error.what();
+      hasDeletedPrograms = true;
+    }
+    if (hasDeletedPrograms) {
+      for (const auto program : previousPrograms) {
+        glState.invalidateUniforms(program);
+        m_SetUpPrograms.erase(program);
+      }
+    }
+  }
+}
+
+size_t ScenePrograms::reloadingCount() const
+{
+  const auto programs = reloadablePrograms();
+  return size_t(std::count_if(begin(programs), end(programs),
+      [](const ProgramPermutations *programs) {
+        return programs->isReloading();
+      }));
+}
+
+size_t ScenePrograms::shadingPermutationCount() const
+{
+  return m_ShadingPrograms->programs().size() +
+         (m_IndirectShadingPrograms
+                 ? m_IndirectShadingPrograms->programs().size()
+                 : 0);
+}
+
+void ScenePrograms::createShadingPrograms(MaterialTextureMode mode)
+{
+  const auto textureShader = m_ShadersRootPath / materialTextureShader(mode);
+  m_ShadingPrograms =
+      std::make_unique<ProgramPermutations>(std::vector<fs::path>{
+          m_ShadersRootPath / m_VertexShader,
+          m_ShadersRootPath / m_FragmentShader, textureShader});
+  if (m_HasIndirect) {
+    m_IndirectShadingPrograms =
+        std::make_unique<ProgramPermutations>(std::vector<fs::path>{
+            m_ShadersRootPath / "forward_normal_indirect.vs.glsl",
+            m_ShadersRootPath / m_FragmentShader, textureShader});
+  }
+}
+
+void ScenePrograms::forget(
+    GLStateCache &glState, const ProgramPermutations *programs)
+{
+  if (!programs) {
+    return;
+  }
+  for (const auto &program : programs->programs()) {
+    glState.invalidateUniforms(program.second.glId());
+    m_SetUpPrograms.erase(program.second.glId());
+  }
+}
+
+std::vector<ProgramPermutations *> ScenePrograms::reloadablePrograms() const
+{
+  std::vector<ProgramPermutations *> programs{m_ShadingPrograms.get(),
+      m_IndirectShadingPrograms.get(), m_DepthPrograms.get(),
+      m_DepthIndirectPrograms.get()};
+  programs.erase(
+      std::remove(begin(programs), end(programs), nullptr), end(programs));
+  return programs;
+}
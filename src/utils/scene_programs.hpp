@@ -0,0 +1,104 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "materials.hpp"
+#include "shader_permutations.hpp"
+#include "shaders.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+class GLStateCache;
+
+// Programs drawing the scene: the shading programs and the position only
+// programs of the depth pre-pass, each one in a classic and an indirect
+// variant. The indirect vertex shaders read matrices and material from the
+// per-draw storage buffer, they exist with multi-draw indirect only.
+//
+// The fragment shader is linked with the sampleMaterialTexture() of the
+// material texture mode, fragment shaders not calling it only support bound
+// textures. Renderer toggles and the textures of each material select a
+// permutation of the shading programs, see ShaderFeature, compiled on first
+// use. Errors of edited shaders are collected in shaderErrors().
+class ScenePrograms
+{
+public:
+  // Throw std::runtime_error if a shader can't be read or the depth programs
+  // don't compile. The shading programs are created by the first call to
+  // setMaterialTextureMode().
+  ScenePrograms(const fs::path &shadersRootPath,
+      const std::string &vertexShader, const std::string &fragmentShader,
+      bool hasIndirect);
+
+  ScenePrograms(const ScenePrograms &) = delete;
+  ScenePrograms &operator=(const ScenePrograms &) = delete;
+
+  // False if the fragment shader doesn't call sampleMaterialTexture()
+  bool hasMaterialTextureModes() const { return m_HasMaterialTextureModes; }
+
+  // Switch the material table and the shading programs to mode. The
+  // permutation of features is compiled now, so the errors of the mode show
+  // up here: the previous mode is then restored, the error is kept in
+  // materialTextureModeError() and false is returned.
+  bool setMaterialTextureMode(GLStateCache &glState,
+      MaterialTable &materialTable, MaterialTextureMode mode,
+      ShaderFeatures features);
+  const std::string &materialTextureModeError() const
+  {
+    return m_MaterialTextureModeError;
+  }
+
+  // Bind a program, setting its uniform blocks and material samplers on first
+  // use. The only uniforms of the programs drawing the scene are their
+  // samplers.
+  void use(GLStateCache &glState, const GLProgram &program);
+
+  // Bind a permutation of the shading program
+  void useShading(GLStateCache &glState, bool indirect, ShaderFeatures features);
+
+  void useDepth(GLStateCache &glState, bool indirect);
+
+  // Start reloading the programs using one of the changed files and swap the
+  // reloaded programs once linked, see ProgramPermutations::reload()
+  void updateReload(
+      GLStateCache &glState, const std::vector<fs::path> &changedFiles);
+
+  // Program sets swapped by updateReload() and program sets compiling
+  size_t reloadCount() const { return m_ReloadCount; }
+  size_t reloadingCount() const;
+
+  size_t shadingPermutationCount() const;
+
+  // Errors of the reloads and blocks not matching their C++ struct, which
+  // are left unbound. Cleared when shaders change.
+  const std::string &shaderErrors() const { return m_ShaderErrors; }
+
+private:
+  void createShadingPrograms(MaterialTextureMode mode);
+
+  // Forget the replaced or deleted programs of a set, their ids can be reused
+  void forget(GLStateCache &glState, const ProgramPermutations *programs);
+
+  std::vector<ProgramPermutations *> reloadablePrograms() const;
+
+  fs::path m_ShadersRootPath;
+  std::string m_VertexShader;
+  std::string m_FragmentShader;
+  bool m_HasIndirect;
+  bool m_HasMaterialTextureModes;
+
+  std::unique_ptr<ProgramPermutations> m_ShadingPrograms;
+  std::unique_ptr<ProgramPermutations> m_IndirectShadingPrograms;
+  // Without features, held as permutations to be reloaded like the shading
+  // programs
+  std::unique_ptr<ProgramPermutations> m_DepthPrograms;
+  std::unique_ptr<ProgramPermutations> m_DepthIndirectPrograms;
+
+  std::unordered_set<GLuint> m_SetUpPrograms;
+  std::string m_MaterialTextureModeError;
+  std::string m_ShaderErrors;
+  size_t m_ReloadCount = 0;
+};
@@ -0,0 +1,157 @@
+#include "shader_permutations.hpp"
+
+#include <algorithm>
+
+const char *materialTextureShader(MaterialTextureMode mode)
+{
+  static const char *shaders[kMaterialTextureModeCount] = {
+      "material_textures_bound.fs.glsl", "material_textures_bindless.fs.glsl",
+      "material_textures_array.fs.glsl"};
+  return shaders[mode];
+}
+
+ShaderFeatures RendererToggles::features() const
+{
+  ShaderFeatures features = 0;
+  features |= useNormalMap ? ShaderFeatures(kNormalMapFeature) : 0;
+  features |= useTBN ? ShaderFeatures(kNormalTBNFeature) : 0;
+  features |= useOcclusion ? ShaderFeatures(kOcclusionFeature) : 0;
+  features |= viewNormal ? ShaderFeatures(kViewNormalFeature) : 0;
+  features |= useMonochromatic ? ShaderFeatures(kMonochromaticFeature) : 0;
+  features |= encodeSRGBOutput ? ShaderFeatures(kSRGBEncodeFeature) : 0;
+  return features;
+}
+
+ShaderFeatures materialFeatures(const MaterialTable &table, uint32_t material)
+{
+  ShaderFeatures features = 0;
+  for (int unit = 0; unit < kMaterialTextureUnitCount; ++unit) {
+    if (table.hasTexture(material, MaterialTextureUnit(unit))) {
+      features |= materialTextureFeature(MaterialTextureUnit(unit));
+    }
+  }
+  // alphaCutoff is 0 for the other alpha modes, and a cutoff of 0 keeps all
+  // the fragments
+  if (table.material(material).alphaCutoff > 0.f) {
+    features |= kAlphaMaskFeature;
+  }
+  return features;
+}
+
+std::vector<std::string> shaderFeatureDefines(ShaderFeatures features)
+{
+  static const char *names[kShaderFeatureCount] = {"USE_NORMAL_MAP", "USE_TBN",
+      "USE_OCCLUSION", "VIEW_NORMAL", "MONOCHROMATIC", "SRGB_ENCODE",
+      "HAS_BASE_COLOR_TEXTURE", "HAS_METALLIC_ROUGHNESS_TEXTURE",
+      "HAS_EMISSIVE_TEXTURE", "HAS_OCCLUSION_TEXTURE", "HAS_NORMAL_TEXTURE",
+      "ALPHA_MASK"};
+  std::vector<std::string> defines;
+  for (int i = 0; i < kShaderFeatureCount; ++i) {
+    if (features & (1u << i)) {
+      defines.emplace_back(names[i]);
+    }
+  }
+  return defines;
+}
+
+const GLProgram &ProgramPermutations::program(ShaderFeatures features)
+{
+  const auto it = m_Programs.find(features);
+  if (it != end(m_Programs)) {
+    return (*it).second;
+  }
+  // First use during a reload: compiled from the reloaded sources, so that
+  // the swap keeps it. Kept aside until then, a failed reload deletes it.
+  if (isReloading()) {
+    const auto reloaded = m_ReloadedPrograms.find(features);
+    if (reloaded != end(m_ReloadedPrograms)) {
+      return (*reloaded).second;
+    }
+    try {
+      return m_ReloadedPrograms
+          .emplace(features,
+              compileProgram(m_ReloadSources, shaderFeatureDefines(features)))
+          .first->second;
+    } catch (const std::runtime_error &) {
+      // Compiled from the previous sources, updateReload() reports the errors
+    }
+  }
+  // References to the elements of an unordered_map survive rehashing
+  return m_Programs
+      .emplace(features,
+          compileProgram(m_Sources, shaderFeatureDefines(features)))
+      .first->second;
+}
+
+bool ProgramPermutations::usesShader(const fs::path &path) const
+{
+  const auto isPath = [&](const fs::path &sourcePath) {
+    return sourcePath.filename() == path.filename();
+  };
+  return std::any_of(
+      begin(m_Sources), end(m_Sources), [&](const ShaderSource &source) {
+        return isPath(source.path) ||
+               std::any_of(begin(source.includes), end(source.includes), isPath);
+      });
+}
+
+void ProgramPermutations::reload()
+{
+  std::vector<fs::path> paths;
+  for (const auto &source : m_Sources) {
+    paths.push_back(source.path);
+  }
+  m_Reloads.clear();
+  m_ReloadedPrograms.clear();
+  m_ReloadSources = loadShaderSources(paths);
+  // Nothing compiled yet, the next uses compile from the new sources
+  if (m_Programs.empty()) {
+    m_Sources = std::move(m_ReloadSources);
+    m_ReloadSources.clear();
+    return;
+  }
+  for (const auto &program : m_Programs) {
+    m_Reloads.emplace_back(program.first,
+        AsyncProgram(m_ReloadSources, shaderFeatureDefines(program.first)));
+  }
+}
+
+bool ProgramPermutations::updateReload()
+{
+  if (m_Reloads.empty() ||
+      !std::all_of(begin(m_Reloads), end(m_Reloads),
+          [](const std::pair<ShaderFeatures, AsyncProgram> &reload) {
+            return reload.second.isCompleted();
+          })) {
+    return false;
+  }
+
+  auto reloads = std::move(m_Reloads);
+  m_Reloads.clear();
+  auto reloadedPrograms = std::move(m_ReloadedPrograms);
+  m_ReloadedPrograms.clear();
+  std::unordered_map<ShaderFeatures, GLProgram> programs;
+  std::string errors;
+  for (auto &reload : reloads) {
+    try {
+      programs.emplace(reload.first, reload.second.finish());
+    } catch (const std::runtime_error &error) {
+      // Errors of the shared shaders are the same for all the permutations
+      if (errors.find(error.what()) == std::string::npos) {
+        errors += error.what();
+      }
+    }
+  }
+  if (!errors.empty()) {
+    // The next uses of the permutations compiled during the reload compile
+    // them again from m_Sources
+    m_ReloadSources.clear();
+    throw std::runtime_error(errors);
+  }
+  for (auto &program : reloadedPrograms) {
+    programs.emplace(program.first, std::move(program.second));
+  }
+  m_Programs = std::move(programs);
+  m_Sources = std::move(m_ReloadSources);
+  return true;
+}
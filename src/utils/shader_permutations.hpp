@@ -0,0 +1,131 @@
+#pragma once
+
+#include "materials.hpp"
+#include "shader_reload.hpp"
+#include "shaders.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Features of the shading programs, each one is a #define of their shaders.
+// The renderer toggles apply to all the draws of a frame, the material
+// features to the draws of a material.
+enum ShaderFeature : uint32_t
+{
+  kNormalMapFeature = 1 << 0,     // USE_NORMAL_MAP
+  kNormalTBNFeature = 1 << 1,     // USE_TBN
+  kOcclusionFeature = 1 << 2,     // USE_OCCLUSION
+  kViewNormalFeature = 1 << 3,    // VIEW_NORMAL
+  kMonochromaticFeature = 1 << 4, // MONOCHROMATIC
+  kSRGBEncodeFeature = 1 << 5,    // SRGB_ENCODE, framebuffer without sRGB
+  // HAS_<unit>_TEXTURE, one bit per MaterialTextureUnit from this one. Shaders
+  // don't sample the missing textures of a material.
+  kFirstMaterialTextureFeature = 1 << 6,
+  // ALPHA_MASK, materials of alphaMode MASK. Only their programs discard
+  // fragments, the others keep early depth tests.
+  kAlphaMaskFeature = kFirstMaterialTextureFeature << kMaterialTextureUnitCount
+};
+
+using ShaderFeatures = uint32_t;
+
+// Renderer toggles of the viewer at startup
+const ShaderFeatures kDefaultRendererFeatures =
+    kNormalMapFeature | kNormalTBNFeature | kOcclusionFeature;
+
+// Renderer toggles of the GUI, selecting the permutation of all the shading
+// programs of a frame
+struct RendererToggles
+{
+  bool useNormalMap = (kDefaultRendererFeatures & kNormalMapFeature) != 0;
+  bool useTBN = (kDefaultRendererFeatures & kNormalTBNFeature) != 0;
+  bool useOcclusion = (kDefaultRendererFeatures & kOcclusionFeature) != 0;
+  bool viewNormal = (kDefaultRendererFeatures & kViewNormalFeature) != 0;
+  bool useMonochromatic =
+      (kDefaultRendererFeatures & kMonochromaticFeature) != 0;
+  // Shaders write linear colors, encoded by sRGB framebuffers. Without one
+  // the shaders encode them.
+  bool encodeSRGBOutput = false;
+
+  ShaderFeatures features() const;
+};
+
+const int kShaderFeatureCount = 7 + kMaterialTextureUnitCount;
+const ShaderFeatures kMaterialFeatureMask =
+    ((1u << kMaterialTextureUnitCount) - 1) * kFirstMaterialTextureFeature |
+    kAlphaMaskFeature;
+
+inline ShaderFeatures materialTextureFeature(MaterialTextureUnit unit)
+{
+  return ShaderFeatures(kFirstMaterialTextureFeature) << unit;
+}
+
+// File name of the fragment shader defining the sampleMaterialTexture() of a
+// mode, linked with the shading fragment shaders
+const char *materialTextureShader(MaterialTextureMode mode);
+
+// Material features of a material table entry
+ShaderFeatures materialFeatures(const MaterialTable &table, uint32_t material);
+
+// Names to #define for a set of features
+std::vector<std::string> shaderFeatureDefines(ShaderFeatures features);
+
+// Programs linked from the same shaders with different features. Each
+// permutation is compiled on first use and cached by feature bitmask.
+// Permutations are compiled from the sources read by the constructor or by
+// the last successful reload, edits of the files don't break them.
+class ProgramPermutations
+{
+public:
+  // Throw std::runtime_error if a shader can't be read
+  explicit ProgramPermutations(const std::vector<fs::path> &shaderPaths) :
+      m_Sources(loadShaderSources(shaderPaths))
+  {
+  }
+
+  // Throw std::runtime_error if the permutation doesn't compile
+  const GLProgram &program(ShaderFeatures features);
+
+  // True if the file at path is one of the shaders or included by one
+  bool usesShader(const fs::path &path) const;
+
+  // Start recompiling the compiled permutations from the shader files in the
+  // background, replacing a reload in progress. program() returns the
+  // previous programs until updateReload() swaps them. Without compiled
+  // permutations, the new sources are used at once. Throw
+  // std::runtime_error if a shader can't be read.
+  void reload();
+
+  bool isReloading() const { return !m_Reloads.empty(); }
+
+  // Once all the permutations of the reload are linked, replace the previous
+  // programs at once and return true. Permutations first used during the
+  // reload are compiled from the new sources and kept by the swap. Throw
+  // std::runtime_error with the errors of the reload if a permutation failed,
+  // the previous programs and sources are kept and the permutations first
+  // used during the reload are deleted.
+  bool updateReload();
+
+  // Compiled permutations
+  const std::unordered_map<ShaderFeatures, GLProgram> &programs() const
+  {
+    return m_Programs;
+  }
+
+  // Permutations first used during the reload in progress, compiled from its
+  // sources. Moved to programs() by a successful swap only.
+  const std::unordered_map<ShaderFeatures, GLProgram> &reloadedPrograms() const
+  {
+    return m_ReloadedPrograms;
+  }
+
+private:
+  std::vector<ShaderSource> m_Sources;
+  std::unordered_map<ShaderFeatures, GLProgram> m_Programs;
+
+  std::vector<ShaderSource> m_ReloadSources;
+  std::vector<std::pair<ShaderFeatures, AsyncProgram>> m_Reloads;
+  // Permutations missing from m_Programs compiled from m_ReloadSources
+  std::unordered_map<ShaderFeatures, GLProgram> m_ReloadedPrograms;
+};
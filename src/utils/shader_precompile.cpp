@@ -0,0 +1,273 @@
+#include "shader_precompile.hpp"
+#include "glfw.hpp"
+#include "shaders.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+// Shaders linked by the viewer outside of the shading programs
+const char *const kFixedShaders[] = {"depth_only.vs.glsl", "depth_only.fs.glsl",
+    "depth_only_indirect.vs.glsl", "forward_normal_indirect.vs.glsl",
+    "fullscreen.vs.glsl", "present.fs.glsl", "hiz_reduce.cs.glsl",
+    "cull_draws.cs.glsl"};
+
+struct Permutation
+{
+  size_t program;
+  ShaderFeatures features;
+};
+
+struct PermutationResult
+{
+  double seconds = 0.;
+  std::string error; // Empty if the permutation linked
+};
+
+// Features of mask mentioned by the shaders
+ShaderFeatures referencedFeatures(
+    const std::vector<ShaderSource> &sources, ShaderFeatures mask)
+{
+  ShaderFeatures features = 0;
+  for (int i = 0; i < kShaderFeatureCount; ++i) {
+    const auto feature = ShaderFeatures(1u << i);
+    if (!(mask & feature)) {
+      continue;
+    }
+    const auto define = shaderFeatureDefines(feature).front();
+    for (const auto &source : sources) {
+      if (source.source.find(define) != std::string::npos) {
+        features |= feature;
+        break;
+      }
+    }
+  }
+  return features;
+}
+
+std::string joinDefines(ShaderFeatures features)
+{
+  std::string defines;
+  for (const auto &define : shaderFeatureDefines(features)) {
+    defines += (defines.empty() ? "" : " ") + define;
+  }
+  return defines.empty() ? "no define" : defines;
+}
+} // namespace
+
+std::string ProgramDescription::name() const
+{
+  std::string name;
+  for (const auto &path : shaderPaths) {
+    name += (name.empty() ? "" : " + ") + path.filename().string();
+  }
+  return name;
+}
+
+std::vector<ProgramDescription> viewerPrograms(const fs::path &shadersRootPath,
+    const std::string &vertexShader, bool allRendererToggles)
+{
+  const bool hasMultiDrawIndirect = GLAD_GL_VERSION_4_3;
+  std::set<std::string> linkedShaders{
+      std::begin(kFixedShaders), std::end(kFixedShaders)};
+  linkedShaders.insert(vertexShader);
+  for (int mode = 0; mode < kMaterialTextureModeCount; ++mode) {
+    linkedShaders.insert(materialTextureShader(MaterialTextureMode(mode)));
+  }
+
+  // Any other fragment shader can be given to the viewer
+  std::set<fs::path> fragmentShaders;
+  for (const auto &entry : fs::directory_iterator(shadersRootPath)) {
+    const auto name = entry.path().filename().string();
+    const auto suffix = std::string(".fs.glsl");
+    if (name.size() > suffix.size() &&
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) ==
+            0 &&
+        !linkedShaders.count(name)) {
+      fragmentShaders.insert(entry.path());
+    }
+  }
+
+  const auto rendererFeatures =
+      ShaderFeatures((1u << kShaderFeatureCount) - 1) & ~kMaterialFeatureMask;
+  ProgramDescription shading;
+  shading.baseFeatures = allRendererToggles ? 0 : kDefaultRendererFeatures;
+  // The sRGB encoding depends on the window, both are compiled
+  shading.variableFeatures =
+      kMaterialFeatureMask |
+      (allRendererToggles ? rendererFeatures : ShaderFeatures(kSRGBEncodeFeature));
+
+  std::vector<ProgramDescription> programs;
+  for (const auto &fragmentShader : fragmentShaders) {
+    const auto hasMaterialTextureModes =
+        loadShaderSource(fragmentShader).find("sampleMaterialTexture") !=
+        std::string::npos;
+    for (int mode = 0; mode < kMaterialTextureModeCount; ++mode) {
+      if (!MaterialTable::isTextureModeSupported(MaterialTextureMode(mode)) ||
+          (!hasMaterialTextureModes && mode != kBoundTextures)) {
+        continue;
+      }
+      const auto textureShader =
+          shadersRootPath / materialTextureShader(MaterialTextureMode(mode));
+      shading.shaderPaths = {
+          shadersRootPath / vertexShader, fragmentShader, textureShader};
+      programs.push_back(shading);
+      if (hasMultiDrawIndirect) {
+        shading.shaderPaths = {
+            shadersRootPath / "forward_normal_indirect.vs.glsl",
+            fragmentShader, textureShader};
+        programs.push_back(shading);
+      }
+    }
+  }
+
+  programs.push_back({{shadersRootPath / "depth_only.vs.glsl",
+      shadersRootPath / "depth_only.fs.glsl"}});
+  if (hasMultiDrawIndirect) {
+    programs.push_back({{shadersRootPath / "depth_only_indirect.vs.glsl",
+        shadersRootPath / "depth_only.fs.glsl"}});
+    programs.push_back({{shadersRootPath / "hiz_reduce.cs.glsl"}});
+    programs.push_back({{shadersRootPath / "cull_draws.cs.glsl"}});
+    programs.push_back({{shadersRootPath / "fullscreen.vs.glsl",
+                            shadersRootPath / "present.fs.glsl"},
+        0, kSRGBEncodeFeature});
+  }
+  return programs;
+}
+
+size_t precompilePrograms(GLFWwindow *window,
+    const std::vector<ProgramDescription> &programs, size_t threadCount)
+{
+  const auto start = std::chrono::steady_clock::now();
+  const auto secondsSince = [](std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start)
+        .count();
+  };
+
+  // Sources are read once, a missing file fails all the permutations
+  std::vector<std::vector<ShaderSource>> sources(programs.size());
+  std::vector<std::string> sourceErrors(programs.size());
+  std::vector<Permutation> permutations;
+  for (size_t i = 0; i < programs.size(); ++i) {
+    try {
+      sources[i] = loadShaderSources(programs[i].shaderPaths);
+    } catch (const std::runtime_error &e) {
+      sourceErrors[i] = e.what();
+      continue;
+    }
+    // Enumerate the subsets of the variable features
+    const auto variableFeatures =
+        referencedFeatures(sources[i], programs[i].variableFeatures);
+    ShaderFeatures subset = 0;
+    do {
+      permutations.push_back({i, programs[i].baseFeatures | subset});
+      subset = (subset - variableFeatures) & variableFeatures;
+    } while (subset != 0);
+  }
+
+  // Contexts are created by the thread of the window, each worker makes its
+  // own current
+  threadCount = std::max<size_t>(
+      std::min(threadCount, std::max<size_t>(permutations.size(), 1)), 1);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  std::vector<GLFWwindow *> contexts;
+  for (size_t i = 0; i < threadCount; ++i) {
+    const auto context = glfwCreateWindow(1, 1, "", nullptr, window);
+    if (!context) {
+      break;
+    }
+    contexts.push_back(context);
+  }
+  if (contexts.empty()) {
+    throw std::runtime_error("Unable to create shared OpenGL contexts");
+  }
+
+  // The logs of each shader are muted, the report lists the errors
+  const auto clogBuffer = std::clog.rdbuf(nullptr);
+  const auto cerrBuffer = std::cerr.rdbuf(nullptr);
+  std::vector<PermutationResult> results(permutations.size());
+  std::atomic<size_t> nextPermutation{0};
+  std::vector<std::thread> workers;
+  for (const auto context : contexts) {
+    workers.emplace_back([&, context]() {
+      glfwMakeContextCurrent(context);
+      for (auto i = nextPermutation++; i < permutations.size();
+           i = nextPermutation++) {
+        const auto &permutation = permutations[i];
+        const auto permutationStart = std::chrono::steady_clock::now();
+        try {
+          compileProgram(sources[permutation.program],
+              shaderFeatureDefines(permutation.features));
+        } catch (const std::runtime_error &e) {
+          results[i].error = e.what();
+        }
+        results[i].seconds = secondsSince(permutationStart);
+      }
+      glfwMakeContextCurrent(nullptr);
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  for (const auto context : contexts) {
+    glfwDestroyWindow(context);
+  }
+  glfwMakeContextCurrent(window);
+  std::clog.rdbuf(clogBuffer);
+  std::cerr.rdbuf(cerrBuffer);
+  std::clog.clear();
+  std::cerr.clear();
+
+  std::printf("%12s %10s %10s %7s  %s\n", "permutations", "total ms",
+      "slowest ms", "errors", "program");
+  size_t failedCount = 0;
+  for (size_t program = 0; program < programs.size(); ++program) {
+    size_t permutationCount = 0;
+    size_t errorCount = sourceErrors[program].empty() ? 0 : 1;
+    double totalSeconds = 0., slowestSeconds = 0.;
+    for (size_t i = 0; i < permutations.size(); ++i) {
+      if (permutations[i].program != program) {
+        continue;
+      }
+      ++permutationCount;
+      errorCount += results[i].error.empty() ? 0 : 1;
+      totalSeconds += results[i].seconds;
+      slowestSeconds = std::max(slowestSeconds, results[i].seconds);
+    }
+    failedCount += errorCount;
+    std::printf("%12zu %10.1f %10.1f %7zu  %s\n", permutationCount,
+        totalSeconds * 1e3, slowestSeconds * 1e3, errorCount,
+        programs[program].name().c_str());
+  }
+
+  for (size_t program = 0; program < programs.size(); ++program) {
+    if (!sourceErrors[program].empty()) {
+      std::printf("\nError in %s:\n%s\n", programs[program].name().c_str(),
+          sourceErrors[program].c_str());
+    }
+  }
+  for (size_t i = 0; i < permutations.size(); ++i) {
+    if (!results[i].error.empty()) {
+      std::printf("\nError in %s (%s):\n%s\n",
+          programs[permutations[i].program].name().c_str(),
+          joinDefines(permutations[i].features).c_str(),
+          results[i].error.c_str());
+    }
+  }
+
+  std::printf("\n%zu permutations of %zu programs on %zu threads in %.1f ms, "
+              "%zu failed\n",
+      permutations.size(), programs.size(), contexts.size(),
+      secondsSince(start) * 1e3, failedCount);
+  if (const auto cache = programBinaryCache()) {
+    std::printf("%s\n", cache->statsSummary().c_str());
+  }
+  return failedCount;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "shader_permutations.hpp"
+
+#include <string>
+#include <vector>
+
+struct GLFWwindow;
+
+// Program of the viewer and the features its permutations are made of
+struct ProgramDescription
+{
+  std::vector<fs::path> shaderPaths;
+  ShaderFeatures baseFeatures = 0; // In every permutation
+  // Each combination of these features is a permutation. Features no shader
+  // mentions are skipped, they don't change the program.
+  ShaderFeatures variableFeatures = 0;
+
+  std::string name() const;
+};
+
+// Programs the viewer links from the shaders of shadersRootPath with the
+// current context: the shading programs of vertexShader with each other
+// fragment shader of the directory and each supported material texture mode,
+// and the depth, culling, HiZ and present programs. The shading permutations
+// cover all the material features, with the startup renderer toggles unless
+// allRendererToggles is set.
+std::vector<ProgramDescription> viewerPrograms(const fs::path &shadersRootPath,
+    const std::string &vertexShader, bool allRendererToggles);
+
+// Compile and link every permutation of programs on threadCount contexts
+// sharing the one of window, through the program binary cache if it is
+// enabled. Compile times and errors are printed on stdout. Return the number
+// of permutations that failed.
+size_t precompilePrograms(GLFWwindow *window,
+    const std::vector<ProgramDescription> &programs, size_t threadCount);
@@ -0,0 +1,134 @@
+#include "shader_reload.hpp"
+#include "gl_extensions.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+DirectoryWatcher::DirectoryWatcher(fs::path directory) :
+    m_Directory(std::move(directory))
+{
+#ifdef __linux__
+  m_Descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_Descriptor < 0) {
+    return;
+  }
+  if (inotify_add_watch(m_Descriptor, m_Directory.string().c_str(),
+          IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    std::cerr << "Unable to watch " << m_Directory << std::endl;
+    close(m_Descriptor);
+    m_Descriptor = -1;
+  }
+#endif
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+#ifdef __linux__
+  if (m_Descriptor >= 0) {
+    close(m_Descriptor);
+  }
+#endif
+}
+
+std::vector<fs::path> DirectoryWatcher::changedFiles()
+{
+  std::vector<fs::path> files;
+#ifdef __linux__
+  if (m_Descriptor < 0) {
+    return files;
+  }
+  alignas(inotify_event) char buffer[4096];
+  for (;;) {
+    const auto size = read(m_Descriptor, buffer, sizeof(buffer));
+    // EAGAIN once all the events are read
+    if (size <= 0) {
+      break;
+    }
+    for (auto event = buffer; event < buffer + size;) {
+      const auto &header = *reinterpret_cast<const inotify_event *>(event);
+      if (header.len > 0) {
+        const auto path = m_Directory / header.name;
+        if (std::find(begin(files), end(files), path) == end(files)) {
+          files.push_back(path);
+        }
+      }
+      event += sizeof(inotify_event) + header.len;
+    }
+  }
+#endif
+  return files;
+}
+
+AsyncProgram::AsyncProgram(std::vector<ShaderSource> shaderSources,
+    const std::vector<std::string> &defines) :
+    m_Sources(std::move(shaderSources)),
+    m_Start(std::chrono::steady_clock::now())
+{
+  const auto cache = programBinaryCache();
+  if (cache) {
+    m_CacheKey = cache->key(m_Sources, defines);
+    if (cache->load(m_CacheKey, m_Program.glId())) {
+      return;
+    }
+    glProgramParameteri(
+        m_Program.glId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+
+  // No status query until the link is completed, the driver can compile all
+  // the shaders in parallel
+  m_Shaders.reserve(m_Sources.size());
+  for (const auto &shaderSource : m_Sources) {
+    std::clog << "Compiling " << shaderSource.path << " in the background\n";
+    m_Shaders.emplace_back(shaderType(shaderSource.path));
+    auto &shader = m_Shaders.back();
+    shader.setSource(injectShaderDefines(shaderSource.source, defines));
+    glCompileShader(shader.glId());
+    m_Program.attachShader(shader);
+  }
+  glLinkProgram(m_Program.glId());
+}
+
+bool AsyncProgram::isCompleted() const
+{
+  if (m_Shaders.empty() || !glExtensions().maxShaderCompilerThreads) {
+    return true;
+  }
+  GLint isCompleted = GL_FALSE;
+  glGetProgramiv(m_Program.glId(), GL_COMPLETION_STATUS_KHR, &isCompleted);
+  return isCompleted == GL_TRUE;
+}
+
+GLProgram AsyncProgram::finish()
+{
+  if (m_Shaders.empty()) {
+    return std::move(m_Program);
+  }
+  if (!m_Program.getLinkStatus()) {
+    std::string log;
+    for (size_t i = 0; i < m_Shaders.size(); ++i) {
+      if (!m_Shaders[i].getCompileStatus()) {
+        log += m_Sources[i].path.filename().string() + ":\n" +
+               m_Shaders[i].getInfoLog();
+      }
+    }
+    // Link errors only make sense once the shaders compile
+    if (log.empty()) {
+      log = "Program link error:" + m_Program.getInfoLog();
+    }
+    std::cerr << log << std::endl;
+    throw std::runtime_error(log);
+  }
+  if (const auto cache = programBinaryCache()) {
+    cache->store(m_CacheKey, m_Program.glId(),
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start)
+            .count());
+  }
+  return std::move(m_Program);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "shaders.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Files of a directory written since the last call to changedFiles(), watched
+// with inotify on Linux. Editors saving to a temporary file renamed over the
+// original are seen as a write of the original.
+class DirectoryWatcher
+{
+public:
+  explicit DirectoryWatcher(fs::path directory);
+
+  ~DirectoryWatcher();
+
+  DirectoryWatcher(const DirectoryWatcher &) = delete;
+  DirectoryWatcher &operator=(const DirectoryWatcher &) = delete;
+
+  // False on other platforms or if the directory can't be watched,
+  // changedFiles() is then always empty
+  bool isSupported() const { return m_Descriptor >= 0; }
+
+  // Never blocks, each file is listed once
+  std::vector<fs::path> changedFiles();
+
+private:
+  fs::path m_Directory;
+  int m_Descriptor = -1;
+};
+
+// Program compiled and linked without waiting for the driver. With
+// KHR_parallel_shader_compile the driver compiles on its own threads and
+// isCompleted() never blocks, otherwise the first query of isCompleted()
+// waits for the compilation. Programs found in the program binary cache are
+// completed on construction.
+class AsyncProgram
+{
+public:
+  AsyncProgram(std::vector<ShaderSource> shaderSources,
+      const std::vector<std::string> &defines);
+
+  bool isCompleted() const;
+
+  // Throw std::runtime_error with the logs of the failed shaders and of the
+  // link if the program didn't link. A linked program is stored in the
+  // program binary cache.
+  GLProgram finish();
+
+private:
+  std::vector<ShaderSource> m_Sources;
+  std::vector<GLShader> m_Shaders; // Empty if loaded from the cache
+  GLProgram m_Program;
+  uint64_t m_CacheKey = 0;
+  std::chrono::steady_clock::time_point m_Start;
+};
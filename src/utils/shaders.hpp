@@ -1,6 +1,9 @@
 #pragma once
 
 #include "filesystem.hpp"
+#include "program_cache.hpp"
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <glad/glad.h>
 #include <iostream>
@@ -66,8 +69,25 @@ public:
   }
 };
 
-inline std::string loadShaderSource(const fs::path &filepath)
+// Source of a shader file, its #include "file" lines replaced by the files,
+// relative to the directory of the including file. #line directives keep
+// compiler messages on the lines of each file. The included files are
+// appended to includes if not null. includeStack holds the files including
+// filepath, throw std::runtime_error if filepath is one of them.
+inline std::string loadShaderSource(const fs::path &filepath,
+    std::vector<fs::path> *includes, std::vector<fs::path> &includeStack)
 {
+  const auto normalPath = filepath.lexically_normal();
+  if (std::find(begin(includeStack), end(includeStack), normalPath) !=
+      end(includeStack)) {
+    std::string cycle;
+    for (const auto &path : includeStack) {
+      cycle += path.string() + " -> ";
+    }
+    throw std::runtime_error(
+        "Shader include cycle: " + cycle + normalPath.string());
+  }
+
   std::ifstream input(filepath.string());
   if (!input) {
     std::stringstream ss;
@@ -75,10 +95,83 @@ inline std::string loadShaderSource(const fs::path &filepath)
     throw std::runtime_error(ss.str());
   }
 
-  std::stringstream buffer;
-  buffer << input.rdbuf();
+  includeStack.push_back(normalPath);
+  static const std::string includeDirective = "#include \"";
+  std::string source, line;
+  for (size_t lineNumber = 1; std::getline(input, line); ++lineNumber) {
+    const auto quote = includeDirective.size();
+    const auto endQuote = line.find('"', quote);
+    if (line.compare(0, quote, includeDirective) != 0 ||
+        endQuote == std::string::npos) {
+      source += line + "\n";
+      continue;
+    }
+    const auto includePath =
+        filepath.parent_path() / line.substr(quote, endQuote - quote);
+    if (includes) {
+      includes->push_back(includePath);
+    }
+    source += "#line 1\n" +
+              loadShaderSource(includePath, includes, includeStack) +
+              "#line " + std::to_string(lineNumber + 1) + "\n";
+  }
+  includeStack.pop_back();
+  return source;
+}
+
+inline std::string loadShaderSource(
+    const fs::path &filepath, std::vector<fs::path> *includes = nullptr)
+{
+  std::vector<fs::path> includeStack;
+  return loadShaderSource(filepath, includes, includeStack);
+}
+
+// Source of a shader, its path gives the shader type. Programs keep the
+// sources they were compiled from while their files are edited.
+struct ShaderSource
+{
+  fs::path path;
+  std::string source;
+  std::vector<fs::path> includes; // Files included by the source
+};
 
-  return buffer.str();
+inline std::vector<ShaderSource> loadShaderSources(
+    const std::vector<fs::path> &shaderPaths)
+{
+  std::vector<ShaderSource> sources;
+  for (const auto &path : shaderPaths) {
+    ShaderSource source;
+    source.path = path;
+    source.source = loadShaderSource(path, &source.includes);
+    sources.push_back(std::move(source));
+  }
+  return sources;
+}
+
+// Insert a #define for each name after the #version directive of a GLSL
+// source. A #line directive keeps compiler messages on the lines of the file.
+inline std::string injectShaderDefines(
+    const std::string &source, const std::vector<std::string> &defines)
+{
+  if (defines.empty()) {
+    return source;
+  }
+  std::string lines;
+  for (const auto &define : defines) {
+    lines += "#define " + define + "\n";
+  }
+
+  const auto version = source.find("#version");
+  if (version == std::string::npos) {
+    return lines + "#line 1\n" + source;
+  }
+  auto lineEnd = source.find('\n', version);
+  lineEnd = lineEnd == std::string::npos ? source.size() : lineEnd + 1;
+  const auto nextLine =
+      std::count(begin(source), begin(source) + lineEnd, '\n') + 1;
+  return source.substr(0, lineEnd) + (lineEnd == source.size() ? "\n" : "") +
+         lines + "#line " + std::to_string(nextLine) + "\n" +
+         source.substr(lineEnd);
 }
 
 template <typename StringType>
@@ -93,12 +186,14 @@ GLShader compileShader(GLenum type, StringType &&src)
   return shader;
 }
 
-// Load and compile a shader according to the following naming convention:
+// Type of a shader according to the following naming convention:
 // *.vs.glsl -> vertex shader
 // *.fs.glsl -> fragment shader
 // *.gs.glsl -> geometry shader
 // *.cs.glsl -> compute shader
-inline GLShader loadShader(const fs::path &shaderPath)
+// The type name is returned in typeName if not null
+inline GLenum shaderType(
+    const fs::path &shaderPath, std::string *typeName = nullptr)
 {
   static auto extToShaderType =
       std::unordered_map<std::string, std::pair<GLenum, std::string>>(
@@ -113,12 +208,24 @@ inline GLShader loadShader(const fs::path &shaderPath)
     std::cerr << "Unrecognized shader extension " << ext << std::endl;
     throw std::runtime_error("Unrecognized shader extension " + ext.string());
   }
+  if (typeName) {
+    *typeName = (*it).second.second;
+  }
+  return (*it).second.first;
+}
 
-  std::clog << "Compiling " << (*it).second.second << " shader " << shaderPath
+// Compile a shader, see shaderType() for the naming convention of the path.
+// defines are the names #defined in the source, see injectShaderDefines()
+inline GLShader compileShaderSource(const ShaderSource &shaderSource,
+    const std::vector<std::string> &defines = {})
+{
+  std::string typeName;
+  const auto type = shaderType(shaderSource.path, &typeName);
+  std::clog << "Compiling " << typeName << " shader " << shaderSource.path
             << "\n";
 
-  GLShader shader{(*it).second.first};
-  shader.setSource(loadShaderSource(shaderPath));
+  GLShader shader{type};
+  shader.setSource(injectShaderDefines(shaderSource.source, defines));
   shader.compile();
   if (!shader.getCompileStatus()) {
     std::cerr << "Shader compilation error:" << shader.getInfoLog()
@@ -128,9 +235,92 @@ inline GLShader loadShader(const fs::path &shaderPath)
   return shader;
 }
 
+// Load and compile a shader, see compileShaderSource()
+inline GLShader loadShader(const fs::path &shaderPath,
+    const std::vector<std::string> &defines = {})
+{
+  ShaderSource source;
+  source.path = shaderPath;
+  source.source = loadShaderSource(shaderPath);
+  return compileShaderSource(source, defines);
+}
+
+// Active uniforms and uniform blocks of a linked program
+struct ProgramReflection
+{
+  struct Uniform
+  {
+    GLint location; // -1 for the members of uniform blocks
+    GLenum type;
+    GLint arraySize;
+    GLint blockIndex; // -1 for the uniforms of the default block
+    GLint blockOffset;
+  };
+
+  struct UniformBlock
+  {
+    GLuint index;
+    GLint dataSize;
+  };
+
+  // Arrays are named without their "[0]" suffix
+  std::unordered_map<std::string, Uniform> uniforms;
+  std::unordered_map<std::string, UniformBlock> uniformBlocks;
+
+  // -1 if the program has no such active uniform, like glGetUniformLocation()
+  GLint location(const std::string &name) const
+  {
+    const auto it = uniforms.find(name);
+    return it == end(uniforms) ? -1 : (*it).second.location;
+  }
+};
+
+// Enumerate the active uniforms and uniform blocks of a linked program. Only
+// uses the OpenGL 3.1 queries, programs of 3.3 contexts can be reflected.
+inline ProgramReflection reflectProgram(GLuint program)
+{
+  ProgramReflection reflection;
+  GLint uniformCount = 0, maxNameLength = 0;
+  glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+  std::vector<char> name(std::max(maxNameLength, 1));
+  for (GLuint i = 0; i < GLuint(uniformCount); ++i) {
+    ProgramReflection::Uniform uniform;
+    glGetActiveUniform(program, i, GLsizei(name.size()), nullptr,
+        &uniform.arraySize, &uniform.type, name.data());
+    glGetActiveUniformsiv(
+        program, 1, &i, GL_UNIFORM_BLOCK_INDEX, &uniform.blockIndex);
+    glGetActiveUniformsiv(program, 1, &i, GL_UNIFORM_OFFSET, &uniform.blockOffset);
+    uniform.location = glGetUniformLocation(program, name.data());
+    std::string key = name.data();
+    if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0) {
+      key.resize(key.size() - 3);
+    }
+    reflection.uniforms.emplace(key, uniform);
+  }
+
+  GLint blockCount = 0;
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+  glGetProgramiv(
+      program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxNameLength);
+  name.resize(std::max(maxNameLength, 1));
+  for (GLuint i = 0; i < GLuint(blockCount); ++i) {
+    ProgramReflection::UniformBlock block;
+    block.index = i;
+    glGetActiveUniformBlockName(
+        program, i, GLsizei(name.size()), nullptr, name.data());
+    glGetActiveUniformBlockiv(
+        program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+    reflection.uniformBlocks.emplace(name.data(), block);
+  }
+  return reflection;
+}
+
 class GLProgram
 {
   GLuint m_GLId;
+  // Built on first call to reflection(), reset by link()
+  mutable std::shared_ptr<const ProgramReflection> m_Reflection;
   typedef std::unique_ptr<char[]> CharBuffer;
 
 public:
@@ -142,12 +332,17 @@ public:
 
   GLProgram &operator=(const GLProgram &) = delete;
 
-  GLProgram(GLProgram &&rvalue) : m_GLId(rvalue.m_GLId) { rvalue.m_GLId = 0; }
+  GLProgram(GLProgram &&rvalue) :
+      m_GLId(rvalue.m_GLId), m_Reflection(std::move(rvalue.m_Reflection))
+  {
+    rvalue.m_GLId = 0;
+  }
 
   GLProgram &operator=(GLProgram &&rvalue)
   {
-    this->~GLProgram();
+    glDeleteProgram(m_GLId);
     m_GLId = rvalue.m_GLId;
+    m_Reflection = std::move(rvalue.m_Reflection);
     rvalue.m_GLId = 0;
     return *this;
   }
@@ -161,10 +356,20 @@ public:
 
   bool link()
   {
+    m_Reflection.reset();
     glLinkProgram(m_GLId);
     return getLinkStatus();
   }
 
+  // Uniforms and uniform blocks of the linked program, enumerated once
+  const ProgramReflection &reflection() const
+  {
+    if (!m_Reflection) {
+      m_Reflection = std::make_shared<ProgramReflection>(reflectProgram(m_GLId));
+    }
+    return *m_Reflection;
+  }
+
   bool getLinkStatus() const
   {
     GLint linkStatus;
@@ -244,11 +449,27 @@ template <typename CSrc> GLProgram buildComputeProgram(CSrc &&src)
   ;
 }
 
-inline GLProgram compileProgram(std::vector<fs::path> shaderPaths)
+// Same defines for all the shaders of the program. With the program binary
+// cache enabled, the binary of a previous run is loaded instead of compiling
+// when the sources, defines and driver are the same.
+inline GLProgram compileProgram(const std::vector<ShaderSource> &shaderSources,
+    const std::vector<std::string> &defines = {})
 {
   GLProgram program;
-  for (const auto &path : shaderPaths) {
-    auto shader = loadShader(path);
+  const auto cache = programBinaryCache();
+  uint64_t cacheKey = 0;
+  if (cache) {
+    cacheKey = cache->key(shaderSources, defines);
+    if (cache->load(cacheKey, program.glId())) {
+      return program;
+    }
+    glProgramParameteri(
+        program.glId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+
+  const auto compileStart = std::chrono::steady_clock::now();
+  for (const auto &shaderSource : shaderSources) {
+    auto shader = compileShaderSource(shaderSource, defines);
     program.attachShader(shader);
   }
   program.link();
@@ -256,5 +477,17 @@ inline GLProgram compileProgram(std::vector<fs::path> shaderPaths)
     std::cerr << "Program link error:" << program.getInfoLog() << std::endl;
     throw std::runtime_error("Program link error:" + program.getInfoLog());
   }
+  if (cache) {
+    cache->store(cacheKey, program.glId(),
+        std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - compileStart)
+            .count());
+  }
   return program;
 }
+
+inline GLProgram compileProgram(const std::vector<fs::path> &shaderPaths,
+    const std::vector<std::string> &defines = {})
+{
+  return compileProgram(loadShaderSources(shaderPaths), defines);
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+// Minimal 4-wide float vector used by the SIMD kernels (BVH traversal, ...).
+// It maps to SSE registers on x86 and falls back to plain arrays elsewhere so
+// the kernels keep a single implementation.
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GLTF_VIEWER_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+#include <cmath>
+
+struct Float4
+{
+#ifdef GLTF_VIEWER_USE_SSE
+  __m128 v;
+
+  Float4() = default;
+  Float4(__m128 x) : v(x) {}
+  explicit Float4(float x) : v(_mm_set1_ps(x)) {}
+  Float4(float x, float y, float z, float w) : v(_mm_setr_ps(x, y, z, w)) {}
+
+  // p must be 16 bytes aligned
+  static Float4 load(const float *p) { return _mm_load_ps(p); }
+  void store(float *p) const { _mm_store_ps(p, v); }
+
+  static Float4 loadUnaligned(const float *p) { return _mm_loadu_ps(p); }
+  void storeUnaligned(float *p) const { _mm_storeu_ps(p, v); }
+
+  float operator[](int i) const
+  {
+    alignas(16) float values[4];
+    store(values);
+    return values[i];
+  }
+#else
+  float v[4];
+
+  Float4() = default;
+  explicit Float4(float x) : v{x, x, x, x} {}
+  Float4(float x, float y, float z, float w) : v{x, y, z, w} {}
+
+  static Float4 load(const float *p) { return Float4(p[0], p[1], p[2], p[3]); }
+  void store(float *p) const
+  {
+    for (int i = 0; i < 4; ++i)
+      p[i] = v[i];
+  }
+
+  static Float4 loadUnaligned(const float *p) { return load(p); }
+  void storeUnaligned(float *p) const { store(p); }
+
+  float operator[](int i) const { return v[i]; }
+#endif
+};
+
+// Result of a lane-wise comparison
+struct Mask4
+{
+#ifdef GLTF_VIEWER_USE_SSE
+  __m128 v;
+
+  Mask4(__m128 x) : v(x) {}
+
+  // Bit i is set if lane i is true
+  int bits() const { return _mm_movemask_ps(v); }
+#else
+  bool v[4];
+
+  Mask4(bool x, bool y, bool z, bool w) : v{x, y, z, w} {}
+
+  int bits() const { return v[0] | (v[1] << 1) | (v[2] << 2) | (v[3] << 3); }
+#endif
+  bool any() const { return bits() != 0; }
+};
+
+#ifdef GLTF_VIEWER_USE_SSE
+
+inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+inline Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+inline Float4 operator/(Float4 a, Float4 b) { return _mm_div_ps(a.v, b.v); }
+inline Float4 min(Float4 a, Float4 b) { return _mm_min_ps(a.v, b.v); }
+inline Float4 max(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+inline Float4 abs(Float4 a)
+{
+  return _mm_andnot_ps(_mm_set1_ps(-0.f), a.v);
+}
+
+inline Mask4 operator<(Float4 a, Float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+inline Mask4 operator<=(Float4 a, Float4 b) { return _mm_cmple_ps(a.v, b.v); }
+inline Mask4 operator>(Float4 a, Float4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline Mask4 operator>=(Float4 a, Float4 b) { return _mm_cmpge_ps(a.v, b.v); }
+inline Mask4 operator&(Mask4 a, Mask4 b) { return _mm_and_ps(a.v, b.v); }
+inline Mask4 operator|(Mask4 a, Mask4 b) { return _mm_or_ps(a.v, b.v); }
+
+// Lane-wise mask ? a : b
+inline Float4 select(Mask4 mask, Float4 a, Float4 b)
+{
+  return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+
+#else
+
+#define GLTF_VIEWER_FLOAT4_OP(op, expr)                                        \
+  inline Float4 op(Float4 a, Float4 b)                                         \
+  {                                                                            \
+    Float4 r;                                                                  \
+    for (int i = 0; i < 4; ++i) {                                              \
+      const float x = a.v[i], y = b.v[i];                                      \
+      r.v[i] = (expr);                                                         \
+    }                                                                          \
+    return r;                                                                  \
+  }
+
+GLTF_VIEWER_FLOAT4_OP(operator+, x + y)
+GLTF_VIEWER_FLOAT4_OP(operator-, x - y)
+GLTF_VIEWER_FLOAT4_OP(operator*, x *y)
+GLTF_VIEWER_FLOAT4_OP(operator/, x / y)
+GLTF_VIEWER_FLOAT4_OP(min, x < y ? x : y)
+GLTF_VIEWER_FLOAT4_OP(max, x > y ? x : y)
+
+#undef GLTF_VIEWER_FLOAT4_OP
+
+inline Float4 abs(Float4 a)
+{
+  return Float4(
+      std::fabs(a.v[0]), std::fabs(a.v[1]), std::fabs(a.v[2]), std::fabs(a.v[3]));
+}
+
+#define GLTF_VIEWER_MASK4_OP(op, T, cmp)                                       \
+  inline Mask4 op(T a, T b)                                                    \
+  {                                                                            \
+    return Mask4(a.v[0] cmp b.v[0], a.v[1] cmp b.v[1], a.v[2] cmp b.v[2],      \
+        a.v[3] cmp b.v[3]);                                                    \
+  }
+
+GLTF_VIEWER_MASK4_OP(operator<, Float4, <)
+GLTF_VIEWER_MASK4_OP(operator<=, Float4, <=)
+GLTF_VIEWER_MASK4_OP(operator>, Float4, >)
+GLTF_VIEWER_MASK4_OP(operator>=, Float4, >=)
+GLTF_VIEWER_MASK4_OP(operator&, Mask4, &&)
+GLTF_VIEWER_MASK4_OP(operator|, Mask4, ||)
+
+#undef GLTF_VIEWER_MASK4_OP
+
+inline Float4 select(Mask4 mask, Float4 a, Float4 b)
+{
+  return Float4(mask.v[0] ? a.v[0] : b.v[0], mask.v[1] ? a.v[1] : b.v[1],
+      mask.v[2] ? a.v[2] : b.v[2], mask.v[3] ? a.v[3] : b.v[3]);
+}
+
+#endif
+
+// Column-major 4x4 matrix product result = a * b, the layout of glm::mat4.
+// Each column of the result is a linear combination of the columns of a.
+inline void multiplyMatrix4(const float *a, const float *b, float *result)
+{
+  const auto a0 = Float4::loadUnaligned(a);
+  const auto a1 = Float4::loadUnaligned(a + 4);
+  const auto a2 = Float4::loadUnaligned(a + 8);
+  const auto a3 = Float4::loadUnaligned(a + 12);
+  for (int column = 0; column < 4; ++column) {
+    const auto *bColumn = b + 4 * column;
+    const auto r = a0 * Float4(bColumn[0]) + a1 * Float4(bColumn[1]) +
+                   a2 * Float4(bColumn[2]) + a3 * Float4(bColumn[3]);
+    r.storeUnaligned(result + 4 * column);
+  }
+}
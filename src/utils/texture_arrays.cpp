@@ -0,0 +1,126 @@
+#include "texture_arrays.hpp"
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+namespace {
+// Textures sharing a key are layers of the same array
+struct TextureDescription
+{
+  GLint width, height, levelCount, internalFormat;
+  GLint minFilter, magFilter, wrapS, wrapT;
+
+  auto tie() const
+  {
+    return std::tie(width, height, levelCount, internalFormat, minFilter,
+        magFilter, wrapS, wrapT);
+  }
+  bool operator<(const TextureDescription &other) const
+  {
+    return tie() < other.tie();
+  }
+};
+
+// Texture bound to GL_TEXTURE_2D, sampled with sampler or with its own
+// parameters if sampler is 0
+TextureDescription describeBoundTexture(GLuint sampler)
+{
+  const auto levelParameter = [](GLint level, GLenum name) {
+    GLint value = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, level, name, &value);
+    return value;
+  };
+  const auto parameter = [sampler](GLenum name) {
+    GLint value = 0;
+    if (sampler) {
+      glGetSamplerParameteriv(sampler, name, &value);
+    } else {
+      glGetTexParameteriv(GL_TEXTURE_2D, name, &value);
+    }
+    return value;
+  };
+
+  TextureDescription description;
+  description.width = levelParameter(0, GL_TEXTURE_WIDTH);
+  description.height = levelParameter(0, GL_TEXTURE_HEIGHT);
+  // Levels past the mipmap chain have a null size
+  description.levelCount = 1;
+  while (description.levelCount < 32 &&
+         levelParameter(description.levelCount, GL_TEXTURE_WIDTH) > 0) {
+    ++description.levelCount;
+  }
+  // Textures are allocated with glTexStorage2D(), their format is sized
+  description.internalFormat = levelParameter(0, GL_TEXTURE_INTERNAL_FORMAT);
+  description.minFilter = parameter(GL_TEXTURE_MIN_FILTER);
+  description.magFilter = parameter(GL_TEXTURE_MAG_FILTER);
+  description.wrapS = parameter(GL_TEXTURE_WRAP_S);
+  description.wrapT = parameter(GL_TEXTURE_WRAP_T);
+  return description;
+}
+} // namespace
+
+TextureArrays::TextureArrays(const std::vector<MaterialTexture> &textures)
+{
+  std::map<TextureDescription, std::vector<MaterialTexture>> groups;
+  glActiveTexture(GL_TEXTURE0);
+  for (const auto &texture : textures) {
+    if (m_Layers.count(texture)) {
+      continue;
+    }
+    glBindTexture(GL_TEXTURE_2D, texture.texture);
+    auto &group = groups[describeBoundTexture(texture.sampler)];
+    m_Layers[texture] = Layer{0, GLuint(group.size())};
+    group.push_back(texture);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  if (groups.size() > kMaxTextureArrays) {
+    m_Layers.clear();
+    throw std::runtime_error("Textures need " + std::to_string(groups.size()) +
+                             " texture arrays, the limit is " +
+                             std::to_string(kMaxTextureArrays));
+  }
+
+  m_Arrays.resize(groups.size());
+  glGenTextures(GLsizei(m_Arrays.size()), m_Arrays.data());
+  GLuint arrayIndex = 0;
+  for (const auto &group : groups) {
+    const auto &description = group.first;
+    const auto array = m_Arrays[arrayIndex];
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, description.levelCount,
+        description.internalFormat, description.width, description.height,
+        GLsizei(group.second.size()));
+    glTexParameteri(
+        GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, description.minFilter);
+    glTexParameteri(
+        GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, description.magFilter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, description.wrapS);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, description.wrapT);
+
+    // Copies stay on the GPU, mipmaps included. Layers of an array share the
+    // internal format of their group, as glCopyImageSubData() requires.
+    for (const auto &sampledTexture : group.second) {
+      auto &layer = m_Layers[sampledTexture];
+      layer.array = arrayIndex;
+      auto width = description.width, height = description.height;
+      for (GLint level = 0; level < description.levelCount; ++level) {
+        glCopyImageSubData(sampledTexture.texture, GL_TEXTURE_2D, level, 0, 0,
+            0, array, GL_TEXTURE_2D_ARRAY, level, 0, 0, GLint(layer.layer),
+            width, height, 1);
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+      }
+    }
+    ++arrayIndex;
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+TextureArrays::~TextureArrays()
+{
+  glDeleteTextures(GLsizei(m_Arrays.size()), m_Arrays.data());
+}
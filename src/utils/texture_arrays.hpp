@@ -0,0 +1,52 @@
+#pragma once
+
+#include "materials.hpp"
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Texture units of the arrays, the first kMaxTextureArrays units. Below
+// kHiZTextureUnit, and only read when the material units are not.
+const GLuint kTextureArrayFirstUnit = 0;
+const GLuint kMaxTextureArrays = 8;
+
+// Copies of 2D textures packed as layers of GL_TEXTURE_2D_ARRAY textures, one
+// array per size, format, level count and sampler state. A draw can then read
+// any of the textures with the arrays bound once. The source textures are
+// left untouched, a texture read through several samplers is copied in the
+// array of each.
+class TextureArrays
+{
+public:
+  struct Layer
+  {
+    GLuint array; // Index in arrays()
+    GLuint layer;
+  };
+
+  // Throw std::runtime_error if the textures need more than kMaxTextureArrays
+  // arrays
+  explicit TextureArrays(const std::vector<MaterialTexture> &textures);
+
+  ~TextureArrays();
+
+  TextureArrays(const TextureArrays &) = delete;
+  TextureArrays &operator=(const TextureArrays &) = delete;
+
+  // Layer of a texture passed to the constructor
+  Layer layer(const MaterialTexture &texture) const
+  {
+    return m_Layers.at(texture);
+  }
+
+  // Texture objects of the arrays, arrays()[i] is bound to unit
+  // kTextureArrayFirstUnit + i
+  const std::vector<GLuint> &arrays() const { return m_Arrays; }
+
+private:
+  std::vector<GLuint> m_Arrays;
+  std::map<MaterialTexture, Layer> m_Layers;
+};
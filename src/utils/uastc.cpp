@@ -0,0 +1,404 @@
+#include "uastc.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace {
+struct UASTCMode
+{
+  uint8_t code, codeBits; // Prefix code, from the first bit of the block
+  uint8_t subsetCount;
+  uint8_t planeCount;     // The second plane weights a single component
+  uint8_t componentCount; // RGB, RGBA, or 2 for luminance and alpha
+  uint8_t endpointRange;  // Index in kIntegerRanges
+  uint8_t weightBits;
+  uint8_t hintBits; // Of the transcoders to BC1 and ETC, skipped
+};
+
+const uint8_t kSolidColorMode = 8;
+// Code 0x45 of 7 bits is reserved
+const uint8_t kReservedMode = 0xFF;
+
+const UASTCMode kModes[] = {
+    {0x01, 4, 1, 1, 3, 19, 4, 15},
+    {0x35, 6, 1, 1, 3, 20, 2, 15},
+    {0x1D, 5, 2, 1, 3, 8, 3, 15},
+    {0x03, 5, 3, 1, 3, 7, 2, 15},
+    {0x13, 5, 2, 1, 3, 12, 2, 15},
+    {0x0B, 5, 1, 1, 3, 20, 3, 15},
+    {0x1B, 5, 1, 2, 3, 18, 2, 15},
+    {0x07, 5, 2, 1, 3, 12, 2, 15},
+    {0x17, 5, 0, 0, 4, 20, 0, 0}, // Solid color, 8 bits per component
+    {0x0F, 5, 2, 1, 4, 8, 2, 23},
+    {0x02, 3, 1, 1, 4, 13, 4, 17},
+    {0x00, 2, 1, 2, 4, 13, 2, 17},
+    {0x06, 3, 1, 1, 4, 19, 3, 17},
+    {0x1F, 5, 1, 2, 4, 20, 1, 23},
+    {0x0D, 5, 1, 1, 4, 20, 2, 23},
+    {0x05, 7, 1, 1, 2, 20, 4, 23},
+    {0x15, 6, 2, 1, 2, 20, 2, 23},
+    {0x25, 6, 1, 2, 2, 20, 2, 23},
+    {0x09, 4, 1, 1, 3, 11, 5, 15},
+};
+const size_t kModeCount = sizeof(kModes) / sizeof(kModes[0]);
+
+// ASTC integer sequence ranges: a value has bits and an optional trit or
+// quint, from 0..1 to 0..255
+struct IntegerRange
+{
+  uint8_t bits, trits, quints;
+};
+
+const IntegerRange kIntegerRanges[21] = {{1, 0, 0}, {0, 1, 0}, {2, 0, 0},
+    {0, 0, 1}, {1, 1, 0}, {3, 0, 0}, {1, 0, 1}, {2, 1, 0}, {4, 0, 0},
+    {2, 0, 1}, {3, 1, 0}, {5, 0, 0}, {3, 0, 1}, {4, 1, 0}, {6, 0, 0},
+    {4, 0, 1}, {5, 1, 0}, {7, 0, 0}, {5, 0, 1}, {6, 1, 0}, {8, 0, 0}};
+
+// Unquantization of the endpoints with a trit or a quint, from the table
+// C.2.16 of the ASTC specification. The bits of the value fill the 9 bits
+// pattern of B, letter b being bit 1 of the value.
+struct DigitUnquantization
+{
+  uint8_t bits;
+  bool isTrit;
+  const char *pattern;
+  uint32_t c;
+};
+
+const DigitUnquantization kDigitUnquantizations[] = {
+    {1, true, "000000000", 204}, {1, false, "000000000", 113},
+    {2, true, "b000b0bb0", 93}, {2, false, "b0000bb00", 54},
+    {3, true, "cb000cbcb", 44}, {3, false, "cb0000cbc", 26},
+    {4, true, "dcb000dcb", 22}, {4, false, "dcb0000dc", 13},
+    {5, true, "edcb000ed", 11}, {5, false, "edcb0000e", 6},
+    {6, true, "fedcb000f", 5}};
+
+// ASTC partition seeds of the partition patterns UASTC shares with BC7, in
+// the order of the pattern index of the blocks: 2 subsets patterns, 3 subsets
+// patterns, and the 2 subsets patterns of mode 7 which merge 2 subsets of a
+// BC7 3 subsets pattern
+const uint16_t kPartitionSeeds2[] = {28, 20, 16, 29, 91, 9, 107, 72, 149, 204,
+    50, 114, 496, 17, 78, 39, 252, 828, 43, 156, 116, 210, 476, 273, 684, 359,
+    246, 195, 694, 524};
+const uint16_t kPartitionSeeds3[] = {
+    260, 74, 32, 156, 183, 15, 745, 0, 335, 902, 254};
+const uint16_t kMode7PartitionSeeds[] = {36, 48, 61, 137, 161, 183, 226, 281,
+    302, 307, 479, 495, 593, 594, 605, 799, 812, 988, 993};
+
+struct PartitionPattern
+{
+  uint8_t subsets[16];
+  // First pixel of each subset, whose weight has its most significant bit
+  // implied 0
+  uint8_t anchors[3];
+};
+
+const size_t kPatternCount2 = sizeof(kPartitionSeeds2) / sizeof(uint16_t);
+const size_t kPatternCount3 = sizeof(kPartitionSeeds3) / sizeof(uint16_t);
+const size_t kMode7PatternCount =
+    sizeof(kMode7PartitionSeeds) / sizeof(uint16_t);
+
+struct UASTCTables
+{
+  uint8_t modes[128];         // Per value of the first 7 bits of a block
+  uint8_t endpoints[21][256]; // Per range and value
+  uint8_t weights[6][32];     // Per bit count and value, from 0 to 64
+  PartitionPattern singleSubset;
+  PartitionPattern patterns2[kPatternCount2];
+  PartitionPattern patterns3[kPatternCount3];
+  PartitionPattern mode7Patterns[kMode7PatternCount];
+};
+
+// ASTC hash of the partition seeds
+uint32_t hashPartitionSeed(uint32_t seed)
+{
+  seed ^= seed >> 15;
+  seed *= 0xEEDE0891;
+  seed ^= seed >> 5;
+  seed += seed << 16;
+  seed ^= seed >> 7;
+  seed ^= seed >> 3;
+  seed ^= seed << 6;
+  seed ^= seed >> 17;
+  return seed;
+}
+
+// Subset of a pixel of a 4x4 block, as by the ASTC partition function of
+// 2D blocks of less than 31 pixels
+uint32_t selectPartition(
+    uint32_t seed, uint32_t subsetCount, uint32_t x, uint32_t y)
+{
+  x <<= 1;
+  y <<= 1;
+  seed += (subsetCount - 1) * 1024;
+  const auto random = hashPartitionSeed(seed);
+  uint32_t seeds[8];
+  for (int i = 0; i < 8; ++i) {
+    seeds[i] = (random >> (i * 4)) & 0xF;
+    seeds[i] *= seeds[i];
+  }
+  uint32_t shift1, shift2;
+  if (seed & 1) {
+    shift1 = seed & 2 ? 4 : 5;
+    shift2 = subsetCount == 3 ? 6 : 5;
+  } else {
+    shift1 = subsetCount == 3 ? 6 : 5;
+    shift2 = seed & 2 ? 4 : 5;
+  }
+  // The seeds of z don't matter in 2D
+  const auto a =
+      ((seeds[0] >> shift1) * x + (seeds[1] >> shift2) * y + (random >> 14)) &
+      0x3F;
+  const auto b =
+      ((seeds[2] >> shift1) * x + (seeds[3] >> shift2) * y + (random >> 10)) &
+      0x3F;
+  const auto c =
+      subsetCount < 3 ? 0
+                      : ((seeds[4] >> shift1) * x + (seeds[5] >> shift2) * y +
+                            (random >> 6)) &
+                            0x3F;
+  if (a >= b && a >= c) {
+    return 0;
+  }
+  return b >= c ? 1 : 2;
+}
+
+PartitionPattern partitionPattern(uint32_t seed, uint32_t subsetCount)
+{
+  PartitionPattern pattern = {};
+  bool hasAnchor[3] = {};
+  for (uint32_t pixel = 0; pixel < 16; ++pixel) {
+    const auto subset =
+        selectPartition(seed, subsetCount, pixel % 4, pixel / 4);
+    pattern.subsets[pixel] = uint8_t(subset);
+    if (!hasAnchor[subset]) {
+      hasAnchor[subset] = true;
+      pattern.anchors[subset] = uint8_t(pixel);
+    }
+  }
+  return pattern;
+}
+
+// Repeat the bits of value to fill bitCount bits
+uint32_t replicateBits(uint32_t value, uint32_t bits, uint32_t bitCount)
+{
+  uint32_t result = 0;
+  uint32_t resultBits = 0;
+  while (resultBits < bitCount) {
+    result = (result << bits) | value;
+    resultBits += bits;
+  }
+  return result >> (resultBits - bitCount);
+}
+
+uint8_t unquantizeEndpoint(const IntegerRange &range, uint32_t value)
+{
+  const auto bits = value & ((1u << range.bits) - 1);
+  const auto digit = value >> range.bits;
+  if (!range.trits && !range.quints) {
+    return uint8_t(replicateBits(bits, range.bits, 8));
+  }
+  const auto unquantization = std::find_if(
+      std::begin(kDigitUnquantizations), std::end(kDigitUnquantizations),
+      [&](const DigitUnquantization &u) {
+        return u.bits == range.bits && u.isTrit == (range.trits != 0);
+      });
+  if (unquantization == std::end(kDigitUnquantizations)) {
+    return 0; // Ranges of weights only
+  }
+  const uint32_t a = bits & 1 ? 0x1FF : 0;
+  uint32_t b = 0;
+  for (int i = 0; i < 9; ++i) {
+    const auto letter = unquantization->pattern[i];
+    if (letter != '0') {
+      b |= ((bits >> (letter - 'a')) & 1) << (8 - i);
+    }
+  }
+  const auto t = (digit * unquantization->c + b) ^ a;
+  return uint8_t((a & 0x80) | (t >> 2));
+}
+
+UASTCTables buildTables()
+{
+  UASTCTables tables;
+  std::memset(tables.modes, kReservedMode, sizeof(tables.modes));
+  for (size_t mode = 0; mode < kModeCount; ++mode) {
+    const auto codeMask = (1u << kModes[mode].codeBits) - 1;
+    for (uint32_t value = 0; value < 128; ++value) {
+      if ((value & codeMask) == kModes[mode].code) {
+        tables.modes[value] = uint8_t(mode);
+      }
+    }
+  }
+
+  std::memset(tables.endpoints, 0, sizeof(tables.endpoints));
+  for (size_t range = 0; range < 21; ++range) {
+    const auto &integerRange = kIntegerRanges[range];
+    const auto digitCount =
+        integerRange.trits ? 3u : integerRange.quints ? 5u : 1u;
+    for (uint32_t value = 0; value < (digitCount << integerRange.bits);
+         ++value) {
+      tables.endpoints[range][value] = unquantizeEndpoint(integerRange, value);
+    }
+  }
+
+  // UASTC weights have no trits nor quints
+  std::memset(tables.weights, 0, sizeof(tables.weights));
+  for (uint32_t bits = 1; bits < 6; ++bits) {
+    for (uint32_t value = 0; value < (1u << bits); ++value) {
+      const auto weight = replicateBits(value, bits, 6);
+      tables.weights[bits][value] = uint8_t(weight > 32 ? weight + 1 : weight);
+    }
+  }
+
+  tables.singleSubset = PartitionPattern{};
+  for (size_t i = 0; i < kPatternCount2; ++i) {
+    tables.patterns2[i] = partitionPattern(kPartitionSeeds2[i], 2);
+  }
+  for (size_t i = 0; i < kPatternCount3; ++i) {
+    tables.patterns3[i] = partitionPattern(kPartitionSeeds3[i], 3);
+  }
+  for (size_t i = 0; i < kMode7PatternCount; ++i) {
+    tables.mode7Patterns[i] = partitionPattern(kMode7PartitionSeeds[i], 2);
+  }
+  return tables;
+}
+
+const UASTCTables &uastcTables()
+{
+  static const UASTCTables tables = buildTables();
+  return tables;
+}
+
+// Fields of a block are stored from its least significant bit
+uint32_t readBits(const uint8_t block[16], uint32_t &bit, uint32_t count)
+{
+  uint32_t value = 0;
+  for (uint32_t i = 0; i < count; ++i, ++bit) {
+    value |= uint32_t((block[bit >> 3] >> (bit & 7)) & 1) << i;
+  }
+  return value;
+}
+
+// ASTC interpolation of endpoints expanded to 16 bits, for UNORM8 pixels
+uint8_t interpolate(uint32_t e0, uint32_t e1, uint32_t weight)
+{
+  return uint8_t(((e0 * 257) * (64 - weight) + (e1 * 257) * weight + 32) >> 14);
+}
+} // namespace
+
+bool decodeUASTCBlock(const uint8_t block[16], uint8_t pixels[64])
+{
+  const auto &tables = uastcTables();
+  const auto modeIndex = tables.modes[block[0] & 0x7F];
+  if (modeIndex == kReservedMode) {
+    return false;
+  }
+  const auto &mode = kModes[modeIndex];
+  uint32_t bit = mode.codeBits;
+  if (modeIndex == kSolidColorMode) {
+    uint8_t color[4];
+    for (auto &component : color) {
+      component = uint8_t(readBits(block, bit, 8));
+    }
+    for (int pixel = 0; pixel < 16; ++pixel) {
+      std::memcpy(pixels + pixel * 4, color, 4);
+    }
+    return true;
+  }
+  bit += mode.hintBits;
+
+  const auto *pattern = &tables.singleSubset;
+  if (mode.subsetCount > 1) {
+    const PartitionPattern *patterns = tables.patterns2;
+    size_t patternCount = kPatternCount2;
+    if (mode.subsetCount == 3) {
+      patterns = tables.patterns3;
+      patternCount = kPatternCount3;
+    } else if (modeIndex == 7) {
+      patterns = tables.mode7Patterns;
+      patternCount = kMode7PatternCount;
+    }
+    const auto patternIndex =
+        readBits(block, bit, mode.subsetCount == 3 ? 4 : 5);
+    if (patternIndex >= patternCount) {
+      return false;
+    }
+    pattern = &patterns[patternIndex];
+  }
+
+  // Component weighted by the second plane, the alpha for luminance and
+  // alpha modes
+  uint32_t dualPlaneComponent = 4;
+  if (mode.planeCount == 2) {
+    dualPlaneComponent =
+        mode.componentCount == 2 ? 3 : readBits(block, bit, 2);
+  }
+
+  // The trits or quints of all the endpoints come first, packed in base 3 or
+  // 5 by groups of 5 trits in 8 bits or 3 quints in 7 bits, then the bits of
+  // each endpoint. The endpoints of a subset are the low and high values of
+  // each component.
+  static const uint32_t kTritGroupBits[6] = {0, 2, 4, 5, 7, 8};
+  static const uint32_t kQuintGroupBits[4] = {0, 3, 5, 7};
+  const auto &range = kIntegerRanges[mode.endpointRange];
+  const auto endpointCount =
+      uint32_t(mode.componentCount) * 2 * mode.subsetCount;
+  uint32_t digits[18] = {};
+  if (range.trits || range.quints) {
+    const auto groupSize = range.trits ? 5u : 3u;
+    const auto base = range.trits ? 3u : 5u;
+    for (uint32_t first = 0; first < endpointCount; first += groupSize) {
+      const auto count = std::min(groupSize, endpointCount - first);
+      auto group = readBits(block, bit,
+          range.trits ? kTritGroupBits[count] : kQuintGroupBits[count]);
+      for (uint32_t i = 0; i < count; ++i) {
+        digits[first + i] = group % base;
+        group /= base;
+      }
+    }
+  }
+  uint8_t endpoints[18];
+  for (uint32_t i = 0; i < endpointCount; ++i) {
+    const auto value =
+        readBits(block, bit, range.bits) | (digits[i] << range.bits);
+    endpoints[i] = tables.endpoints[mode.endpointRange][value];
+  }
+
+  // Weights are interleaved per pixel with a dual plane. The anchors of the
+  // subsets, and the first pixel of both planes, have one bit less.
+  uint8_t weights[32];
+  const auto weightCount = 16u * mode.planeCount;
+  for (uint32_t i = 0; i < weightCount; ++i) {
+    auto isAnchor = mode.planeCount == 2 ? i < 2 : i == pattern->anchors[0];
+    for (uint32_t subset = 1; subset < mode.subsetCount; ++subset) {
+      isAnchor = isAnchor || i == pattern->anchors[subset];
+    }
+    weights[i] = tables.weights[mode.weightBits][readBits(
+        block, bit, mode.weightBits - (isAnchor ? 1 : 0))];
+  }
+
+  for (uint32_t pixel = 0; pixel < 16; ++pixel) {
+    const auto subsetEndpoints =
+        endpoints + pattern->subsets[pixel] * mode.componentCount * 2;
+    for (uint32_t component = 0; component < 4; ++component) {
+      // Luminance for the colors, alpha, or opaque without an alpha endpoint
+      uint32_t e0 = 255, e1 = 255;
+      if (mode.componentCount == 2) {
+        const auto endpoint = component < 3 ? 0 : 2;
+        e0 = subsetEndpoints[endpoint];
+        e1 = subsetEndpoints[endpoint + 1];
+      } else if (component < mode.componentCount) {
+        e0 = subsetEndpoints[component * 2];
+        e1 = subsetEndpoints[component * 2 + 1];
+      }
+      const auto weight =
+          mode.planeCount == 2
+              ? weights[pixel * 2 + (component == dualPlaneComponent ? 1 : 0)]
+              : weights[pixel];
+      pixels[pixel * 4 + component] = interpolate(e0, e1, weight);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+// Decoder of the Basis Universal UASTC blocks of KTX2 files, see
+// https://github.com/BinomialLLC/basis_universal/wiki/UASTC-Texture-Specification.
+// A 16 bytes block is a 4x4 ASTC block restricted to 19 modes (number of
+// subsets, dual plane, endpoint and weight ranges) plus a solid color mode,
+// with its endpoints and weights repacked, and hints for the transcoders to
+// other formats, which the decoder skips.
+
+// RGBA8 pixels of a block, row major. The colors are interpolated as by a
+// linear ASTC decoder. Return false if the block uses a reserved mode or
+// partition pattern.
+bool decodeUASTCBlock(const uint8_t block[16], uint8_t pixels[64]);
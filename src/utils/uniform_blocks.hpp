@@ -0,0 +1,77 @@
+#pragma once
+
+#include "shaders.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+// Binding points of the uniform blocks, assigned to each program by
+// bindUniformBlocks()
+const GLuint kFrameUniformsBinding = 0;
+const GLuint kDrawUniformsBinding = 1;
+
+// std140 layout of the FrameUniforms block of shaders/frame_uniforms.glsl:
+// camera, light, viewport and time of the frame. Written once per frame and
+// shared by all the programs drawing it.
+struct FrameUniforms
+{
+  glm::mat4 viewMatrix;
+  glm::mat4 projMatrix;
+  glm::mat4 viewProjMatrix;
+  glm::mat4 invViewMatrix;
+  glm::mat4 invProjMatrix;
+  glm::vec4 lightDirection; // xyz, view space
+  glm::vec4 lightIntensity; // xyz
+  glm::vec4 viewport;       // Width, height, 1 / width, 1 / height
+  float time;               // Seconds since the start of the viewer
+  float frameTime;          // Seconds since the previous frame
+  float padding[2];
+};
+static_assert(sizeof(FrameUniforms) == 384, "FrameUniforms must match std140");
+
+// std140 layout of the DrawUniforms block of shaders/draw_uniforms.glsl, for
+// the vertex shaders drawing one packet per call. Blocks of consecutive draws
+// are stored in one buffer, each at an offset aligned to
+// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+struct DrawUniforms
+{
+  glm::mat4 modelViewProjMatrix;
+  glm::mat4 modelViewMatrix;
+  glm::mat4 normalMatrix; // Upper 3x3 is the view space normal matrix
+  int32_t materialIndex;  // Index in the MaterialTable
+  int32_t padding[3];
+};
+static_assert(sizeof(DrawUniforms) == 208, "DrawUniforms must match std140");
+
+// Bind the blocks a program uses to their binding point. Throw
+// std::runtime_error if a block is larger than its C++ struct. Blocks may be
+// smaller: the size a driver reports can leave out the trailing padding of the
+// struct, which the shader doesn't declare.
+inline void bindUniformBlocks(const GLProgram &program)
+{
+  static const struct
+  {
+    const char *name;
+    GLuint binding;
+    size_t size;
+  } blocks[] = {{"FrameUniforms", kFrameUniformsBinding, sizeof(FrameUniforms)},
+      {"DrawUniforms", kDrawUniformsBinding, sizeof(DrawUniforms)}};
+
+  const auto &uniformBlocks = program.reflection().uniformBlocks;
+  for (const auto &block : blocks) {
+    const auto it = uniformBlocks.find(block.name);
+    if (it == end(uniformBlocks)) {
+      continue;
+    }
+    if (size_t((*it).second.dataSize) > block.size) {
+      throw std::runtime_error(std::string("Uniform block ") + block.name +
+                               " has " + std::to_string((*it).second.dataSize) +
+                               " bytes, at most " +
+                               std::to_string(block.size) + " expected");
+    }
+    glUniformBlockBinding(program.glId(), (*it).second.index, block.binding);
+  }
+}